@@ -279,7 +279,13 @@ static void arm_cpu_init()
         machine_config_t *mach = get_current_mach();
         mach->cpu_data = get_conf_obj_by_cast(cpu, "ARM_CPU_State");
 
-	cpu->core_num = 1;
+	cpu->core_num = get_smp_cores();
+	/* the interpreter has no atomic LDREX/STREX and shares its state
+	 * between the cores, so they can not run on their own threads */
+	if(smp_parallel_enabled()){
+		skyeye_log(Warning_log, __FUNCTION__, "parallel smp mode needs the dyncom engine, the cores run on one thread.\n");
+		smp_parallel_disable();
+	}
 	if(!cpu->core_num){
 		fprintf(stderr, "ERROR:you need to set numbers of core in mach_init.\n");
 		skyeye_exit(-1);
@@ -306,7 +312,7 @@ static void arm_cpu_init()
 		//exec->priv_data = get_conf_obj_by_cast(core, "ARMul_State");
 		exec->run = per_cpu_step;
 		exec->stop = per_cpu_stop;
-		add_to_default_cell(exec);
+		add_to_smp_cell(exec);
 
 		register_arm_core_chp(core, i);
 	}
@@ -345,6 +351,8 @@ arm_core_init (ARMul_State *state, int i)
 	state->abort_model = 0;
 	state->cpu = p_arm_cpu;
 	state->bigendSig = (big_endian ? HIGH : LOW);
+	/* the multiprocessor format, cpu id in the affinity level 0 */
+	state->mpidr = 0x80000000 | i;
 
 	if (!strcmp(p_arm_cpu->cpu_arch_name, "armv3"))
 		ARMul_SelectProcessor (state, ARM_v4_Prop);
@@ -428,6 +436,39 @@ arm_get_pc(){
 	ARMul_State *state = get_current_core();
 	return (generic_address_t)state->Reg[15];
 }
+
+/**
+* @brief read the pc, the mode and the asid of a core for the sampling
+* profiler, called from another thread while the core is running
+*
+* @param core_id the index of the core
+* @param sample the state of the core
+*
+* @return 0 on success, -1 if there is no such core
+*/
+static int
+arm_get_sample(int core_id, guest_sample_t *sample){
+	ARM_CPU_State *cpu = get_current_cpu();
+	ARMul_State *state;
+	if (cpu == NULL || core_id < 0 || core_id >= cpu->core_num)
+		return -1;
+	state = &cpu->core[core_id];
+	sample->pc = state->Reg[15];
+	sample->mode = state->Cpsr & 0x1f;
+	switch (sample->mode) {
+	case USER32MODE: sample->mode_name = "usr"; break;
+	case FIQ32MODE: sample->mode_name = "fiq"; break;
+	case IRQ32MODE: sample->mode_name = "irq"; break;
+	case SVC32MODE: sample->mode_name = "svc"; break;
+	case ABORT32MODE: sample->mode_name = "abt"; break;
+	case UNDEF32MODE: sample->mode_name = "und"; break;
+	case SYSTEM32MODE: sample->mode_name = "sys"; break;
+	default: sample->mode_name = NULL; break;
+	}
+	/* only kept by the engines that maintain the CP15 registers */
+	sample->asid = state->CP15[CP15_CONTEXT_ID - CP15_BASE] & 0xff;
+	return 0;
+}
 static int
 arm_ICE_write_byte (generic_address_t addr, uint8_t v)
 {
@@ -627,6 +668,7 @@ init_arm_arch ()
 	arm_arch.set_regval_by_id = arm_set_register_by_id;
 	arm_arch.get_regnum = arm_get_gpr_regnum;
 	arm_arch.signal = arm_signal;
+	arm_arch.get_sample = arm_get_sample;
 
 	register_arch (&arm_arch);
 }
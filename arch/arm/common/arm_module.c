@@ -41,6 +41,14 @@ extern int
 do_mode_option (skyeye_option_t * this_option, int num_params,
                 const char *params[]);
 
+extern int
+do_code_cache_option (skyeye_option_t * this_option, int num_params,
+                const char *params[]);
+
+extern int
+do_mmu_cache_option (skyeye_option_t * this_option, int num_params,
+                const char *params[]);
+
 extern void init_arm11_core();
 extern void init_ram_image();
 void module_init(){
@@ -51,6 +59,8 @@ void module_init(){
 	init_arm_dyncom ();
 	if(register_option("run", do_mode_option, "Indicate the different running mode, such as dyncom, hybrid etc.\n") != No_exp)
 		fprintf(stderr,"Can not register run option\n");
+	if(register_option("code_cache", do_code_cache_option, "Set the size and segments of the translation buffer of the fast interpreter.\n") != No_exp)
+		fprintf(stderr,"Can not register code_cache option\n");
 
 #else
 	skyeye_log(Debug_log, __FUNCTION__, "LLVM not exist and dyncom not available.\n");
@@ -68,6 +78,8 @@ void module_init(){
 
 	if(register_option("cpu", do_cpu_option, "Processor option for arm architecture.") != No_exp)
                 fprintf(stderr,"Can not register cpu option\n");
+	if(register_option("mmu_cache", do_mmu_cache_option, "Simulate the caches of the mmu always, in sampled windows or not at all.\n") != No_exp)
+                fprintf(stderr,"Can not register mmu_cache option\n");
 
 }
 void module_fini(){
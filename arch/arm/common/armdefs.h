@@ -451,6 +451,10 @@ So, if lateabtSig=1, then it means Late Abort Model(Base Updated Abort Model)
 	uint32 WriteData[17];
 	uint32 WritePc[17];
 	uint32 CurrWrite;
+	/* the multiprocessor affinity register, the core number of smp */
+	ARMword mpidr;
+	/* the memory value read by ldrex, strex only stores if it is unchanged */
+	ARMword exclusive_value;
 };
 #define DIFF_WRITE 0
 
@@ -908,6 +908,8 @@ ARMul_Emulate26 (ARMul_State * state)
 		}
 		io_do_cycle (state);
 		state->NumInstrs++;
+		if (state->NumInstrs >= state->mmu.cache_sim.window_end)
+			mmu_cache_sim_window (state);
 		#if 0
 		if (state->NumInstrs % 10000000 == 0) {
 				printf("10 MIPS instr have been executed\n");
@@ -89,6 +89,7 @@ mmu_init (ARMul_State * state)
 	};
 	ret = state->mmu.ops.init (state);
 	state->mmu_inited = (ret == 0);
+	mmu_cache_sim_start (state);
 	/* initialize mmu_read and mmu_write for disassemble */
 	skyeye_config_t *config  = get_current_config();
 	generic_arch_t *arch_instance = get_arch_instance(config->arch->arch_name);
@@ -191,6 +192,7 @@ mmu_mrc (ARMul_State * state, ARMword instr, ARMword * value)
 void
 mmu_mcr (ARMul_State * state, ARMword instr, ARMword value)
 {
+	mmu_utlb_cp15_write (state, BITS (16, 19));
 	MMU_OPS.mcr (state, instr, value);
 }
 
@@ -102,6 +102,9 @@ typedef enum mmu_regnum_t
 #define MMU_WBEnabled (MMU_CTL & CONTROL_WRITE_BUFFER)
 #define MMU_WBDisabled (!(MMU_WBEnabled))
 
+/* the caches and the buffers are simulated, not only the memory */
+#define MMU_CacheSim (state->mmu.cache_sim.enabled)
+
 /*virt_addr exchange according to CP15.R13(process id virtul mapping)*/
 #define PID_VA_MAP_MASK	0xfe000000
 #define mmu_pid_va_map(va) ({\
@@ -212,6 +215,10 @@ typedef struct mmu_state_t
 	ARMword aux_control;	// 1
 	ARMword copro_access;	// 15
 
+	/* bumped by a write of cp15 to drop the micro tlb entries */
+	ARMword utlb_gen;
+	cache_sim_t cache_sim;
+
 	mmu_ops_t ops;
 	union
 	{
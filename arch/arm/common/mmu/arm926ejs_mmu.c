@@ -110,6 +110,10 @@ arm926ejs_mmu_init (ARMul_State * state)
 		err_msg ("wb init %d\n", -1);
 		goto wb_init_error;
 	}
+
+	mmu_cache_sim_register (state, "d_cache", ARM926EJS_D_CACHE ());
+	mmu_cache_sim_register (state, "i_cache", ARM926EJS_I_CACHE ());
+	state->mmu.cache_sim.wb = ARM926EJS_WB ();
 	return 0;
 
       wb_init_error:
@@ -139,7 +143,7 @@ static fault_t
 arm926ejs_mmu_load_instr (ARMul_State * state, ARMword va, ARMword * instr)
 {
 	fault_t fault;
-	tlb_entry_t *tlb;
+	tlb_entry_t *tlb = NULL;
 	cache_line_t *cache;
 	int c;			//cache bit
 	ARMword pa;		//physical addr
@@ -174,7 +178,7 @@ arm926ejs_mmu_load_instr (ARMul_State * state, ARMword va, ARMword * instr)
 	}
 
 	/*search cache no matter MMU enabled/disabled */
-	cache = mmu_cache_search (state, ARM926EJS_I_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, ARM926EJS_I_CACHE (), va) : NULL;
 	if (cache) {
 		*instr = cache->
 			data[va_cache_index (va, ARM926EJS_I_CACHE ())];
@@ -191,7 +195,7 @@ arm926ejs_mmu_load_instr (ARMul_State * state, ARMword va, ARMword * instr)
 		pa = tlb_va_to_pa (tlb, va);
 	}
 
-	if (c) {
+	if (c && MMU_CacheSim) {
 		int index;
 
 		debug_count++;
@@ -202,7 +206,7 @@ arm926ejs_mmu_load_instr (ARMul_State * state, ARMword va, ARMword * instr)
 	}
 	else
 		//*instr = mem_read_word (state, pa);
-		bus_read(32, pa, instr);
+		tlb_bus_read(tlb, 32, pa, instr);
 
 	return 0;
 };
@@ -294,7 +298,7 @@ arm926ejs_mmu_read (ARMul_State * state, ARMword va, ARMword * data,
 	if (fault)
 		return fault;
 	/*search main cache */
-	cache = mmu_cache_search (state, ARM926EJS_D_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, ARM926EJS_D_CACHE (), va) : NULL;
 	if (cache) {
 		*data = cache->
 			data[va_cache_index (va, ARM926EJS_D_CACHE ())];
@@ -316,11 +320,11 @@ arm926ejs_mmu_read (ARMul_State * state, ARMword va, ARMword * data,
 	}
 
 	/*if Buffer, drain Write Buffer first */
-	if (tlb_b_flag (tlb))
+	if (tlb_b_flag (tlb) && MMU_CacheSim)
 		mmu_wb_drain_all (state, ARM926EJS_WB ());
 
 	/*alloc cache or mem_read */
-	if (tlb_c_flag (tlb) && MMU_DCacheEnabled) {
+	if (tlb_c_flag (tlb) && MMU_DCacheEnabled && MMU_CacheSim) {
 		cache_s *cache_t;
 
 		//if (tlb_b_flag(tlb))
@@ -332,13 +336,13 @@ arm926ejs_mmu_read (ARMul_State * state, ARMword va, ARMword * data,
 		//*data = mem_read_word(state, pa);
 		if (datatype == ARM_BYTE_TYPE)
 			//*data = mem_read_byte (state, pa | (real_va & 3));
-			bus_read(8, pa | (real_va & 3), data);
+			tlb_bus_read(tlb, 8, pa | (real_va & 3), data);
 		else if (datatype == ARM_HALFWORD_TYPE)
 			//*data = mem_read_halfword (state, pa | (real_va & 2));
-			bus_read(16, pa | (real_va & 2), data);
+			tlb_bus_read(tlb, 16, pa | (real_va & 2), data);
 		else if (datatype == ARM_WORD_TYPE)
 			//*data = mem_read_word (state, pa);
-			bus_read(32, pa, data);
+			tlb_bus_read(tlb, 32, pa, data);
 		else {
 			printf ("SKYEYE:2 arm926ejs_mmu_read error: unknown data type %d\n", datatype);
 			skyeye_exit (-1);
@@ -404,7 +408,7 @@ arm926ejs_mmu_write (ARMul_State * state, ARMword va, ARMword data,
 	real_va = va;
 
 	/*search instruction cache */
-	cache = mmu_cache_search (state, ARM926EJS_I_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, ARM926EJS_I_CACHE (), va) : NULL;
 	if (cache) {
 		update_cache (state, va, data, datatype, cache,
 			      ARM926EJS_I_CACHE (), real_va);
@@ -449,14 +453,14 @@ arm926ejs_mmu_write (ARMul_State * state, ARMword va, ARMword data,
 		return fault;
 	}
 	/*search main cache */
-	cache = mmu_cache_search (state, ARM926EJS_D_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, ARM926EJS_D_CACHE (), va) : NULL;
 	if (cache) {
 		update_cache (state, va, data, datatype, cache,
 			      ARM926EJS_D_CACHE (), real_va);
 	}
 
 	if (!cache) {
-		b = tlb_b_flag (tlb);
+		b = tlb_b_flag (tlb) && MMU_CacheSim;
 		pa = tlb_va_to_pa (tlb, va);
 		if (b) {
 			if (MMU_WBEnabled) {
@@ -481,7 +485,7 @@ arm926ejs_mmu_write (ARMul_State * state, ARMword va, ARMword data,
 			else {
 				if (datatype == ARM_WORD_TYPE)
 					//mem_write_word (state, pa, data);
-					bus_write(32, pa, data);
+					tlb_bus_write(tlb, 32, pa, data);
 				else if (datatype == ARM_HALFWORD_TYPE)
 					/*
 					mem_write_halfword (state,
@@ -489,35 +493,36 @@ arm926ejs_mmu_write (ARMul_State * state, ARMword va, ARMword data,
 							     (real_va & 2)),
 							    data);
 					*/
-					bus_write(16, pa |(real_va & 2), data);
+					tlb_bus_write(tlb, 16, pa |(real_va & 2), data);
 				else if (datatype == ARM_BYTE_TYPE)
 					/*
 					mem_write_byte (state,
 							(pa | (real_va & 3)),
 							data);
 					*/
-					bus_write(8, pa | (real_va & 3), data);
+					tlb_bus_write(tlb, 8, pa | (real_va & 3), data);
 			}
 		}
 		else {
-			mmu_wb_drain_all (state, ARM926EJS_WB ());
+			if (MMU_CacheSim)
+				mmu_wb_drain_all (state, ARM926EJS_WB ());
 
 			if (datatype == ARM_WORD_TYPE)
 				//mem_write_word (state, pa, data);
-				bus_write(32, pa, data);
+				tlb_bus_write(tlb, 32, pa, data);
 			else if (datatype == ARM_HALFWORD_TYPE)
 				/*
 				mem_write_halfword (state,
 						    (pa | (real_va & 2)),
 						    data);
 				*/
-				bus_write(16, pa | (real_va & 2), data);
+				tlb_bus_write(tlb, 16, pa | (real_va & 2), data);
 			else if (datatype == ARM_BYTE_TYPE)
 				/*
 				mem_write_byte (state, (pa | (real_va & 3)),
 						data);
 				*/
-				bus_write(8, pa | (real_va & 3), data);
+				tlb_bus_write(tlb, 8, pa | (real_va & 3), data);
 		}
 	}
 	return 0;
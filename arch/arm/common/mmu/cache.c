@@ -1,5 +1,17 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include "armdefs.h"
+#include "armcpu.h"
 #include "bank_defs.h"
+#include "skyeye_command.h"
+#include "skyeye_options.h"
+#include "skyeye_log.h"
+
+static cache_sim_mode_t cache_sim_mode = CACHE_SIM_FUNCTIONAL;
+static unsigned long long cache_sim_window_size = 100000;
+static int cache_sim_sample = 1;
+static int cache_sim_period = 10;
 
 /* mmu cache init
  *
@@ -58,6 +70,10 @@ mmu_cache_init (cache_s * cache_t, int width, int way, int set, int w_mode)
 	cache_t->set = set;
 	cache_t->way = way;
 	cache_t->w_mode = w_mode;
+	cache_t->searches = 0;
+	cache_t->hits = 0;
+	cache_t->fills = 0;
+	cache_t->write_backs = 0;
 	return 0;
 
       data_error:
@@ -124,10 +140,13 @@ mmu_cache_search (ARMul_State * state, cache_s * cache_t, ARMword va)
 	cache_line_t *cache;
 
 	cache_set_t *cache_set = cache_t->sets + set;
+	cache_t->searches++;
 	for (i = 0, cache = cache_set->lines; i < cache_t->way; i++, cache++) {
 		if ((cache->tag & TAG_VALID_FLAG)
-		    && (tag == va_cache_align (cache->tag, cache_t)))
+		    && (tag == va_cache_align (cache->tag, cache_t))) {
+			cache_t->hits++;
 			return cache;
+		}
 	}
 	return NULL;
 }
@@ -180,6 +199,7 @@ mmu_cache_alloc (ARMul_State * state, cache_s * cache_t, ARMword va,
 	pa = va_cache_align (pa, cache_t);
 
 	set = &cache_t->sets[va_cache_set (va, cache_t)];
+	cache_t->fills++;
 
 	/*robin-round */
 	cache = &set->lines[set->cycle++];
@@ -241,6 +261,7 @@ mmu_cache_write_back (ARMul_State * state, cache_s * cache_t,
 	case TAG_FIRST_HALF_DIRTY | TAG_LAST_HALF_DIRTY:
 		break;
 	}
+	cache_t->write_backs++;
 	for (i = 0; i < nw; i++, data++, pa += WORD_SIZE)
 		//mem_write_word (state, pa, *data);
 		bus_write(32, pa, *data);
@@ -369,3 +390,187 @@ cache_line_t*  mmu_cache_dirty_cache(ARMul_State *state,cache_s *cache){
 	}
 	return NULL;
 }
+
+void
+mmu_cache_sim_register (ARMul_State * state, const char *name,
+			cache_s * cache_t)
+{
+	cache_sim_t *sim = &state->mmu.cache_sim;
+	int i;
+
+	/* the model is inited again on reset */
+	for (i = 0; i < sim->num; i++)
+		if (sim->caches[i] == cache_t)
+			return;
+	if (sim->num == CACHE_SIM_MAX_CACHES) {
+		err_msg ("too many caches %d\n", sim->num);
+		return;
+	}
+	sim->names[sim->num] = name;
+	sim->caches[sim->num] = cache_t;
+	sim->num++;
+}
+
+/* write back and empty everything, the memory is accessed directly later */
+static void
+cache_sim_stop (ARMul_State * state)
+{
+	cache_sim_t *sim = &state->mmu.cache_sim;
+	int i;
+
+	/* the lines are allocated after the buffer is drained, so it is older */
+	if (sim->wb)
+		mmu_wb_drain_all (state, sim->wb);
+	for (i = 0; i < sim->num; i++)
+		mmu_cache_invalidate_all (state, sim->caches[i]);
+	if (sim->rb)
+		mmu_rb_invalidate_all (sim->rb);
+	sim->enabled = 0;
+}
+
+/**
+* @brief show the hit rate of the caches of every core, "cache-stat clear"
+* resets the counters
+*
+* @param arg
+*
+* @return
+*/
+static int
+com_cache_stat (char *arg)
+{
+	static const char *mode_name[] = { "functional", "timing", "sampled" };
+	ARM_CPU_State *cpu = get_current_cpu ();
+	ARMul_State *state;
+	cache_sim_t *sim;
+	cache_s *cache_t;
+	int i, j;
+
+	for (i = 0; i < cpu->core_num; i++) {
+		state = &cpu->core[i];
+		sim = &state->mmu.cache_sim;
+		if (arg != NULL && !strncmp (arg, "clear", strlen ("clear"))) {
+			for (j = 0; j < sim->num; j++) {
+				cache_t = sim->caches[j];
+				cache_t->searches = cache_t->hits = 0;
+				cache_t->fills = cache_t->write_backs = 0;
+			}
+			sim->sampled = 0;
+			continue;
+		}
+		if (sim->num == 0)
+			continue;
+		printf ("core %d, %s mode", i, mode_name[cache_sim_mode]);
+		if (cache_sim_mode == CACHE_SIM_SAMPLED)
+			printf (", %d of %d windows of %llu instructions, %llu sampled",
+				cache_sim_sample, cache_sim_period,
+				cache_sim_window_size, sim->sampled);
+		printf ("\n%-16s%-16s%-16s%-16s%-16s%s\n", "cache", "search",
+			"hit", "fill", "write back", "miss rate");
+		for (j = 0; j < sim->num; j++) {
+			cache_t = sim->caches[j];
+			printf ("%-16s%-16llu%-16llu%-16llu%-16llu%.2f%%\n",
+				sim->names[j], cache_t->searches, cache_t->hits,
+				cache_t->fills, cache_t->write_backs,
+				cache_t->searches ? (cache_t->searches - cache_t->hits) * 100.0 / cache_t->searches : 0.0);
+		}
+	}
+	return 0;
+}
+
+void
+mmu_cache_sim_start (ARMul_State * state)
+{
+	static int command_registered = 0;
+	cache_sim_t *sim = &state->mmu.cache_sim;
+
+	sim->window = 0;
+	sim->sampled = 0;
+	sim->enabled = (cache_sim_mode != CACHE_SIM_FUNCTIONAL);
+	if (cache_sim_mode == CACHE_SIM_SAMPLED)
+		sim->window_end = state->NumInstrs + cache_sim_window_size;
+	else
+		sim->window_end = ~0ULL;
+	if (!command_registered) {
+		add_command ("cache-stat", com_cache_stat, "Show the hit rate of the simulated caches of the mmu.\n");
+		command_registered = 1;
+	}
+}
+
+void
+mmu_cache_sim_window (ARMul_State * state)
+{
+	cache_sim_t *sim = &state->mmu.cache_sim;
+
+	if (cache_sim_mode != CACHE_SIM_SAMPLED) {
+		sim->window_end = ~0ULL;
+		return;
+	}
+	if (sim->enabled)
+		sim->sampled += cache_sim_window_size;
+	sim->window = (sim->window + 1) % cache_sim_period;
+	if (sim->window < cache_sim_sample)
+		sim->enabled = 1;
+	else if (sim->enabled)
+		cache_sim_stop (state);
+	sim->window_end = state->NumInstrs + cache_sim_window_size;
+}
+
+/**
+* @brief the handler of mmu_cache option, for example
+* "mmu_cache: mode=sampled, window=100000, sample=1, period=10"
+*
+* @param this_option
+* @param num_params
+* @param params[]
+*
+* @return
+*/
+int
+do_mmu_cache_option (skyeye_option_t * this_option, int num_params,
+		     const char *params[])
+{
+	char name[MAX_PARAM_NAME], value[MAX_PARAM_NAME];
+	cache_sim_mode_t mode = cache_sim_mode;
+	unsigned long long window = cache_sim_window_size;
+	int sample = cache_sim_sample, period = cache_sim_period;
+	int i;
+
+	for (i = 0; i < num_params; i++) {
+		if (split_param (params[i], name, value) < 0) {
+			SKYEYE_ERR ("Error: mmu_cache has wrong parameter \"%s\".\n", params[i]);
+			return -1;
+		}
+		if (!strncmp ("mode", name, strlen (name))) {
+			if (!strcmp (value, "functional"))
+				mode = CACHE_SIM_FUNCTIONAL;
+			else if (!strcmp (value, "timing"))
+				mode = CACHE_SIM_TIMING;
+			else if (!strcmp (value, "sampled"))
+				mode = CACHE_SIM_SAMPLED;
+			else {
+				SKYEYE_ERR ("Error: Unknown mmu_cache mode \"%s\"\n", value);
+				return -1;
+			}
+		}
+		else if (!strncmp ("window", name, strlen (name)))
+			window = strtoull (value, NULL, 0);
+		else if (!strncmp ("sample", name, strlen (name)))
+			sample = strtol (value, NULL, 0);
+		else if (!strncmp ("period", name, strlen (name)))
+			period = strtol (value, NULL, 0);
+		else {
+			SKYEYE_ERR ("Error: Unknown mmu_cache option \"%s\"\n", params[i]);
+			return -1;
+		}
+	}
+	if (window == 0 || period <= 0 || sample <= 0 || sample > period) {
+		SKYEYE_ERR ("Error: mmu_cache needs 0 < sample <= period and a window\n");
+		return -1;
+	}
+	cache_sim_mode = mode;
+	cache_sim_window_size = window;
+	cache_sim_sample = sample;
+	cache_sim_period = period;
+	return 0;
+}
@@ -36,6 +36,11 @@ typedef struct cache_s
 	int w_mode;		/*write back or write through */
 	//int a_mode;   /*alloc mode: random or round-bin*/
 	cache_set_t *sets;
+	/*statistics while the cache is simulated */
+	unsigned long long searches;
+	unsigned long long hits;
+	unsigned long long fills;
+	unsigned long long write_backs;
   /**/} cache_s;
 
 typedef struct cache_desc_s
@@ -48,6 +53,34 @@ typedef struct cache_desc_s
 } cache_desc_t;
 
 
+/*
+ * The caches, the write buffer and the read buffer of a mmu model are not
+ * simulated by default, the memory is accessed directly. In the timing mode
+ * they are always simulated, in the sampled mode only in the first
+ * "sample" of every "period" windows of "window" instructions.
+ */
+typedef enum
+{
+	CACHE_SIM_FUNCTIONAL,
+	CACHE_SIM_TIMING,
+	CACHE_SIM_SAMPLED,
+} cache_sim_mode_t;
+
+#define CACHE_SIM_MAX_CACHES 4
+
+typedef struct cache_sim_s
+{
+	int enabled;		/*the caches are simulated now */
+	int window;		/*the index of the window in the period */
+	unsigned long long window_end;	/*NumInstrs at the end of the window */
+	unsigned long long sampled;	/*instructions run with the caches */
+	int num;
+	const char *names[CACHE_SIM_MAX_CACHES];
+	cache_s *caches[CACHE_SIM_MAX_CACHES];
+	wb_s *wb;
+	rb_s *rb;
+} cache_sim_t;
+
 /*virtual address to cache set index*/
 #define va_cache_set(va, cache_t) \
 	(((va) / (cache_t)->width) & ((cache_t)->set - 1))
@@ -165,4 +198,24 @@ mmu_cache_soft_flush (ARMul_State * state, cache_s * cache_t, ARMword pa);
 
 cache_line_t* mmu_cache_dirty_cache(ARMul_State * state, cache_s * cache_t);
 
+/* mmu_cache_sim_register: add a cache of the mmu model to the simulation
+ * mode, its statistics are shown by the cache-stat command
+ *
+ * @state	:ARMul_State
+ * @name	:the name in the statistics
+ * @cache_t	:the cache
+ */
+void mmu_cache_sim_register (ARMul_State * state, const char *name,
+			     cache_s * cache_t);
+
+/* mmu_cache_sim_start: begin the first window, after the mmu model is inited
+ */
+void mmu_cache_sim_start (ARMul_State * state);
+
+/* mmu_cache_sim_window: called when NumInstrs reaches the end of the window,
+ * a window without the simulation begins with the caches written back and
+ * emptied
+ */
+void mmu_cache_sim_window (ARMul_State * state);
+
 #endif /*_MMU_CACHE_H_*/
@@ -113,6 +113,12 @@ sa_mmu_init (ARMul_State * state)
 		err_msg ("rb init %d\n", -1);
 		goto rb_init_error;
 	}
+
+	mmu_cache_sim_register (state, "main_d_cache", MAIN_D_CACHE ());
+	mmu_cache_sim_register (state, "mini_d_cache", MINI_D_CACHE ());
+	mmu_cache_sim_register (state, "i_cache", I_CACHE ());
+	state->mmu.cache_sim.wb = WB ();
+	state->mmu.cache_sim.rb = RB ();
 	return 0;
 
       rb_init_error:
@@ -148,7 +154,7 @@ static fault_t
 sa_mmu_load_instr (ARMul_State * state, ARMword va, ARMword * instr)
 {
 	fault_t fault;
-	tlb_entry_t *tlb;
+	tlb_entry_t *tlb = NULL;
 	cache_line_t *cache;
 	int c;			//cache bit
 	ARMword pa;		//physical addr
@@ -183,7 +189,7 @@ sa_mmu_load_instr (ARMul_State * state, ARMword va, ARMword * instr)
 	}
 
 	/*search cache no matter MMU enabled/disabled */
-	cache = mmu_cache_search (state, I_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, I_CACHE (), va) : NULL;
 	if (cache) {
 		*instr = cache->data[va_cache_index (va, I_CACHE ())];
 		return 0;
@@ -199,7 +205,7 @@ sa_mmu_load_instr (ARMul_State * state, ARMword va, ARMword * instr)
 		pa = tlb_va_to_pa (tlb, va);
 	}
 
-	if (c) {
+	if (c && MMU_CacheSim) {
 		int index;
 
 		debug_count++;
@@ -209,7 +215,7 @@ sa_mmu_load_instr (ARMul_State * state, ARMword va, ARMword * instr)
 	}
 	else
 		//*instr = mem_read_word (state, pa);
-		bus_read(32, pa, instr);
+		tlb_bus_read(tlb, 32, pa, instr);
 
 	return 0;
 };
@@ -297,7 +303,7 @@ sa_mmu_read (ARMul_State * state, ARMword va, ARMword * data,
 	if (fault)
 		return fault;
 	/*search in read buffer */
-	rb = mmu_rb_search (RB (), va);
+	rb = MMU_CacheSim ? mmu_rb_search (RB (), va) : NULL;
 	if (rb) {
 		if (rb->fault)
 			return rb->fault;
@@ -306,14 +312,14 @@ sa_mmu_read (ARMul_State * state, ARMword va, ARMword * data,
 		//return 0;
 	};
 	/*search main cache */
-	cache = mmu_cache_search (state, MAIN_D_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, MAIN_D_CACHE (), va) : NULL;
 	if (cache) {
 		*data = cache->data[va_cache_index (va, MAIN_D_CACHE ())];
 		goto datatrans;
 		//return 0;
 	}
 	/*search mini cache */
-	cache = mmu_cache_search (state, MINI_D_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, MINI_D_CACHE (), va) : NULL;
 	if (cache) {
 		*data = cache->data[va_cache_index (va, MINI_D_CACHE ())];
 		goto datatrans;
@@ -337,11 +343,11 @@ sa_mmu_read (ARMul_State * state, ARMword va, ARMword * data,
 	}
 
 	/*if Buffer, drain Write Buffer first */
-	if (tlb_b_flag (tlb))
+	if (tlb_b_flag (tlb) && MMU_CacheSim)
 		mmu_wb_drain_all (state, WB ());
 
 	/*alloc cache or mem_read */
-	if (tlb_c_flag (tlb) && MMU_DCacheEnabled) {
+	if (tlb_c_flag (tlb) && MMU_DCacheEnabled && MMU_CacheSim) {
 		cache_s *cache_t;
 
 		if (tlb_b_flag (tlb))
@@ -355,13 +361,13 @@ sa_mmu_read (ARMul_State * state, ARMword va, ARMword * data,
 		//*data = mem_read_word(state, pa);
 		if (datatype == ARM_BYTE_TYPE)
 			//*data = mem_read_byte (state, pa | (real_va & 3));
-			bus_read(8, pa | (real_va & 3), data);
+			tlb_bus_read(tlb, 8, pa | (real_va & 3), data);
 		else if (datatype == ARM_HALFWORD_TYPE)
 			//*data = mem_read_halfword (state, pa | (real_va & 2));
-			bus_read(16, pa | (real_va & 2), data);
+			tlb_bus_read(tlb, 16, pa | (real_va & 2), data);
 		else if (datatype == ARM_WORD_TYPE)
 			//*data = mem_read_word (state, pa);
-			bus_read(32, pa, data);
+			tlb_bus_read(tlb, 32, pa, data);
 		else {
 			printf ("SKYEYE:2 sa_mmu_read error: unknown data type %d\n", datatype);
 			skyeye_exit (-1);
@@ -420,7 +426,7 @@ sa_mmu_write (ARMul_State * state, ARMword va, ARMword data, ARMword datatype)
 	real_va = va;
 
 	/*search instruction cache */
-	cache = mmu_cache_search (state, I_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, I_CACHE (), va) : NULL;
 	if (cache) {
 		update_cache (state, va, data, datatype, cache, I_CACHE (),
 			      real_va);
@@ -465,14 +471,14 @@ sa_mmu_write (ARMul_State * state, ARMword va, ARMword data, ARMword datatype)
 		return fault;
 	}
 	/*search main cache */
-	cache = mmu_cache_search (state, MAIN_D_CACHE (), va);
+	cache = MMU_CacheSim ? mmu_cache_search (state, MAIN_D_CACHE (), va) : NULL;
 	if (cache) {
 		update_cache (state, va, data, datatype, cache,
 			      MAIN_D_CACHE (), real_va);
 	}
 	else {
 		/*search mini cache */
-		cache = mmu_cache_search (state, MINI_D_CACHE (), va);
+		cache = MMU_CacheSim ? mmu_cache_search (state, MINI_D_CACHE (), va) : NULL;
 		if (cache) {
 			update_cache (state, va, data, datatype, cache,
 				      MINI_D_CACHE (), real_va);
@@ -480,7 +486,7 @@ sa_mmu_write (ARMul_State * state, ARMword va, ARMword data, ARMword datatype)
 	}
 
 	if (!cache) {
-		b = tlb_b_flag (tlb);
+		b = tlb_b_flag (tlb) && MMU_CacheSim;
 		pa = tlb_va_to_pa (tlb, va);
 		if (b) {
 			if (MMU_WBEnabled) {
@@ -502,7 +508,7 @@ sa_mmu_write (ARMul_State * state, ARMword va, ARMword data, ARMword datatype)
 			else {
 				if (datatype == ARM_WORD_TYPE)
 					//mem_write_word (state, pa, data);
-					bus_write(32, pa, data);
+					tlb_bus_write(tlb, 32, pa, data);
 				else if (datatype == ARM_HALFWORD_TYPE)
 					/*
 					mem_write_halfword (state,
@@ -510,35 +516,36 @@ sa_mmu_write (ARMul_State * state, ARMword va, ARMword data, ARMword datatype)
 							     (real_va & 2)),
 							    data);
 					*/
-					bus_write(16, pa | (real_va & 2), data);
+					tlb_bus_write(tlb, 16, pa | (real_va & 2), data);
 				else if (datatype == ARM_BYTE_TYPE)
 					/*
 					mem_write_byte (state,
 							(pa | (real_va & 3)),
 							data);
 					*/
-					bus_write(8, pa | (real_va & 3), data);
+					tlb_bus_write(tlb, 8, pa | (real_va & 3), data);
 			}
 		}
 		else {
-			mmu_wb_drain_all (state, WB ());
+			if (MMU_CacheSim)
+				mmu_wb_drain_all (state, WB ());
 
 			if (datatype == ARM_WORD_TYPE)
 				//mem_write_word (state, pa, data);
-				bus_write(32, pa, data);
+				tlb_bus_write(tlb, 32, pa, data);
 			else if (datatype == ARM_HALFWORD_TYPE)
 				/*
 					mem_write_halfword (state,
 						    (pa | (real_va & 2)),
 						    data);
 				*/
-				bus_write(16, pa | (real_va & 2), data);
+				tlb_bus_write(tlb, 16, pa | (real_va & 2), data);
 			else if (datatype == ARM_BYTE_TYPE)
 				/*
 				mem_write_byte (state, (pa | (real_va & 3)),
 						data);
 				*/
-				bus_write(8, pa | (real_va & 3), data);
+				tlb_bus_write(tlb, 8, pa | (real_va & 3), data);
 		}
 	}
 	return 0;
@@ -1,7 +1,12 @@
 #include <assert.h>
+#include <string.h>
 
 #include "armdefs.h"
 #include "bank_defs.h"
+#include "skyeye_callback.h"
+#include "skyeye_pref.h"
+#include "skyeye_exec_info.h"
+#include "skyeye_ram.h"
 
 ARMword tlb_masks[] = {
 	0x00000000,		/* TLB_INVALID */
@@ -111,10 +116,41 @@ check_access (ARMul_State * state, ARMword virt_addr, tlb_entry_t * tlb,
 	return NO_FAULT;
 }
 
+/* copy the tlb entry into the micro tlb, with the page entry of the ram */
+static tlb_entry_t *
+utlb_fill (ARMul_State * state, tlb_s * tlb_t, ARMword virt_addr,
+	   tlb_entry_t * tlb)
+{
+	utlb_entry_t *u = &tlb_t->utlb[utlb_index (virt_addr)];
+	ARMword pa;
+
+	if (tlb->mapping == TLB_TINYPAGE)
+		return tlb;
+	u->tag = utlb_tag (virt_addr);
+	u->gen = state->mmu.utlb_gen;
+	u->tlb = *tlb;
+	/* the bus reads the host address itself in that mode */
+	if (get_skyeye_exec_info ()->mmap_access && get_skyeye_pref ()->user_mode_sim)
+		u->tlb.page = NULL;
+	else {
+		pa = tlb_va_to_pa (tlb, virt_addr);
+		u->tlb.page = bank_page_ptr (pa);
+	}
+	return &u->tlb;
+}
+
 fault_t
 translate (ARMul_State * state, ARMword virt_addr, tlb_s * tlb_t,
 	   tlb_entry_t ** tlb)
 {
+	utlb_entry_t *u = &tlb_t->utlb[utlb_index (virt_addr)];
+
+	if (u->tag == utlb_tag (virt_addr) && u->gen == state->mmu.utlb_gen) {
+		*tlb = &u->tlb;
+		state->mmu.last_domain = u->tlb.domain;
+		return NO_FAULT;
+	}
+
 	*tlb = mmu_tlb_search (state, tlb_t, virt_addr);
 	if (!*tlb) {
 		/* walk the translation tables */
@@ -226,12 +262,14 @@ translate (ARMul_State * state, ARMword virt_addr, tlb_s * tlb_t,
 		}
 		entry.virt_addr &= tlb_masks[entry.mapping];
 		entry.phys_addr &= tlb_masks[entry.mapping];
+		entry.page = NULL;
 
 		/* place entry in the tlb */
 		*tlb = &tlb_t->entrys[tlb_t->cycle];
 		tlb_t->cycle = (tlb_t->cycle + 1) % tlb_t->num;
 		**tlb = entry;
 	}
+	*tlb = utlb_fill (state, tlb_t, virt_addr, *tlb);
 	state->mmu.last_domain = (*tlb)->domain;
 	return NO_FAULT;
 }
@@ -240,6 +278,7 @@ int
 mmu_tlb_init (tlb_s * tlb_t, int num)
 {
 	tlb_entry_t *e;
+	utlb_entry_t *u;
 	int i;
 
 	e = (tlb_entry_t *) malloc (sizeof (*e) * num);
@@ -247,13 +286,21 @@ mmu_tlb_init (tlb_s * tlb_t, int num)
 		err_msg ("malloc size %d\n", sizeof (*e) * num);
 		goto tlb_malloc_error;
 	}
+	u = (utlb_entry_t *) calloc (UTLB_SIZE, sizeof (*u));
+	if (u == NULL) {
+		err_msg ("malloc size %d\n", sizeof (*u) * UTLB_SIZE);
+		goto utlb_malloc_error;
+	}
 	tlb_t->entrys = e;
+	tlb_t->utlb = u;
 	for (i = 0; i < num; i++, e++)
 		e->mapping = TLB_INVALID;
 	tlb_t->cycle = 0;
 	tlb_t->num = num;
 	return 0;
 
+      utlb_malloc_error:
+	free (e);
       tlb_malloc_error:
 	return -1;
 }
@@ -261,6 +308,7 @@ mmu_tlb_init (tlb_s * tlb_t, int num)
 void
 mmu_tlb_exit (tlb_s * tlb_t)
 {
+	free (tlb_t->utlb);
 	free (tlb_t->entrys);
 };
 
@@ -273,17 +321,49 @@ mmu_tlb_invalidate_all (ARMul_State * state, tlb_s * tlb_t)
 		tlb_t->entrys[entry].mapping = TLB_INVALID;
 	}
 	tlb_t->cycle = 0;
+	memset (tlb_t->utlb, 0, sizeof (utlb_entry_t) * UTLB_SIZE);
 }
 
 void
 mmu_tlb_invalidate_entry (ARMul_State * state, tlb_s * tlb_t, ARMword addr)
 {
 	tlb_entry_t *tlb;
+	utlb_entry_t *u;
+	int entry;
 
 	tlb = mmu_tlb_search (state, tlb_t, addr);
 	if (tlb) {
 		tlb->mapping = TLB_INVALID;
 	}
+	/* a section or a large page may be in several micro tlb entries */
+	for (entry = 0; entry < UTLB_SIZE; entry++) {
+		u = &tlb_t->utlb[entry];
+		if ((u->tag & UTLB_VALID) &&
+		    (addr & tlb_masks[u->tlb.mapping]) == u->tlb.virt_addr)
+			u->tag = 0;
+	}
+}
+
+/**
+* @brief drop the micro tlb entries of all the tlbs of a core when a cp15
+* register that the translation depends on is written
+*
+* @param state the core
+* @param creg the cp15 register written by mcr
+*/
+void
+mmu_utlb_cp15_write (ARMul_State * state, ARMword creg)
+{
+	switch (creg) {
+	case MMU_CONTROL:
+	case MMU_TRANSLATION_TABLE_BASE:
+	case MMU_DOMAIN_ACCESS_CONTROL:
+	case MMU_PID:
+		state->mmu.utlb_gen++;
+		break;
+	default:
+		break;
+	}
 }
 
 tlb_entry_t *
@@ -306,3 +386,45 @@ mmu_tlb_search (ARMul_State * state, tlb_s * tlb_t, ARMword virt_addr)
 	}
 	return NULL;
 }
+
+/**
+* @brief read the physical address translated by a tlb entry, a ram page
+* remembered by the micro tlb is read without looking up the bank again
+*
+* @param tlb the tlb entry returned by translate, NULL if the mmu is off
+* @param size the data width
+* @param pa the physical address
+* @param data the return value
+*
+* @return the return value of the bus
+*/
+int
+tlb_bus_read (tlb_entry_t * tlb, short size, ARMword pa, ARMword * data)
+{
+	bank_page_t *page = tlb ? tlb->page : NULL;
+
+	if (page && page->host && !is_callback_armed (Bus_read_callback))
+		return mem_read_page (page, size, pa, data);
+	return bus_read (size, pa, data);
+}
+
+/**
+* @brief write the physical address translated by a tlb entry
+*
+* @param tlb the tlb entry returned by translate, NULL if the mmu is off
+* @param size the data width
+* @param pa the physical address
+* @param data the value written
+*
+* @return the return value of the bus
+*/
+int
+tlb_bus_write (tlb_entry_t * tlb, short size, ARMword pa, ARMword data)
+{
+	bank_page_t *page = tlb ? tlb->page : NULL;
+
+	if (page && (page->flags & BANK_PAGE_WRITABLE)
+	    && !is_callback_armed (Bus_write_callback))
+		return mem_write_page (page, size, pa, data);
+	return bus_write (size, pa, data);
+}
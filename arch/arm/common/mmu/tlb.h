@@ -48,13 +48,36 @@ typedef struct tlb_entry_t
 	ARMword perms;
 	ARMword domain;
 	tlb_mapping_t mapping;
+	/* the page entry of the physical page, only set in a micro tlb entry */
+	struct bank_page *page;
 } tlb_entry_t;
 
+/*
+ * A direct mapped micro tlb in front of every tlb, indexed by the virtual
+ * page, so a hit does not scan the tlb. It holds a copy of the tlb entry,
+ * which stays valid when the entry is replaced in the tlb, the same as a
+ * micro tlb in the hardware. Tiny pages are not kept in it.
+ */
+#define UTLB_BITS	8
+#define UTLB_SIZE	(1 << UTLB_BITS)
+#define UTLB_PAGE_BITS	12
+#define UTLB_VALID	0x1
+#define utlb_index(va)	(((va) >> UTLB_PAGE_BITS) & (UTLB_SIZE - 1))
+#define utlb_tag(va)	(((va) & ~((1 << UTLB_PAGE_BITS) - 1)) | UTLB_VALID)
+
+typedef struct utlb_entry_t
+{
+	ARMword tag;		/* the virtual page | UTLB_VALID */
+	ARMword gen;		/* state->mmu.utlb_gen when it was filled */
+	tlb_entry_t tlb;
+} utlb_entry_t;
+
 typedef struct tlb_s
 {
 	int num;		/*num of tlb entry */
 	int cycle;		/*current tlb cycle */
 	tlb_entry_t *entrys;
+	utlb_entry_t *utlb;
 } tlb_s;
 
 
@@ -91,4 +114,10 @@ mmu_tlb_invalidate_entry (ARMul_State * state, tlb_s * tlb_t, ARMword addr);
 tlb_entry_t *mmu_tlb_search (ARMul_State * state, tlb_s * tlb_t,
 			     ARMword virt_addr);
 
+void mmu_utlb_cp15_write (ARMul_State * state, ARMword creg);
+
+int tlb_bus_read (tlb_entry_t * tlb, short size, ARMword pa, ARMword * data);
+
+int tlb_bus_write (tlb_entry_t * tlb, short size, ARMword pa, ARMword data);
+
 #endif	    /*_MMU_TLB_H_*/
@@ -470,6 +470,9 @@ int xscale_cp15_init (ARMul_State * state)
 	}
 #endif
 
+	mmu_cache_sim_register (state, "main_d_cache", MAIN_D_CACHE ());
+	mmu_cache_sim_register (state, "mini_d_cache", MINI_D_CACHE ());
+	state->mmu.cache_sim.wb = WB ();
 	return 0;
 #if 0
       rb_init_error:
@@ -506,7 +509,7 @@ static fault_t
 			       ARMword * instr)
 {
 	fault_t fault;
-	tlb_entry_t *tlb;
+	tlb_entry_t *tlb = NULL;
 	cache_line_t *cache;
 	int c;			//cache bit
 	ARMword pa;		//physical addr
@@ -560,7 +563,7 @@ static fault_t
 
 	//chy 2003-09-03 only read mem, don't use cache now,will change later ????
 	//*instr = mem_read_word (state, pa);
-	bus_read(32, pa, instr);
+	tlb_bus_read(tlb, 32, pa, instr);
 #if 0
 //-----------------------------------------------------------
 	//chy 2003-09-02 for test????
@@ -583,7 +586,7 @@ static fault_t
 	}
 	else
 		//*instr = mem_read_word (state, pa);
-		bus_read(32, pa, instr);
+		tlb_bus_read(tlb, 32, pa, instr);
 
 	return 0;
 };
@@ -709,19 +712,19 @@ static fault_t
 #endif
 
 	/*2004-07-19 chy: add support of xscale MMU CacheDisabled option */
-	if (MMU_CacheDisabled) {
+	if (MMU_CacheDisabled || !MMU_CacheSim) {
 		//if(1){ can be used to test cache error
 		/*get phy_addr */
 		pa = tlb_va_to_pa (tlb, real_va);
 		if (datatype == ARM_BYTE_TYPE)
 			//*data = mem_read_byte (state, pa);
-			bus_read(8, pa, data);
+			tlb_bus_read(tlb, 8, pa, data);
 		else if (datatype == ARM_HALFWORD_TYPE)
 			//*data = mem_read_halfword (state, pa);
-			bus_read(16, pa, data);
+			tlb_bus_read(tlb, 16, pa, data);
 		else if (datatype == ARM_WORD_TYPE)
 			//*data = mem_read_word (state, pa);
-			bus_read(32, pa, data);
+			tlb_bus_read(tlb, 32, pa, data);
 		else {
 			printf ("SKYEYE:MMU_CacheDisabled xscale_mmu_read error: unknown data type %d\n", datatype);
 			skyeye_exit (-1);
@@ -806,13 +809,13 @@ static fault_t
 		//*data = mem_read_word(state, pa);
 		if (datatype == ARM_BYTE_TYPE)
 			//*data = mem_read_byte (state, pa | (real_va & 3));
-			bus_read(8, pa | (real_va & 3), data);
+			tlb_bus_read(tlb, 8, pa | (real_va & 3), data);
 		else if (datatype == ARM_HALFWORD_TYPE)
 			//*data = mem_read_halfword (state, pa | (real_va & 2));
-			bus_read(16, pa | (real_va & 2), data);
+			tlb_bus_read(tlb, 16, pa | (real_va & 2), data);
 		else if (datatype == ARM_WORD_TYPE)
 			//*data = mem_read_word (state, pa);
-			bus_read(32, pa, data);
+			tlb_bus_read(tlb, 32, pa, data);
 		else {
 			printf ("SKYEYE:2 xscale_mmu_read error: unknown data type %d\n", datatype);
 			skyeye_exit (-1);
@@ -918,19 +921,19 @@ static fault_t
 	}
 
 	/*2004-07-19 chy: add support for xscale MMU_CacheDisabled */
-	if (MMU_CacheDisabled) {
+	if (MMU_CacheDisabled || !MMU_CacheSim) {
 		//if(1){ can be used to test the cache error
 		/*get phy_addr */
 		pa = tlb_va_to_pa (tlb, real_va);
 		if (datatype == ARM_BYTE_TYPE)
 			//mem_write_byte (state, pa, data);
-			bus_write(8, pa, data);
+			tlb_bus_write(tlb, 8, pa, data);
 		else if (datatype == ARM_HALFWORD_TYPE)
 			//mem_write_halfword (state, pa, data);
-			bus_write(16, pa, data);
+			tlb_bus_write(tlb, 16, pa, data);
 		else if (datatype == ARM_WORD_TYPE)
 			//mem_write_word (state, pa, data);
-			bus_write(32, pa , data);
+			tlb_bus_write(tlb, 32, pa , data);
 		else {
 			printf ("SKYEYE:MMU_CacheDisabled xscale_mmu_write error: unknown data type %d\n", datatype);
 			skyeye_exit (-1);
@@ -1012,13 +1015,13 @@ static fault_t
 	//chy 2003-08-24, just write phy addr
 	if (datatype == ARM_WORD_TYPE)
 		//mem_write_word (state, pa, data);
-		bus_write(32, pa, data);
+		tlb_bus_write(tlb, 32, pa, data);
 	else if (datatype == ARM_HALFWORD_TYPE)
 		//mem_write_halfword (state, (pa | (real_va & 2)), data);
-		bus_write(16, pa | (real_va & 2), data);
+		tlb_bus_write(tlb, 16, pa | (real_va & 2), data);
 	else if (datatype == ARM_BYTE_TYPE)
 		//mem_write_byte (state, (pa | (real_va & 3)), data);
-		bus_write(8, (pa | (real_va & 3)), data);
+		tlb_bus_write(tlb, 8, (pa | (real_va & 3)), data);
 #if 0
 //-------------------------------------------------------------
 //chy 2003-09-02 for test ????
@@ -1080,13 +1083,13 @@ static fault_t
 #endif
 	if (datatype == ARM_WORD_TYPE)
 		//mem_write_word (state, pa, data);
-		bus_write(32, pa, data);
+		tlb_bus_write(tlb, 32, pa, data);
 	else if (datatype == ARM_HALFWORD_TYPE)
 		//mem_write_halfword (state, (pa | (real_va & 2)), data);
-		bus_write(16, pa | (real_va & 2), data);
+		tlb_bus_write(tlb, 16, pa | (real_va & 2), data);
 	else if (datatype == ARM_BYTE_TYPE)
 		//mem_write_byte (state, (pa | (real_va & 3)), data);
-		bus_write(8, (pa | (real_va & 3)), data);
+		tlb_bus_write(tlb, 8, (pa | (real_va & 3)), data);
 	return 0;
 }
 
@@ -1275,6 +1278,7 @@ ARMword xscale_mmu_mcr (ARMul_State * state, ARMword instr, ARMword value)
 	unsigned result;
 	mmu_regnum_t creg = reg;
 
+	mmu_utlb_cp15_write (state, reg);
 	//printf("SKYEYE: xscale_cp15_mcr: opcode_2 0x%x, CRm 0x%x, reg ox%x, value 0x%x, reg[15] 0x%x, instr 0x%x\n",opcode_2,CRm,reg, value, state->Reg[15], instr);
 
 	switch (creg) {
@@ -25,6 +25,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "skyeye_options.h"
 #include "skyeye_signal.h"
 #include "skyeye_cell.h"
+#include "skyeye_pref.h"
+#include "skyeye_callback.h"
 #include <skyeye_log.h>
 #ifdef __CYGWIN__
 #include <sys/time.h>
@@ -249,7 +251,19 @@ static bool arm_cpu_init()
 	}
 	mach->cpu_data = get_conf_obj_by_cast(cpu, "ARM_CPU_State");
 
-	cpu->core_num = 1;
+	cpu->core_num = get_smp_cores();
+	/* We only use one core for user mode running */
+	if(get_user_mode() == True)
+		cpu->core_num = 1;
+	/* the legacy interpreter of the pure interpret mode is not thread
+	 * safe, so its cores can not run on their own threads */
+	if(smp_parallel_enabled() && (running_mode == PURE_INTERPRET || get_skyeye_pref()->interpret_mode)){
+		skyeye_log(Warning_log, __FUNCTION__, "parallel smp mode needs the dyncom engine, the cores run on one thread.\n");
+		smp_parallel_disable();
+	}
+	/* the fast interpreter runs every block through InterpreterMainLoop */
+	if(running_mode == FAST_INTERPRET && !get_skyeye_pref()->interpret_mode)
+		provide_block_callback();
 
 	if(!cpu->core_num){
 		skyeye_log(Critical_log, __FUNCTION__, "Can not get the core number or set wrong mach name?\n");
@@ -282,15 +296,18 @@ static bool arm_cpu_init()
         	exec->run =  per_cpu_step;
 		//exec->stop = (void (*)(conf_object_t*))per_cpu_stop;
 		exec->stop = per_cpu_stop;
-		add_to_default_cell(exec);
+		add_to_smp_cell(exec);
 	}
 
 	cpu->boot_core_id = 0;
 
 	ARMul_EmulateInit(); /* Needed by the interpreter */
-#if PROFILE
-	signal(SIGVTALRM, update_walltime);
-	set_profiler_timer();
+#ifndef __WIN32__
+	if (trace_jit) {
+		/* the walltime ages the branch counters of the traces */
+		signal(SIGVTALRM, update_walltime);
+		set_profiler_timer();
+	}
 #endif
 	return true;
 }
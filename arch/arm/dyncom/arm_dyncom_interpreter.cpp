@@ -44,6 +44,11 @@ using namespace std;
 #include "dyncom/profiler.h"
 #include "skyeye_ram.h"
 #include "vfp/vfp.h"
+#include "arm_dyncom_interpreter.h"
+#include "skyeye_log.h"
+#include "skyeye_callback.h"
+#include "skyeye_cell.h"
+#include "armcpu.h"
 /* shenoubang 2012-6-14 */
 #ifdef __WIN32__
 #include "bank_defs.h"
@@ -53,6 +58,8 @@ using namespace std;
 
 #define THRESHOLD			1000
 #define DURATION			500
+/* the most blocks stitched into one trace */
+#define MAX_TRACE_BLOCKS		64
 //#define PRINT_PROFILE_INFO
 
 #define CHECK_RS 	if(RS == 15) rs += 8
@@ -423,7 +430,49 @@ fault_t interpreter_read_memory(cpu_t *cpu, addr_t virt_addr, addr_t phys_addr,
 fault_t interpreter_write_memory(cpu_t *cpu, addr_t virt_addr, addr_t phys_addr, uint32_t value, uint32_t size);
 fault_t interpreter_fetch(cpu_t *cpu, addr_t virt_addr, uint32_t &value, uint32_t size);
 fault_t check_address_validity(arm_core_t *core, addr_t virt_addr, addr_t *phys_addr, uint32_t rw, tlb_type_t access_type = DATA_TLB);
+#if CHECK_IN_WRITE
+void flush_written_code(cpu_t *cpu, addr_t phys_addr);
+#endif
+#endif
+
+/**
+* @brief the store of strex. In the parallel smp mode the other cores may
+* write the location between ldrex and strex, with plain stores too, so
+* the store is an atomic compare and swap against the value ldrex read.
+*
+* @param core the dyncom cpu
+* @param cpu the arm core
+* @param addr the virtual address
+* @param phys_addr the physical address
+* @param value the value to store
+* @param size 8 or 32
+* @param fault the fault of the store
+*
+* @return 0 if stored, 1 if the location was changed by another core
+*/
+static int exclusive_store(cpu_t *core, arm_processor *cpu, addr_t addr, addr_t phys_addr, uint32_t value, uint32_t size, fault_t &fault)
+{
+	uint8_t *host;
+	fault = NO_FAULT;
+	if (smp_parallel_enabled() && !core->is_user_mode && cpu->bigendSig == LOW &&
+	    (host = mem_block_host(phys_addr, size / 8)) != NULL) {
+		bool stored;
+		if (size == 32)
+			stored = __sync_bool_compare_and_swap((uint32_t *)host, (uint32_t)cpu->exclusive_value, value);
+		else
+			stored = __sync_bool_compare_and_swap(host, (uint8_t)cpu->exclusive_value, (uint8_t)value);
+		if (!stored)
+			return 1;
+		mem_mark_dirty(phys_addr, size / 8);
+#if !USER_MODE_OPT && CHECK_IN_WRITE
+		/* drop the code of the page as a plain store does */
+		flush_written_code(core, phys_addr);
 #endif
+		return 0;
+	}
+	fault = interpreter_write_memory(core, addr, phys_addr, value, size);
+	return 0;
+}
 
 typedef fault_t (*get_addr_fp_t)(arm_processor *cpu, unsigned int inst, unsigned int &virt_addr, unsigned int &phys_addr, unsigned int rw);
 
@@ -1415,16 +1464,49 @@ typedef struct _blx_1_thumb {
 
 typedef arm_inst * ARM_INST_PTR;
 
+/*
+ * inst_buf is split into segments used in FIFO order. Blocks are bump
+ * allocated in the current segment, when it can not hold another block
+ * the oldest segment is reused and the blocks translated into it are
+ * dropped from the CreamCache, so the memory used is bounded by the
+ * code_cache option of skyeye.conf.
+ */
 #define CACHE_BUFFER_SIZE	(64 * 1024 * 2000)
-char inst_buf[CACHE_BUFFER_SIZE];
+#define CACHE_SEGMENT_NUM	8
+#define MAX_CACHE_SEGMENT_NUM	64
+#define MAX_CACHE_BUFFER_SIZE	(1024 * 1024 * 1024)
+/* a block never crosses a page, so it holds at most 2048 thumb instructions */
+#define MAX_BLOCK_BUFFER_SIZE	(2048 * 128)
+char *inst_buf = NULL;
 int top = 0;
+static int cache_buffer_size = CACHE_BUFFER_SIZE;
+static int cache_segment_num = CACHE_SEGMENT_NUM;
+static int cache_segment_size;
+static int cur_segment;
+static int segment_end;
+/* the offset of the block being translated */
+static int block_top;
+static void next_code_segment();
 inline void *AllocBuffer(unsigned int size)
 {
 	int start = top;
+	int len;
 	top += size;
-	if (top > CACHE_BUFFER_SIZE) {
-		fprintf(stderr, "inst_buf is full\n");
-		exit(-1);
+	if (top > segment_end) {
+		/*
+		 * move the block being translated to the next segment, its
+		 * instructions are only reached by their offset from the start
+		 */
+		len = start - block_top;
+		if (len + size > cache_segment_size) {
+			fprintf(stderr, "inst_buf segment overflow, a block is larger than %d bytes\n", cache_segment_size);
+			exit(-1);
+		}
+		next_code_segment();
+		memcpy(&inst_buf[top], &inst_buf[block_top], len);
+		block_top = top;
+		start = top + len;
+		top = start + size;
 	}
 	return (void *)&inst_buf[start];
 }
@@ -3307,9 +3389,131 @@ const transop_fp_t arm_instruction_trans[] = {
 	INTERPRETER_TRANSLATE(blx_1_thumb)
 };
 
-typedef map<unsigned int, int> bb_map;
-bb_map CreamCache[65536];
-bb_map ProfileCache[65536];
+/*
+ * Translated basic blocks are looked up on every dispatch, so the
+ * CreamCache is a flat open-addressing table (linear probing, power of
+ * two capacity) in front of which sits a small direct-mapped jump cache
+ * indexed by the low pc bits. The key is the physical pc with bit 0 set
+ * for thumb blocks, so the same address translated in both states does
+ * not alias.
+ */
+#define BB_KEY(addr, thumb)	((uint32_t)(addr) | ((thumb) ? 1 : 0))
+#define BB_EMPTY_KEY		0xffffffff
+#define BB_CACHE_INIT_BITS	16
+#define BB_JMP_CACHE_BITS	12
+#define BB_JMP_CACHE_SIZE	(1 << BB_JMP_CACHE_BITS)
+#define BB_JMP_HASH(key)	(((key) >> 1) & (BB_JMP_CACHE_SIZE - 1))
+#define BB_PAGE(key)		((key) & 0xfffff000)
+/* the blocks a core runs in the parallel smp mode before it returns to its cell */
+#define SMP_RUN_BLOCKS		256
+
+typedef struct bb_entry {
+	uint32_t key;
+	int start;
+} bb_entry_t;
+
+typedef struct bb_cache {
+	bb_entry_t *entry;
+	uint32_t mask;
+	uint32_t num;
+	/* keys of every block per physical page, used by flush_bb */
+	map<uint32_t, vector<uint32_t> > page_keys;
+} bb_cache_t;
+
+static bb_cache_t CreamCache;
+static bb_cache_t ProfileCache;
+
+/*
+ * In the parallel smp mode every core runs the shared code cache on its
+ * own host thread. A core holds the cache "active" while it runs blocks
+ * out of inst_buf, it only looks up the CreamCache and translates with
+ * code_cache_lock held and inactive, so a segment is evicted only when no
+ * core is inside a block. Every thread has its own jump cache, the flush
+ * and the eviction bump code_cache_gen to drop the jump caches of the
+ * other threads.
+ */
+static pthread_mutex_t code_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t code_cache_cond = PTHREAD_COND_INITIALIZER;
+static volatile int code_cache_exclusive = 0;
+static int code_cache_active = 0;
+static volatile uint32_t code_cache_gen = 1;
+static int code_cache_smp = -1;
+
+static __thread bb_entry_t *bb_jmp_cache = NULL;
+static __thread uint32_t bb_jmp_gen = 0;
+
+static inline bool is_code_cache_smp()
+{
+	if (code_cache_smp == -1)
+		code_cache_smp = smp_parallel_enabled() ? 1 : 0;
+	return code_cache_smp;
+}
+
+/**
+* @brief the jump cache of the calling thread, it is emptied when the code
+* cache has been changed by another thread. A new thread has the gen 0,
+* never taken by code_cache_gen, so its cache is filled with the empty key
+* before the first lookup and a zero key does not hit.
+*/
+static inline bb_entry_t *get_jmp_cache()
+{
+	if (bb_jmp_gen != code_cache_gen) {
+		int i;
+		if (bb_jmp_cache == NULL) {
+			bb_jmp_cache = (bb_entry_t *)malloc(BB_JMP_CACHE_SIZE * sizeof(bb_entry_t));
+			if (bb_jmp_cache == NULL) {
+				fprintf(stderr, "In %s, can not allocate the jump cache\n", __FUNCTION__);
+				exit(-1);
+			}
+		}
+		for (i = 0; i < BB_JMP_CACHE_SIZE; i++)
+			bb_jmp_cache[i].key = BB_EMPTY_KEY;
+		bb_jmp_gen = code_cache_gen;
+	}
+	return bb_jmp_cache;
+}
+
+static void code_cache_changed()
+{
+	/* skip the gen 0 of the new threads */
+	if (is_code_cache_smp() && __sync_add_and_fetch(&code_cache_gen, 1) == 0)
+		__sync_fetch_and_add(&code_cache_gen, 1);
+}
+
+/* start running blocks out of the code cache */
+static void code_cache_enter()
+{
+	pthread_mutex_lock(&code_cache_lock);
+	while (code_cache_exclusive)
+		pthread_cond_wait(&code_cache_cond, &code_cache_lock);
+	code_cache_active++;
+	pthread_mutex_unlock(&code_cache_lock);
+}
+
+/* stop running blocks out of the code cache */
+static void code_cache_leave()
+{
+	pthread_mutex_lock(&code_cache_lock);
+	code_cache_active--;
+	pthread_cond_broadcast(&code_cache_cond);
+	pthread_mutex_unlock(&code_cache_lock);
+}
+
+/* lock the code cache between two blocks, the caller is inactive until unlocked */
+static void code_cache_lock_slow()
+{
+	pthread_mutex_lock(&code_cache_lock);
+	code_cache_active--;
+	pthread_cond_broadcast(&code_cache_cond);
+	while (code_cache_exclusive)
+		pthread_cond_wait(&code_cache_cond, &code_cache_lock);
+}
+
+static void code_cache_unlock_slow()
+{
+	code_cache_active++;
+	pthread_mutex_unlock(&code_cache_lock);
+}
 
 //#define USE_DUMMY_CACHE
 
@@ -3317,62 +3521,348 @@ bb_map ProfileCache[65536];
 unsigned int DummyCache[0x100000];
 #endif
 
-#define HASH(x) ((x + (x << 3) + (x >> 6)) % 65536)
-void insert_bb(unsigned int addr, int start)
+static inline uint32_t bb_hash(uint32_t key)
+{
+	/* fibonacci hashing, the low pc bits carry too little entropy */
+	return (key * 0x9e3779b1) >> 7;
+}
+
+static void bb_cache_alloc(bb_cache_t *cache, uint32_t size)
+{
+	cache->entry = (bb_entry_t *)malloc(size * sizeof(bb_entry_t));
+	if (cache->entry == NULL) {
+		fprintf(stderr, "In %s, can not allocate %u cache entries\n", __FUNCTION__, size);
+		exit(-1);
+	}
+	memset(cache->entry, 0xff, size * sizeof(bb_entry_t));
+	cache->mask = size - 1;
+	cache->num = 0;
+}
+
+static void bb_cache_put(bb_cache_t *cache, uint32_t key, int start)
+{
+	uint32_t i = bb_hash(key) & cache->mask;
+	while (cache->entry[i].key != BB_EMPTY_KEY && cache->entry[i].key != key)
+		i = (i + 1) & cache->mask;
+	if (cache->entry[i].key == BB_EMPTY_KEY)
+		cache->num ++;
+	cache->entry[i].key = key;
+	cache->entry[i].start = start;
+}
+
+static void bb_cache_grow(bb_cache_t *cache)
+{
+	bb_entry_t *old = cache->entry;
+	uint32_t old_size = cache->mask + 1;
+
+	bb_cache_alloc(cache, old_size << 1);
+	for (uint32_t i = 0; i < old_size; i ++)
+		if (old[i].key != BB_EMPTY_KEY)
+			bb_cache_put(cache, old[i].key, old[i].start);
+	free(old);
+}
+
+static void bb_cache_insert(bb_cache_t *cache, uint32_t key, int start)
+{
+	if (cache->entry == NULL)
+		bb_cache_alloc(cache, 1 << BB_CACHE_INIT_BITS);
+	/* keep the load factor under 1/2 so the probe chains stay short */
+	if ((cache->num + 1) * 2 > cache->mask + 1)
+		bb_cache_grow(cache);
+	uint32_t num = cache->num;
+	bb_cache_put(cache, key, start);
+	if (cache->num != num)
+		cache->page_keys[BB_PAGE(key)].push_back(key);
+}
+
+static inline int bb_cache_find(bb_cache_t *cache, uint32_t key, int &start)
+{
+	if (cache->entry == NULL)
+		return -1;
+	uint32_t i = bb_hash(key) & cache->mask;
+	while (cache->entry[i].key != BB_EMPTY_KEY) {
+		if (cache->entry[i].key == key) {
+			start = cache->entry[i].start;
+			return 0;
+		}
+		i = (i + 1) & cache->mask;
+	}
+	return -1;
+}
+
+static void bb_cache_erase(bb_cache_t *cache, uint32_t key)
+{
+	uint32_t i = bb_hash(key) & cache->mask;
+	while (cache->entry[i].key != key) {
+		if (cache->entry[i].key == BB_EMPTY_KEY)
+			return;
+		i = (i + 1) & cache->mask;
+	}
+	/* backward shift deletion, no tombstones are left in the table */
+	uint32_t j = i;
+	for (;;) {
+		cache->entry[i].key = BB_EMPTY_KEY;
+		do {
+			j = (j + 1) & cache->mask;
+			if (cache->entry[j].key == BB_EMPTY_KEY) {
+				cache->num --;
+				return;
+			}
+			uint32_t home = bb_hash(cache->entry[j].key) & cache->mask;
+			/* entry j may move into the hole only if its home is not in (i, j] */
+			if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+				continue;
+			break;
+		} while (1);
+		cache->entry[i] = cache->entry[j];
+		i = j;
+	}
+}
+
+static void bb_cache_flush_page(bb_cache_t *cache, uint32_t page, bool jmp)
+{
+	map<uint32_t, vector<uint32_t> >::iterator it = cache->page_keys.find(page);
+	if (it == cache->page_keys.end())
+		return;
+	vector<uint32_t> &keys = it->second;
+	for (vector<uint32_t>::iterator k = keys.begin(); k != keys.end(); ++k) {
+		bb_cache_erase(cache, *k);
+		if (jmp && get_jmp_cache()[BB_JMP_HASH(*k)].key == *k)
+			get_jmp_cache()[BB_JMP_HASH(*k)].key = BB_EMPTY_KEY;
+	}
+	cache->page_keys.erase(it);
+}
+
+static void bb_cache_remove(bb_cache_t *cache, uint32_t key)
+{
+	bb_cache_erase(cache, key);
+	map<uint32_t, vector<uint32_t> >::iterator it = cache->page_keys.find(BB_PAGE(key));
+	if (it == cache->page_keys.end())
+		return;
+	vector<uint32_t> &keys = it->second;
+	vector<uint32_t>::iterator k = find(keys.begin(), keys.end(), key);
+	if (k != keys.end()) {
+		*k = keys.back();
+		keys.pop_back();
+	}
+	if (keys.empty())
+		cache->page_keys.erase(it);
+}
+
+/* keys of the blocks translated into each segment of inst_buf */
+static vector<uint32_t> segment_keys[MAX_CACHE_SEGMENT_NUM];
+/* the pcs whose code page was counted or protected for a block of each segment */
+static vector<uint32_t> segment_code_pages[MAX_CACHE_SEGMENT_NUM];
+
+void unprotect_code_page(uint32_t addr);
+
+static void init_code_cache()
+{
+	cache_segment_size = (cache_buffer_size / cache_segment_num) & ~0xf;
+	inst_buf = (char *)malloc(cache_buffer_size);
+	if (inst_buf == NULL) {
+		fprintf(stderr, "In %s, can not allocate %d bytes for inst_buf\n", __FUNCTION__, cache_buffer_size);
+		exit(-1);
+	}
+	cur_segment = 0;
+	top = 0;
+	segment_end = cache_segment_size;
+}
+
+static void evict_code_segment(int seg)
+{
+	int lo = seg * cache_segment_size;
+	int hi = lo + cache_segment_size;
+	int start;
+	vector<uint32_t> &keys = segment_keys[seg];
+
+	for (vector<uint32_t>::iterator k = keys.begin(); k != keys.end(); ++k) {
+		/* the block may have been flushed and translated again elsewhere */
+		if (bb_cache_find(&CreamCache, *k, start) == 0 && start >= lo && start < hi) {
+			bb_cache_remove(&CreamCache, *k);
+			if (get_jmp_cache()[BB_JMP_HASH(*k)].key == *k)
+				get_jmp_cache()[BB_JMP_HASH(*k)].key = BB_EMPTY_KEY;
+		}
+		if (bb_cache_find(&ProfileCache, *k & ~1, start) == 0 && start >= lo && start < hi)
+			bb_cache_remove(&ProfileCache, *k & ~1);
+	}
+	keys.clear();
+	/* the writes of a page without any block left take the fast path again */
+	vector<uint32_t> &pages = segment_code_pages[seg];
+	for (vector<uint32_t>::iterator p = pages.begin(); p != pages.end(); ++p) {
+#if CHECK_IN_WRITE
+		dec_jit_num(*p);
+#else
+		if (CreamCache.page_keys.find(BB_PAGE(*p)) == CreamCache.page_keys.end())
+			unprotect_code_page(*p);
+#endif
+	}
+	pages.clear();
+	code_cache_changed();
+}
+
+/**
+* @brief switch to the oldest segment of inst_buf and evict its blocks
+*/
+static void next_code_segment()
+{
+	cur_segment = (cur_segment + 1) % cache_segment_num;
+	if (is_code_cache_smp()) {
+		/* wait for the other cores to leave their blocks */
+		code_cache_exclusive = 1;
+		while (code_cache_active > 0)
+			pthread_cond_wait(&code_cache_cond, &code_cache_lock);
+		evict_code_segment(cur_segment);
+		code_cache_exclusive = 0;
+		pthread_cond_broadcast(&code_cache_cond);
+	} else
+		evict_code_segment(cur_segment);
+	top = cur_segment * cache_segment_size;
+	segment_end = top + cache_segment_size;
+}
+
+/**
+* @brief Make sure the current segment of inst_buf has room for a whole
+* block, switch to the oldest segment and evict its blocks otherwise.
+*/
+static void reserve_code_cache()
+{
+	if (inst_buf == NULL)
+		init_code_cache();
+	if (segment_end - top >= MAX_BLOCK_BUFFER_SIZE)
+		return;
+	next_code_segment();
+}
+
+/**
+* @brief the handler of code_cache option, set the size and the number of
+* segments of the translation buffer of the fast interpreter.
+*
+* @param this_option
+* @param num_params
+* @param params[]
+*
+* @return 
+*/
+int
+do_code_cache_option (skyeye_option_t * this_option, int num_params,
+	       const char *params[])
+{
+	char name[MAX_PARAM_NAME], value[MAX_PARAM_NAME];
+	unsigned long size = cache_buffer_size;
+	int num = cache_segment_num;
+	char *end;
+	int i;
+	if (inst_buf != NULL) {
+		skyeye_log(Error_log, __FUNCTION__, "Error: code_cache should be set before running.\n");
+		return -1;
+	}
+	for (i = 0; i < num_params; i++) {
+		if (split_param (params[i], name, value) < 0) {
+			skyeye_log(Error_log, __FUNCTION__, "Error: code_cache has wrong parameter \"%s\".\n", name);
+			continue;
+		}
+		if (!strncmp ("size", name, strlen (name))) {
+			size = strtoul (value, &end, 0);
+			if (*end == 'M' || *end == 'm')
+				size <<= 20;
+			else if (*end == 'K' || *end == 'k')
+				size <<= 10;
+		}
+		else if (!strncmp ("segments", name, strlen (name)))
+			num = strtol (value, NULL, 0);
+		else
+			skyeye_log(Error_log, __FUNCTION__, "Error: Unknown code_cache option \"%s\"\n", params[i]);
+	}
+	if (num < 2 || num > MAX_CACHE_SEGMENT_NUM) {
+		skyeye_log(Error_log, __FUNCTION__, "Error: code_cache segments should be between 2 and %d\n", MAX_CACHE_SEGMENT_NUM);
+		return -1;
+	}
+	if (size > MAX_CACHE_BUFFER_SIZE || size / num < 2 * MAX_BLOCK_BUFFER_SIZE) {
+		skyeye_log(Error_log, __FUNCTION__, "Error: code_cache size 0x%lx is out of range for %d segments\n", size, num);
+		return -1;
+	}
+	cache_buffer_size = size;
+	cache_segment_num = num;
+	return 0;
+}
+
+void insert_bb(unsigned int key, int start)
 {
 #ifdef USE_DUMMY_CACHE
-	DummyCache[addr] = start;
+	DummyCache[key & ~1] = start;
 #else
-//	CreamCache[addr] = start;
-	CreamCache[HASH(addr)][addr] = start;
+	bb_cache_insert(&CreamCache, key, start);
+	bb_entry_t *jmp = &get_jmp_cache()[BB_JMP_HASH(key)];
+	jmp->key = key;
+	jmp->start = start;
 #endif
 }
 
 void insert_profiling_data(unsigned int addr, int start)
 {
-	ProfileCache[HASH(addr)][addr] = start;
+	bb_cache_insert(&ProfileCache, addr, start);
 }
 
 int find_profiling_data(cpu_t *cpu, unsigned int addr, int &start)
 {
-	int ret = -1;
-	bb_map::const_iterator it = ProfileCache[HASH(addr)].find(addr);
-	if (it != ProfileCache[HASH(addr)].end()) {
-		start = static_cast<int>(it->second);
-		ret = 0;
-	} else {
-		ret = -1;
-	}
+	int ret;
+	if (!is_code_cache_smp())
+		return bb_cache_find(&ProfileCache, addr, start);
+	pthread_mutex_lock(&code_cache_lock);
+	ret = bb_cache_find(&ProfileCache, addr, start);
+	pthread_mutex_unlock(&code_cache_lock);
 	return ret;
 }
 
 #define TRANS_THRESHOLD                 65000
-int find_bb(cpu_t* cpu, unsigned int addr, int &start)
+/**
+* @brief Look up the translated block of the given key, the jump cache is
+* checked before the CreamCache.
+*
+* @param cpu the dyncom cpu
+* @param key physical pc built with BB_KEY
+* @param start the offset of the block in inst_buf
+*
+* @return 0 if found, -1 otherwise
+*/
+int find_bb(cpu_t* cpu, unsigned int key, int &start)
 {
 	int ret = -1;
 #ifdef USE_DUMMY_CACHE
-	start = DummyCache[addr];
+	start = DummyCache[key & ~1];
 	if (start) {
 		ret = 0;
 	} else
 		ret = -1;
 #else
-	bb_map::const_iterator it = CreamCache[HASH(addr)].find(addr);
-	if (it != CreamCache[HASH(addr)].end()) {
-		start = static_cast<int>(it->second);
+	bb_entry_t *jmp = &get_jmp_cache()[BB_JMP_HASH(key)];
+	if (jmp->key == key) {
+		start = jmp->start;
+		ret = 0;
+	} else if (is_code_cache_smp()) {
+		code_cache_lock_slow();
+		jmp = &get_jmp_cache()[BB_JMP_HASH(key)];
+		if (bb_cache_find(&CreamCache, key, start) == 0) {
+			jmp->key = key;
+			jmp->start = start;
+			ret = 0;
+		}
+		code_cache_unlock_slow();
+	} else if (bb_cache_find(&CreamCache, key, start) == 0) {
+		jmp->key = key;
+		jmp->start = start;
 		ret = 0;
+	}
 #if HYBRID_MODE
-#if PROFILE
-#else
+	/* with the trace jit the hot blocks are compiled as parts of traces */
+	if (ret == 0 && !trace_jit) {
 		/* increase the bb counter */
-		if(get_bb_prof(cpu, addr, 1) == TRANS_THRESHOLD){
-			push_to_compiled(cpu, addr);
+		if(get_bb_prof(cpu, key & ~1, 1) == TRANS_THRESHOLD){
+			push_to_compiled(cpu, key & ~1);
 		}
-#endif
-#endif
-	} else {
-		ret = -1;
 	}
+#endif
 #endif
 	return ret;
 }
@@ -3485,35 +3975,20 @@ vector<uint64_t> code_page_set;
 
 void flush_bb(uint32_t addr)
 {
-	bb_map::iterator it;
-	uint32_t start;
-
 	addr  &= 0xfffff000;
-	for (int i = 0; i < 65536; i ++) {
-		for (it = CreamCache[i].begin(); it != CreamCache[i].end(); ) {
-			start = static_cast<uint32_t>(it->first);
-			//start = (start >> 12) << 12;
-			start &= 0xfffff000;
-			if (start == addr) {
-				//printf("[ERASE][0x%08x]\n", static_cast<int>(it->first));
-				CreamCache[i].erase(it ++);
-			} else
-				++it;
-		}
-	}
-
-	for (int i = 0; i < 65536; i ++) {
-		for (it = ProfileCache[i].begin(); it != ProfileCache[i].end(); ) {
-			start = static_cast<uint32_t>(it->first);
-			//start = (start >> 12) << 12;
-			start &= 0xfffff000;
-			if (start == addr) {
-				//printf("[ERASE][0x%08x]\n", static_cast<int>(it->first));
-				ProfileCache[i].erase(it ++);
-			} else
-				++it;
-		}
+	if (is_code_cache_smp()) {
+		/* the writer may be inside a block, so it stays active */
+		pthread_mutex_lock(&code_cache_lock);
+		bb_cache_flush_page(&CreamCache, addr, true);
+		bb_cache_flush_page(&ProfileCache, addr, false);
+		code_cache_changed();
+		pthread_mutex_unlock(&code_cache_lock);
+		return;
 	}
+	bb_cache_flush_page(&CreamCache, addr, true);
+	bb_cache_flush_page(&ProfileCache, addr, false);
+	/* the traces are only built when the code cache is not shared */
+	flush_hotpath_by_pfn(addr);
 
 	//printf("flush bb @ %x\n", addr);
 }
@@ -3589,14 +4064,28 @@ void protect_code_page(uint32_t addr)
 }
 
 
+/* forget a page whose blocks were all evicted */
+void unprotect_code_page(uint32_t addr)
+{
+	void *mem_ptr = (void *)get_dma_addr(addr);
+	mem_ptr = (void *)((long long int)mem_ptr & 0xfffffffffffff000LL);
+
+	const vector<uint64_t>::iterator it = find(code_page_set.begin(),
+						   code_page_set.end(),
+						   (uint64_t)mem_ptr);
+	if (it != code_page_set.end())
+		code_page_set.erase(it);
+}
+
 extern uint64_t walltime;
 /* Allocate memory for profiling data */
-void alloc_profiling_data(uint32_t start, uint32_t type, uint32_t size)
+void alloc_profiling_data(uint32_t start, uint32_t end, uint32_t type, uint32_t size)
 {
 	arm_inst *inst_base = (arm_inst *)AllocBuffer(sizeof(arm_inst) + sizeof(profiling_data));
 
 	profiling_data *prof = (profiling_data *)inst_base->component;
 	prof->start = start;
+	prof->end = end;
 	prof->type = type;
 	prof->size = size;
 	prof->in_superblock = 0;
@@ -3611,7 +4100,89 @@ void alloc_profiling_data(uint32_t start, uint32_t type, uint32_t size)
 	prof->start_of_sb = 0;
 }
 
-int InterpreterTranslate(cpu_t *core, int &bb_start, addr_t addr)
+/**
+* @brief Age the branch counters of a block, they are halved every tick of
+* the walltime.
+*
+* @param prof the profiling data of the block
+* @param time the current walltime
+*/
+static inline void decay_profiling_data(profiling_data *prof, uint64_t time)
+{
+	if (prof->clocktime >= time)
+		return;
+	if (time - prof->clocktime >= 32) {
+		prof->count[0] = 0;
+		prof->count[1] = 0;
+	} else {
+		prof->count[0] >>= (time - prof->clocktime);
+		prof->count[1] >>= (time - prof->clocktime);
+	}
+	prof->clocktime = time;
+}
+
+/**
+* @brief Count the exit of a block to the block at the physical address
+* target, the two most frequent successors are kept.
+*
+* @param prof the profiling data of the block
+* @param target the physical address of the successor
+*
+* @return the count of the successor
+*/
+static inline uint32_t profile_block_exit(profiling_data *prof, uint32_t target)
+{
+	int i;
+	decay_profiling_data(prof, walltime);
+	if (prof->addr[0] == target)
+		i = 0;
+	else if (prof->addr[1] == target)
+		i = 1;
+	else {
+		i = (prof->count[0] < prof->count[1]) ? 0 : 1;
+		prof->addr[i] = target;
+		prof->count[i] = 0;
+	}
+	return ++prof->count[i];
+}
+
+/**
+* @brief Mark phys_addr as fast interpreter code. The blocks are shared by
+* all the cores in the parallel smp mode, so the code is marked for every
+* core and a write by any core flushes it.
+*
+* @param core the dyncom cpu
+* @param phys_addr the physical address of the instruction
+*/
+static void tag_fast_interp(cpu_t *core, addr_t phys_addr)
+{
+	if (!is_code_cache_smp()) {
+		or_tag(core, phys_addr, TAG_FAST_INTERP);
+		return;
+	}
+	ARM_CPU_State *arm_cpu = get_current_cpu();
+	for (int i = 0; i < arm_cpu->core_num; i++)
+		or_tag((cpu_t *)(arm_cpu->core[i].dyncom_cpu->obj), phys_addr, TAG_FAST_INTERP);
+}
+
+/**
+* @brief Report the basic block entered at pc to the block callback, the
+* length of the block is kept in its profiling data.
+*
+* @param core the dyncom cpu
+* @param pc the virtual address of the block
+* @param phys_addr the physical address of the block
+*/
+static void enter_bb_callback(cpu_t *core, uint32_t pc, uint32_t phys_addr)
+{
+	int pos;
+	if (find_profiling_data(core, phys_addr, pos) == -1)
+		return;
+	profiling_data *prof = (profiling_data *)((arm_inst *)&inst_buf[pos])->component;
+	block_callback(pc, pc + (prof->end - prof->start));
+}
+
+static int InterpreterTranslateBlock(cpu_t *core, int &bb_start, addr_t addr)
 {
 	/* Decode instruction, get index */
 	/* Allocate memory and init InsCream */
@@ -3628,7 +4199,8 @@ int InterpreterTranslate(cpu_t *core, int &bb_start, addr_t addr)
 	int size = 0;
 	/* (R15 - 8) ? */
 	//cpu->translate_pc = cpu->Reg[15];
-	bb_start = top;
+	reserve_code_cache();
+	bb_start = block_top = top;
 
 	if (cpu->TFlag)
 		thumb = THUMB;
@@ -3661,7 +4233,7 @@ int InterpreterTranslate(cpu_t *core, int &bb_start, addr_t addr)
 #else
 		inst = *(uint32_t *)(phys_addr & 0xFFFFFFFC);
 #endif
-		or_tag(core, phys_addr,  TAG_FAST_INTERP);
+		tag_fast_interp(core, phys_addr);
 
 		/*if (ret == FETCH_FAILURE) {
 			return FETCH_EXCEPTION;
@@ -3706,9 +4278,11 @@ translated:
 	   We use it in gene_hot_path later. 
 	 */
 //	printf("insert profiling data @ %x:%x\n", cpu->Reg[15], pc_start);
-	insert_profiling_data(pc_start, top);
-
-	alloc_profiling_data(pc_start, ret | thumb, size);
+	/* the block may be moved by AllocBuffer, keep the offsets in it */
+	int prof_offset = top - block_top;
+	alloc_profiling_data(pc_start, phys_addr, ret | thumb, size);
+	bb_start = block_top;
+	insert_profiling_data(pc_start, bb_start + prof_offset);
 
 	if (!core->is_user_mode) {
 		//printf("before protect_code_page, pc_start=0x%x\n", pc_start);
@@ -3717,12 +4291,25 @@ translated:
 #else
 		protect_code_page(pc_start);
 #endif
+		segment_code_pages[cur_segment].push_back(pc_start);
 	}
 	//printf("In %s,insert_bb pc=0x%x, TFlag=0x%x\n", __FUNCTION__, pc_start, cpu->TFlag);
-	insert_bb(pc_start, bb_start);
+	insert_bb(BB_KEY(pc_start, thumb), bb_start);
+	segment_keys[cur_segment].push_back(BB_KEY(pc_start, thumb));
 	return KEEP_GOING;
 }
 
+int InterpreterTranslate(cpu_t *core, int &bb_start, addr_t addr)
+{
+	int ret;
+	if (!is_code_cache_smp())
+		return InterpreterTranslateBlock(core, bb_start, addr);
+	code_cache_lock_slow();
+	ret = InterpreterTranslateBlock(core, bb_start, addr);
+	code_cache_unlock_slow();
+	return ret;
+}
+
 #define LOG_IN_CLR	skyeye_printf_in_color
 
 static int
@@ -3786,6 +4373,7 @@ int gene_hot_path(arm_processor *cpu, uint32_t start_pc, int value, uint64_t tim
 	extern uint64_t walltime;
 	static int trace = 0;
 	static int isloop = 0;
+	static uint32_t trace_thumb = 0;
 	static int max_depth = 0;
 	uint32_t phys_addr;
 	uint32_t next_pc;
@@ -3828,12 +4416,18 @@ int gene_hot_path(arm_processor *cpu, uint32_t start_pc, int value, uint64_t tim
 	#endif
 //	if (prof->in_superblock == total_hotpath && total_hotpath)
 //		return;
-	if (prof->clocktime < time) {
-		prof->count[0] >>= (time - prof->clocktime);
-		prof->count[1] >>= (time - prof->clocktime);
-		prof->clocktime = time;
-	}
+	decay_profiling_data(prof, time);
 	hotspot_id = get_hotspot_id();
+	/* the trace holding the block was dropped by a write to one of its pages */
+	if (prof->in_superblock && prof->in_superblock != hotspot_id && !is_hotspot_alive(prof->in_superblock)) {
+		prof->in_superblock = 0;
+		prof->start_of_sb = 0;
+	}
+	if (trace == 0)
+		trace_thumb = prof->type & THUMB;
+	/* one native function is either arm or thumb code, and a trace is kept short */
+	else if ((prof->type & THUMB) != trace_thumb || trace >= MAX_TRACE_BLOCKS)
+		return 0;
 #if 1
 	if ((prof->count[0] >= value) && (!prof->in_superblock)) {
 //	if ((prof->count[0] >= value) && (!prof->start_of_sb) && (prof->in_superblock != hotspot_id)) {
@@ -3952,6 +4546,9 @@ int gene_hot_path(arm_processor *cpu, uint32_t start_pc, int value, uint64_t tim
 	++trace;
 
 	ret = gene_hot_path(cpu, next_pc, DURATION, time, type);
+	/* the successor is not in the code cache any more, the trace ends here */
+	if (ret == -2)
+		ret = 0;
 
 	--trace;
 
@@ -3968,20 +4565,19 @@ int gene_hot_path(arm_processor *cpu, uint32_t start_pc, int value, uint64_t tim
 //			print_entry();
 
 			uint8_t func_attr = FUNC_ATTR_NONE;
-			if(cpu->TFlag)
+			if(trace_thumb)
 				func_attr |= FUNC_ATTR_THUMB;
 			if(cpu->Reg[15] < 0xc0000000)
 				func_attr |= FUNC_ATTR_USERMODE;
-			dyncom_cpu->dyncom_engine->func_attr[dyncom_cpu->dyncom_engine->functions] = func_attr;
 
-			gene_native_code(dyncom_cpu);
+			return compile_trace(dyncom_cpu, func_attr);
 		}
 	}
 	return 0;
 }
 
 /* r15 = r15 + 8 */
-void InterpreterMainLoop(cpu_t *core)
+static void InterpreterRunBlocks(cpu_t *core)
 {
 	#define CRn				inst_cream->crn
 	#define OPCODE_2			inst_cream->opcode_2
@@ -4086,14 +4682,30 @@ void InterpreterMainLoop(cpu_t *core)
 	unsigned int lop, rop, dst;
 	unsigned int addr;
 	unsigned int phys_addr;
-	unsigned int last_pc = 0;
 	fault_t fault;
-	static unsigned int last_physical_base = 0, last_logical_base = 0;
+	/* the soft tlb of the pc, kept per host thread for the parallel smp mode */
+	static __thread unsigned int last_physical_base = 0, last_logical_base = 0;
+	static __thread cpu_t *last_core = NULL;
 	int ptr;
+	/* a parallel core returns to its cell now and then to keep the quantum */
+	uint32_t blocks_left = is_code_cache_smp() ? SMP_RUN_BLOCKS : 0;
+
+	if (last_core != core) {
+		/* never matches a page base */
+		last_logical_base = 1;
+		last_core = core;
+	}
 
 	LOAD_NZCVT;
 	DISPATCH:
 	{
+		if (blocks_left && --blocks_left == 0)
+			goto END;
+		if (code_cache_exclusive) {
+			/* another core evicts a segment of the code cache */
+			code_cache_leave();
+			code_cache_enter();
+		}
 		if (!cpu->NirqSig) {
                 	if (!(cpu->Cpsr & 0x80)) {
 				goto END;
@@ -4104,10 +4716,6 @@ void InterpreterMainLoop(cpu_t *core)
 			cpu->Reg[15] &= 0xfffffffe;
 		} else
 			cpu->Reg[15] &= 0xfffffffc;
-#if PROFILE
-		/* check next instruction address is valid. */
-		last_pc = cpu->Reg[15];
-#endif
 #if USER_MODE_OPT
 		phys_addr = cpu->Reg[15];
 #else
@@ -4137,6 +4745,9 @@ void InterpreterMainLoop(cpu_t *core)
 		//if(pfunc){
 		if(is_translated_entry(core, phys_addr)){
 			int rc = JIT_RETURN_NOERR;
+			/* the native code is only entered at interpreted blocks */
+			if (is_block_callback_armed())
+				enter_bb_callback(core, cpu->Reg[15], phys_addr);
 			//printf("enter jit icounter is %lld, pc=0x%x\n", core->icounter, cpu->Reg[15]);
 			SAVE_NZCVT;
 //			resume_timing();
@@ -4217,7 +4828,7 @@ void InterpreterMainLoop(cpu_t *core)
 #endif /* #if HYBRID_MODE */
 #endif /* #if USER_MODE_OPT */
 		if(is_fast_interp_code(core, phys_addr)){
-			if (find_bb(core, phys_addr, ptr) == -1)
+			if (find_bb(core, BB_KEY(phys_addr, cpu->TFlag), ptr) == -1)
 				if (InterpreterTranslate(core, ptr, cpu->Reg[15]) == FETCH_EXCEPTION)
 					goto END;
 		}
@@ -4225,122 +4836,33 @@ void InterpreterMainLoop(cpu_t *core)
 			if (InterpreterTranslate(core, ptr, cpu->Reg[15]) == FETCH_EXCEPTION)
 				goto END;
 		}
-#if PROFILE
-		resume_timing();
-#endif
+		if (is_block_callback_armed())
+			enter_bb_callback(core, cpu->Reg[15], phys_addr);
 		inst_base = (arm_inst *)&inst_buf[ptr];
 		GOTO_NEXT_INST;
 	}
 	PROFILING:
 	{
-#if PROFILE
-		pause_timing();
-		inst_base = (arm_inst *)&inst_buf[ptr];
-		profiling_data *prof = (profiling_data *)inst_base->component;
-		if ((PC >> 12) != (last_pc >> 12))
-			goto DISPATCH;
-		if (prof->type & INDIRECT_BRANCH)
-			goto DISPATCH;
-		#if 0
-		if ((PC == prof->addr[0]) && (prof->count[0] > 1) && (prof->vpc[0] != -1)) {
-			prof->count[0] ++;
-			ptr = prof->vpc[0];
-			inst_base = (arm_inst *)&inst_buf[ptr];
-			resume_timing();
-			CHECK_EXT_INT;
-			GOTO_NEXT_INST;
-		}
-		else if ((PC == prof->addr[1]) && (prof->count[1] > 1) && (prof->vpc[1] != -1)) {
-			prof->count[1] ++;
-			ptr = prof->vpc[1];
+		if (trace_jit && !is_code_cache_smp()) {
+			/* the profiling data follows the last instruction of the block */
 			inst_base = (arm_inst *)&inst_buf[ptr];
-			resume_timing();
-			CHECK_EXT_INT;
-			GOTO_NEXT_INST;
-		}
-		#endif
-//		if (prof->addr[0] == PC) {
-		if (prof->addr[0] == (last_physical_base | (PC & 0xfff))) {
-			if (prof->clocktime < walltime) {
-				prof->count[0] >>= (walltime - prof->clocktime);
-				prof->count[1] >>= (walltime - prof->clocktime);
-				prof->clocktime = walltime;
-			}
-			prof->count[0] ++;
-		#if 0
-			if (prof->count[0] > 1) {
-			        fault = check_address_validity(cpu, cpu->Reg[15], &phys_addr, 1, INSN_TLB);
-				if (fault)
-					goto DISPATCH;
-				if (find_bb(core, phys_addr, ptr) == -1) {
-					printf("phys addr : %x could not be found.\n");
-					goto DISPATCH;
-//					exit(-1);
-				}
-				if (ptr < 0) {
-					printf("ptr < 0\n");
-					exit(-1);
-				}
-				prof->vpc[0] = ptr;
-				inst_base = (arm_inst *)&inst_buf[ptr];
-				GOTO_NEXT_INST;
-			}
-		#endif
-		}
-		else if (prof->addr[1] == (last_physical_base | (PC & 0xfff))) {
-			if (prof->clocktime < walltime) {
-				prof->count[0] >>= (walltime - prof->clocktime);
-				prof->count[1] >>= (walltime - prof->clocktime);
-				prof->clocktime = walltime;
-			}
-			prof->count[1] ++;
-		#if 0
-			if (prof->count[1] > 1) {
-			        fault = check_address_validity(cpu, cpu->Reg[15], &phys_addr, 1, INSN_TLB);
+			profiling_data *prof = (profiling_data *)inst_base->component;
+			if ((prof->type & INDIRECT_BRANCH) || cpu->abortSig)
+				goto DISPATCH;
+			if (last_logical_base != (PC & 0xfffff000)) {
+				/* the successor is on another page, the trace crosses it */
+				fault = check_address_validity(cpu, PC, &phys_addr, 1, INSN_TLB);
 				if (fault)
 					goto DISPATCH;
-				if (find_bb(core, phys_addr, ptr) == -1) {
-					printf("phys addr : %x could not be found.\n");
-					goto DISPATCH;
-					exit(-1);
-				}
-				if (ptr < 0) {
-					printf("ptr < 0\n");
-					exit(-1);
-				}
-				prof->vpc[1] = ptr;
-				inst_base = (arm_inst *)&inst_buf[ptr];
-				GOTO_NEXT_INST;
+				last_logical_base = PC & 0xfffff000;
+				last_physical_base = phys_addr & 0xfffff000;
 			}
-		#endif
-		}
-		else {
-			if (prof->count[0] < prof->count[1]) {
-				prof->addr[0] = last_physical_base | (PC & 0xfff);
-				prof->count[0] = 1;
-			} else {
-				prof->addr[1] = last_physical_base | (PC & 0xfff);
-				prof->count[1] = 1;
+			if (profile_block_exit(prof, last_physical_base | (PC & 0xfff)) == THRESHOLD) {
+				alloc_hotspot_id();
+				if (0 != gene_hot_path(cpu, prof->start, THRESHOLD, walltime, JIT_TYPE_TRACE))
+					free_hotspot_id();
 			}
 		}
-
-                if (prof->count[0] >= THRESHOLD) {
-                        alloc_hotspot_id();
-//                        if (0 != gene_hot_path(cpu, last_pc, THRESHOLD, walltime, JIT_TYPE_TRACE))
-                        if (0 != gene_hot_path(cpu, last_physical_base | (last_pc & 0xfff), THRESHOLD, walltime, JIT_TYPE_TRACE))
-                                free_hotspot_id();
-			else
-				goto DISPATCH;
-                } else if (prof->count[1] >= THRESHOLD) {
-                        alloc_hotspot_id();
-//                        if (0 != gene_hot_path(cpu, last_pc, THRESHOLD, walltime, JIT_TYPE_TRACE))
-                        if (0 != gene_hot_path(cpu, last_physical_base | (last_pc & 0xfff), THRESHOLD, walltime, JIT_TYPE_TRACE))
-                                free_hotspot_id();
-			else
-				goto DISPATCH;
-                }
-
-#endif
 		goto DISPATCH;
 	}
 	ADC_INST:
@@ -5081,6 +5603,7 @@ void InterpreterMainLoop(cpu_t *core)
 
 			add_exclusive_addr(cpu, phys_addr);
 			cpu->exclusive_state = 1;
+			cpu->exclusive_value = value;
 
 			//bus_read(32, addr, &value);
 			cpu->Reg[BITS(inst_cream->inst, 12, 15)] = value;
@@ -5108,6 +5631,7 @@ void InterpreterMainLoop(cpu_t *core)
 			
 			add_exclusive_addr(cpu, phys_addr);
 			cpu->exclusive_state = 1;
+			cpu->exclusive_value = value;
 
 			//bus_read(8, addr, &value);
 			cpu->Reg[BITS(inst_cream->inst, 12, 15)] = value;
@@ -5475,6 +5999,9 @@ void InterpreterMainLoop(cpu_t *core)
 					} else if (CRn == 0 && CRm == 0 && OPCODE_2 == 1) {
 						//LET(RD, R(CP15_CACHE_TYPE));
 						RD = cpu->CP15[CP15(CP15_CACHE_TYPE)];
+					} else if (CRn == 0 && CRm == 0 && OPCODE_2 == 5) {
+						/* multiprocessor affinity, the core number */
+						RD = cpu->mpidr;
 					} else if (CRn == 5 && CRm == 0 && OPCODE_2 == 1) {
 						//LET(RD, R(CP15_INSTR_FAULT_STATUS));
 						RD = cpu->CP15[CP15(CP15_INSTR_FAULT_STATUS)];
@@ -6276,11 +6803,10 @@ void InterpreterMainLoop(cpu_t *core)
 			int dest_reg = BITS(inst_cream->inst, 12, 15);
 			if((exclusive_detect(cpu, phys_addr) == 0) && (cpu->exclusive_state == 1)){
 				remove_exclusive(cpu, phys_addr);
-				cpu->Reg[dest_reg] = 0;
 				cpu->exclusive_state = 0;
 				
 				//			bus_write(32, addr, value);
-				fault = interpreter_write_memory(core, addr, phys_addr, value, 32);
+				cpu->Reg[dest_reg] = exclusive_store(core, cpu, addr, phys_addr, value, 32, fault);
 				if (fault) goto MMU_EXCEPTION;
 			}
 			else{
@@ -6306,9 +6832,8 @@ void InterpreterMainLoop(cpu_t *core)
 			int dest_reg = BITS(inst_cream->inst, 12, 15);
 			if((exclusive_detect(cpu, phys_addr) == 0) && (cpu->exclusive_state == 1)){
 				remove_exclusive(cpu, phys_addr);
-				cpu->Reg[dest_reg] = 0;
 				cpu->exclusive_state = 0;
-				fault = interpreter_write_memory(core, addr, phys_addr, value, 8);
+				cpu->Reg[dest_reg] = exclusive_store(core, cpu, addr, phys_addr, value, 8, fault);
 				if (fault) goto MMU_EXCEPTION;
 
 			}
@@ -6691,13 +7216,11 @@ void InterpreterMainLoop(cpu_t *core)
 		cpu->AbortAddr = addr;
 		cpu->CP15[CP15(CP15_FAULT_STATUS)] = fault & 0xff;
 		cpu->CP15[CP15(CP15_FAULT_ADDRESS)] = addr;
-		pause_timing();
 		return;
 	}
 	END:
 	{
 		SAVE_NZCVT;
-		pause_timing();
 		return;
 	}
 	INIT_INST_LENGTH:
@@ -6720,3 +7243,14 @@ void InterpreterMainLoop(cpu_t *core)
 	}
 }
 
+void InterpreterMainLoop(cpu_t *core)
+{
+	if (!is_code_cache_smp()) {
+		InterpreterRunBlocks(core);
+		return;
+	}
+	code_cache_enter();
+	InterpreterRunBlocks(core);
+	code_cache_leave();
+}
+
@@ -25,7 +25,16 @@
 
 #ifndef __ARM_DYNCOM_INTERPRETER_H__
 #define __ARM_DYNCOM_INTERPRETER_H__
+#include "skyeye_options.h"
 void protect_code_page(uint32_t addr);
 void flush_bb(uint32_t addr);
-#define PROFILE 0
+#ifdef __cplusplus
+ extern "C" {
+#endif
+int
+do_code_cache_option (skyeye_option_t * this_option, int num_params,
+	       const char *params[]);
+#ifdef __cplusplus
+}
+#endif
 #endif
@@ -45,6 +45,7 @@
 #include "dyncom/defines.h"
 #include "common/mmu/arm1176jzf_s_mmu.h"
 #include "armmmu.h"
+#include "skyeye_ram.h"
 typedef llvm::ArrayRef<llvm::Type*> TypeArray;
 typedef llvm::ArrayRef<llvm::Value*> ValueArray;
 
@@ -229,6 +230,14 @@ void memory_read(cpu_t* cpu, BasicBlock*bb, Value* addr, uint32_t sign, uint32_t
 	return;
 }
 
+/* the direct stores bypass the ram bank, mark the page dirty as the bank
+ * does so that the display and the checkpoint see the store */
+static void mark_page_dirty(cpu_t* cpu, BasicBlock* bb, Value* phys_addr){
+	Value* a = ADD(CONST64((uintptr_t)mem_dirty_map()), ZEXT64(LSHR(phys_addr, CONST(BANK_PAGE_BITS))));
+	a = new IntToPtrInst(a, PointerType::get(XgetType(Int8Ty), 0), "", bb);
+	new StoreInst(CONST8(MEM_DIRTY_ALL), a, bb);
+}
+
 void memory_write(cpu_t* cpu, BasicBlock*bb, Value* addr, Value* value, uint32_t size){
 	int fault = TLB_WRITE_MISS;
 	Value* va =  AND(addr, CONST(0xFFFFF000));
@@ -298,6 +307,7 @@ void memory_write(cpu_t* cpu, BasicBlock*bb, Value* addr, Value* value, uint32_t
 			printf("in %s, error size\n", __func__);
 			exit(0);
 		}
+		mark_page_dirty(cpu, bb, phys_addr);
 		#else
 		//Type const *intptr_type = cpu->dyncom_engine->exec_engine->getTargetData()->getIntPtrType(_CTX());
 		IntegerType *intptr_type = cpu->dyncom_engine->exec_engine->getTargetData()->getIntPtrType(_CTX());
@@ -328,6 +338,7 @@ void memory_write(cpu_t* cpu, BasicBlock*bb, Value* addr, Value* value, uint32_t
 			printf("in %s, error size\n", __func__);
 			exit(0);
 		}
+		mark_page_dirty(cpu, bb, phys_addr);
 	#else
 		//Type const *intptr_type = cpu->dyncom_engine->exec_engine->getTargetData()->getIntPtrType(_CTX());
 		IntegerType *intptr_type = cpu->dyncom_engine->exec_engine->getTargetData()->getIntPtrType(_CTX());
@@ -22,7 +22,6 @@
 * @version 7849
 * @date 2012-03-08
 */
-//#include "lru_tlb.h"
 #include "arm_dyncom_mmu.h"
 #include "dyncom/tlb.h"
 #include "arm_dyncom_thumb.h"
@@ -36,12 +35,42 @@
 #include "dyncom/tag.h"
 #include "dyncom/defines.h"
 #include "skyeye_ram.h"
+#include "skyeye_cell.h"
+#include "armcpu.h"
 /* shenoubang add win32 2102-6-12 */
 #ifndef __WIN32__
 #include <execinfo.h>
 #endif
 
 #if FAST_MEMORY
+/**
+* @brief In the parallel smp mode every core keeps its own tags and native
+* code, drop the code page written by one core from the other cores too.
+* The fast interpreter blocks are shared and already flushed by flush_bb,
+* only the tags of the other cores are cleared for them.
+*
+* @param cpu the dyncom cpu of the writing core
+* @param phys_addr the written physical address
+*/
+static void flush_code_of_other_cores(cpu_t *cpu, addr_t phys_addr)
+{
+	ARM_CPU_State *arm_cpu;
+	if (!smp_parallel_enabled())
+		return;
+	arm_cpu = get_current_cpu();
+	for (int i = 0; i < arm_cpu->core_num; i++) {
+		cpu_t *other = (cpu_t *)(arm_cpu->core[i].dyncom_cpu->obj);
+		if (other == cpu || (!is_translated_code(other, phys_addr) && !is_fast_interp_code(other, phys_addr)))
+			continue;
+		pthread_rwlock_wrlock(&(other->dyncom_engine->rwlock));
+#if L3_HASHMAP
+		clear_cache_item(other->dyncom_engine->fmap, phys_addr);
+#endif
+		pthread_rwlock_unlock(&(other->dyncom_engine->rwlock));
+		clear_tag_page(other, phys_addr);
+	}
+}
+
 static inline void mem_read_raw(void *mem_ptr, uint32_t offset, uint32_t &value, int size)
 {
 	switch(size) {
@@ -96,6 +125,8 @@ static inline int mem_write_directly(cpu_t* cpu, uint32_t phys_addr, uint32_t va
 	if (phys_addr >= BANK0_START && phys_addr < BANK0_END) {
 		//offset = phys_addr - BANK0_START;
 		mem_write_raw(0, phys_addr, value, size);
+		/* the store bypasses the ram bank, keep its dirty pages */
+		mem_mark_dirty(phys_addr, size / 8);
 		ret = 0;
 	}
 	return ret;
@@ -241,6 +272,7 @@ fault_t check_address_validity(arm_core_t *core, addr_t virt_addr, addr_t *phys_
 	fault_t fault = NO_FAULT;
 	int ap, sop;
 	uint32_t p;
+	cpu_t *cpu = (cpu_t *)core->dyncom_cpu->obj;
 
 	int user_mode = USER_MODE(core);
 	if(access_type == DATA_TLB){
@@ -256,18 +288,18 @@ fault_t check_address_validity(arm_core_t *core, addr_t virt_addr, addr_t *phys_
                                 access_type = DATA_USER_WRITE;
                 }
 	
-		if (!get_phys_page((virt_addr & 0xfffff000) , (CP15REG(CP15_CONTEXT_ID) & 0xff), p, access_type)) {
+		if (!get_phys_page(cpu, (virt_addr & 0xfffff000) , (CP15REG(CP15_CONTEXT_ID) & 0xff), p, access_type)) {
 			*phys_addr = (p & 0xfffff000) | (virt_addr & 0xfff);
 			return fault;
 		}
-		else if(!get_phys_page((virt_addr & 0xfffff000) , (CP15REG(CP15_CONTEXT_ID) & 0xff), p, IO_TLB)){
+		else if(!get_phys_page(cpu, (virt_addr & 0xfffff000) , (CP15REG(CP15_CONTEXT_ID) & 0xff), p, IO_TLB)){
         	        if (dyncom_check_perms(core, GET_AP(p), rw)) {
                 	        *phys_addr = (p & 0xfffff000) | (virt_addr & 0xfff);
                         	return fault;
                 	}
         	}
 		/* also need to check instruction tlb for some insn and data mixed page */
-		else if(!get_phys_page((virt_addr & 0xfffff000), (CP15REG(CP15_CONTEXT_ID) & 0xff), p, MIXED_TLB)){
+		else if(!get_phys_page(cpu, (virt_addr & 0xfffff000), (CP15REG(CP15_CONTEXT_ID) & 0xff), p, MIXED_TLB)){
                 	if (dyncom_check_perms(core, GET_AP(p), rw)){
 				*phys_addr = (p & 0xfffff000) | (virt_addr & 0xfff);
 				return fault;
@@ -280,7 +312,7 @@ fault_t check_address_validity(arm_core_t *core, addr_t virt_addr, addr_t *phys_
                 else
                         access_type = INSN_KERNEL;
 
-		if (!get_phys_page((virt_addr & 0xfffff000) , (CP15REG(CP15_CONTEXT_ID) & 0xff), p, access_type)) {
+		if (!get_phys_page(cpu, (virt_addr & 0xfffff000) , (CP15REG(CP15_CONTEXT_ID) & 0xff), p, access_type)) {
 			*phys_addr = (p & 0xfffff000) | (virt_addr & 0xfff);
 			return fault;
 		}
@@ -292,7 +324,7 @@ fault_t check_address_validity(arm_core_t *core, addr_t virt_addr, addr_t *phys_
 	if ((CP15REG(CP15_CONTROL) & 1) == 0) {
 		/* MMU or MPU disabled. */
 		*phys_addr = virt_addr;
-		insert((virt_addr & 0xfffff000), (CP15REG(CP15_CONTEXT_ID) & 0xff), ((*phys_addr) & 0xfffff000) | (0x3), access_type);
+		insert(cpu, (virt_addr & 0xfffff000), (CP15REG(CP15_CONTEXT_ID) & 0xff), ((*phys_addr) & 0xfffff000) | (0x3), access_type);
 		return NO_FAULT;
 	} else {
 	
@@ -314,7 +346,7 @@ fault_t check_address_validity(arm_core_t *core, addr_t virt_addr, addr_t *phys_
 			}
 		}
 		//printf("In %s, get phys_addr=0x%x\n", __FUNCTION__, *phys_addr);
-		insert((virt_addr & 0xfffff000), (CP15REG(CP15_CONTEXT_ID) & 0xff), ((*phys_addr) & 0xfffff000) | (ap), access_type);
+		insert(cpu, (virt_addr & 0xfffff000), (CP15REG(CP15_CONTEXT_ID) & 0xff), ((*phys_addr) & 0xfffff000) | (ap), access_type);
 		//insert_tlb(core, (virt_addr & 0xfffff000) | (CP15REG(CP15_CONTEXT_ID) & 0xff), ((*phys_addr) & 0xfffff000) | ap);
 	}
 	return fault;
@@ -377,6 +409,34 @@ fault_t interpreter_read_memory(cpu_t *cpu, addr_t virt_addr, addr_t phys_addr,
 	return fault;
 }
 
+#if CHECK_IN_WRITE
+/**
+* @brief drop the translated and the fast interpreter code of a page
+* written by the guest
+*
+* @param cpu the dyncom cpu of the writing core
+* @param phys_addr the written physical address
+*/
+void flush_written_code(cpu_t *cpu, addr_t phys_addr)
+{
+	if(is_fast_interp_code(cpu, phys_addr) || is_translated_code(cpu, phys_addr)){
+		//printf("In %s, selfmodified code is 0x%x\n", __FUNCTION__, phys_addr);
+		flush_bb(phys_addr);
+		pthread_rwlock_wrlock(&(cpu->dyncom_engine->rwlock));
+#if L3_HASHMAP
+		clear_cache_item(cpu->dyncom_engine->fmap, phys_addr);
+#else
+		fprintf(stderr, "Warnning: not clear the cache");
+#endif
+		if(pthread_rwlock_unlock(&(cpu->dyncom_engine->rwlock))){
+			fprintf(stderr, "unlock error\n");
+		}
+		clear_tag_page(cpu, phys_addr);
+		flush_code_of_other_cores(cpu, phys_addr);
+	}
+}
+#endif
+
 fault_t interpreter_write_memory(cpu_t *cpu, addr_t virt_addr, addr_t phys_addr, uint32_t value, uint32_t size)
 {
 	fault_t fault = NO_FAULT;
@@ -425,29 +485,7 @@ fault_t interpreter_write_memory(cpu_t *cpu, addr_t virt_addr, addr_t phys_addr,
 #endif
 
 #if CHECK_IN_WRITE
-	if(is_fast_interp_code(cpu, phys_addr) || is_translated_code(cpu, phys_addr)){
-		//printf("In %s, selfmodified code is 0x%x, pc=0x%x\n", __FUNCTION__, phys_addr, core->Reg[15]);
-		//if(is_fast_interp_code(cpu, phys_addr)){
-		//printf("In %s, fast interp page 0x%x is written, at 0x%x\n", __FUNCTION__, phys_addr & 0xFFFFF000, core->Reg[15]);
-		flush_bb(phys_addr);
-		//}
-		//printf("In %s, end fast interp page 0x%x is written\n", __FUNCTION__, phys_addr & 0xFFFFF000);
-
-		//addr_t addr = find_bb_start(cpu, phys_addr);
-		//if(is_translated_code(cpu, phys_addr)){
-		//printf("clear code cache 0x%x in %s\n", phys_addr, __FUNCTION__);
-		pthread_rwlock_wrlock(&(cpu->dyncom_engine->rwlock));
-#if L3_HASHMAP
-                clear_cache_item(cpu->dyncom_engine->fmap, phys_addr);
-#else
-               	fprintf(stderr, "Warnning: not clear the cache");
-#endif
-		if(pthread_rwlock_unlock(&(cpu->dyncom_engine->rwlock))){
-			fprintf(stderr, "unlock error\n");
-		}
-		//}
-                clear_tag_page(cpu, phys_addr);
-	}
+	flush_written_code(cpu, phys_addr);
 #endif
 #if FAST_MEMORY
 	phys_addr = phys_addr | (virt_addr & 3);
@@ -621,6 +659,7 @@ static void arch_arm_write_memory(cpu_t *cpu, addr_t virt_addr, uint32_t value,
 		//printf("In %s, end fast interp page 0x%x is written at 0x%x\n", __FUNCTION__, phys_addr & 0xFFFFF000, core->Reg[15]);
 		//}
                 clear_tag_page(cpu, phys_addr);
+		flush_code_of_other_cores(cpu, phys_addr);
         }
 #endif
 #if FAST_MEMORY
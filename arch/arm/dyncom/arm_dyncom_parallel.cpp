@@ -32,10 +32,14 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "dyncom/tag.h"
 #include "dyncom/basicblock.h"
 #include "dyncom/phys_page.h"
+#include "dyncom/profiler.h"
 #include "bank_defs.h"
 
 #include <stack>
 #include <hash_map>
+#include <map>
+#include <queue>
+#include <vector>
 using namespace std;
 #ifndef __ARMEMU_H__
 #define __ARMEMU_H__
@@ -59,24 +63,50 @@ extern ARMword ARMul_Emulate32 (ARMul_State *);
 #endif
 
 #define QUEUE_LENGTH 1024
-/* Monothread: threshold compilation only
-   Multithread: threshold compilation or Polling compilation (cpu intensive) */
-#define MULTI_THREAD 0
+/* No worker: threshold compilation in the cpu thread only
+   Workers: hot blocks are queued and compiled by the worker threads */
+#define MAX_COMPILE_WORKERS 16
 #define LIFO 0
 static uint32_t compiled_queue[QUEUE_LENGTH]; /* list of tagged addresses. Note: is not a shared resource */
-static stack<uint32_t> compile_stack; /* stack of untranslated addresses. Note: is a shared resource */
-static stack<uint8_t> func_attr_stack; /* record the attribute for untranslated function . Note: is a shared resource */
-static pthread_rwlock_t compile_stack_rwlock;
+
+/*
+ * Blocks waiting for the compile workers, the hottest block is compiled
+ * first. A block is queued once it is interpreted COMPILE_THRESHOLD times.
+ * compile_pending holds the hotness of the live entry of every queued
+ * address, so a block is queued again only when its hotness doubled and
+ * the stale entries are skipped by the workers.
+ */
+#define COMPILE_THRESHOLD 64
+typedef struct compile_work {
+	uint32_t addr;
+	uint8_t func_attr;
+	int hotness;
+} compile_work_t;
+
+struct compile_work_less {
+	bool operator()(const compile_work_t &a, const compile_work_t &b) const {
+		return a.hotness < b.hotness;
+	}
+};
+
+static priority_queue<compile_work_t, vector<compile_work_t>, compile_work_less> compile_queue;
+static map<uint32_t, int> compile_pending;
+static pthread_mutex_t compile_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compile_queue_cond = PTHREAD_COND_INITIALIZER;
+static int compile_workers = 0;
 static pthread_rwlock_t translation_rwlock;
 static uint32_t translated_block = 0; /* translated block count, for block threshold */
 static void* compiled_worker(void* cpu);
 static void push_compiled_work(cpu_t* cpu, uint32_t pc, uint8_t func_attr);
+static void queue_compile_work(cpu_t* cpu, uint32_t addr, uint8_t func_attr);
+static uint8_t get_func_attr(arm_core_t* core);
 /*
  * Three running mode: PURE_INTERPRET, PURE_DYNCOM, HYBRID
  */
 //running_mode_t running_mode = PURE_INTERPRET;
 running_mode_t running_mode = PURE_DYNCOM;
 //running_mode_t running_mode = HYBRID;
+int trace_jit = 0;
 static char* running_mode_str[] = {
 	"pure interpret running",
 	"pure dyncom running",
@@ -118,7 +148,22 @@ do_mode_option (skyeye_option_t * this_option, int num_params,
 			}
 			else
 				running_mode = mode;
-			break;
+		}
+		else if (!strncmp ("workers", name, strlen (name))) {
+			int workers = strtol (value, NULL, 0);
+			if (workers < 0 || workers > MAX_COMPILE_WORKERS){
+				SKYEYE_ERR ("Error: compile workers should be between 0 and %d\n", MAX_COMPILE_WORKERS);
+			}
+			else
+				compile_workers = workers;
+		}
+		else if (!strncmp ("trace", name, strlen (name))) {
+			if (!strcmp (value, "on"))
+				trace_jit = 1;
+			else if (!strcmp (value, "off"))
+				trace_jit = 0;
+			else
+				SKYEYE_ERR ("Error: trace should be on or off\n");
 		}
 	}
 	return 0;
@@ -130,17 +175,14 @@ void init_compiled_queue(cpu_t* cpu){
 	}
 	skyeye_log(Info_log, __FUNCTION__, "Current running mode: %s\n", running_mode_str[running_mode]);
 	//if (running_mode == HYBRID){
-		if(pthread_rwlock_init(&compile_stack_rwlock, NULL)){
-			fprintf(stderr, "can not initilize the rwlock\n");
-		}
 		if(pthread_rwlock_init(&translation_rwlock, NULL)){
 			fprintf(stderr, "can not initilize the rwlock\n");
 		}
-	#if MULTI_THREAD
-		/* Create a thread to compile IR to native code */
-		pthread_t id;
-		create_thread(compiled_worker, (void*)cpu, &id);
-	#endif
+		/* Create the threads to compile IR to native code */
+		for (int i = 0; i < compile_workers; i++) {
+			pthread_t id;
+			create_thread(compiled_worker, (void*)cpu, &id);
+		}
 	//}
 	cpu->dyncom_engine->cur_tagging_pos = 0;
 }
@@ -267,17 +309,8 @@ int launch_compiled_queue(cpu_t* cpu, uint32_t pc){
 		//printf("Interpreting %p-%p with MMU %x\n", core->phys_pc, pc, (core->mmu.control));
 		//compiled_queue[(++cur_compile_pos )% QUEUE_LENGTH] = core->phys_pc;
 		//bb_prof
-		//pthread_rwlock_wrlock(&compile_stack_rwlock);
-		//if(cur_compile_pos == QUEUE_LENGTH){
-		int ret;
-		if((ret = pthread_rwlock_trywrlock(&compile_stack_rwlock)) == 0){ 
-			compile_stack.push(core->phys_pc);
-			pthread_rwlock_unlock(&compile_stack_rwlock);
-		}
-		else{
-			printf("Warning ,can not get the wrlock ,error is %d, %s\n", ret, strerror(ret));
-		}
-		//}
+		if (compile_workers)
+			queue_compile_work(cpu, core->phys_pc, get_func_attr(core));
 		extern void InterpreterMainLoop(cpu_t *core);
 		InterpreterMainLoop(cpu);
 
@@ -522,41 +555,71 @@ static inline void push_compiled_work(cpu_t* cpu, uint32_t pc, uint8_t func_attr
 /* Compiled the target to the host address , and try to free some unused translation block */
 static void* compiled_worker(void* argp){
 	cpu_t* cpu = (cpu_t*) argp;
-	//uint32_t pos_to_translate;
+	compile_work_t work;
 	for(;;){
-		while(1){
-			uint32_t compiled_addr = 0xFFFFFFFF;
-			uint8_t func_attr;
-			pthread_rwlock_wrlock(&compile_stack_rwlock);
-			if (!compile_stack.empty()) {
-				compiled_addr = compile_stack.top();
-				compile_stack.pop();
-
-				func_attr = func_attr_stack.top();
-				func_attr_stack.pop();
-			}
-			else{
-				pthread_rwlock_unlock(&compile_stack_rwlock);
-				/* All the code is translated, we need to out for a rest */
+		pthread_mutex_lock(&compile_queue_lock);
+		for(;;){
+			/* All the code is translated, sleep until a hot block is queued */
+			while (compile_queue.empty())
+				pthread_cond_wait(&compile_queue_cond, &compile_queue_lock);
+			work = compile_queue.top();
+			compile_queue.pop();
+			map<uint32_t, int>::iterator it = compile_pending.find(work.addr);
+			if (it != compile_pending.end() && it->second == work.hotness) {
+				compile_pending.erase(it);
 				break;
 			}
-			pthread_rwlock_unlock(&compile_stack_rwlock);
-			/* begin translation */
-			pthread_rwlock_wrlock(&translation_rwlock);
-			fast_map hash_map = cpu->dyncom_engine->fmap;
-			void* pfunc;
-
-			PFUNC(compiled_addr);
-			if(pfunc == NULL){
-				push_compiled_work(cpu, compiled_addr, func_attr);
-			}
-			pthread_rwlock_unlock(&translation_rwlock);
 		}
-		//usleep(2);
+		pthread_mutex_unlock(&compile_queue_lock);
+		/* begin translation */
+		pthread_rwlock_wrlock(&translation_rwlock);
+		fast_map hash_map = cpu->dyncom_engine->fmap;
+		void* pfunc;
+
+		PFUNC(work.addr);
+		if(pfunc == NULL){
+			push_compiled_work(cpu, work.addr, work.func_attr);
+		}
+		pthread_rwlock_unlock(&translation_rwlock);
 	}
 	return NULL;
 }
 
+/**
+* @brief Queue a hot block for the compile workers, ordered by its bb
+* profiling counter.
+*
+* @param cpu
+* @param addr physical address of the block
+* @param func_attr
+*/
+static void queue_compile_work(cpu_t* cpu, uint32_t addr, uint8_t func_attr){
+	compile_work_t work;
+	work.addr = addr;
+	work.func_attr = func_attr;
+	work.hotness = get_bb_prof(cpu, addr, 0);
+	if (work.hotness < COMPILE_THRESHOLD)
+		return;
+
+	pthread_mutex_lock(&compile_queue_lock);
+	map<uint32_t, int>::iterator it = compile_pending.find(addr);
+	if (it == compile_pending.end() || work.hotness >= 2 * it->second) {
+		compile_pending[addr] = work.hotness;
+		compile_queue.push(work);
+		pthread_cond_signal(&compile_queue_cond);
+	}
+	pthread_mutex_unlock(&compile_queue_lock);
+}
+
+static uint8_t get_func_attr(arm_core_t* core){
+	uint8_t func_attr = FUNC_ATTR_NONE;
+	if(core->TFlag)
+		func_attr |= FUNC_ATTR_THUMB;
+	if(core->Reg[15] < 0xc0000000)
+		func_attr |= FUNC_ATTR_USERMODE;
+	return func_attr;
+}
+
 void push_to_compiled(cpu_t* cpu, addr_t addr){
 	arm_core_t* core = (arm_core_t*)(cpu->cpu_data->obj);
 	//cpu->user_mode = USER_MODE(core);
@@ -564,22 +627,28 @@ void push_to_compiled(cpu_t* cpu, addr_t addr){
 	core->Cpsr = (core->Cpsr & 0xffffffdf) | (core->TFlag << 5);
 	//cpu->TFlag = core->TFlag;
 	//assert((addr & 0x1) == 0);
-	uint8_t func_attr = FUNC_ATTR_NONE;
-	if(core->TFlag)
-		func_attr |= FUNC_ATTR_THUMB;
-	if(core->Reg[15] < 0xc0000000)
-		func_attr |= FUNC_ATTR_USERMODE;
-        #if MULTI_THREAD
-        int ret;
-        if((ret = pthread_rwlock_trywrlock(&compile_stack_rwlock)) == 0){
-                compile_stack.push(addr);
-		func_attr_stack.push (func_attr);
-                pthread_rwlock_unlock(&compile_stack_rwlock);
-        }
-        else{
-                printf("Warning ,can not get the wrlock ,error is %d, %s\n", ret, strerror(ret));
-        }
-        #else
-        push_compiled_work(cpu, addr, func_attr);
-        #endif
+	uint8_t func_attr = get_func_attr(core);
+	if (compile_workers)
+		queue_compile_work(cpu, addr, func_attr);
+	else
+		push_compiled_work(cpu, addr, func_attr);
+}
+
+/**
+* @brief Compile the trace recorded by the profiler into one native
+* function, serialized with the compile workers.
+*
+* @param cpu
+* @param func_attr
+*
+* @return 0 on success, -1 otherwise
+*/
+int compile_trace(cpu_t* cpu, uint8_t func_attr){
+	hotspot *hs;
+	pthread_rwlock_wrlock(&translation_rwlock);
+	cpu->dyncom_engine->func_attr[cpu->dyncom_engine->functions] = func_attr;
+	cpu->dyncom_engine->func_size[cpu->dyncom_engine->functions] = 0;
+	hs = gene_native_code(cpu);
+	pthread_rwlock_unlock(&translation_rwlock);
+	return hs ? 0 : -1;
 }
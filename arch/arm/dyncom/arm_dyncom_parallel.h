@@ -33,6 +33,9 @@ typedef enum{
 }running_mode_t;
 
 extern running_mode_t running_mode;
+/* hot traces of the fast interpreter are compiled instead of single blocks */
+extern int trace_jit;
+int compile_trace(cpu_t* cpu, uint8_t func_attr);
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -791,7 +791,7 @@ void arm_dyncom_init(arm_core_t* core){
 	core->Mode = SVC32MODE;
 
 //	load_symbol_from_sysmap();
-	//new_tlb(TLB_SIZE, ASID_SIZE);
+	init_tlb(cpu);
 	/* undefined instr handler init */
 	arch_arm_undef_init(cpu);
 	arch_arm_invalidate_by_asid_init(cpu);
@@ -138,13 +138,21 @@ typedef struct TLBEntry_s {
 	UInt16 hash;	// TLB map index
 }TLBEntry;
 
+struct mips_code_page_s;
+
 /* The two-entry ITLB. Each entry maps a 4KB page */
 typedef struct ITLBEntry_s {
 	VA vpn;		// virtual address page number (va / 4KB)
 	PA pa;		// physical address and the caching algorithm
 	Int16 asid;	// ASID and the global bit.
+	UInt8 mode;	// umode when the entry was filled
+	struct mips_code_page_s* code;	// the predecoded page of pa, NULL if not cached
+	UInt32 code_tag;	// the tag of code when it was looked up
 }ITLBEntry;
 
+/* An invalid vpn used to mark unused ITLB entries */
+#define bad_itlb_vpn ~(VA)0
+
 /* Although not in real hardware, we also cache the two most recent
  * I-cache accesses, as simulating cache lookups is slow, and as many as 8
  * instructions can be fetched from one cache line.
@@ -276,6 +284,9 @@ TLBEntry* probe_tlb(MIPS_State* mstate, VA va);
 void set_tlb_entry(MIPS_State* mstate, int index);
 
 int translate_vaddr(MIPS_State* mstate, VA va, int type, PA *pa);
+void reset_itlb(MIPS_State* mstate);
+int translate_fetch(MIPS_State* mstate, VA va, PA *pa, ITLBEntry** entry);
+int itlb_match(MIPS_State* mstate, ITLBEntry* e, VA va);
 
 /* Instruction cache operations */
 void reset_icache(MIPS_State* mstate);
@@ -344,6 +355,7 @@ int get_random(MIPS_State* mstate);
 void leave_kernel_mode(MIPS_State* mstate);
 void enter_kernel_mode(MIPS_State* mstate);
 
+UInt32 mips_bus_addr(UInt32 pa);
 void mips_mem_read(UInt32 pa, UInt32 *data, int len);
 void mips_mem_write(UInt32 pa, const UInt32* data, int len);
 void load(MIPS_State* mstate, VA va, PA pa, UInt32* x, int size);
@@ -33,8 +33,11 @@
 #include "skyeye_mm.h"
 #include "skyeye_callback.h"
 #include "bank_defs.h"
+#include "skyeye_ram.h"
+#include "sim_control.h"
 
 #include "emul.h"
+#include "predecode.h"
 #include <stdlib.h>
 #include "mipsdef.h"
 #include <stdio.h>
@@ -82,14 +85,14 @@ mips_trigger_irq(MIPS_State* mstate)
 
 
 /**
-* @brief mips read mem interface
+* @brief the bus address of a physical address
 *
 * @param pa	physic addr
-* @param data  data pointer
-* @param len	data length
+*
+* @return the address given to the bus
 */
-void
-mips_mem_read(UInt32 pa, UInt32 *data, int len)
+UInt32
+mips_bus_addr(UInt32 pa)
 {
 	sky_pref_t* pref = get_skyeye_pref();
 	if(!pref->user_mode_sim){
@@ -100,6 +103,20 @@ mips_mem_read(UInt32 pa, UInt32 *data, int len)
 		if(pa >= 0xA0000000 && pa < 0xC0000000)
 			pa = pa & ~0xE0000000;
 	}
+	return pa;
+}
+
+/**
+* @brief mips read mem interface
+*
+* @param pa	physic addr
+* @param data  data pointer
+* @param len	data length
+*/
+void
+mips_mem_read(UInt32 pa, UInt32 *data, int len)
+{
+	pa = mips_bus_addr(pa);
 	//if(pa >= 0x14a1a0 && pa <= 0x14c000)
 	//	printf("###############read addr pa=0x%x,pc=0x%x\n", pa, mstate->pc);
 	bus_read(len * 8, pa, data);
@@ -115,15 +132,7 @@ mips_mem_read(UInt32 pa, UInt32 *data, int len)
 void 
 mips_mem_write(UInt32 pa, const UInt32* data, int len)
 {
-	sky_pref_t* pref = get_skyeye_pref();
-	if(!pref->user_mode_sim){
-		/* if pa is located at kseg0 */
-		if(pa >= 0x80000000 && pa < 0xA0000000)
-			pa = pa & ~0x80000000;
-		/* if pa is located at kseg1 */
-		if(pa >= 0xA0000000 && pa < 0xC0000000)
-			pa = pa & ~0xE0000000;
-	}
+	pa = mips_bus_addr(pa);
 
 	UInt32 addr = bits(pa, 31, 0);
 	bus_write(len * 8, pa, *data);
@@ -151,6 +160,19 @@ per_cpu_step(conf_object_t *running_core)
 {
 	mips_core_t* mstate = (mips_core_t *)get_cast_conf_obj(running_core, "mips_core_t");
 	MIPS_CPU_State* cpu = get_current_cpu();
+	/* the code page of the chain, the slots that follow in the page run
+	 * without the ITLB and page lookup */
+	mips_code_page_t* page = NULL;
+	mips_insn_t* insn = NULL;
+	ITLBEntry* e = NULL;
+	int chain = PREDECODE_CHAIN;
+	VA next_pc;
+	PA pa; //Shi yang 2006-08-18
+	VA va;
+	Instr instr;
+	int next_state;
+
+next_insn:
 	mstate->gpr[0] = 0;
 
 	/* if active is 0, the core is suspend */
@@ -163,6 +185,7 @@ per_cpu_step(conf_object_t *running_core)
          */
 	if(mstate->irq_pending)
 	{
+		page = NULL;
 		mips_trigger_irq(mstate);
 	}
 
@@ -174,19 +197,41 @@ per_cpu_step(conf_object_t *running_core)
 	 * caches and JTLB.
 	*/
 
-	PA pa; //Shi yang 2006-08-18
-	VA va;
-	Instr instr;
-	int next_state;
 	va = mstate->pc;
 	mstate->cycle++;
 
-	generic_arch_t *arch_instance = get_arch_instance("");
-	exec_callback(Step_callback, arch_instance);
+	if(is_callback_armed(Step_callback)){
+		generic_arch_t *arch_instance = get_arch_instance("");
+		exec_callback(Step_callback, arch_instance);
+	}
 
-	if(translate_vaddr(mstate, va, instr_fetch, &pa) == TLB_SUCC){
-		mips_mem_read(pa, &instr, 4);
-		next_state = decode(mstate, instr);
+	if(mstate->mt_flag){
+		if(translate_vaddr(mstate, va, instr_fetch, &pa) == TLB_SUCC){
+			mips_mem_read(pa, &instr, 4);
+			next_state = decode(mstate, instr);
+		}
+	}
+	else if(page){
+		/* the next slot of the chain */
+		pa = (pa & ~0xFFF) | (va & 0xFFF);
+		insn = predecode_slot(page, pa);
+		instr = insn->instr;
+		next_state = insn->handler(mstate, insn);
+	}
+	else if(translate_fetch(mstate, va, &pa, &e) == TLB_SUCC){
+		/* the instructions of ram run from their predecoded slot */
+		page = itlb_code_page(e);
+		if(page){
+			if(predecode_dirty(page))
+				predecode_flush(page);
+			insn = predecode_slot(page, pa);
+			instr = insn->instr;
+			next_state = insn->handler(mstate, insn);
+		}
+		else{
+			mips_mem_read(pa, &instr, 4);
+			next_state = decode(mstate, instr);
+		}
 		//skyeye_exit(-1);
 	}
 	else{
@@ -213,6 +258,7 @@ per_cpu_step(conf_object_t *running_core)
 			return; /* do nothing */
 	}
 	mstate->pipeline = next_state;
+	next_pc = mstate->pc;
 	/* if timer int is not mask and counter value is equal to compare value */
 	if(mstate->cp0[Count]++ >= mstate->cp0[Compare]){
 			/* update counter value in cp0 */
@@ -243,6 +289,17 @@ per_cpu_step(conf_object_t *running_core)
 		}
 	}
 
+	/* Run the next slot of the page in the chain, unless an exception
+	 * moved the pc or the instruction may have written the page or changed
+	 * the mapping of the ITLB entry */
+	if(page == NULL || --chain == 0 || mstate->pc != next_pc
+	   || (mstate->pipeline != nothing_special && mstate->pipeline != branch_delay)
+	   || ((mstate->pc ^ va) & ~0xFFF) || mstate->irq_pending || !SIM_is_running())
+		return;
+	if(insn->generic && (!itlb_match(mstate, e, mstate->pc) || predecode_dirty(page)))
+		return;
+	goto next_insn;
+
 	//skyeye_config.mach->mach_io_do_cycle (mstate);
 	//exec_callback();
 }
@@ -323,6 +380,7 @@ mips_core_init(mips_core_t* mstate,int core_id)
 	init_icache(mstate);
 	init_dcache(mstate);
 	init_tlb(mstate);
+	reset_itlb(mstate);
 
 	return true;
 }
@@ -0,0 +1,439 @@
+/* Copyright (C)
+* 2011 - skyeye team
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+*/
+
+/**
+* @file predecode.c
+* @brief the predecoded instructions of the guest code pages
+* @author skyeye team
+* @version
+* @date 2011-05-05
+*/
+
+/*
+ * An instruction is decoded the first time it is fetched from a page of ram,
+ * its fields and handler are kept in the slot of the page, so running it
+ * again is one indirect call. The common integer and branch instructions
+ * have their own handler with the semantics of decode(), the others are
+ * handed to decode().
+ *
+ * A write of the page sets its MEM_DIRTY_CODE flag, the next fetch that
+ * enters the page clears it and bumps the gen of the page, which drops
+ * every slot. The ITLB entry of a page keeps its code page, so the slots
+ * that follow in the page run without looking up the page again.
+ */
+
+#include <stdio.h>
+#include "skyeye_mm.h"
+#include "skyeye_ram.h"
+#include "instr.h"
+#include "predecode.h"
+
+static mips_code_page_t* code_pages[PREDECODE_PAGES];
+
+static int
+handle_decode(MIPS_State* mstate, mips_insn_t* insn)
+{
+	return decode(mstate, insn->instr);
+}
+
+static int
+handle_sll(MIPS_State* mstate, mips_insn_t* insn)
+{
+	if (insn->rd)
+		mstate->gpr[insn->rd] = mstate->gpr[insn->rt] << insn->sa;
+	return nothing_special;
+}
+
+static int
+handle_srl(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = mstate->gpr[insn->rt] >> insn->sa;
+	return nothing_special;
+}
+
+static int
+handle_sra(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = (UInt32)((Int32)mstate->gpr[insn->rt] >> insn->sa);
+	return nothing_special;
+}
+
+static int
+handle_movz(MIPS_State* mstate, mips_insn_t* insn)
+{
+	if (!mstate->gpr[insn->rt])
+		mstate->gpr[insn->rd] = mstate->gpr[insn->rs];
+	return nothing_special;
+}
+
+static int
+handle_movn(MIPS_State* mstate, mips_insn_t* insn)
+{
+	if (mstate->gpr[insn->rt])
+		mstate->gpr[insn->rd] = mstate->gpr[insn->rs];
+	return nothing_special;
+}
+
+static int
+handle_jr(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->branch_target = mstate->gpr[insn->rs];
+	if (mstate->pipeline == branch_delay)
+		printf("Can't handle branch in branch delay slot\n");
+	return bits(mstate->branch_target, 1, 0) ? instr_addr_error : branch_delay;
+}
+
+static int
+handle_jalr(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->branch_target = mstate->gpr[insn->rs];
+	mstate->gpr[insn->rd] = mstate->pc + 8;
+	if (mstate->pipeline == branch_delay)
+		printf("Can't handle branch in branch delay slot\n");
+	return bits(mstate->branch_target, 1, 0) ? instr_addr_error : branch_delay;
+}
+
+static int
+handle_addu(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = mstate->gpr[insn->rs] + mstate->gpr[insn->rt];
+	return nothing_special;
+}
+
+static int
+handle_subu(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = mstate->gpr[insn->rs] - mstate->gpr[insn->rt];
+	return nothing_special;
+}
+
+static int
+handle_and(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = mstate->gpr[insn->rs] & mstate->gpr[insn->rt];
+	return nothing_special;
+}
+
+static int
+handle_or(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = mstate->gpr[insn->rs] | mstate->gpr[insn->rt];
+	return nothing_special;
+}
+
+static int
+handle_xor(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = mstate->gpr[insn->rs] ^ mstate->gpr[insn->rt];
+	return nothing_special;
+}
+
+static int
+handle_nor(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = ~(mstate->gpr[insn->rs] | mstate->gpr[insn->rt]);
+	return nothing_special;
+}
+
+static int
+handle_slt(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = ((Int32)mstate->gpr[insn->rs] < (Int32)mstate->gpr[insn->rt]);
+	return nothing_special;
+}
+
+static int
+handle_sltu(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rd] = (mstate->gpr[insn->rs] < mstate->gpr[insn->rt]);
+	return nothing_special;
+}
+
+static int
+handle_j(MIPS_State* mstate, mips_insn_t* insn)
+{
+	VA msb = clear_bits(mstate->pc + 4, 27, 0);
+	mstate->branch_target = msb | insn->imm;
+	if (mstate->pipeline == branch_delay)
+		printf("Can't handle branch in branch delay slot");
+	return branch_delay;
+}
+
+static int
+handle_jal(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[31] = mstate->pc + 8;
+	return handle_j(mstate, insn);
+}
+
+/* the target of a taken conditional branch, imm is the offset << 2 */
+static inline int
+branch(MIPS_State* mstate, mips_insn_t* insn, int taken)
+{
+	if (taken)
+		mstate->branch_target = mstate->pc + 4 + insn->imm;
+	else
+		mstate->branch_target = mstate->pc + 8;
+	if (mstate->pipeline == branch_delay)
+		printf("Can't handle branch in branch delay slot");
+	return branch_delay;
+}
+
+static int
+handle_beq(MIPS_State* mstate, mips_insn_t* insn)
+{
+	return branch(mstate, insn, mstate->gpr[insn->rs] == mstate->gpr[insn->rt]);
+}
+
+static int
+handle_bne(MIPS_State* mstate, mips_insn_t* insn)
+{
+	return branch(mstate, insn, mstate->gpr[insn->rs] != mstate->gpr[insn->rt]);
+}
+
+static int
+handle_blez(MIPS_State* mstate, mips_insn_t* insn)
+{
+	return branch(mstate, insn, (Int32)mstate->gpr[insn->rs] <= 0);
+}
+
+static int
+handle_bgtz(MIPS_State* mstate, mips_insn_t* insn)
+{
+	return branch(mstate, insn, (Int32)mstate->gpr[insn->rs] > 0);
+}
+
+/* imm is sign extended for ADDIU, SLTI and SLTIU, zero extended for the
+ * logical instructions and shifted for LUI */
+static int
+handle_addiu(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rt] = mstate->gpr[insn->rs] + insn->imm;
+	return nothing_special;
+}
+
+static int
+handle_slti(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rt] = ((Int32)mstate->gpr[insn->rs] < (Int32)insn->imm);
+	return nothing_special;
+}
+
+static int
+handle_sltiu(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rt] = (mstate->gpr[insn->rs] < insn->imm);
+	return nothing_special;
+}
+
+static int
+handle_andi(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rt] = mstate->gpr[insn->rs] & insn->imm;
+	return nothing_special;
+}
+
+static int
+handle_ori(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rt] = mstate->gpr[insn->rs] | insn->imm;
+	return nothing_special;
+}
+
+static int
+handle_xori(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rt] = mstate->gpr[insn->rs] ^ insn->imm;
+	return nothing_special;
+}
+
+static int
+handle_lui(MIPS_State* mstate, mips_insn_t* insn)
+{
+	mstate->gpr[insn->rt] = insn->imm;
+	return nothing_special;
+}
+
+/**
+* @brief extract the fields of an instruction and select its handler
+*
+* @param insn the slot
+* @param instr the instruction
+*/
+static void
+predecode(mips_insn_t* insn, Instr instr)
+{
+	UInt32 imm = immediate(instr);
+
+	insn->instr = instr;
+	insn->rs = rs(instr);
+	insn->rt = rt(instr);
+	insn->rd = rd(instr);
+	insn->sa = shamt(instr);
+	insn->imm = imm;
+	insn->handler = handle_decode;
+	insn->generic = 1;
+
+	switch (opcode(instr)) {
+		case SPECIAL:
+			switch (function(instr)) {
+				case SLL: insn->handler = handle_sll; break;
+				case SRL: insn->handler = handle_srl; break;
+				case SRA: insn->handler = handle_sra; break;
+				case MOVZ: insn->handler = handle_movz; break;
+				case MOVN: insn->handler = handle_movn; break;
+				case JR: insn->handler = handle_jr; break;
+				case JALR: insn->handler = handle_jalr; break;
+				case ADDU: insn->handler = handle_addu; break;
+				case SUBU: insn->handler = handle_subu; break;
+				case AND: insn->handler = handle_and; break;
+				case OR: insn->handler = handle_or; break;
+				case XOR: insn->handler = handle_xor; break;
+				case NOR: insn->handler = handle_nor; break;
+				case SLT: insn->handler = handle_slt; break;
+				case SLTU: insn->handler = handle_sltu; break;
+			}
+			break;
+		case J:
+		case JAL:
+			insn->imm = target(instr) << 2;
+			insn->handler = opcode(instr) == J ? handle_j : handle_jal;
+			break;
+		case BEQ:
+		case BNE:
+		case BLEZ:
+		case BGTZ:
+			insn->imm = (UInt32)(Int32)(Int16)imm << 2;
+			if (opcode(instr) == BEQ)
+				insn->handler = handle_beq;
+			else if (opcode(instr) == BNE)
+				insn->handler = handle_bne;
+			else if (opcode(instr) == BLEZ)
+				insn->handler = handle_blez;
+			else
+				insn->handler = handle_bgtz;
+			break;
+		case ADDIU:
+			insn->imm = (UInt32)(Int32)(Int16)imm;
+			insn->handler = handle_addiu;
+			break;
+		case SLTI:
+			insn->imm = (UInt32)(Int32)(Int16)imm;
+			insn->handler = handle_slti;
+			break;
+		case SLTIU:
+			insn->imm = (UInt32)(Int32)(Int16)imm;
+			insn->handler = handle_sltiu;
+			break;
+		case ANDI: insn->handler = handle_andi; break;
+		case ORI: insn->handler = handle_ori; break;
+		case XORI: insn->handler = handle_xori; break;
+		case LUI:
+			insn->imm = imm << 16;
+			insn->handler = handle_lui;
+			break;
+	}
+	if (insn->handler != handle_decode)
+		insn->generic = 0;
+}
+
+/**
+* @brief give a page of ram a slot of the table, the pages without dirty
+* tracking are not cached as their writes could not be seen
+*
+* @param addr the bus address
+*
+* @return the code page, NULL if the page is not cached
+*/
+static mips_code_page_t*
+code_page_fill(UInt32 addr)
+{
+	bank_page_t* bp = bank_page_ptr(addr);
+	mips_code_page_t** slot = &code_pages[(addr >> BANK_PAGE_BITS) % PREDECODE_PAGES];
+	mips_code_page_t* page;
+	uint8_t* dirty;
+
+	if (bp == NULL || bp->host == NULL || (bp->flags & BANK_PAGE_PARTIAL)
+	    || (bp->bank->addr & BANK_PAGE_MASK))
+		return NULL;
+	dirty = mem_dirty_flags(addr);
+	if (dirty == NULL)
+		return NULL;
+	if (*slot == NULL) {
+		*slot = skyeye_mm_zero(sizeof(mips_code_page_t));
+		if (*slot == NULL)
+			return NULL;
+	}
+	page = *slot;
+	page->tag = (addr & ~BANK_PAGE_MASK) | 1;
+	page->dirty = dirty;
+	/* the slots hold the instructions of the previous page */
+	*dirty |= MEM_DIRTY_CODE;
+	return page;
+}
+
+/**
+* @brief get the code page of a physical page, it is kept by the ITLB entry
+* of the page
+*
+* @param pa the physical address of the page
+*
+* @return the code page, NULL if the page is not cached and its
+* instructions have to be fetched and decoded as before
+*/
+mips_code_page_t*
+predecode_page(PA pa)
+{
+	UInt32 addr = mips_bus_addr(pa);
+	mips_code_page_t* page = code_pages[(addr >> BANK_PAGE_BITS) % PREDECODE_PAGES];
+
+	if (page == NULL || page->tag != ((addr & ~BANK_PAGE_MASK) | 1))
+		page = code_page_fill(addr);
+	return page;
+}
+
+/**
+* @brief drop every slot of a code page written since the last check
+*
+* @param page the code page
+*/
+void
+predecode_flush(mips_code_page_t* page)
+{
+	__sync_fetch_and_and(page->dirty, (uint8_t)~MEM_DIRTY_CODE);
+	/* the slots are all zero at gen 0 */
+	if (++page->gen == 0)
+		page->gen = 1;
+}
+
+/**
+* @brief decode the instruction of a slot that is not of the page gen
+*
+* @param page the code page
+* @param insn the slot
+* @param pa the physical address of the instruction
+*/
+void
+predecode_fill(mips_code_page_t* page, mips_insn_t* insn, PA pa)
+{
+	Instr instr;
+
+	mips_mem_read(pa, &instr, 4);
+	predecode(insn, instr);
+	insn->gen = page->gen;
+}
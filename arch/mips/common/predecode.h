@@ -0,0 +1,95 @@
+/* Copyright (C)
+* 2011 - skyeye team
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+*/
+
+/**
+* @file predecode.h
+* @brief the predecoded instructions of the guest code pages
+* @author skyeye team
+* @version
+* @date 2011-05-05
+*/
+
+#ifndef __MIPS_PREDECODE_H__
+#define __MIPS_PREDECODE_H__
+
+#include "bank_defs.h"
+#include "emul.h"
+
+struct mips_insn_s;
+typedef int (*mips_handler_t)(MIPS_State* mstate, struct mips_insn_s* insn);
+
+/* An instruction with its fields extracted, run by calling its handler */
+typedef struct mips_insn_s {
+	mips_handler_t handler;
+	Instr instr;
+	UInt32 imm;	// the immediate, extended as the instruction uses it
+	UInt8 rs, rt, rd, sa;
+	UInt8 generic;	// run by decode(), it may write memory or change the mapping
+	UInt32 gen;	// the gen of the page when the slot was decoded
+}mips_insn_t;
+
+#define PREDECODE_PAGE_INSNS	(BANK_PAGE_SIZE / 4)
+/* The number of code pages kept, direct mapped by the physical page */
+#define PREDECODE_PAGES		128
+/* The most slots run in a chain by one call of the step function */
+#define PREDECODE_CHAIN		64
+
+/* The predecoded instructions of a 4KB physical page of ram */
+typedef struct mips_code_page_s {
+	UInt32 tag;	// the page address | 1, 0 when unused
+	UInt32 gen;	// bumped to invalidate every slot of the page
+	uint8_t* dirty;	// the dirty flags of the page in the memory
+	mips_insn_t insn[PREDECODE_PAGE_INSNS];
+}mips_code_page_t;
+
+mips_code_page_t* predecode_page(PA pa);
+void predecode_flush(mips_code_page_t* page);
+void predecode_fill(mips_code_page_t* page, mips_insn_t* insn, PA pa);
+
+/* the code page kept by an ITLB entry, looked up again when its slot of the
+ * table has been given to another page */
+static inline mips_code_page_t*
+itlb_code_page(ITLBEntry* e)
+{
+	if (e->code == NULL || e->code->tag != e->code_tag) {
+		e->code = predecode_page(e->pa);
+		e->code_tag = e->code ? e->code->tag : 0;
+	}
+	return e->code;
+}
+
+/* non-zero when the page has been written since its slots were checked, it
+ * is checked when the page is entered and after the instructions that may
+ * write it */
+static inline int
+predecode_dirty(mips_code_page_t* page)
+{
+	return *page->dirty & MEM_DIRTY_CODE;
+}
+
+/* the slot of the instruction at pa in its code page */
+static inline mips_insn_t*
+predecode_slot(mips_code_page_t* page, PA pa)
+{
+	mips_insn_t* insn = &page->insn[(pa & BANK_PAGE_MASK) >> 2];
+	if (insn->gen != page->gen)
+		predecode_fill(page, insn, pa);
+	return insn;
+}
+
+#endif
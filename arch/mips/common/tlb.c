@@ -16,6 +16,7 @@ int translate_vaddr_mt(MIPS_State* mstate, VA va, int type, PA * pa);
 void 
 reset_tlb(MIPS_State* mstate)
 {
+	reset_itlb(mstate);
 	if(mstate->mt_flag)
 		reset_tlb_mt(mstate);
 	else{
@@ -67,6 +68,7 @@ reset_tlb_mt(MIPS_State* mstate)
 void 
 set_tlb_entry(MIPS_State* mstate, int n)
 {
+	reset_itlb(mstate);
 	if(mstate->mt_flag)
 		set_tlb_entry_mt(mstate, n);
 	else{
@@ -270,6 +272,85 @@ translate_vaddr(MIPS_State* mstate, VA va, int type, PA * pa)
 	return TLB_EXP;
 }
 
+// Invalidate the ITLB, every change of the TLB may remap a fetched page.
+
+void
+reset_itlb(MIPS_State* mstate)
+{
+	mstate->itlb[0].vpn = bad_itlb_vpn;
+	mstate->itlb[1].vpn = bad_itlb_vpn;
+	mstate->itlb[0].code = NULL;
+	mstate->itlb[1].code = NULL;
+	mstate->lru_itlb = 0;
+}
+
+/**
+* @brief check if an ITLB entry still maps an address in the current mode
+* and ASID
+*
+* @param mstate core state
+* @param e the entry
+* @param va the virtual address
+*
+* @return non-zero if the entry maps va
+*/
+int
+itlb_match(MIPS_State* mstate, ITLBEntry* e, VA va)
+{
+	Int16 asid = mstate->cp0[EntryHi] & 0xFF;
+	return e->vpn == (va >> 12) && e->mode == (mstate->mode & umode)
+		&& (e->asid < 0 || e->asid == asid);
+}
+
+/**
+* @brief translate the address of an instruction fetch through the ITLB, a
+* miss goes through translate_vaddr() and replaces the least recently used
+* entry. kseg0 and kseg1 are not mapped, so their entries match every ASID.
+*
+* @param mstate core state
+* @param va the virtual address of the instruction
+* @param pa the physical address
+* @param entry the entry that maps va, it keeps the code page of pa
+*
+* @return TLB_SUCC, or the failure of translate_vaddr()
+*/
+int
+translate_fetch(MIPS_State* mstate, VA va, PA *pa, ITLBEntry** entry)
+{
+	ITLBEntry *e;
+	Int16 asid = mstate->cp0[EntryHi] & 0xFF;
+	UInt8 mode = mstate->mode & umode;
+	VA vpn = va >> 12;
+	int i, ret;
+
+	for (i = 0; i < 2; i++) {
+		e = &mstate->itlb[i];
+		if (itlb_match(mstate, e, va)) {
+			mstate->lru_itlb = !i;
+			*pa = e->pa | (va & 0xFFF);
+			*entry = e;
+			return TLB_SUCC;
+		}
+	}
+	ret = translate_vaddr(mstate, va, instr_fetch, pa);
+	if (ret != TLB_SUCC)
+		return ret;
+
+	e = &mstate->itlb[mstate->lru_itlb];
+	e->vpn = vpn;
+	e->pa = *pa & ~0xFFF;
+	e->mode = mode;
+	if (vaddr_region(va) == vaddr_region(kseg0) || vaddr_region(va) == vaddr_region(kseg1))
+		e->asid = -1;
+	else
+		e->asid = asid;
+	/* the code page is looked up at the first fetch from the entry */
+	e->code = NULL;
+	mstate->lru_itlb = !mstate->lru_itlb;
+	*entry = e;
+	return TLB_SUCC;
+}
+
 // Perform a full TLB lookup.
 int
 translate_vaddr_mt(MIPS_State* mstate, VA va, int type, PA * pa)
@@ -50,6 +50,27 @@ extern "C" {
 #define L2_TLB0_SIZE 256
 #define L2_TLB1_SIZE 16
 
+/* tlb0 is 2-way set associative, the set is chosen by the low bits of EPN */
+#define L2_TLB0_WAYS 2
+#define L2_TLB0_SETS (L2_TLB0_SIZE / L2_TLB0_WAYS)
+#define TLB0_INDEX(epn, way) ((((epn) & (L2_TLB0_SETS - 1)) * L2_TLB0_WAYS) + ((way) % L2_TLB0_WAYS))
+
+/* a translated 4k page, looked up before walking tlb0 and tlb1 */
+	typedef struct ppc_tcache_entry_s {
+		uint32 tag;	/* effective page | TCACHE_TS | TCACHE_VALID */
+		uint32 gen;	/* tcache_gen of the mmu when filled */
+		uint32 tid;	/* 0 for a global page */
+		uint32 rpn;	/* physical page address */
+		uint32 usxrw;
+		struct bank_page *page;	/* the bus page of rpn */
+	} ppc_tcache_entry_t;
+
+#define TCACHE_BITS 10
+#define TCACHE_SIZE (1 << TCACHE_BITS)
+#define TCACHE_VALID 0x1
+#define TCACHE_TS 0x2
+#define tcache_index(addr) (((addr) >> 12) & (TCACHE_SIZE - 1))
+
 	typedef struct e500_mmu_s {
 		uint64 pid[3];
 		uint64 mmucsr0;
@@ -61,6 +82,10 @@ extern "C" {
 		ppc_tlb_entry_t l2_tlb0_4k[L2_TLB0_SIZE];	/* unified, filled by tlbwe instruction */
 		ppc_tlb_entry_t l2_tlb1_vsp[L2_TLB1_SIZE];	/* filled by tlbwe insructions */
 
+		/* bumped by a change of the tlbs to drop the whole tcache */
+		uint32 tcache_gen;
+		ppc_tcache_entry_t tcache[TCACHE_SIZE];
+
 	} e500_mmu_t;
 
 #define TLBSEL(e) ((e >> 28) & 0x1)
@@ -125,11 +125,11 @@ bool_t e500_ppc_exception(e500_core_t * core, uint32 type, uint32 flags,
 			tlb0_nv++;
 #endif
 			core->mmu.mas[0] =
-			    (core->mmu.tlb0_nv << 18) | (core->mmu.
+			    (core->mmu.tlb0_nv << 16) | (core->mmu.
 							 mas[0] & 0xFFF0FFFF);
 			/* update NV of MAS0 , NV = ~TLB[0].NV */
 			core->mmu.mas[0] =
-			    (~core->mmu.tlb0_nv & 0x3) | (core->mmu.
+			    ((core->mmu.tlb0_nv + 1) % L2_TLB0_WAYS) | (core->mmu.
 							  mas[0] & 0xFFFFFFFC);
 		}
 		/**
@@ -202,11 +202,11 @@ bool_t e500_ppc_exception(e500_core_t * core, uint32 type, uint32 flags,
 			tlb0_nv++;
 #endif
 			core->mmu.mas[0] =
-			    (core->mmu.tlb0_nv << 18) | (core->mmu.
+			    (core->mmu.tlb0_nv << 16) | (core->mmu.
 							 mas[0] & 0xFFF0FFFF);
 			/* update NV of MAS0 , NV = ~TLB[0].NV */
 			core->mmu.mas[0] =
-			    (~core->mmu.tlb0_nv & 0x3) | (core->mmu.
+			    ((core->mmu.tlb0_nv + 1) % L2_TLB0_WAYS) | (core->mmu.
 							  mas[0] & 0xFFFFFFFC);
 		}
 		/**
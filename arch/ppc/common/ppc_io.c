@@ -33,6 +33,8 @@
 #include "ppc_cpu.h"
 #include "sysendian.h"
 #include "bank_defs.h"
+#include "skyeye_ram.h"
+#include "skyeye_callback.h"
 #define UART_IRQ 26
 
 /* For e500 */
@@ -54,6 +56,37 @@ static inline bool_t in_ccsr_range(uint32 p)
 		 current_core->ccsr_size));
 }
 
+/**
+* @brief read the real address p translated from addr, the ram page found by
+* the translation is read without looking up the bank again
+*
+* @param core the current core
+* @param size the data width
+* @param addr the effective address
+* @param p the real address
+* @param value the return value
+*
+* @return the return value of the bus
+*/
+static inline int ppc_bus_read(e500_core_t * core, short size, uint32 addr,
+			       uint32 p, uint32 * value)
+{
+	bank_page_t *page = e500_tcache_page(core, addr, p);
+	if (page && page->host && !is_callback_armed(Bus_read_callback))
+		return mem_read_page(page, size, p, value);
+	return bus_read(size, p, value);
+}
+
+static inline int ppc_bus_write(e500_core_t * core, short size, uint32 addr,
+				uint32 p, uint32 value)
+{
+	bank_page_t *page = e500_tcache_page(core, addr, p);
+	if (page && (page->flags & BANK_PAGE_WRITABLE)
+	    && !is_callback_armed(Bus_write_callback))
+		return mem_write_page(page, size, p, value);
+	return bus_write(size, p, value);
+}
+
 int FASTCALL ppc_read_effective_word(uint32 addr, uint32 * result)
 {
 	e500_core_t *current_core = get_current_core();
@@ -72,7 +105,7 @@ int FASTCALL ppc_read_effective_word(uint32 addr, uint32 * result)
 							     get_ccsr_base(cpu->
 									   ccsr)));
 		} else {
-			if (bus_read(32, p, result) != 0) {
+			if (ppc_bus_read(current_core, 32, addr, p, result) != 0) {
 			}
 		}
 	}
@@ -100,8 +133,10 @@ int FASTCALL ppc_read_effective_half(uint32 addr, uint16 * result)
 								 get_ccsr_base
 								 (cpu->ccsr)));
 		} else {
-			if (bus_read(16, p, result) != 0) {
+			uint32 value = 0;
+			if (ppc_bus_read(current_core, 16, addr, p, &value) != 0) {
 			}
+			*result = value;
 			//fprintf(stderr,"in %s, can not find address 0x%x,pc=0x%x\n", __FUNCTION__, p, current_core->pc);
 			//skyeye_exit(-1);
 		}
@@ -129,8 +164,10 @@ int ppc_read_effective_byte(uint32 addr, uint8 * result)
 			//printf("In %s, offset=0x%x, *result=0x%x\n", __FUNCTION__, offset, *result);
 			return r;
 		} else {
-			if (bus_read(8, p, result) != 0) {
+			uint32 value = 0;
+			if (ppc_bus_read(current_core, 8, addr, p, &value) != 0) {
 			}
+			*result = value;
 			//fprintf(stderr,"in %s, can not find address 0x%x,pc=0x%x\n", __FUNCTION__, p, current_core->pc);
 			//skyeye_exit(-1);
 		}
@@ -158,7 +195,7 @@ int FASTCALL ppc_write_effective_word(uint32 addr, uint32 data)
 			config->mach->mach_io_write_word(cpu, offset, data);
 			//printf("DBG:write to CCSR,value=0x%x,offset=0x%x,pc=0x%x\n", data, offset,current_core->pc);
 		} else {
-			bus_write(32, p, data);
+			ppc_bus_write(current_core, 32, addr, p, data);
 			//fprintf(stderr,"in %s, can not find address 0x%x,pc=0x%x,ccsr_base=0x%x, ccsr=0x%x\n", __FUNCTION__, p, current_core->pc, GET_CCSR_BASE(gCPU.ccsr), gCPU.ccsr);
 			//skyeye_exit(-1);
 		}
@@ -183,7 +220,7 @@ int FASTCALL ppc_write_effective_half(uint32 addr, uint16 data)
 			config->mach->mach_io_write_halfword(cpu, offset, data);
 			//printf("DBG:write to CCSR,value=0x%x,offset=0x%x,pc=0x%x\n", data, offset,current_core->pc);
 		} else {
-			bus_write(16, p, data);
+			ppc_bus_write(current_core, 16, addr, p, data);
 			//fprintf(stderr,"in %s, can not find address 0x%x,pc=0x%x\n", __FUNCTION__, p, current_core->pc);
 			//skyeye_exit(-1);
 		}
@@ -213,7 +250,7 @@ int FASTCALL ppc_write_effective_byte(uint32 addr, uint8 data)
 			return r;
 			//printf("DBG:write to CCSR,value=0x%x,offset=0x%x\n", data, offset);
 		} else {
-			bus_write(8, p, data);
+			ppc_bus_write(current_core, 8, addr, p, data);
 			//fprintf(stderr,"in %s, can not find address 0x%x,pc=0x%x,ccsr=0x%x\n", __FUNCTION__, p, current_core->pc, gCPU.ccsr);
 			//skyeye_exit(-1);
 		}
@@ -69,14 +69,71 @@ for all TLB entries
 	endfor
 	end translation tlb miss
 */
+/* the effective page mask of a tlb1 entry, whose page is 4^size KB */
+#define TLB1_MASK(size) (~((1024U << (2 * (size))) - 1))
+
+/**
+* @brief find the valid entry of tlb0 or tlb1 that maps addr for the pid.
+* Only the set of addr is probed in tlb0.
+*
+* @param core the current core
+* @param addr the effective address
+* @param result the real address of addr
+*
+* @return the entry, NULL on a tlb miss
+*/
+static ppc_tlb_entry_t *e500_tlb_search(e500_core_t * core, uint32 addr,
+					uint32 * result)
+{
+	uint32 epn = addr >> 12;
+	uint32 mask;
+	ppc_tlb_entry_t *entry;
+	int i;
+
+	entry = &core->mmu.l2_tlb0_4k[TLB0_INDEX(epn, 0)];
+	for (i = 0; i < L2_TLB0_WAYS; i++, entry++) {
+		if (!entry->v || entry->epn != epn)
+			continue;
+		/* FIXME, not check ts bit now, we should check all the pid register */
+		if (entry->tid != 0 && core->mmu.pid[0] != entry->tid)
+			continue;
+		*result = (entry->rpn << 12) | (addr & 0xFFF);
+		return entry;
+	}
+	for (i = 0; i < L2_TLB1_SIZE; i++) {
+		entry = &core->mmu.l2_tlb1_vsp[i];
+		if (!entry->v)
+			continue;
+		if (entry->tid != 0 && core->mmu.pid[0] != entry->tid)
+			continue;
+		if (entry->size == 0xb) {
+			/*if 4G size is mapped, we will not do address check */
+			if (addr < (entry->epn << 12))
+				continue;
+			*result = (entry->rpn << 12) | (addr - (entry->epn << 12));
+			return entry;
+		}
+		mask = TLB1_MASK(entry->size);
+		if ((addr & mask) != ((entry->epn << 12) & mask))
+			continue;
+		*result = (entry->rpn << 12) | (addr & ~mask);
+		return entry;
+	}
+	return NULL;
+}
+
+/* check the SW or UW bit of an entry, by MSR[PR] */
+static inline int e500_write_allowed(e500_core_t * core, uint32 usxrw)
+{
+	return usxrw & ((core->msr & MSR_PR) ? 0x8 : 0x4);
+}
+
 int e500_effective_to_physical(e500_core_t * core, uint32 addr, int flags,
 			       uint32 * result)
 {
-	int i, j;
-	uint32 mask;
+	ppc_tcache_entry_t *tc;
 	ppc_tlb_entry_t *entry;
-	int tlb1_index;
-	int pid_match = 0;
+	uint32 tag;
 	e500_core_t *current_core = get_current_core();
 	PPC_CPU_State *cpu = get_current_cpu();
 
@@ -85,82 +142,65 @@ int e500_effective_to_physical(e500_core_t * core, uint32 addr, int flags,
 		*result = (addr & 0xFFF) | (cpu->bptr << 12);	/* please refer to P259 of MPC8572UM */
 		return PPC_MMU_OK;
 	}
-	i = 0;
-	/* walk over tlb0 and tlb1 to find the entry */
-	while (i++ < (L2_TLB0_SIZE + L2_TLB1_SIZE)) {
-		if (i > (L2_TLB0_SIZE - 1)) {
-			tlb1_index = i - L2_TLB0_SIZE;
-			entry = &current_core->mmu.l2_tlb1_vsp[tlb1_index];
-		} else
-			entry = &current_core->mmu.l2_tlb0_4k[i];
-		if (!entry->v)
-			continue;
-		//if(addr == 0xfdff9080)
-		//      printf("In %s,entry=0x%x, i = 0x%x, current_core->pir=0x%x\n", __FUNCTION__, entry, i, current_core->pir);
-		/* FIXME, not check ts bit now */
-		if (entry->ts & 0x0)
-			continue;
-		if (entry->tid != 0) {
-			/*
-			   for(j = 0; j < 3; j++){
-			   if(current_core->mmu.pid[j] == entry->tid)
-			   break;
-			   } */
-			//printf("entry->tid=0x%x\n", entry->tid);
-			/* FIXME, we should check all the pid register */
-			if (current_core->mmu.pid[0] != entry->tid)
-				continue;
-
-		}
-		if (i > (L2_TLB0_SIZE - 1)) {
-			int k, s = 1;
-			for (k = 0; k < entry->size; k++)
-				s = s * 4;
-			mask = ~((1024 * (s - 1) - 0x1) + 1024);
-		} else
-			mask = ~(1024 * 4 - 0x1);
-		if (entry->size != 0xb) {
-			if ((addr & mask) != ((entry->epn << 12) & mask))
-				continue;
-			/* check rwx bit */
-			if (flags == PPC_MMU_WRITE) {
-				if (current_core->msr & 0x4000) {	/* Pr =1 , we are in user mode */
-					if (!(entry->usxrw & 0x8)) {
-						//printf("In %s,usermode,offset=0x%x, entry->usxrw=0x%x,pc=0x%x\n", __FUNCTION__, i, entry->usxrw, current_core->pc);
-						ppc_exception(core, DATA_ST,
-							      flags, addr);
-						return PPC_MMU_EXC;
-					}
-				} else {	/* Or PR is 0,we are in Supervisor mode */
-					if (!(entry->usxrw & 0x4)) {	/* we judge SW bit */
-						//printf("In %s,Super mode,entry->usxrw=0x%x,pc=0x%x\n", __FUNCTION__, entry->usxrw, current_core->pc);
-						ppc_exception(core, DATA_ST,
-							      flags, addr);
-						return PPC_MMU_EXC;
-					}
-				}
-			}
-
-			*result = (entry->rpn << 12) | (addr & ~mask);	// get real address
-		} else {	/*if 4G size is mapped, we will not do address check */
-			//fprintf(stderr,"warning:4G address is used.\n");
-			if (addr < (entry->epn << 12))
-				continue;
-			*result = (entry->rpn << 12) | (addr - (entry->epn << 12));	// get real address
+	/* the address space is MSR[IS] for instructions and MSR[DS] for data */
+	tag = (addr & ~0xFFF) | TCACHE_VALID;
+	if (current_core->msr & ((flags & PPC_MMU_CODE) ? MSR_IR : MSR_DR))
+		tag |= TCACHE_TS;
+	tc = &current_core->mmu.tcache[tcache_index(addr)];
+	if (tc->tag == tag && tc->gen == current_core->mmu.tcache_gen
+	    && (tc->tid == 0 || tc->tid == current_core->mmu.pid[0])
+	    && (flags != PPC_MMU_WRITE
+		|| e500_write_allowed(current_core, tc->usxrw))) {
+		*result = tc->rpn | (addr & 0xFFF);
+		return PPC_MMU_OK;
+	}
 
+	entry = e500_tlb_search(current_core, addr, result);
+	if (entry == NULL) {
+		//printf("In %s,DATA_TLB exp,addr=0x%x,pc=0x%x, pir=0x%x\n", __FUNCTION__, addr, core->pc, core->pir);
+		if (flags == PPC_MMU_CODE) {
+			ppc_exception(core, INSN_TLB, flags, addr);
+			return PPC_MMU_EXC;
+		} else {
+			if (ppc_exception(core, DATA_TLB, flags, addr))
+				return PPC_MMU_EXC;
 		}
-		return PPC_MMU_OK;
+		return PPC_MMU_FATAL;
 	}
-	//printf("In %s,DATA_TLB exp,addr=0x%x,pc=0x%x, pir=0x%x\n", __FUNCTION__, addr, core->pc, core->pir);
-	if (flags == PPC_MMU_CODE) {
-		ppc_exception(core, INSN_TLB, flags, addr);
+	/* check rwx bit, a 4G page is not checked */
+	if (flags == PPC_MMU_WRITE && entry->size != 0xb
+	    && !e500_write_allowed(current_core, entry->usxrw)) {
+		ppc_exception(core, DATA_ST, flags, addr);
 		return PPC_MMU_EXC;
-	} else {
-		if (ppc_exception(core, DATA_TLB, flags, addr))
-			return PPC_MMU_EXC;
 	}
-	return PPC_MMU_FATAL;
 
+	tc->tag = tag;
+	tc->gen = current_core->mmu.tcache_gen;
+	tc->tid = entry->tid;
+	tc->rpn = *result & ~0xFFF;
+	tc->usxrw = (entry->size == 0xb) ? 0x3F : entry->usxrw;
+	tc->page = bank_page_ptr(tc->rpn);
+	return PPC_MMU_OK;
+}
+
+/**
+* @brief the bus page of the physical address p just translated from addr
+* through the tcache
+*
+* @param core the current core
+* @param addr the effective address
+* @param p the real address of addr
+*
+* @return the page, NULL if the translation is not cached
+*/
+bank_page_t *e500_tcache_page(e500_core_t * core, uint32 addr, uint32 p)
+{
+	ppc_tcache_entry_t *tc = &core->mmu.tcache[tcache_index(addr)];
+
+	if ((tc->tag & TCACHE_VALID) && (tc->tag & ~0xFFF) == (addr & ~0xFFF)
+	    && tc->gen == core->mmu.tcache_gen && tc->rpn == (p & ~0xFFF))
+		return tc->page;
+	return NULL;
 }
 
 const uint32_t default_page_size = 4 * 1024;
@@ -485,7 +525,7 @@ int e500_mmu_init(e500_mmu_t * mmu)
 	entry->x = 0;		/* Reserved system attributes */
 	entry->u = 0;		/* User attribute bits */
 	entry->iprot = 1;	/* Page is protected from invalidation */
-	mmu->tlbcfg[0] = 0x4110200;
+	mmu->tlbcfg[0] = 0x2110100;	/* 2-way, 256 entries */
 	mmu->tlbcfg[1] = 0x101bc010;
 
 	return No_exp;
@@ -494,6 +534,7 @@ int e500_mmu_init(e500_mmu_t * mmu)
 void ppc_mmu_tlb_invalidate(e500_core_t * core)
 {
 	core->effective_code_page = 0xffffffff;
+	core->mmu.tcache_gen++;
 }
 
 /*
@@ -2025,16 +2066,16 @@ void ppc_opc_tlbivax()
 	e500_core_t *current_core = get_current_core();
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(current_core->current_opc, rD, rA, rB);
-	int i = 0, j = 0;
+	int i = 0;
 	uint32 mask;
 	ppc_tlb_entry_t *entry;
-	int tlb1_index;
 	uint32 addr;
 	if (rA)
 		addr = current_core->gpr[rA] + current_core->gpr[rB];
 	else
 		addr = current_core->gpr[rB];
 	//printf("In %s,addr=0x%x,pc=0x%x\n", __FUNCTION__,  addr, current_core->pc);
+	current_core->mmu.tcache_gen++;
 	/* check if IA bit is set */
 	if (addr & 0x4) {
 		int i, j;
@@ -2053,39 +2094,30 @@ void ppc_opc_tlbivax()
 		}
 		return;
 	}
-	/* walk over tlb0 and tlb1 to find the entry */
-	while (i++ < (L2_TLB0_SIZE + L2_TLB1_SIZE)) {
-		if (i > (L2_TLB0_SIZE - 1)) {
-			tlb1_index = i - L2_TLB0_SIZE;
-			entry = &current_core->mmu.l2_tlb1_vsp[tlb1_index];
-		} else
-			entry = &current_core->mmu.l2_tlb0_4k[i];
+	/* the page can only be in its set of tlb0 */
+	entry = &current_core->mmu.l2_tlb0_4k[TLB0_INDEX(addr >> 12, 0)];
+	for (i = 0; i < L2_TLB0_WAYS; i++, entry++) {
 		/* check if entry is protected. */
+		if (entry->iprot || entry->epn != (addr >> 12))
+			continue;
+		/* FIXME, not check ts bit now, we should check all the pid register */
+		if (entry->tid != 0 && current_core->mmu.pid[0] != entry->tid)
+			continue;
+		entry->v = 0;
+	}
+	for (i = 0; i < L2_TLB1_SIZE; i++) {
+		entry = &current_core->mmu.l2_tlb1_vsp[i];
 		if (entry->iprot)
 			continue;
-		/* FIXME, not check ts bit now */
-		if (entry->ts & 0x0)
+		if (entry->tid != 0 && current_core->mmu.pid[0] != entry->tid)
 			continue;
-		if (entry->tid != 0) {
-			/* FIXME, we should check all the pid register */
-			if (current_core->mmu.pid[0] != entry->tid)
-				continue;
-		}
-		if (i > (L2_TLB0_SIZE - 1)) {
-			int k, s = 1;
-			for (k = 0; k < entry->size; k++)
-				s = s * 4;
-			mask = ~((1024 * (s - 1) - 0x1) + 1024);
-		} else
-			mask = ~(1024 * 4 - 0x1);
 		if (entry->size != 0xb) {
+			mask = TLB1_MASK(entry->size);
 			if ((addr & mask) != ((entry->epn << 12) & mask))
 				continue;
 		} else {	/*if 4G size is mapped, we will not do address check */
-			//fprintf(stderr,"warning:4G address is used.\n");
 			if (addr < (entry->epn << 12))
 				continue;
-
 		}
 		//printf("In %s,found ,offset = 0x%x,addr=0x%x,pc=0x%x, pir=0x%x\n", __FUNCTION__, i, addr, current_core->pc, current_core->pir);
 		entry->v = 0;
@@ -2106,8 +2138,8 @@ void ppc_opc_tlbwe()
 	int offset;
 	if (TLBSEL(current_core->mmu.mas[0]) == 0x0) {
 		offset =
-		    ((ESEL(current_core->mmu.mas[0]) & 0xC) << 4) |
-		    (EPN(current_core->mmu.mas[2]) & 0x3f);
+		    TLB0_INDEX(EPN(current_core->mmu.mas[2]),
+			       ESEL(current_core->mmu.mas[0]));
 		/* Fixme: we just implement a simple round-robin replace for TLB0. that is not as described in manual of e500 */
 #if 0
 		static int tlb0_nv = 0;
@@ -2123,7 +2155,7 @@ void ppc_opc_tlbwe()
 			entry = &current_core->mmu.l2_tlb0_4k[0 + offset];
 			/* update TLB0[NV] with MAS0[NV] */
 			current_core->mmu.tlb0_nv =
-			    current_core->mmu.mas[0] & 0x1;
+			    (current_core->mmu.mas[0] & 0x3) % L2_TLB0_WAYS;
 		}
 	} else {
 		offset = ESEL(current_core->mmu.mas[0]);
@@ -2144,7 +2176,7 @@ void ppc_opc_tlbwe()
 	entry->usxrw = current_core->mmu.mas[3] & 0x3F;
 	entry->u = (current_core->mmu.mas[3]) >> 6 & 0xF;
 	entry->rpn = (current_core->mmu.mas[3] >> 12) & 0xFFFFF;
-	current_core->mmu.tlb0_nv = current_core->mmu.mas[0] & 0x3;
+	current_core->mmu.tcache_gen++;
 	/* workaround for second core */
 	//if(entry->epn == 0xfdff9)
 	//      entry->v = 1;
@@ -2160,14 +2192,14 @@ void ppc_opc_tlbsx()
 	int tlb1_index;
 	int va, ea;
 	int mask;
-	int i = 0;
+	int i;
 	int rA, rD, rB;
 	PPC_OPC_TEMPL_X(current_core->current_opc, rD, rA, rB);
 	ea = current_core->gpr[rB];
 	/* walk over tlb0 and tlb1 to find the entry */
 
 	//printf("In %s, ea=0x%x\n", __FUNCTION__, ea);
-	while (i++ < (L2_TLB0_SIZE + L2_TLB1_SIZE)) {
+	for (i = 0; i < (L2_TLB0_SIZE + L2_TLB1_SIZE); i++) {
 		if (i > (L2_TLB0_SIZE - 1)) {
 			tlb1_index = i - L2_TLB0_SIZE;
 			entry = &current_core->mmu.l2_tlb1_vsp[tlb1_index];
@@ -2184,12 +2216,9 @@ void ppc_opc_tlbsx()
 			continue;
 		}
 		//printf("In %s,entry->tid=0x%x,mas[6]=0x%x\n", __FUNCTION__, entry->tid, current_core->mmu.mas[6]);
-		if (i > (L2_TLB0_SIZE - 1)) {
-			int k, s = 1;
-			for (k = 0; k < entry->size; k++)
-				s = s * 4;
-			mask = ~(1024 * s - 0x1);
-		} else
+		if (i > (L2_TLB0_SIZE - 1))
+			mask = TLB1_MASK(entry->size);
+		else
 			mask = ~(1024 * 4 - 0x1);
 		/* we found the entry */
 		if ((ea & mask) == (entry->epn << 12)) {
@@ -2222,7 +2251,7 @@ void ppc_opc_tlbsx()
 				/* fill ESEL */
 				current_core->mmu.mas[0] =
 				    (current_core->mmu.
-				     mas[0] & 0xFFF0FFFF) | (((i & 0xC0) >> 4)
+				     mas[0] & 0xFFF0FFFF) | ((i % L2_TLB0_WAYS)
 							     << 16);
 				current_core->mmu.mas[2] =
 				    (current_core->mmu.
@@ -2258,8 +2287,8 @@ void ppc_opc_tlbrehi()
 	int offset;
 	if (TLBSEL(current_core->mmu.mas[0]) == 0x0) {
 		offset =
-		    ((ESEL(current_core->mmu.mas[0]) & 0xC) << 4) |
-		    (EPN(current_core->mmu.mas[2]) & 0x3f);
+		    TLB0_INDEX(EPN(current_core->mmu.mas[2]),
+			       ESEL(current_core->mmu.mas[0]));
 		if (offset > L2_TLB0_SIZE) {
 			fprintf(stderr, "Out of TLB size..\n");
 			skyeye_exit(-1);
@@ -53,6 +53,8 @@ extern "C" {
 				       int flags, uint32 * result);
 	bool_t ppc_mmu_set_sdr1(uint32 newval, bool_t quiesce);
 	void ppc_mmu_tlb_invalidate(e500_core_t * core);
+	struct bank_page *e500_tcache_page(e500_core_t * core, uint32 addr,
+					   uint32 p);
 
 	int ppc_read_physical_dword(uint32 addr, uint64 * result);
 	int ppc_read_physical_word(uint32 addr, uint32 * result);
@@ -17,6 +17,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "types.h"
@@ -39,6 +40,7 @@ static inline void iu_set_pc(uint32 addr);
 static inline int iu_trap_cycle(void);
 
 static void iu_isa_register(void);
+static void iu_decode_build(void);
 
 #define FORMAT_TYPES    4
 #define BICC            0x0
@@ -56,6 +58,41 @@ struct _i_set
 
 static struct _i_set *i_set[FORMAT_TYPES];
 
+/*
+ *  The decode table. It is indexed by the format and the opcode fields of an
+ *  instruction (op2 and cond for the format 0, op3 for the formats 2 and 3)
+ *  and holds the indexes in i_set of the registered instructions that can
+ *  match such a word, in the order of registration.
+ */
+#define DECODE_KEY_BITS     7
+#define DECODE_KEYS         (FORMAT_TYPES << DECODE_KEY_BITS)
+/*  The words tried against every instruction to fill the decode table  */
+#define DECODE_PROBES       128
+
+struct _i_decode
+{
+    int *index;
+    int count;
+};
+
+static struct _i_decode i_decode[DECODE_KEYS];
+
+/*
+ *  The predecoded instructions, direct mapped by the PC. An entry is only
+ *  used while the word at its PC is still the decoded one.
+ */
+#define ICACHE_BITS         12
+#define ICACHE_SIZE         (1 << ICACHE_BITS)
+
+struct _i_cache
+{
+    uint32 pc;
+    uint32 instr;
+    sparc_instruction_t *pi;
+};
+
+static struct _i_cache i_cache[ICACHE_SIZE];
+
 static iu_config_t iu_config = {
    iu_init_state,
    iu_cycle_step,
@@ -292,6 +329,7 @@ static int iu_cycle_step(void)
     uint32 pc;
     sparc_instr instr;
     sparc_instruction_t *pi;
+    struct _i_cache *ic;
 
     /*  program counter */
     pc = iu_get_pc();
@@ -308,10 +346,23 @@ static int iu_cycle_step(void)
 //    DBG("%s(): instr = 0x%x\n", __func__, instr);
 
 
-    if( (pi = iu_get_instr(instr)) == NULL )
+    ic = &i_cache[(pc >> 2) & (ICACHE_SIZE - 1)];
+    if( ic->pi && ic->pc == pc && ic->instr == instr )
+    {
+        /*  The operands are kept by the instruction itself, refresh them  */
+        pi = ic->pi;
+        pi->disassemble(instr, &sparc_state);
+    }
+    else
     {
-        DBG("Instruction not implemented at PC=0x%x\n", pc);
-        skyeye_exit(1);
+        if( (pi = iu_get_instr(instr)) == NULL )
+        {
+            DBG("Instruction not implemented at PC=0x%x\n", pc);
+            skyeye_exit(1);
+        }
+        ic->pc = pc;
+        ic->instr = instr;
+        ic->pi = pi;
     }
 
     cycles = (*pi->execute)(&sparc_state);
@@ -473,12 +524,136 @@ static void iu_isa_register(void)
         n_instructions += i_count[i];
 
     DBG("ISA: %d registered instructions\n", n_instructions);
+
+    iu_decode_build();
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  iu_decode_key
+ *  Description:  This function returns the index of an instruction word in
+ *  the decode table
+ * =====================================================================================
+ */
+static inline int iu_decode_key(uint32 instr)
+{
+    int format = bits(instr, 31, 30);
+
+    switch(format)
+    {
+        case BICC:
+            return (BICC << DECODE_KEY_BITS) | (bits(instr, 24, 22) << 4) | bits(instr, 28, 25);
+        case CALL:
+            return (CALL << DECODE_KEY_BITS);
+        default:
+            return (format << DECODE_KEY_BITS) | bits(instr, 24, 19);
+    }
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  iu_decode_probe
+ *  Description:  This function returns the n-th word with the opcode fields
+ *  of a decode table key, the other fields are varied from a probe to the
+ *  next one.
+ * =====================================================================================
+ */
+static uint32 iu_decode_probe(int key, int n)
+{
+    static const uint32 fill[4] = { 0x0, 0xffffffff, 0xaaaaaaaa, 0x55555555 };
+    int format = key >> DECODE_KEY_BITS;
+    uint32 field = key & ((1 << DECODE_KEY_BITS) - 1);
+    uint32 instr = (uint32)format << 30;
+
+    switch(format)
+    {
+        case BICC:
+            /*  op2, cond, the annul bit and disp22 */
+            instr |= ((field >> 4) << 22) | ((field & 0xf) << 25);
+            instr |= (n & 1) << 29;
+            instr |= fill[(n >> 1) & 3] & 0x3fffff;
+            break;
+        case CALL:
+            instr |= fill[n & 3] & 0x3fffffff;
+            break;
+        default:
+            /*  op3, rd, the i bit, rs1 and the low bits */
+            instr |= field << 19;
+            instr |= (n & 0x1f) << 25;
+            instr |= ((n >> 5) & 1) << 13;
+            instr |= fill[(n >> 6) & 1] & 0x7dfff;
+            break;
+    }
+    return instr;
+}
+
+static void iu_decode_add(struct _i_decode *d, int index)
+{
+    int n;
+
+    d->index = (int *)realloc(d->index, (d->count + 1) * sizeof(int));
+    if( !d->index )
+    {
+        DBG("%s(): Error extending the decode table\n", __func__);
+        d->count = 0;
+        return;
+    }
+
+    /*  keep the order of registration, the first match wins   */
+    for( n = d->count; n > 0 && d->index[n - 1] > index; --n )
+        d->index[n] = d->index[n - 1];
+    d->index[n] = index;
+    d->count++;
+}
+
+/* 
+ * ===  FUNCTION  ======================================================================
+ *         Name:  iu_decode_build
+ *  Description:  This function fills the decode table by trying the probe
+ *  words of every key against the registered instructions of its format.
+ *  An instruction missed by the probes is still found by iu_get_instr().
+ * =====================================================================================
+ */
+static void iu_decode_build(void)
+{
+    int key, i, n;
+    int format;
+
+    for( key = 0; key < DECODE_KEYS; ++key )
+    {
+        free(i_decode[key].index);
+        i_decode[key].index = NULL;
+        i_decode[key].count = 0;
+    }
+    memset(i_cache, 0, sizeof(i_cache));
+
+    for( key = 0; key < DECODE_KEYS; ++key )
+    {
+        format = key >> DECODE_KEY_BITS;
+        if( format == CALL && key != (CALL << DECODE_KEY_BITS) )
+            continue;
+        if( format != BICC && format != CALL && (key & ((1 << DECODE_KEY_BITS) - 1)) > 0x3f )
+            continue;
+
+        for( i = 0; i < i_count[format]; ++i )
+        {
+            for( n = 0; n < DECODE_PROBES; ++n )
+            {
+                if( i_set[format][i].instr->disassemble(iu_decode_probe(key, n), &sparc_state) )
+                {
+                    iu_decode_add(&i_decode[key], i);
+                    break;
+                }
+            }
+        }
+    }
 }
 
 static sparc_instruction_t *iu_get_instr(uint32 instr)
 {
-    int i;
+    int i, n;
     sparc_state_t *state = &sparc_state;
+    struct _i_decode *d;
     int format;
 
     format = bits(instr, 31, 30);
@@ -487,11 +662,25 @@ static sparc_instruction_t *iu_get_instr(uint32 instr)
 
     if( !state ) return NULL;
 
+    d = &i_decode[iu_decode_key(instr)];
+    for( n = 0; n < d->count; ++n )
+    {
+        i = d->index[n];
+        if( (i_set[format][i].instr) && i_set[format][i].instr->disassemble(instr, state) )
+            return i_set[format][i].instr;
+    }
+
+    /*  The probes did not find every instruction of this key, scan the rest */
     for( i = 0; i < i_count[format]; ++i )
     {
+        for( n = 0; n < d->count && d->index[n] != i; ++n )
+            ;
+        if( n < d->count )
+            continue;
         if( (i_set[format][i].instr) && i_set[format][i].instr->disassemble(instr, state) )
         {
 //            DBG("%s: opcode - 0x%x\n", __func__, i_set[i].instr->opcode_mask);
+            iu_decode_add(d, i);
             return i_set[format][i].instr;
         }
     }
@@ -30,6 +30,10 @@
 #include "skyeye_bus.h"
 #include "skyeye_pref.h"
 #include "skyeye_exec_info.h"
+#include "skyeye_ram.h"
+#include "skyeye_mm.h"
+#include "skyeye_log.h"
+#include "skyeye_cell.h"
 
 /**
 * @brief The global memory map
@@ -37,27 +41,139 @@
 static mem_config_t global_memmap;
 
 /**
-* @brief Get a memory bank for given address
+* @brief The page directory of the guest physical space, every
+* entry points to a table of BANK_DIR_SIZE pages allocated on demand.
+*/
+static bank_page_t *page_dir[BANK_DIR_SIZE];
+
+/**
+* @brief Get the page entry of an address in the page directory
+*
+* @param addr the guest physical address
+* @param alloc allocate the page table if it does not exist
+*
+* @return the page entry or NULL
+*/
+static bank_page_t *
+get_page_entry (uint32_t addr, int alloc)
+{
+	uint32_t dir_index = addr >> (BANK_PAGE_BITS + BANK_DIR_BITS);
+	if (page_dir[dir_index] == NULL) {
+		if (!alloc)
+			return NULL;
+		page_dir[dir_index] = skyeye_mm_zero(BANK_DIR_SIZE * sizeof(bank_page_t));
+		if (page_dir[dir_index] == NULL)
+			return NULL;
+	}
+	return &page_dir[dir_index][(addr >> BANK_PAGE_BITS) & (BANK_DIR_SIZE - 1)];
+}
+
+/**
+* @brief Find the bank by scanning the whole memory map, only used
+* for the pages that are shared by several banks.
 *
 * @param addr
 *
 * @return 
 */
-mem_bank_t *
-bank_ptr (uint32_t addr)
+static mem_bank_t *
+scan_bank (uint32_t addr)
 {
-	/* Try to reduce the time of find the right bank */
-	static mem_bank_t *mbp = NULL;
-	if (mbp) {
-		if (mbp->addr <= addr && (addr - mbp->addr) < mbp->len)
-			return (mbp);
-	}
+	mem_bank_t *mbp;
 	for (mbp = global_memmap.mem_banks; mbp->len; mbp++)
 		if (mbp->addr <= addr && (addr - mbp->addr) < mbp->len)
 			return (mbp);
 	return (NULL);
 }
 
+/**
+* @brief Fill the page entries covered by a bank. The bank inserted
+* first wins when the banks overlap, the same as the scan order.
+*
+* @param bank the bank in the global memory map
+*/
+void
+bank_map_pages (mem_bank_t *bank)
+{
+	uint64_t page_addr, end = (uint64_t)bank->addr + bank->len;
+	bank_page_t *page;
+
+	if (bank->len == 0)
+		return;
+	for (page_addr = bank->addr & ~BANK_PAGE_MASK; page_addr < end;
+			page_addr += BANK_PAGE_SIZE) {
+		page = get_page_entry((uint32_t)page_addr, 1);
+		if (page == NULL) {
+			skyeye_log(Error_log, __FUNCTION__, "Can not allocate page table for 0x%x\n", (uint32_t)page_addr);
+			return;
+		}
+		if (page->bank != NULL || (page->flags & BANK_PAGE_PARTIAL))
+			continue;
+		if (page_addr >= bank->addr && page_addr + BANK_PAGE_SIZE <= end)
+			page->bank = bank;
+		else
+			page->flags = BANK_PAGE_PARTIAL;
+	}
+}
+
+/**
+* @brief Record the host memory of a bank in its page entries,
+* so the ram access does not need to find the bank again.
+*
+* @param bank the bank in the global memory map
+* @param host the host memory of the first byte of the bank
+* @param writable the bank can be written directly
+*/
+void
+bank_map_host (mem_bank_t *bank, void *host, int writable)
+{
+	uint64_t page_addr, end = (uint64_t)bank->addr + bank->len;
+	bank_page_t *page;
+
+	for (page_addr = bank->addr & ~BANK_PAGE_MASK; page_addr < end;
+			page_addr += BANK_PAGE_SIZE) {
+		page = get_page_entry((uint32_t)page_addr, 0);
+		if (page == NULL || page->bank != bank)
+			continue;
+		page->host = (uint8_t *)host + (page_addr - bank->addr);
+		if (writable)
+			page->flags |= BANK_PAGE_WRITABLE;
+		else
+			page->flags &= ~BANK_PAGE_WRITABLE;
+	}
+}
+
+/**
+* @brief Get the page entry for given address
+*
+* @param addr
+*
+* @return the page entry, NULL if no bank is mapped there
+*/
+bank_page_t *
+bank_page_ptr (uint32_t addr)
+{
+	return get_page_entry(addr, 0);
+}
+
+/**
+* @brief Get a memory bank for given address
+*
+* @param addr
+*
+* @return 
+*/
+mem_bank_t *
+bank_ptr (uint32_t addr)
+{
+	bank_page_t *page = get_page_entry(addr, 0);
+	if (page == NULL)
+		return NULL;
+	if (page->flags & BANK_PAGE_PARTIAL)
+		return scan_bank(addr);
+	return page->bank;
+}
+
 uint64_t
 get_bank_size (uint32_t addr)
 {
@@ -81,12 +197,11 @@ get_bank_size (uint32_t addr)
 */
 int bus_read(short size, generic_address_t addr, uint32_t * value){
 	mem_bank_t * bank;
-	generic_arch_t* arch_instance = get_arch_instance("");
+	bank_page_t * page;
 
 	/* bypass the bank check */
-	sky_pref_t *pref = get_skyeye_pref();
 	/* in case of error, a seg fault will happen, I guess */
-	if (get_skyeye_exec_info()->mmap_access && pref->user_mode_sim) {
+	if (get_skyeye_exec_info()->mmap_access && get_skyeye_pref()->user_mode_sim) {
 		if (size == 8) {
 			*value = *(uint8_t *)(addr) & 0xff;
 		} else if (size == 16) {
@@ -97,15 +212,24 @@ int bus_read(short size, generic_address_t addr, uint32_t * value){
 		return 0;
 	} 
 		
-	if((bank = bank_ptr(addr)) && (bank->bank_read))
+	page = bank_page_ptr(addr);
+	if (page && page->host)
+		mem_read_page(page, size, addr, value);
+	else if((bank = bank_ptr(addr)) && (bank->bank_read)) {
+		smp_device_lock();
 		bank->bank_read(size, addr, value);
+		smp_device_unlock();
+	}
 	else{
-		SKYEYE_ERR( "Bus read error, can not find corresponding bank for addr 0x%x,pc=0x%x\n", addr, arch_instance->get_pc());
+		SKYEYE_ERR( "Bus read error, can not find corresponding bank for addr 0x%x,pc=0x%x\n", addr, get_arch_instance("")->get_pc());
 		return -1;
 		//skyeye_exit(-1);
 	}
-	bus_snoop(SIM_access_read, size ,addr, *value, After_act);
-	exec_callback(Bus_read_callback, arch_instance);
+	/* nobody listens to the bus in most of time, skip the record */
+	if (is_callback_armed(Bus_read_callback)) {
+		bus_snoop(SIM_access_read, size ,addr, *value, After_act);
+		exec_callback(Bus_read_callback, get_arch_instance(""));
+	}
 	return 0;	
 }
 
@@ -124,12 +248,11 @@ int bus_read(short size, generic_address_t addr, uint32_t * value){
 */
 int bus_write(short size, generic_address_t addr, uint32_t value){
 	mem_bank_t * bank;
-	generic_arch_t* arch_instance = get_arch_instance("");
+	bank_page_t * page;
 
-	sky_pref_t *pref = get_skyeye_pref();
 	/* bypass the bank check */
 	/* in case of error, a seg fault will happen, I guess */
-	if (get_skyeye_exec_info()->mmap_access && pref->user_mode_sim) {
+	if (get_skyeye_exec_info()->mmap_access && get_skyeye_pref()->user_mode_sim) {
 		if (size == 8) {
 			*(uint8_t *)(addr) = (value & 0xff);
 		} else if (size == 16) {
@@ -140,12 +263,20 @@ int bus_write(short size, generic_address_t addr, uint32_t value){
 		return 0;
 	}
 	
-	bus_snoop(SIM_access_write, size ,addr, value, Before_act);
-	exec_callback(Bus_write_callback, arch_instance);
-        if(bank = bank_ptr(addr))
+	if (is_callback_armed(Bus_write_callback)) {
+		bus_snoop(SIM_access_write, size ,addr, value, Before_act);
+		exec_callback(Bus_write_callback, get_arch_instance(""));
+	}
+	page = bank_page_ptr(addr);
+	if (page && (page->flags & BANK_PAGE_WRITABLE))
+		mem_write_page(page, size, addr, value);
+	else if(bank = bank_ptr(addr)) {
+		smp_device_lock();
                 bank->bank_write(size, addr, value);
+		smp_device_unlock();
+	}
         else{
-		SKYEYE_ERR( "Bus write error, can not find corresponding bank for addr 0x%x,pc=0x%x\n", addr, arch_instance->get_pc());
+		SKYEYE_ERR( "Bus write error, can not find corresponding bank for addr 0x%x,pc=0x%x\n", addr, get_arch_instance("")->get_pc());
 		//skyeye_exit(-1);
 	}
        return 0; 
@@ -155,7 +286,14 @@ int bus_write(short size, generic_address_t addr, uint32_t value){
 * @brief initialization of global memory map
 */
 void reset_global_memmap(){
+	int i;
 	memset(&global_memmap, 0, sizeof(mem_config_t));
+	for (i = 0; i < BANK_DIR_SIZE; i++) {
+		if (page_dir[i] != NULL) {
+			skyeye_free(page_dir[i]);
+			page_dir[i] = NULL;
+		}
+	}
 }
 
 /**
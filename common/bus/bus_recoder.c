@@ -22,18 +22,129 @@
  * 12/26/2009   Michael.Kang  <blackfin.kang@gmail.com>
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/time.h>
 #include "skyeye_bus.h"
+#include "skyeye_bus_trace.h"
+#include "skyeye_mm.h"
+#include "skyeye_log.h"
+#include "skyeye_exec.h"
+
+/* records in the ring of every core, power of two */
+#define BUS_TRACE_RING_SIZE	(1 << 16)
+#define BUS_TRACE_RING_MASK	(BUS_TRACE_RING_SIZE - 1)
+/* the drain thread is woken when a ring is filled up to this level */
+#define BUS_TRACE_RING_HIGH	(BUS_TRACE_RING_SIZE / 2)
+/* interval of the drain thread in millisecond */
+#define BUS_TRACE_DRAIN_MS	10
 
 /**
-* @brief The buffer for the memory record
+* @brief the bus record of a host thread. The ring is written by the
+* thread and read by the drain thread only, so no lock is needed between
+* them. A cell thread runs its cores one after another, so the core of a
+* record is the one running when it is written.
 */
-static bus_recorder_t buffer;
+typedef struct bus_trace_ring {
+	/* the last bus access of the core */
+	bus_recorder_t last;
+	bus_trace_rec_t *rec;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	/* the running core of the last record and its number */
+	void *core_obj;
+	uint8_t core;
+	struct bus_trace_ring *next;
+} bus_trace_ring_t;
+
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t ring_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static bus_trace_ring_t *ring_list;
+/* the cores numbered in the order of their first record */
+static void *core_list[BUS_TRACE_MAX_CORES];
+static int core_num;
 
+static volatile int trace_enabled;
+static volatile int drain_stop;
+static pthread_t drain_thread;
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_cond = PTHREAD_COND_INITIALIZER;
+static FILE *trace_fp;
+static bus_trace_codec_t trace_codec;
+
+static void create_ring_key(){
+	pthread_key_create(&ring_key, NULL);
+}
+
+/**
+* @brief Get the record ring of the calling thread, it is created at the
+* first bus access of the thread.
+*
+* @return the ring
+*/
+static bus_trace_ring_t *get_ring(){
+	bus_trace_ring_t *ring;
+	pthread_once(&ring_key_once, create_ring_key);
+	ring = pthread_getspecific(ring_key);
+	if (ring)
+		return ring;
+	ring = skyeye_mm_zero(sizeof(bus_trace_ring_t));
+	ring->rec = skyeye_mm(BUS_TRACE_RING_SIZE * sizeof(bus_trace_rec_t));
+	if (ring->rec == NULL) {
+		skyeye_log(Error_log, __FUNCTION__, "can not allocate the bus trace ring\n");
+		exit(-1);
+	}
+	pthread_mutex_lock(&ring_list_lock);
+	ring->next = ring_list;
+	ring_list = ring;
+	pthread_mutex_unlock(&ring_list_lock);
+	pthread_setspecific(ring_key, ring);
+	return ring;
+}
+
+/**
+* @brief Get the core running on the calling thread
+*
+* @param ring the ring of the calling thread
+*
+* @return the core object, or the ring itself for a thread that is not a
+* cell, such as a device thread
+*/
+static void *get_running_core(bus_trace_ring_t *ring){
+	conf_object_t *core = get_running_exec_priv();
+	return core != NULL ? (void *)core : (void *)ring;
+}
+
+/**
+* @brief Get the number of a core in the trace, a core is numbered at its
+* first record.
+*
+* @param core the core object
+*
+* @return the number of the core
+*/
+static uint8_t get_core_num(void *core){
+	int i;
+	pthread_mutex_lock(&ring_list_lock);
+	for (i = 0; i < core_num; i++)
+		if (core_list[i] == core)
+			break;
+	if (i == core_num && core_num < BUS_TRACE_MAX_CORES)
+		core_list[core_num++] = core;
+	pthread_mutex_unlock(&ring_list_lock);
+	return i % BUS_TRACE_MAX_CORES;
+}
 
 /**
 * @brief initialization of bus recorder
 */
 void init_bus_recorder(){
+	pthread_once(&ring_key_once, create_ring_key);
 }
 
 /**
@@ -46,11 +157,12 @@ void init_bus_recorder(){
 * @param when before or after of the bus activity
 */
 void bus_snoop(access_t rw, short size, int addr, uint32_t value, before_after_t when){
-	buffer.rw = rw;	
-	buffer.size = size;
-	buffer.addr = addr;
-	buffer.value = value;
-	buffer.when = when;
+	bus_recorder_t *buffer = &get_ring()->last;
+	buffer->rw = rw;	
+	buffer->size = size;
+	buffer->addr = addr;
+	buffer->value = value;
+	buffer->when = when;
 }
 
 /**
@@ -58,8 +170,163 @@ void bus_snoop(access_t rw, short size, int addr, uint32_t value, before_after_t
 *
 * @param rw The flag of read or write
 *
-* @return return the last bus record
+* @return return the last bus record of the calling core
 */
 bus_recorder_t* get_last_bus_access(access_t rw){
-	return &buffer;
+	return &get_ring()->last;
+}
+
+/**
+* @brief write the records of a ring to the trace file
+*
+* @param ring
+*/
+static void drain_ring(bus_trace_ring_t *ring){
+	uint8_t buf[4096];
+	int len = 0;
+	uint32_t tail = ring->tail;
+	uint32_t head = ring->head;
+	/* read the records after they are written */
+	__sync_synchronize();
+	while (tail != head) {
+		len += bus_trace_encode(&trace_codec, &ring->rec[tail & BUS_TRACE_RING_MASK], buf + len);
+		tail++;
+		if (len > sizeof(buf) - BUS_TRACE_MAX_ENCODED) {
+			fwrite(buf, 1, len, trace_fp);
+			len = 0;
+		}
+	}
+	if (len)
+		fwrite(buf, 1, len, trace_fp);
+	/* release the records to the core after they are read */
+	__sync_synchronize();
+	ring->tail = tail;
+}
+
+static void drain_all_rings(){
+	bus_trace_ring_t *ring;
+	pthread_mutex_lock(&ring_list_lock);
+	for (ring = ring_list; ring != NULL; ring = ring->next)
+		drain_ring(ring);
+	pthread_mutex_unlock(&ring_list_lock);
+}
+
+static void *bus_trace_drain(void *arg){
+	struct timeval now;
+	struct timespec timeout;
+	pthread_mutex_lock(&drain_lock);
+	while (!drain_stop) {
+		gettimeofday(&now, NULL);
+		timeout.tv_sec = now.tv_sec;
+		timeout.tv_nsec = now.tv_usec * 1000 + BUS_TRACE_DRAIN_MS * 1000000;
+		if (timeout.tv_nsec >= 1000000000) {
+			timeout.tv_sec++;
+			timeout.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&drain_cond, &drain_lock, &timeout);
+		pthread_mutex_unlock(&drain_lock);
+		drain_all_rings();
+		pthread_mutex_lock(&drain_lock);
+	}
+	pthread_mutex_unlock(&drain_lock);
+	return NULL;
+}
+
+/**
+* @brief Start to record the bus accesses of all the cores
+*
+* @param filename the trace file
+*
+* @return 0 if success
+*/
+int bus_trace_start(const char *filename){
+	bus_trace_header_t header;
+	bus_trace_ring_t *ring;
+
+	if (trace_enabled)
+		bus_trace_stop();
+	trace_fp = fopen(filename, "wb");
+	if (trace_fp == NULL) {
+		skyeye_log(Error_log, __FUNCTION__, "Can not open the file %s for bus trace.\n", filename);
+		return -1;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BUS_TRACE_MAGIC, sizeof(header.magic));
+	header.version = BUS_TRACE_VERSION;
+	fwrite(&header, sizeof(header), 1, trace_fp);
+	memset(&trace_codec, 0, sizeof(trace_codec));
+
+	/* drop the records of a previous trace */
+	pthread_mutex_lock(&ring_list_lock);
+	for (ring = ring_list; ring != NULL; ring = ring->next)
+		ring->tail = ring->head;
+	pthread_mutex_unlock(&ring_list_lock);
+
+	drain_stop = 0;
+	if (pthread_create(&drain_thread, NULL, bus_trace_drain, NULL)) {
+		skyeye_log(Error_log, __FUNCTION__, "Can not create the drain thread of bus trace.\n");
+		fclose(trace_fp);
+		trace_fp = NULL;
+		return -1;
+	}
+	trace_enabled = 1;
+	return 0;
+}
+
+/**
+* @brief Stop recording and flush the records left in the rings
+*/
+void bus_trace_stop(void){
+	if (!trace_enabled)
+		return;
+	trace_enabled = 0;
+	pthread_mutex_lock(&drain_lock);
+	drain_stop = 1;
+	pthread_cond_signal(&drain_cond);
+	pthread_mutex_unlock(&drain_lock);
+	pthread_join(drain_thread, NULL);
+	drain_all_rings();
+	fclose(trace_fp);
+	trace_fp = NULL;
+}
+
+/**
+* @brief Record the last bus access of the calling core in its ring, the
+* core waits for the drain thread when the ring is full.
+*
+* @param pc the pc of the access
+* @param icount the instruction count of the core
+*/
+void bus_trace_record(uint32_t pc, uint64_t icount){
+	bus_trace_ring_t *ring;
+	bus_trace_rec_t *rec;
+	uint32_t used;
+	void *core;
+
+	if (!trace_enabled)
+		return;
+	ring = get_ring();
+	core = get_running_core(ring);
+	if (core != ring->core_obj) {
+		ring->core_obj = core;
+		ring->core = get_core_num(core);
+	}
+	used = ring->head - ring->tail;
+	if (used >= BUS_TRACE_RING_HIGH) {
+		pthread_cond_signal(&drain_cond);
+		while (ring->head - ring->tail >= BUS_TRACE_RING_SIZE && trace_enabled)
+			sched_yield();
+	}
+	rec = &ring->rec[ring->head & BUS_TRACE_RING_MASK];
+	rec->icount = icount;
+	rec->pc = pc;
+	rec->addr = ring->last.addr;
+	rec->value = ring->last.value;
+	rec->size = ring->last.size;
+	rec->write = ring->last.rw == SIM_access_write;
+	rec->after = ring->last.when == After_act;
+	rec->core = ring->core;
+	/* publish the record after it is written */
+	__sync_synchronize();
+	ring->head++;
 }
@@ -23,6 +23,7 @@
 
 #include "skyeye_config.h"
 #include "skyeye_device.h"
+#include "skyeye_cell.h"
 
 /*
  *  7/17/2003     clean some routine.
@@ -32,7 +33,16 @@
 
 /* some machine need less number. e.g. s3c2440 only need DIVISOR = 1 to boot*/
 #define DIVISOR      (50)
-static int prescale = DIVISOR;
+/*
+ * The devices are driven by the thread scheduler and the io reactor now,
+ * only the ones with an update function or a mach_io_do_cycle are still
+ * polled here. io_poll_deadline is the cycle of the next poll, it is set
+ * to the end of time when nobody polls so that the per instruction cost
+ * is one compare. Both are per thread, every core running on its own
+ * thread counts its own cycles without sharing a cache line.
+ */
+static __thread uint64_t io_cycles;
+static __thread uint64_t io_poll_deadline = 0;
 
 void
 io_reset (void * state)
@@ -50,6 +60,9 @@ io_reset (void * state)
 		config->mach->mach_io_reset (state);
 	else
 		fprintf(stderr,"SKYEYE_ERR:mach_io_reset is NULL\n");
+	/* look for the polled devices again at the next cycle, the other
+	 * cores do it at their next deadline */
+	io_poll_deadline = 0;
 }
 
 void
@@ -62,18 +75,26 @@ io_do_cycle (void * state)
 	state->instr_count++;
 #endif	//DBCT_TEST_SPEED
 #endif
-	skyeye_config_t* config = get_current_config();
-	prescale--;
-	if (prescale < 0) {
-		prescale = DIVISOR;
-		for (i = 0; i < config->mach->dev_count; i++) {
-			dev = config->mach->devices[i];
-			if (dev->update)
-				dev->update (dev);
+	skyeye_config_t* config;
+	int polled = 0;
+
+	if (++io_cycles < io_poll_deadline)
+		return;
+	config = get_current_config();
+	smp_device_lock();
+	for (i = 0; i < config->mach->dev_count; i++) {
+		dev = config->mach->devices[i];
+		if (dev->update) {
+			dev->update (dev);
+			polled = 1;
 		}
-		if(config->mach->mach_io_do_cycle != NULL)
-			config->mach->mach_io_do_cycle (state);
 	}
+	if(config->mach->mach_io_do_cycle != NULL) {
+		config->mach->mach_io_do_cycle (state);
+		polled = 1;
+	}
+	smp_device_unlock();
+	io_poll_deadline = polled ? io_cycles + DIVISOR + 1 : (uint64_t)-1;
 }
 
 static uint32_t
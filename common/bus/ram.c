@@ -22,6 +22,7 @@
  * 12/16/2006   Michael.Kang  <blackfin.kang@gmail.com>
  */
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -44,38 +45,50 @@
 */
 static mem_state_t global_memory;
 
+/**
+* @brief The dirty flags of every guest page, the dirty flags of a bank are
+* its slice. The translators mark their direct stores in it by the page
+* number, with no bank lookup.
+*/
+static uint8_t dirty_map[1 << (32 - BANK_PAGE_BITS)];
+
+/**
+* @brief mark the page of an address written
+*
+* @param bank the bank of the address
+* @param addr the written address
+*/
+static inline void
+mem_set_dirty (mem_bank_t *bank, uint32_t addr)
+{
+	uint8_t *dirty = global_memory.dirty[bank - get_global_memmap()->mem_banks];
+	if (dirty)
+		dirty[(addr - bank->addr) >> BANK_PAGE_BITS] = MEM_DIRTY_ALL;
+}
+
 /**
 * @brief byte read function of ram
 *
+* @param bank the bank of the address
+* @param base the host memory of the bank
 * @param addr
 *
 * @return 
 */
 static uint32_t
-mem_read_byte (uint32_t addr)
+mem_read_byte (mem_bank_t *bank, uint8_t *base, uint32_t addr)
 {
 	uint32_t data, offset;
-	mem_bank_t * global_mbp = bank_ptr(addr);
-	if(global_mbp == NULL){
-		printf("Can not find the suitable bank for the address 0x%x\n", addr);
-		return 0;
-	}
-	mem_config_t * memmap = get_global_memmap();
-	mem_state_t * memory = get_global_memory();
 	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
 	/* judge the alignment */
 	if(arch_instance->alignment == Align)
 	{
-		data = memory->rom[global_mbp -
-			      	memmap->mem_banks][(addr -
-								   global_mbp->
-							   		addr) >> 2];
+		data = ((uint32_t *)base)[(addr - bank->addr) >> 2];
 	}
 	else if(arch_instance->alignment == UnAlign)
 	{
-		uint8_t *base = &global_memory.rom[global_mbp -memmap->mem_banks][0];
-		data = base[addr - global_mbp->addr];
+		data = base[addr - bank->addr];
 	}
 	/* judge the endianess */
 	if(arch_instance->endianess == Little_endian)
@@ -94,35 +107,26 @@ mem_read_byte (uint32_t addr)
 /**
 * @brief the half read function of the data
 *
+* @param bank the bank of the address
+* @param base the host memory of the bank
 * @param addr
 *
 * @return 
 */
 static uint32_t
-mem_read_halfword (uint32_t addr)
+mem_read_halfword (mem_bank_t *bank, uint8_t *base, uint32_t addr)
 {
 	uint32_t data, offset;
-	mem_bank_t * global_mbp = bank_ptr(addr);
-	if(global_mbp == NULL){
-		printf("Can not find the suitable bank for the address 0x%x\n", addr);
-		return 0;
-	}
-
-	mem_config_t * memmap = get_global_memmap();
 	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
 	/* judge the alignment */
 	if(arch_instance->alignment == Align)
 	{
-		data = global_memory.rom[global_mbp -
-				      memmap->mem_banks][(addr -
-								   global_mbp->
-								   addr) >> 2];
+		data = ((uint32_t *)base)[(addr - bank->addr) >> 2];
 	}
 	else if(arch_instance->alignment == UnAlign)
 	{
-		uint8_t *base = &global_memory.rom[global_mbp -memmap->mem_banks][0];
-		data = *(uint16_t *)(&base[addr - global_mbp->addr]);
+		data = *(uint16_t *)(&base[addr - bank->addr]);
 	}
 
 	/* judge the endianess */
@@ -142,35 +146,26 @@ mem_read_halfword (uint32_t addr)
 /**
 * @brief Word read of the ram
 *
+* @param bank the bank of the address
+* @param base the host memory of the bank
 * @param addr
 *
 * @return 
 */
 static uint32_t
-mem_read_word (uint32_t addr)
+mem_read_word (mem_bank_t *bank, uint8_t *base, uint32_t addr)
 {
 	uint32_t data;
-	mem_bank_t * global_mbp = bank_ptr(addr);
-	if(global_mbp == NULL){
-		printf("Can not find the suitable bank for the address 0x%x\n", addr);
-		return 0;
-	}
-
-	mem_config_t * memmap = get_global_memmap();
 	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
 	/* judge the alignment */
 	if(arch_instance->alignment == Align)
 	{
-		data = global_memory.rom[global_mbp -
-					  memmap->mem_banks][(addr -
-								   global_mbp->
-								   addr) >> 2];
+		data = ((uint32_t *)base)[(addr - bank->addr) >> 2];
 	}
 	else if(arch_instance->alignment == UnAlign)
 	{
-		uint8_t *base = &global_memory.rom[global_mbp -memmap->mem_banks][0];
-		data = *(uint32_t *)(&base[addr - global_mbp->addr]);
+		data = *(uint32_t *)(&base[addr - bank->addr]);
 	}
 
 	/* judge the endianess */
@@ -185,45 +180,32 @@ mem_read_word (uint32_t addr)
 /**
 * @brief the byte write of the ram
 *
+* @param bank the bank of the address
+* @param base the host memory of the bank
 * @param addr the written address
 * @param data the written data
 */
 static void
-mem_write_byte (uint32_t addr, uint32_t data)
+mem_write_byte (mem_bank_t *bank, uint8_t *base, uint32_t addr, uint32_t data)
 {
 	uint32_t *temp, offset;
+	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
-	mem_bank_t * global_mbp = bank_ptr(addr);
-	if(global_mbp == NULL){
-		printf("Can not find the suitable bank for the address 0x%x\n", addr);
-		return 0;
-	}
-
-	mem_config_t * memmap = get_global_memmap();
-	mem_state_t* memory = get_global_memory();
 #ifdef DBCT
 	if (!skyeye_config.no_dbct) {
 		//teawater add for arm2x86 2005.03.18----------------------------------
-		tb_setdirty (arch_instance, addr, global_mbp);
+		tb_setdirty (arch_instance, addr, bank);
 	}
 #endif
-	//printf("In %s, addr=0x%x,banks=0x%x,offset=0x%x\n", __FUNCTION__, addr, global_mbp - memmap->mem_banks, (addr - global_mbp-> addr) >> 2);
-	assert(global_mbp != NULL);
-	assert(memmap != NULL);	
-	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
 	/* judge the alignment */
 	if(arch_instance->alignment == Align)
 	{
-		temp = &global_memory.rom[global_mbp -
-					   memmap->mem_banks][(addr -
-									global_mbp->
-									addr) >> 2];
+		temp = &((uint32_t *)base)[(addr - bank->addr) >> 2];
 	}
 	else if(arch_instance->alignment == UnAlign)
 	{
-		uint8_t *base = &global_memory.rom[global_mbp -memmap->mem_banks][0];
-		temp = (uint32_t *)(&base[addr - global_mbp->addr]);
+		temp = (uint32_t *)(&base[addr - bank->addr]);
 	}
 
 	/* judge the endianess */
@@ -239,40 +221,31 @@ mem_write_byte (uint32_t addr, uint32_t data)
 /**
 * @brief the halfword write function
 *
+* @param bank the bank of the address
+* @param base the host memory of the bank
 * @param addr the written address
 * @param data the written data
 */
 static void
-mem_write_halfword (uint32_t addr, uint32_t data)
+mem_write_halfword (mem_bank_t *bank, uint8_t *base, uint32_t addr, uint32_t data)
 {
 	uint32_t *temp, offset;
-	mem_bank_t * global_mbp = bank_ptr(addr);
-	if(global_mbp == NULL){
-		printf("Can not find the suitable bank for the address 0x%x\n", addr);
-		return 0;
-	}
-
-	mem_config_t * memmap = get_global_memmap();
+	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
 #ifdef DBCT
 	if (!skyeye_config.no_dbct) {
-		tb_setdirty (arch_instance, addr, global_mbp);
+		tb_setdirty (arch_instance, addr, bank);
 	}
 #endif
-	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
 	/* judge the alignment */
 	if(arch_instance->alignment == Align)
 	{
-		temp = &global_memory.rom[global_mbp -
-					   memmap->mem_banks][(addr -
-									global_mbp->
-									addr) >> 2];
+		temp = &((uint32_t *)base)[(addr - bank->addr) >> 2];
 	}
 	else if(arch_instance->alignment == UnAlign)
 	{
-		uint8_t *base = &global_memory.rom[global_mbp -memmap->mem_banks][0];
-		temp = (uint32_t *)(&base[addr - global_mbp->addr]);
+		temp = (uint32_t *)(&base[addr - bank->addr]);
 	}
 
 	/* judge the endianess */
@@ -288,40 +261,32 @@ mem_write_halfword (uint32_t addr, uint32_t data)
 /**
 * @brief the word write function of the ram
 *
+* @param bank the bank of the address
+* @param base the host memory of the bank
 * @param addr the written address
 * @param data the written data
 */
 static void
-mem_write_word (uint32_t addr, uint32_t data)
+mem_write_word (mem_bank_t *bank, uint8_t *base, uint32_t addr, uint32_t data)
 {
 	uint32_t *temp;
-	mem_bank_t * global_mbp = bank_ptr(addr);
-	if(global_mbp == NULL){
-		printf("Can not find the suitable bank for the address 0x%x\n", addr);
-		return 0;
-	}
-
-	mem_config_t * memmap = get_global_memmap();
+	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
 #ifdef DBCT
 	if (!skyeye_config.no_dbct) {
 		//teawater add for arm2x86 2005.03.18----------------------------------
-		tb_setdirty (arch_instance, addr, global_mbp);
+		tb_setdirty (arch_instance, addr, bank);
 	}
 #endif
-	generic_arch_t* arch_instance = get_arch_instance(NULL);
 
 	/* judge the alignment */
 	if(arch_instance->alignment == Align)
 	{
-		temp = &global_memory.rom[global_mbp -
-				   		memmap->mem_banks][(addr -
-								global_mbp->addr) >> 2];
+		temp = &((uint32_t *)base)[(addr - bank->addr) >> 2];
 	}	
 	else if(arch_instance->alignment == UnAlign)
 	{
-		uint8_t *base = &global_memory.rom[global_mbp -memmap->mem_banks][0];
-		temp = (uint32_t *)(&base[addr - global_mbp->addr]);
+		temp = (uint32_t *)(&base[addr - bank->addr]);
 	}
 
 	/* judge the endianess */
@@ -330,6 +295,34 @@ mem_write_word (uint32_t addr, uint32_t data)
 	else if(arch_instance->endianess == Big_endian)
 		*temp = word_to_BE(data);
 }
+
+/**
+* @brief Get the host memory of the bank for an address
+*
+* @param addr the guest address
+* @param bank return the bank of the address
+*
+* @return the host memory of the first byte of the bank, NULL if not found
+*/
+static uint8_t *
+mem_bank_base (uint32_t addr, mem_bank_t **bank)
+{
+	bank_page_t *page = bank_page_ptr(addr);
+	mem_config_t * memmap = get_global_memmap();
+
+	/* the page entry has already recorded the host memory */
+	if (page && page->host) {
+		*bank = page->bank;
+		return page->host - ((addr & ~BANK_PAGE_MASK) - page->bank->addr);
+	}
+	*bank = bank_ptr(addr);
+	if (*bank == NULL) {
+		printf("Can not find the suitable bank for the address 0x%x\n", addr);
+		return NULL;
+	}
+	return (uint8_t *)global_memory.rom[*bank - memmap->mem_banks];
+}
+
 /*
  * allocate memory space for the banks
  */
@@ -376,6 +369,11 @@ mem_reset ()
 		if (global_memory.rom[bank]){
 			skyeye_free (global_memory.rom[bank]);
 		}
+		if (global_memory.dirty[bank]){
+			if (global_memory.dirty[bank] < dirty_map || global_memory.dirty[bank] >= dirty_map + sizeof(dirty_map))
+				skyeye_free (global_memory.dirty[bank]);
+			global_memory.dirty[bank] = NULL;
+		}
 		global_memory.rom_size[bank] = 0;
 		//chy 2003-09-21: if mem type =MEMTYPE_IO, we need not malloc space for it.
 		global_memory.rom_size[bank] = mb[bank].len;
@@ -486,67 +484,155 @@ mem_reset ()
 
 
 
+		/* every page is dirty until every client has seen it once */
+		if (mb[bank].addr & BANK_PAGE_MASK) {
+			skyeye_log(Warning_log, __FUNCTION__, "bank %d at 0x%x is not page aligned, the direct stores of the translators to it are not tracked.\n", bank, mb[bank].addr);
+			global_memory.dirty[bank] = skyeye_mm (MEM_PAGE_NUM(mb[bank].len));
+		}
+		else
+			global_memory.dirty[bank] = &dirty_map[mb[bank].addr >> BANK_PAGE_BITS];
+		if (global_memory.dirty[bank])
+			memset(global_memory.dirty[bank], MEM_DIRTY_ALL, MEM_PAGE_NUM(mb[bank].len));
+
+		/* only the banks handled by ram can be accessed directly through the page */
+		if (mb[bank].type == MEMTYPE_RAM || mb[bank].type == MEMTYPE_ROM)
+			bank_map_host(&mb[bank], global_memory.rom[bank],
+					mb[bank].type == MEMTYPE_RAM);
 	}/*end  for(i = 0;i < num; i++) */
 
 	return No_exp;
 }
 
 /**
-* @brief The generic memory read function
+* @brief read the ram with the known bank and host memory
 *
+* @param bank the bank of the address
+* @param base the host memory of the bank
 * @param size data width
-* @param offset data offset
+* @param addr data address
 * @param value the return value of read from
 *
 * @return the flash used to indicate the success or failure
 */
-int mem_read(short size, int offset, uint32_t * value){
-	void * state;
+static int
+ram_read (mem_bank_t *bank, uint8_t *base, short size, uint32_t addr, uint32_t *value)
+{
 	switch(size){
 		case 8:
-			*value = (uint8_t)mem_read_byte (offset);
+			*value = (uint8_t)mem_read_byte (bank, base, addr);
 			break;
 		case 16:
-			*value = (uint16_t)mem_read_halfword(offset);
+			*value = (uint16_t)mem_read_halfword(bank, base, addr);
 			break;
 		case 32:
-			*value = mem_read_word(offset);
+			*value = mem_read_word(bank, base, addr);
 			break;
 		default:
 			fprintf(stderr, "In %s, invalid data length %d\n", __FUNCTION__, size);
 			return -1;
 	}
 	return 0;
-
 }
 
 /**
-* @brief the write function of the ram
+* @brief write the ram with the known bank and host memory
 *
+* @param bank the bank of the address
+* @param base the host memory of the bank
 * @param size the data width
-* @param offset the data offset
+* @param addr the data address
 * @param value the data value written to
 *
 * @return the flag
 */
-int mem_write(short size, int offset, uint32_t value){
+static int
+ram_write (mem_bank_t *bank, uint8_t *base, short size, uint32_t addr, uint32_t value)
+{
+	mem_set_dirty(bank, addr);
 	switch(size){
 		case 8:
-                        mem_write_byte (offset, value);
-                        break;
-                case 16:
-                        mem_write_halfword(offset, value);
-                        break;
-                case 32:
-                        mem_write_word(offset, value);
-                        break;
-                default:
+			mem_write_byte (bank, base, addr, value);
+			break;
+		case 16:
+			mem_write_halfword(bank, base, addr, value);
+			break;
+		case 32:
+			mem_write_word(bank, base, addr, value);
+			break;
+		default:
 			fprintf(stderr, "In %s, invalid data length %d\n", __FUNCTION__, size);
-                        return -1;
+			return -1;
 	}
 	return 0;
 }
 
+/**
+* @brief The generic memory read function
+*
+* @param size data width
+* @param offset data offset
+* @param value the return value of read from
+*
+* @return the flash used to indicate the success or failure
+*/
+int mem_read(short size, int offset, uint32_t * value){
+	mem_bank_t *bank;
+	uint8_t *base = mem_bank_base(offset, &bank);
+	if (base == NULL) {
+		*value = 0;
+		return -1;
+	}
+	return ram_read(bank, base, size, offset, value);
+}
+
+/**
+* @brief the write function of the ram
+*
+* @param size the data width
+* @param offset the data offset
+* @param value the data value written to
+*
+* @return the flag
+*/
+int mem_write(short size, int offset, uint32_t value){
+	mem_bank_t *bank;
+	uint8_t *base = mem_bank_base(offset, &bank);
+	if (base == NULL)
+		return -1;
+	return ram_write(bank, base, size, offset, value);
+}
+
+/**
+* @brief read the ram through a page entry found by the bus,
+* the bank is not looked up again.
+*
+* @param page the page entry with host memory
+* @param size data width
+* @param addr data address
+* @param value the return value of read from
+*
+* @return the flash used to indicate the success or failure
+*/
+int mem_read_page(bank_page_t *page, short size, uint32_t addr, uint32_t *value){
+	uint8_t *base = page->host - ((addr & ~BANK_PAGE_MASK) - page->bank->addr);
+	return ram_read(page->bank, base, size, addr, value);
+}
+
+/**
+* @brief write the ram through a page entry found by the bus
+*
+* @param page the page entry with host memory
+* @param size the data width
+* @param addr the data address
+* @param value the data value written to
+*
+* @return the flag
+*/
+int mem_write_page(bank_page_t *page, short size, uint32_t addr, uint32_t value){
+	uint8_t *base = page->host - ((addr & ~BANK_PAGE_MASK) - page->bank->addr);
+	return ram_write(page->bank, base, size, addr, value);
+}
+
 /* 
  * Here, we translate an address from guest machine 
  * to the address of host machine, you can use it as dma transfer. 
@@ -594,6 +680,230 @@ unsigned long get_dma_addr(unsigned long guest_addr){
 }
 
 
+/**
+* @brief mark a range of memory written, used by the code writing the
+* host memory directly instead of through the bus
+*
+* @param addr the start guest address
+* @param len the length of the range
+*/
+void mem_mark_dirty(uint32_t addr, uint32_t len){
+	mem_config_t * memmap = get_global_memmap();
+	uint64_t a, end = (uint64_t)addr + len;
+	uint8_t *dirty;
+	mem_bank_t *bank;
+
+	for (a = addr; a < end; a = (a & ~BANK_PAGE_MASK) + BANK_PAGE_SIZE) {
+		bank = bank_ptr((uint32_t)a);
+		if (bank && (dirty = global_memory.dirty[bank - memmap->mem_banks]))
+			dirty[((uint32_t)a - bank->addr) >> BANK_PAGE_BITS] = MEM_DIRTY_ALL;
+	}
+}
+
+/**
+* @brief check if a range of memory is written since the client reset it
+*
+* @param addr the start guest address
+* @param len the length of the range
+* @param flags the MEM_DIRTY_* flags of the client
+*
+* @return nonzero if a page of the range has one of flags, a page without
+* dirty tracking is always dirty
+*/
+int mem_get_dirty(uint32_t addr, uint32_t len, int flags){
+	mem_config_t * memmap = get_global_memmap();
+	uint64_t a, end = (uint64_t)addr + len;
+	uint8_t *dirty;
+	mem_bank_t *bank;
+
+	for (a = addr; a < end; a = (a & ~BANK_PAGE_MASK) + BANK_PAGE_SIZE) {
+		bank = bank_ptr((uint32_t)a);
+		if (bank == NULL || (dirty = global_memory.dirty[bank - memmap->mem_banks]) == NULL)
+			return 1;
+		if (dirty[((uint32_t)a - bank->addr) >> BANK_PAGE_BITS] & flags)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+* @brief clear the flags of a client for a range of memory
+*
+* @param addr the start guest address
+* @param len the length of the range, every page it touches is reset
+* @param flags the MEM_DIRTY_* flags of the client
+*/
+void mem_reset_dirty(uint32_t addr, uint32_t len, int flags){
+	mem_config_t * memmap = get_global_memmap();
+	uint64_t a, end = (uint64_t)addr + len;
+	uint8_t *dirty;
+	mem_bank_t *bank;
+
+	for (a = addr; a < end; a = (a & ~BANK_PAGE_MASK) + BANK_PAGE_SIZE) {
+		bank = bank_ptr((uint32_t)a);
+		if (bank && (dirty = global_memory.dirty[bank - memmap->mem_banks]))
+			dirty[((uint32_t)a - bank->addr) >> BANK_PAGE_BITS] &= ~flags;
+	}
+}
+
+/**
+* @brief get and clear the flags of a client for the page of an address,
+* a write racing with the client is never lost.
+*
+* @param addr the guest address
+* @param flags the MEM_DIRTY_* flags of the client
+*
+* @return the flags of the page that were set, flags for a page without
+* dirty tracking
+*/
+int mem_test_and_reset_dirty(uint32_t addr, int flags){
+	mem_config_t * memmap = get_global_memmap();
+	mem_bank_t *bank = bank_ptr(addr);
+	uint8_t *dirty;
+
+	if (bank == NULL || (dirty = global_memory.dirty[bank - memmap->mem_banks]) == NULL)
+		return flags;
+	return __sync_fetch_and_and(&dirty[(addr - bank->addr) >> BANK_PAGE_BITS], (uint8_t)~flags) & flags;
+}
+
+/**
+* @brief get the dirty flags of the page of an address, for a client that
+* polls them on a hot path and can not afford the bank lookup each time
+*
+* @param addr the guest address
+*
+* @return the flags of the page, NULL for a page without dirty tracking
+*/
+uint8_t *mem_dirty_flags(uint32_t addr){
+	mem_config_t * memmap = get_global_memmap();
+	mem_bank_t *bank = bank_ptr(addr);
+	uint8_t *dirty;
+
+	if (bank == NULL || (dirty = global_memory.dirty[bank - memmap->mem_banks]) == NULL)
+		return NULL;
+	return &dirty[(addr - bank->addr) >> BANK_PAGE_BITS];
+}
+
+/**
+* @brief get the dirty flags of all the guest pages, for the translators that
+* emit the dirty store of their direct stores inline. The flags of a page
+* are at the index addr >> BANK_PAGE_BITS, the pages outside the ram banks
+* are never read.
+*
+* @return the map of the dirty flags
+*/
+uint8_t *mem_dirty_map(void){
+	return dirty_map;
+}
+
+/**
+* @brief Get the host memory of a guest physical range that can be copied
+* directly. The host memory of a ram bank keeps the bytes in the guest
+* order, so a range inside one ram or rom bank needs no bus access.
+*
+* @param addr the start guest address
+* @param len the length of the range
+*
+* @return the host address of addr, NULL if the range must go through the bus
+*/
+uint8_t *mem_block_host(uint32_t addr, uint32_t len){
+	mem_config_t * memmap = get_global_memmap();
+	mem_bank_t *bank;
+	uint8_t *base;
+
+	if(get_skyeye_exec_info()->mmap_access)
+		return (uint8_t *)(unsigned long)addr;
+	bank = bank_ptr(addr);
+	if(bank == NULL || (bank->type != MEMTYPE_RAM && bank->type != MEMTYPE_ROM))
+		return NULL;
+	if((uint64_t)addr + len > (uint64_t)bank->addr + bank->len)
+		return NULL;
+	base = (uint8_t *)global_memory.rom[bank - memmap->mem_banks];
+	if(base == NULL)
+		return NULL;
+	return base + (addr - bank->addr);
+}
+
+/**
+* @brief copy or fill a guest physical range bank by bank, the ram banks
+* are accessed with memcpy/memset and the others byte by byte through
+* their bank_write.
+*
+* @param addr the start guest address
+* @param buf the source buffer, NULL to fill with c
+* @param c the filled byte
+* @param len the length of the range
+*
+* @return No_exp on success, Excess_range_exp if some address has no bank
+*/
+static exception_t mem_block_access(uint32_t addr, const uint8_t *buf, int c, uint32_t len){
+	mem_bank_t *bank;
+	uint8_t *host;
+	uint64_t chunk;
+	uint32_t i;
+
+	if(get_skyeye_exec_info()->mmap_access){
+		if(buf)
+			memcpy((void *)(unsigned long)addr, buf, len);
+		else
+			memset((void *)(unsigned long)addr, c, len);
+		return No_exp;
+	}
+	while(len > 0){
+		bank = bank_ptr(addr);
+		if(bank == NULL){
+			skyeye_log(Error_log, __FUNCTION__, "Can not find the bank for the address 0x%x\n", addr);
+			return Excess_range_exp;
+		}
+		chunk = (uint64_t)bank->addr + bank->len - addr;
+		if(chunk > len)
+			chunk = len;
+		host = mem_block_host(addr, chunk);
+		if(host){
+			if(buf)
+				memcpy(host, buf, chunk);
+			else
+				memset(host, c, chunk);
+			mem_mark_dirty(addr, chunk);
+		}
+		else{
+			for(i = 0; i < chunk; i++)
+				bank->bank_write(8, addr + i, buf ? buf[i] : (uint8_t)c);
+		}
+		addr += chunk;
+		len -= chunk;
+		if(buf)
+			buf += chunk;
+	}
+	return No_exp;
+}
+
+/**
+* @brief copy a buffer to the guest physical memory
+*
+* @param addr the start guest address
+* @param buf the buffer
+* @param len the length of the buffer
+*
+* @return the exception
+*/
+exception_t mem_write_block(uint32_t addr, const void *buf, uint32_t len){
+	return mem_block_access(addr, buf, 0, len);
+}
+
+/**
+* @brief fill the guest physical memory with a byte
+*
+* @param addr the start guest address
+* @param c the byte
+* @param len the length of the range
+*
+* @return the exception
+*/
+exception_t mem_set_block(uint32_t addr, int c, uint32_t len){
+	return mem_block_access(addr, NULL, c, len);
+}
+
 /**
 * @brief the warnning function of the read-only memory
 *
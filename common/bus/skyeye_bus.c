@@ -66,8 +66,7 @@ static void insert_bank(mem_bank_t* bank);
 */
 void init_bus(){
 	register_option("mem_bank", do_mem_bank_option, "");
-	mem_config_t *mc = get_global_memmap();
-	memset(mc, 0, sizeof(mem_config_t));
+	reset_global_memmap();
 	//register_option("mem_bank", do_bus_bank_option, "");
 }
 
@@ -112,6 +111,7 @@ static void insert_bank(mem_bank_t* bank){
 	mb[num].bank_write = bank->bank_write; 
 	mb[num].bank_read = bank->bank_read; 
 	mb[num].type = bank->type;
+	bank_map_pages(&mb[num]);
 }
 
 /**
@@ -39,6 +39,12 @@ typedef struct callback_queue{
 */
 callback_queue_t callbacks[Max_callback];
 
+/**
+* @brief the flag of every callback kind, non-zero when at least one
+* function is registered, so the hot path can skip the queue scan.
+*/
+int callback_armed[Max_callback];
+
 /**
 * @brief initilization of the given callback
 *
@@ -53,6 +59,7 @@ static void init_callback_queue(callback_kind_t kind){
 	queue->kind = kind;
 	queue->func = NULL;
 	queue->next = NULL;
+	callback_armed[kind] = 0;
 }
 
 /**
@@ -87,9 +94,6 @@ static exception_t add_callback_func(callback_func_t func, callback_kind_t kind)
 	return No_exp;
 }
 
-/* remove a callback function from queue */
-static void remove_callback(){
-}
 
 /**
 * @brief initializtion of callback module
@@ -120,7 +124,30 @@ void register_callback(callback_func_t func, callback_kind_t kind){
 		return;
 	}
 	/* put func to the corresponding queue */	
-	add_callback_func(func, kind);
+	if(add_callback_func(func, kind) == No_exp)
+		callback_armed[kind] = 1;
+}
+
+/**
+* @brief Remove a callback handler from a given callback queue, the kind is
+* disarmed when no handler is left. The node is kept and only its function
+* is cleared, so a core scanning the queue at the same time is safe.
+*
+* @param func the callback function
+* @param kind the callback type
+*/
+void unregister_callback(callback_func_t func, callback_kind_t kind){
+	callback_queue_t* queue;
+	int armed = 0;
+	if(kind >= Max_callback)
+		return;
+	for(queue = &callbacks[kind]; queue; queue = queue->next){
+		if(queue->func == func)
+			queue->func = NULL;
+		else if(queue->func != NULL)
+			armed = 1;
+	}
+	callback_armed[kind] = armed;
 }
 
 /**
@@ -133,6 +160,8 @@ void register_callback(callback_func_t func, callback_kind_t kind){
 */
 int exec_callback(callback_kind_t kind, generic_arch_t* arch_instance){
 	callback_queue_t* queue = &callbacks[kind];
+	if(!callback_armed[kind])
+		return No_exp;
 	while(queue){
 		callback_func_t func = queue->func;
 		if(func != NULL)
@@ -142,3 +171,31 @@ int exec_callback(callback_kind_t kind, generic_arch_t* arch_instance){
 
 	return No_exp;
 }
+
+/**
+* @brief the block callback, only one tool can own it at a time
+*/
+block_callback_func_t block_callback = NULL;
+
+/**
+* @brief non-zero when the running engine reports every block it runs to the
+* block callback, so a tool can drop its per instruction callbacks
+*/
+int block_callback_provided = 0;
+
+/**
+* @brief called by an engine that reports every block it runs
+*/
+void provide_block_callback(void){
+	block_callback_provided = 1;
+}
+
+/**
+* @brief set the function called when a basic block is entered by a block
+* based engine
+*
+* @param func the callback function, NULL to disarm it
+*/
+void register_block_callback(block_callback_func_t func){
+	block_callback = func;
+}
@@ -68,27 +68,23 @@ void save_chp(char *arg)
 		strcpy(dir, arg);
 	}
 
-	save_mem_to_file(dir);
-
-	if(access(dir, 0) == -1){
-		if(mkdir(dir, 0777)){
-			skyeye_log(Warning_log, __func__, "create dir %s failed\n", dir);
-			return;
-		}
-	}
+	if(save_mem_incremental(dir) != No_exp)
+		return;
 
 	strcat(dir,"/config");
 
 	//fp = fopen("config", "wb");
 	fp = fopen(dir, "wb");
-	if(fp == NULL)
+	if(fp == NULL){
 		skyeye_log(Warning_log, __func__, "can't create file %s\n",dir);
+		return;
+	}
 	/* check for difference archtecture */
 	for( p = chp_data_list.head; p != NULL; p = p->next){
 		ret = 0;
 		fprintf(fp, "%s=%d\n", p->name, p->size);
 		do{
-			ret += fwrite(p->data + ret, 1, p->size, fp);
+			ret += fwrite(p->data + ret, 1, p->size - ret, fp);
 		}while(p->size - ret > 0);
 
 		fprintf(fp,"\n");
@@ -106,10 +102,10 @@ void save_chp(char *arg)
 void load_chp(char *arg)
 {
 	chp_data *p;
-	int ret,i;
+	int ret,i,size;
 	FILE *fp;
 	char dir[100];
-	char tmp[100],tmp2[100];
+	char tmp[100];
 
 	if(arg == NULL || *arg == '\0'){
 		strcpy(dir,"default");
@@ -117,7 +113,7 @@ void load_chp(char *arg)
 		strcpy(dir, arg);
 	}
 
-	load_mem_from_file(dir);
+	load_mem_incremental(dir);
 
 	strcat(dir,"/config");
 	//fp = fopen("config", "rb");
@@ -129,21 +125,26 @@ void load_chp(char *arg)
 
 	/* check for difference archtecture */
 	while(fgets(tmp, 100, fp) != NULL){
+		/* every record is "name=size\n", the data and "\n" */
+		char *sep = strrchr(tmp, '=');
+		if(sep == NULL)
+			continue;
+		*sep = '\0';
+		size = atoi(sep + 1);
 		for( p = chp_data_list.head; p != NULL; p = p->next){
-			ret = 0;
-			sprintf(tmp2, "%s=%d\n", p->name, p->size);
-
-			if(!strcmp(tmp2, tmp)){
-				do{
-					ret += fread(p->data + ret, 1, p->size, fp);
-				}while(p->size - ret > 0);
-
+			if(p->size == size && !strcmp(p->name, tmp))
 				break;
-			}else
-				continue;
 		}
-		memset(tmp, 0, 100);
-		memset(tmp2, 0, 100);
+		if(p == NULL){
+			/* skip the data not registered, instead of parsing it as lines */
+			fseek(fp, size + 1, SEEK_CUR);
+			continue;
+		}
+		ret = 0;
+		do{
+			ret += fread(p->data + ret, 1, p->size - ret, fp);
+		}while(p->size - ret > 0 && !feof(fp));
+		fgetc(fp);
 	}
 
 	fclose(fp);
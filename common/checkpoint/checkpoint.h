@@ -50,4 +50,7 @@ typedef struct chp_list{
 	int num;
 }chp_list;
 
+exception_t save_mem_incremental(char *dir);
+exception_t load_mem_incremental(char *dir);
+
 #endif
@@ -0,0 +1,446 @@
+/* Copyright (C)
+* 2011 - Michael.Kang
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not, write to the Free Software
+* Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*
+*/
+/**
+* @file chp_store.c
+* @brief The incremental memory image of the checkpoint
+*
+* Every page of the memory is saved once by its sha1 digest in
+* pages.pack of the checkpoint directory, pages.idx records the digest and
+* the offset of every saved page. ramN.manifest lists the page of every
+* offset of bank N. Only the pages written since the previous checkpoint
+* are hashed again, and only the pages never seen before are appended to
+* the pack, so a checkpoint costs about the memory written since the last
+* one. When restoring, the pack is mapped and only the pages that differ
+* from the current memory are copied.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "skyeye_types.h"
+#include "skyeye_ram.h"
+#include "skyeye_mm.h"
+#include "skyeye_log.h"
+#include "bank_defs.h"
+#include "portable/mman.h"
+#include "checkpoint.h"
+#include "dyncom/sha1.h"
+
+#define CHP_MANIFEST_MAGIC	"SKYCHP01"
+#define CHP_NO_OFFSET		((uint64_t)-1)
+#define CHP_INDEX_INIT_SIZE	(1 << 16)
+
+/**
+* @brief the entry of the manifest and of the page index
+*/
+typedef struct chp_page {
+	uint8_t digest[SHA_DIGEST_LENGTH];
+	uint32_t reserved;
+	uint64_t offset;
+} chp_page_t;
+
+typedef struct chp_manifest_header {
+	char magic[8];
+	uint32_t bank;
+	uint32_t size;
+	uint32_t page_num;
+	uint32_t reserved;
+} chp_manifest_header_t;
+
+/**
+* @brief the page index of the opened checkpoint directory
+*/
+typedef struct chp_store {
+	char dir[256];
+	FILE *pack;
+	FILE *idx;
+	uint64_t pack_size;
+	chp_page_t *index;
+	uint32_t mask;
+	uint32_t num;
+} chp_store_t;
+
+static chp_store_t store;
+
+/* the digest of every page as it was at the last save or load */
+static chp_page_t *page_digest[ROM_BANKS];
+static uint8_t *digest_valid[ROM_BANKS];
+
+static inline uint32_t digest_hash(const uint8_t *digest)
+{
+	uint32_t h;
+	memcpy(&h, digest, sizeof(h));
+	return h;
+}
+
+static chp_page_t *index_lookup(const uint8_t *digest)
+{
+	uint32_t i = digest_hash(digest) & store.mask;
+	while (store.index[i].offset != CHP_NO_OFFSET) {
+		if (!memcmp(store.index[i].digest, digest, SHA_DIGEST_LENGTH))
+			return &store.index[i];
+		i = (i + 1) & store.mask;
+	}
+	return &store.index[i];
+}
+
+static exception_t index_alloc(uint32_t size)
+{
+	uint32_t i;
+	store.index = skyeye_mm(size * sizeof(chp_page_t));
+	if (store.index == NULL)
+		return Malloc_exp;
+	for (i = 0; i < size; i++)
+		store.index[i].offset = CHP_NO_OFFSET;
+	store.mask = size - 1;
+	store.num = 0;
+	return No_exp;
+}
+
+/* double the index, the entries are moved to the slots of the new size */
+static exception_t index_grow()
+{
+	chp_page_t *old = store.index;
+	uint32_t i, old_size = store.mask + 1, old_num = store.num;
+	if (index_alloc(old_size << 1) != No_exp) {
+		store.index = old;
+		store.mask = old_size - 1;
+		store.num = old_num;
+		return Malloc_exp;
+	}
+	for (i = 0; i < old_size; i++)
+		if (old[i].offset != CHP_NO_OFFSET)
+			*index_lookup(old[i].digest) = old[i];
+	store.num = old_num;
+	skyeye_free(old);
+	return No_exp;
+}
+
+static exception_t index_insert(const uint8_t *digest, uint64_t offset)
+{
+	chp_page_t *entry;
+	if ((store.num + 1) * 2 > store.mask + 1 && index_grow() != No_exp)
+		return Malloc_exp;
+	entry = index_lookup(digest);
+	if (entry->offset == CHP_NO_OFFSET) {
+		memcpy(entry->digest, digest, SHA_DIGEST_LENGTH);
+		entry->offset = offset;
+		store.num++;
+	}
+	return No_exp;
+}
+
+static void close_store()
+{
+	if (store.pack)
+		fclose(store.pack);
+	if (store.idx)
+		fclose(store.idx);
+	if (store.index)
+		skyeye_free(store.index);
+	memset(&store, 0, sizeof(store));
+}
+
+/**
+* @brief open the page store of a checkpoint directory and load its index
+*
+* @param dir the checkpoint directory
+* @param create create the store if it does not exist
+*
+* @return the exception
+*/
+static exception_t open_store(const char *dir, int create)
+{
+	char buf[300];
+	chp_page_t entry;
+	struct stat st;
+	uint32_t idx_num = 0;
+
+	if (store.pack && !strcmp(store.dir, dir))
+		return No_exp;
+	close_store();
+
+	if (create && access(dir, 0) == -1 && mkdir(dir, 0777)) {
+		skyeye_log(Warning_log, __func__, "create dir %s failed\n", dir);
+		return File_open_exp;
+	}
+	snprintf(buf, sizeof(buf), "%s/pages.pack", dir);
+	store.pack = fopen(buf, "r+b");
+	if (store.pack == NULL && create)
+		store.pack = fopen(buf, "w+b");
+	snprintf(buf, sizeof(buf), "%s/pages.idx", dir);
+	store.idx = fopen(buf, "r+b");
+	if (store.idx == NULL && create)
+		store.idx = fopen(buf, "w+b");
+	if (store.pack == NULL || store.idx == NULL) {
+		skyeye_log(Warning_log, __func__, "can't open the page store in %s\n", dir);
+		close_store();
+		return File_open_exp;
+	}
+	if (index_alloc(CHP_INDEX_INIT_SIZE) != No_exp) {
+		close_store();
+		return Malloc_exp;
+	}
+	fstat(fileno(store.pack), &st);
+	/* new pages are appended after all the data of the pack, even after
+	 * the pages of the entries dropped below */
+	store.pack_size = st.st_size;
+	/* drop the pages whose data did not reach the pack */
+	while (fread(&entry, sizeof(entry), 1, store.idx) == 1) {
+		if (entry.offset + BANK_PAGE_SIZE > store.pack_size)
+			break;
+		index_insert(entry.digest, entry.offset);
+		idx_num++;
+	}
+	fseek(store.idx, (long)idx_num * sizeof(entry), SEEK_SET);
+	strncpy(store.dir, dir, sizeof(store.dir) - 1);
+	return No_exp;
+}
+
+static void page_sha1(const uint8_t *page, uint32_t len, uint8_t *digest)
+{
+	SHA1_CTX ctx;
+	SHA1Init(&ctx);
+	SHA1Update(&ctx, page, len);
+	SHA1Final(digest, &ctx);
+}
+
+static exception_t alloc_digest(int bank, uint32_t page_num)
+{
+	if (page_digest[bank])
+		return No_exp;
+	page_digest[bank] = skyeye_mm(page_num * sizeof(chp_page_t));
+	digest_valid[bank] = skyeye_mm_zero(page_num);
+	if (page_digest[bank] == NULL || digest_valid[bank] == NULL)
+		return Malloc_exp;
+	return No_exp;
+}
+
+/**
+* @brief save the pages of a bank to the store and write its manifest
+*
+* @param dir the checkpoint directory
+* @param bank the bank index
+* @param mem the global memory
+*
+* @return the exception
+*/
+static exception_t save_bank(const char *dir, int bank, mem_state_t *mem)
+{
+	uint8_t *host = (uint8_t *)mem->rom[bank];
+	uint8_t *dirty = mem->dirty[bank];
+	uint32_t size = mem->rom_size[bank];
+	uint32_t page_num = MEM_PAGE_NUM(size);
+	chp_manifest_header_t header;
+	uint8_t page_buf[BANK_PAGE_SIZE];
+	char buf[300];
+	uint32_t i, len;
+	FILE *fp;
+
+	if (alloc_digest(bank, page_num) != No_exp)
+		return Malloc_exp;
+
+	for (i = 0; i < page_num; i++) {
+		chp_page_t *digest = &page_digest[bank][i];
+		chp_page_t *entry;
+		len = (i == page_num - 1 && (size & BANK_PAGE_MASK)) ? (size & BANK_PAGE_MASK) : BANK_PAGE_SIZE;
+		if (!digest_valid[bank][i] || (dirty[i] & MEM_DIRTY_CHECKPOINT)) {
+			page_sha1(host + i * BANK_PAGE_SIZE, len, digest->digest);
+			digest_valid[bank][i] = 1;
+			dirty[i] &= ~MEM_DIRTY_CHECKPOINT;
+		}
+		entry = index_lookup(digest->digest);
+		if (entry->offset == CHP_NO_OFFSET) {
+			/* the pack is made of whole pages, the tail of the last one is padded */
+			memset(page_buf, 0, BANK_PAGE_SIZE);
+			memcpy(page_buf, host + i * BANK_PAGE_SIZE, len);
+			fseek(store.pack, store.pack_size, SEEK_SET);
+			if (fwrite(page_buf, BANK_PAGE_SIZE, 1, store.pack) != 1)
+				return File_open_exp;
+			digest->offset = store.pack_size;
+			digest->reserved = 0;
+			store.pack_size += BANK_PAGE_SIZE;
+			if (index_insert(digest->digest, digest->offset) != No_exp)
+				return Malloc_exp;
+			fwrite(digest, sizeof(chp_page_t), 1, store.idx);
+		}
+		else
+			digest->offset = entry->offset;
+	}
+
+	snprintf(buf, sizeof(buf), "%s/ram%d.manifest", dir, bank);
+	fp = fopen(buf, "wb");
+	if (fp == NULL) {
+		skyeye_log(Warning_log, __func__, "can't create file %s\n", buf);
+		return File_open_exp;
+	}
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CHP_MANIFEST_MAGIC, sizeof(header.magic));
+	header.bank = bank;
+	header.size = size;
+	header.page_num = page_num;
+	if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+	    fwrite(page_digest[bank], sizeof(chp_page_t), page_num, fp) != page_num) {
+		fclose(fp);
+		return File_open_exp;
+	}
+	fclose(fp);
+	return No_exp;
+}
+
+/**
+* @brief restore the pages of a bank from its manifest
+*
+* @param dir the checkpoint directory
+* @param bank the bank index
+* @param mem the global memory
+* @param pack the mapped page pack
+*
+* @return the exception
+*/
+static exception_t load_bank(const char *dir, int bank, mem_state_t *mem, const uint8_t *pack)
+{
+	uint8_t *host = (uint8_t *)mem->rom[bank];
+	uint8_t *dirty = mem->dirty[bank];
+	uint32_t size = mem->rom_size[bank];
+	uint32_t page_num = MEM_PAGE_NUM(size);
+	chp_manifest_header_t header;
+	chp_page_t *manifest;
+	char buf[300];
+	uint32_t i, len;
+	FILE *fp;
+
+	snprintf(buf, sizeof(buf), "%s/ram%d.manifest", dir, bank);
+	fp = fopen(buf, "rb");
+	if (fp == NULL) {
+		skyeye_log(Warning_log, __func__, "can't find a mem copy file %s, may be it does not exist\n", buf);
+		return File_open_exp;
+	}
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+	    memcmp(header.magic, CHP_MANIFEST_MAGIC, sizeof(header.magic)) ||
+	    header.size != size || header.page_num != page_num) {
+		skyeye_log(Warning_log, __func__, "different size of bank %d in %s\n", bank, buf);
+		fclose(fp);
+		return Invarg_exp;
+	}
+	manifest = skyeye_mm(page_num * sizeof(chp_page_t));
+	if (manifest == NULL || alloc_digest(bank, page_num) != No_exp) {
+		fclose(fp);
+		skyeye_free(manifest);
+		return Malloc_exp;
+	}
+	if (fread(manifest, sizeof(chp_page_t), page_num, fp) != page_num) {
+		fclose(fp);
+		skyeye_free(manifest);
+		return File_open_exp;
+	}
+	fclose(fp);
+
+	for (i = 0; i < page_num; i++) {
+		if (manifest[i].offset + BANK_PAGE_SIZE > store.pack_size) {
+			skyeye_log(Warning_log, __func__, "page %d of bank %d is not in the pack\n", i, bank);
+			continue;
+		}
+		len = (i == page_num - 1 && (size & BANK_PAGE_MASK)) ? (size & BANK_PAGE_MASK) : BANK_PAGE_SIZE;
+		page_digest[bank][i] = manifest[i];
+		digest_valid[bank][i] = 1;
+		/* the page still holds the content of the checkpoint. The live page
+		 * is compared since the stores of JIT code and DMA do not mark the
+		 * dirty flags. */
+		if (!memcmp(host + i * BANK_PAGE_SIZE, pack + manifest[i].offset, len)) {
+			dirty[i] &= ~MEM_DIRTY_CHECKPOINT;
+			continue;
+		}
+		memcpy(host + i * BANK_PAGE_SIZE, pack + manifest[i].offset, len);
+		/* the display and the decoded code of the page are stale */
+		dirty[i] = MEM_DIRTY_ALL & ~MEM_DIRTY_CHECKPOINT;
+	}
+	skyeye_free(manifest);
+	return No_exp;
+}
+
+/**
+* @brief save the memory to the checkpoint directory, only the pages
+* written since the previous checkpoint are hashed and stored again.
+*
+* @param dir the checkpoint directory
+*
+* @return the exception
+*/
+exception_t save_mem_incremental(char *dir)
+{
+	mem_state_t *mem = get_global_memory();
+	int num = get_global_memmap()->current_num;
+	exception_t ret;
+	int bank;
+
+	if ((ret = open_store(dir, 1)) != No_exp)
+		return ret;
+	for (bank = 0; bank < num && bank < ROM_BANKS; bank++) {
+		if (mem->rom[bank] == NULL || mem->dirty[bank] == NULL)
+			continue;
+		if ((ret = save_bank(dir, bank, mem)) != No_exp) {
+			skyeye_log(Warning_log, __func__, "save bank %d to %s failed\n", bank, dir);
+			close_store();
+			return ret;
+		}
+	}
+	fflush(store.pack);
+	fflush(store.idx);
+	return No_exp;
+}
+
+/**
+* @brief restore the memory from the checkpoint directory, the page pack
+* is mapped and only the pages different from the current memory are
+* copied.
+*
+* @param dir the checkpoint directory
+*
+* @return the exception
+*/
+exception_t load_mem_incremental(char *dir)
+{
+	mem_state_t *mem = get_global_memory();
+	int num = get_global_memmap()->current_num;
+	exception_t ret = No_exp;
+	uint8_t *pack;
+	int bank;
+
+	if ((ret = open_store(dir, 0)) != No_exp)
+		return ret;
+	if (store.pack_size == 0)
+		return No_exp;
+	fflush(store.pack);
+	pack = mmap(NULL, store.pack_size, PROT_READ, MAP_PRIVATE, fileno(store.pack), 0);
+	if (pack == MAP_FAILED) {
+		skyeye_log(Warning_log, __func__, "can't map the page pack of %s\n", dir);
+		return File_open_exp;
+	}
+	for (bank = 0; bank < num && bank < ROM_BANKS; bank++) {
+		if (mem->rom[bank] == NULL || mem->dirty[bank] == NULL)
+			continue;
+		if ((ret = load_bank(dir, bank, mem, pack)) != No_exp)
+			break;
+	}
+	munmap(pack, store.pack_size);
+	return ret;
+}
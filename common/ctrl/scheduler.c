@@ -1,6 +1,7 @@
 /*
         scheduler.c - Implement a scheduler based on timer. the 
-	smallest schedule cycle is one micro second.
+	smallest schedule cycle is one micro second. The events are kept
+	in a min-heap ordered by their deadlines.
 
         Copyright (C) 2009 - 2010 Michael.Kang
         for help please send mail to <skyeye-developer@lists.sf.linuxforum.net>
@@ -25,9 +26,11 @@
  */
 
 #include "skyeye_sched.h"
-#include "skyeye_queue.h"
 #include "skyeye_types.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <signal.h>
@@ -35,6 +38,7 @@
 #include "sim_control.h"
 #include "skyeye_lock.h"
 #include "skyeye_mm.h"
+#include "skyeye_options.h"
 #include "portable/portable.h"
 
 //#define DEBUG
@@ -47,25 +51,240 @@ struct event{
 	sched_mode_t mode;		/* scheduler mode  */
 	sched_func_t func;		/* scheduler callback function */	
 	void *func_arg;			/* argument of scheduler callback */
-	int delta;			/* recode the time before scheduler occur */
 	int id;				/* the scheduler id */
+	int heap_index;			/* the position in the heap */
 	unsigned int expiration;	/* scheduler period */
-	LIST_ENTRY (event)list_entry;	
+	uint64_t deadline;		/* the absolute time of next expiration */
 };
 
+/**
+* @brief the queue of events, a binary min-heap ordered by the deadline
+* and a table from the event id to the event.
+*/
+typedef struct event_queue{
+	struct event **heap;
+	int heap_num;
+	struct event **id_table;
+	int id_num;
+	int *free_ids;
+	int free_num;
+}event_queue_t;
+
+/*
+ * An event id is the index in the id table and a generation bumped each
+ * time the index is freed, so a holder keeping the id of an expired
+ * oneshot event can not delete or modify the event reusing its index.
+ * The ids stay positive, -1 is kept for the holders as no event.
+ */
+#define EVENT_INDEX_BITS	16
+#define EVENT_INDEX_MASK	((1 << EVENT_INDEX_BITS) - 1)
+#define EVENT_GEN_MASK		0x7fff
+#define EVENT_INDEX(id)		((id) & EVENT_INDEX_MASK)
+#define EVENT_NEXT_GEN(id)	((((((id) >> EVENT_INDEX_BITS) + 1) & EVENT_GEN_MASK) << EVENT_INDEX_BITS) | EVENT_INDEX(id))
+/* the period of a periodic event armed with 0, it stays registered */
+#define EVENT_MIN_PERIOD	1
+
+/**
+* @brief swap two events in the heap and keep their index
+*/
+static void heap_swap(event_queue_t *q, int i, int j){
+	struct event *tmp = q->heap[i];
+	q->heap[i] = q->heap[j];
+	q->heap[j] = tmp;
+	q->heap[i]->heap_index = i;
+	q->heap[j]->heap_index = j;
+}
+
+static void heap_up(event_queue_t *q, int i){
+	while(i > 0 && q->heap[(i - 1) / 2]->deadline > q->heap[i]->deadline){
+		heap_swap(q, i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void heap_down(event_queue_t *q, int i){
+	int child;
+	while((child = 2 * i + 1) < q->heap_num){
+		if(child + 1 < q->heap_num && q->heap[child + 1]->deadline < q->heap[child]->deadline)
+			child++;
+		if(q->heap[i]->deadline <= q->heap[child]->deadline)
+			break;
+		heap_swap(q, i, child);
+		i = child;
+	}
+}
+
+/**
+* @brief put an event into the heap
+*/
+static void heap_insert(event_queue_t *q, struct event *e){
+	e->heap_index = q->heap_num++;
+	q->heap[e->heap_index] = e;
+	heap_up(q, e->heap_index);
+}
+
+/**
+* @brief remove an event from any position of the heap
+*/
+static void heap_remove(event_queue_t *q, struct event *e){
+	int i = e->heap_index;
+	if(i < 0)
+		return;
+	e->heap_index = -1;
+	if(i == --q->heap_num)
+		return;
+	q->heap[i] = q->heap[q->heap_num];
+	q->heap[i]->heap_index = i;
+	heap_up(q, i);
+	heap_down(q, q->heap[i]->heap_index);
+}
+
+/**
+* @brief the earliest event of the queue
+*/
+static struct event *heap_top(event_queue_t *q){
+	return q->heap_num ? q->heap[0] : NULL;
+}
+
+/**
+* @brief allocate an id for the event, reuse the free indexes first with
+* the next generation
+*
+* @return the id or -1 when the memory or the indexes are exhausted
+*/
+static int alloc_event_id(event_queue_t *q, struct event *e){
+	int id;
+	if(q->free_num > 0){
+		id = q->free_ids[--q->free_num];
+		id = EVENT_NEXT_GEN(id);
+	}
+	else{
+		if(q->id_num > EVENT_INDEX_MASK)
+			return -1;
+		/* grow the tables by double size */
+		if((q->id_num & (q->id_num - 1)) == 0){
+			int size = q->id_num ? q->id_num * 2 : 16;
+			struct event **table = realloc(q->id_table, size * sizeof(struct event *));
+			struct event **heap = realloc(q->heap, size * sizeof(struct event *));
+			int *free_ids = realloc(q->free_ids, size * sizeof(int));
+			if(table)
+				q->id_table = table;
+			if(heap)
+				q->heap = heap;
+			if(free_ids)
+				q->free_ids = free_ids;
+			if(table == NULL || heap == NULL || free_ids == NULL)
+				return -1;
+		}
+		id = q->id_num++;
+	}
+	q->id_table[EVENT_INDEX(id)] = e;
+	e->id = id;
+	return id;
+}
+
+static void free_event_id(event_queue_t *q, int id){
+	q->id_table[EVENT_INDEX(id)] = NULL;
+	q->free_ids[q->free_num++] = id;
+}
+
+/**
+* @brief find an event by its id, the id of a freed event does not match
+* the event reusing its index
+*/
+static struct event *find_event(event_queue_t *q, int id){
+	struct event *e;
+	if(id < 0 || EVENT_INDEX(id) >= q->id_num)
+		return NULL;
+	e = q->id_table[EVENT_INDEX(id)];
+	if(e == NULL || e->id != id)
+		return NULL;
+	return e;
+}
+
+/**
+* @brief take the next expired event out of the queue. The periodic
+* event is put back with its next deadline, the oneshot event is
+* released and its content is copied to the caller.
+*
+* @return 1 when an event expired
+*/
+static int pop_expired_event(event_queue_t *q, uint64_t now, struct event *expired){
+	struct event *e = heap_top(q);
+	if(e == NULL || e->deadline > now)
+		return 0;
+	*expired = *e;
+	if(e->mode == Periodic_sched){
+		uint64_t period = e->expiration ? e->expiration : EVENT_MIN_PERIOD;
+		e->deadline += period;
+		/* the host is too slow, skip the missed periods */
+		if(e->deadline <= now)
+			e->deadline = now + period;
+		heap_down(q, 0);
+	}
+	else{
+		heap_remove(q, e);
+		free_event_id(q, e->id);
+		skyeye_free(e);
+	}
+	return 1;
+}
+
+/**
+* @brief free all the events in the queue
+*/
+static void flush_event_queue(event_queue_t *q){
+	int i;
+	for(i = 0; i < q->id_num; i++){
+		if(q->id_table[i] != NULL){
+			skyeye_free(q->id_table[i]);
+			q->id_table[i] = NULL;
+		}
+	}
+	q->heap_num = q->id_num = q->free_num = 0;
+}
+
 /* thread scheduler */
-LIST_HEAD(list_thread_head, event) thread_head;
+static event_queue_t thread_queue;
 
 /**
-* @brief the thread lock
+* @brief the thread lock and the condition to wake up the scheduler thread
 */
-RWLOCK_T  thread_lock;
+static pthread_mutex_t thread_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t thread_cond;
 
 /**
 * @brief the pthread id running event list
 */
 static pthread_t pid;
 
+/**
+* @brief the clock used by the thread scheduler
+*/
+static sched_clock_t sched_clock = Wallclock_sched;
+
+/**
+* @brief guest instructions per microsecond in the icount mode
+*/
+static uint64_t icount_per_us = 100;
+
+/**
+* @brief the instruction counter of the icount mode
+*/
+static uint64_t icount = 0;
+static uint32_t last_step = 0;
+int sched_icount_enabled = 0;
+
+/**
+* @brief the instruction count of next expiration in the icount mode
+*/
+static uint64_t icount_deadline = (uint64_t)-1;
+
+/**
+* @brief the host time when the scheduler starts
+*/
+static uint64_t start_time_us = 0;
+
 /**
 * @brief The wall clock
 */
@@ -78,6 +297,83 @@ uint64_t get_clock_sec(){
 	return now_sec;
 }
 
+/**
+* @brief the monotonic host time in microsecond
+*/
+static uint64_t host_time_us(void){
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+/**
+* @brief the current time of the scheduler in microsecond, it is
+* the passed host time or the passed guest time in the icount mode.
+*/
+uint64_t get_sched_clock_us(){
+	uint64_t passed;
+	if(sched_clock == Icount_sched)
+		passed = icount / icount_per_us;
+	else
+		passed = host_time_us() - start_time_us;
+	/* Update the clock on the wall */
+	now_sec = passed / 1000000;
+	now_us = passed % 1000000;
+	return passed;
+}
+
+/**
+* @brief recalculate the instruction count of next expiration,
+* should be called with thread_lock held.
+*/
+static void update_icount_deadline(void){
+	struct event *e = heap_top(&thread_queue);
+	if(e == NULL || sched_clock != Icount_sched)
+		icount_deadline = (uint64_t)-1;
+	else
+		icount_deadline = e->deadline * icount_per_us;
+}
+
+/**
+* @brief run all the expired events, the callback is called without
+* the lock, so it can create, modify or delete the events.
+*/
+static void run_expired_events(uint64_t now){
+	struct event expired;
+	while(pop_expired_event(&thread_queue, now, &expired)){
+		update_icount_deadline();
+		pthread_mutex_unlock(&thread_lock);
+		DBG("In %s, event %d expired at %lld\n", __FUNCTION__, expired.id, now);
+		/* execute the scheduler callback */
+		if(expired.func != NULL)
+			expired.func((void*)expired.func_arg);
+		pthread_mutex_lock(&thread_lock);
+	}
+	update_icount_deadline();
+}
+
+/**
+* @brief advance the guest time in the icount mode, called by the cell
+* after the cores run.
+*
+* @param step the step counter of the core
+*/
+void sched_update_icount(uint32_t step){
+	icount += (uint32_t)(step - last_step);
+	last_step = step;
+	if(icount < icount_deadline)
+		return;
+	pthread_mutex_lock(&thread_lock);
+	run_expired_events(get_sched_clock_us());
+	pthread_mutex_unlock(&thread_lock);
+}
+
 /**
 * @brief the scheduler of event thread
 */
@@ -86,63 +382,96 @@ static void thread_scheduler(void){
 	 * Check if there is some timer is expiried, we
 	 * should execute the corresponding event.
 	 */
-	struct event *tmp ;
+	struct event *e;
+	struct timespec ts;
+	uint64_t now;
 	while(!(SIM_is_running()))
 	{
 		/* set a thread cancelation-point */
 		usleep(100);
 	}
-	struct timeval tv;
-	unsigned long long start_usec, start_sec, current_utime, last_utime, passed_utime;
-	gettimeofday(&tv,NULL);
-	start_usec = tv.tv_usec;
-	start_sec = tv.tv_sec;
-	current_utime = start_sec * 1000000 + start_usec;
-	//printf("In %s, %d  sec, %d usec\n", __FUNCTION__, tv.tv_sec, tv.tv_usec);
+	pthread_mutex_lock(&thread_lock);
+	start_time_us = host_time_us();
 	while(1)
 	{
-		usleep(100);
-		gettimeofday(&tv,NULL);
-		last_utime = current_utime;
-		current_utime = tv.tv_sec * 1000000 + tv.tv_usec;
-		/* Update the clock on the wall */
-		now_us = tv.tv_usec - start_usec;
-		now_sec = tv.tv_sec - start_sec;
-
-		/* Calculate how much microseconds passed comparing to last time */
-		passed_utime = current_utime - last_utime;
-		DBG("In %s, passed_utime=%d\n", __FUNCTION__, passed_utime);
-		LIST_FOREACH(tmp, &thread_head,list_entry){
-			/* Decrease dleta */
-			tmp->delta -= passed_utime;
-			DBG("In %s, tmp->delta=%d\n", __FUNCTION__, tmp->delta);
-			if (tmp->delta > (int)tmp->expiration)
-				tmp->delta = (int)tmp->expiration;
-//			if (tmp->id == 1
-//				printf("In %s, tmp->delta=0x%x,id %d\n", __FUNCTION__, tmp->delta,tmp->id);
-			
-			if(tmp->delta == 0 || tmp->delta < 0){
-				/* Sometimes, delta is missing */
-			//	if(tmp->id == 1)
-			//		printf("In %s, tmp->delta=%d\n", __FUNCTION__, tmp->delta);
-				if(tmp->delta < 0)
-					DBG("scheduler occur later \n");
-				/* execute the scheduler callback */
-				if(tmp->func != NULL)
-					tmp->func((void*)tmp->func_arg);
-
-				if(tmp->mode  == Oneshot_sched){
-RW_WRLOCK(thread_lock);
-					LIST_REMOVE(tmp, list_entry);		
-RW_UNLOCK(thread_lock);
-					skyeye_free(tmp);
-				}
-				else{
-					tmp->delta = (int)tmp->expiration;
-				}
-			}
+		e = heap_top(&thread_queue);
+		/* the cores drive the events in the icount mode */
+		if(e == NULL || sched_clock == Icount_sched){
+			pthread_cond_wait(&thread_cond, &thread_lock);
+			continue;
+		}
+		now = get_sched_clock_us();
+		if(e->deadline > now){
+			/* sleep until the deadline or an earlier event is inserted */
+			uint64_t wake = host_time_us() + (e->deadline - now);
+			ts.tv_sec = wake / 1000000;
+			ts.tv_nsec = (wake % 1000000) * 1000;
+			pthread_cond_timedwait(&thread_cond, &thread_lock, &ts);
+			continue;
 		}
+		run_expired_events(now);
 	}
+	pthread_mutex_unlock(&thread_lock);
+}
+
+/**
+* @brief set the clock of the thread scheduler
+*
+* @param clock the wall clock or the guest instruction count
+* @param per_us guest instructions per microsecond in icount mode
+*
+* @return 
+*/
+int set_sched_clock(sched_clock_t clock, uint64_t per_us){
+	if(clock != Wallclock_sched && clock != Icount_sched)
+		return Invarg_exp;
+	if(clock == Icount_sched && per_us == 0)
+		return Invarg_exp;
+	pthread_mutex_lock(&thread_lock);
+	sched_clock = clock;
+	if(per_us != 0)
+		icount_per_us = per_us;
+	sched_icount_enabled = (clock == Icount_sched);
+	update_icount_deadline();
+	pthread_cond_signal(&thread_cond);
+	pthread_mutex_unlock(&thread_lock);
+	return No_exp;
+}
+
+/**
+* @brief the handler of scheduler option
+*
+* @param this_option
+* @param num_params
+* @param params[]
+*
+* @return 
+*/
+static int
+do_scheduler_option (skyeye_option_t * this_option, int num_params,
+		    const char *params[])
+{
+	char name[MAX_PARAM_NAME], value[MAX_PARAM_NAME];
+	sched_clock_t clock = Wallclock_sched;
+	uint64_t per_us = 0;
+	int i;
+	for (i = 0; i < num_params; i++) {
+		if (split_param (params[i], name, value) < 0)
+			SKYEYE_ERR ("Error: scheduler has wrong parameter \"%s\".\n", name);
+		if (!strncmp ("clock", name, strlen (name))) {
+			if (!strncmp ("icount", value, strlen (value)))
+				clock = Icount_sched;
+			else if (!strncmp ("wall", value, strlen (value)))
+				clock = Wallclock_sched;
+			else
+				SKYEYE_ERR ("Error: Unknown scheduler clock \"%s\"\n", value);
+		}
+		else if (!strncmp ("mips", name, strlen (name)))
+			per_us = strtoull (value, NULL, 0);
+		else
+			SKYEYE_ERR ("Error: Unknown scheduler option \"%s\"\n", params[i]);
+	}
+	return set_sched_clock(clock, per_us);
 }
 
 /*
@@ -155,8 +484,17 @@ RW_UNLOCK(thread_lock);
 * @return 
 */
 int init_thread_scheduler(){
-	RWLOCK_INIT(thread_lock);
-	LIST_INIT(&thread_head);
+	pthread_condattr_t attr;
+	memset(&thread_queue, 0, sizeof(thread_queue));
+	pthread_condattr_init(&attr);
+#ifdef CLOCK_MONOTONIC
+	/* the deadline of pthread_cond_timedwait is the same clock of host_time_us */
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+	pthread_cond_init(&thread_cond, &attr);
+	pthread_condattr_destroy(&attr);
+	start_time_us = host_time_us();
+	register_option("scheduler", do_scheduler_option, "Set the clock of scheduler, wall clock or guest instruction count.\n");
 
 	/* creat a thread for  scheduling */
 	create_thread(thread_scheduler, NULL, &pid); 
@@ -177,44 +515,59 @@ int init_thread_scheduler(){
 */
 int create_thread_scheduler(unsigned int ms, sched_mode_t mode, sched_func_t func, void *arg, int *id){
 	
-	/* create a new event */
-	struct event* e = skyeye_mm(sizeof(struct event));
-	if( e == NULL){
-		return Malloc_exp;
-	}
-
 	/* check arguments */
-	if( ms < 0){
-		return Invarg_exp;
-	}
 	if(mode != Periodic_sched && mode != Oneshot_sched){
 		return Invarg_exp;
 	}
 	if(func == NULL){
 		return Invarg_exp;
 	}
+
+	/* create a new event */
+	struct event* e = skyeye_mm(sizeof(struct event));
+	if( e == NULL){
+		return Malloc_exp;
+	}
 	e->mode = mode;		
 	e->expiration = ms;
-	e->delta = ms;
 	e->func = func;
 	e->func_arg = (void*)arg;
 
+	pthread_mutex_lock(&thread_lock);
 	/* get the new event id */
-	if(LIST_EMPTY(&thread_head))
-		*id = 0;
-	else
-		*id = LIST_FIRST(&thread_head)->id + 1;
-	e->id = *id;
-	//printf("timer id = %d,delta = 0x%x,expiration = 0x%x\n",e->id,e->delta,e->expiration);
+	if(alloc_event_id(&thread_queue, e) < 0){
+		pthread_mutex_unlock(&thread_lock);
+		skyeye_free(e);
+		return Malloc_exp;
+	}
+	*id = e->id;
+	e->deadline = get_sched_clock_us() + ms;
+	//printf("timer id = %d,deadline = 0x%llx,expiration = 0x%x\n",e->id,e->deadline,e->expiration);
 
-RW_WRLOCK(thread_lock);
-	/* insert the event to the list */
-	LIST_INSERT_HEAD(&thread_head, e, list_entry);
-RW_UNLOCK(thread_lock);
+	/* insert the event to the heap */
+	heap_insert(&thread_queue, e);
+	update_icount_deadline();
+	pthread_cond_signal(&thread_cond);
+	pthread_mutex_unlock(&thread_lock);
 
 	return No_exp;
 }
 
+/**
+* @brief run a function in the scheduler as soon as possible, it can be
+* called from any host thread, e.g. the io reactor posting the readiness
+* of a file descriptor.
+*
+* @param func the function
+* @param arg the argument of the function
+*
+* @return the exception
+*/
+int post_thread_event(sched_func_t func, void *arg){
+	int id;
+	return create_thread_scheduler(0, Oneshot_sched, func, arg, &id);
+}
+
 /**
 * @brief modify expiration and mode of the thread scheduler
 *
@@ -225,27 +578,27 @@ RW_UNLOCK(thread_lock);
 * @return 
 */
 int mod_thread_scheduler(int id,unsigned int ms, sched_mode_t mode){
-	struct event *tmp;
-	LIST_FOREACH(tmp, &thread_head,list_entry){
-		if(tmp->id == id){
-	
-			if( ms < 0){
-				return Invarg_exp;
-			}
-			if(mode != Periodic_sched && mode != Oneshot_sched){
-				return Invarg_exp;
-			}
-
-RW_WRLOCK(thread_lock);
-			/* update the scheduler */
-			tmp->expiration = ms;
-			tmp->delta = (int)ms;
-			tmp->mode = mode;
-RW_UNLOCK(thread_lock);
-			return No_exp;	
-		}
+	struct event *e;
+	if(mode != Periodic_sched && mode != Oneshot_sched){
+		return Invarg_exp;
 	}
-	return  Invarg_exp;
+
+	pthread_mutex_lock(&thread_lock);
+	e = find_event(&thread_queue, id);
+	if(e == NULL){
+		pthread_mutex_unlock(&thread_lock);
+		return Invarg_exp;
+	}
+	/* update the scheduler */
+	heap_remove(&thread_queue, e);
+	e->expiration = ms;
+	e->deadline = get_sched_clock_us() + ms;
+	e->mode = mode;
+	heap_insert(&thread_queue, e);
+	update_icount_deadline();
+	pthread_cond_signal(&thread_cond);
+	pthread_mutex_unlock(&thread_lock);
+	return No_exp;	
 }
 
 /**
@@ -256,19 +609,20 @@ RW_UNLOCK(thread_lock);
 * @return 
 */
 int del_thread_scheduler(int id){
-	struct event *tmp ;
-	struct event *q = NULL;
-	LIST_FOREACH(tmp, &thread_head,list_entry){
-		if(tmp->id == id){
-			q = tmp;
-RW_WRLOCK(thread_lock);
-			LIST_REMOVE(tmp, list_entry);
-RW_UNLOCK(thread_lock);
-			skyeye_free(q);
-			return No_exp;
-		}
+	struct event *e;
+
+	pthread_mutex_lock(&thread_lock);
+	e = find_event(&thread_queue, id);
+	if(e == NULL){
+		pthread_mutex_unlock(&thread_lock);
+		return Invarg_exp;
 	}
-	return Invarg_exp;
+	heap_remove(&thread_queue, e);
+	free_event_id(&thread_queue, id);
+	update_icount_deadline();
+	pthread_mutex_unlock(&thread_lock);
+	skyeye_free(e);
+	return No_exp;
 }
 
 /**
@@ -277,10 +631,16 @@ RW_UNLOCK(thread_lock);
 void list_thread_scheduler(void)
 {
 	struct event *tmp ;
+	uint64_t now;
+	int i;
+	pthread_mutex_lock(&thread_lock);
+	now = get_sched_clock_us();
 	printf("id\tperiod\tdleta\tmode\n");
-	LIST_FOREACH(tmp, &thread_head,list_entry){
-		printf("%d\t%d\t%d\t%s\n", tmp->id, tmp->expiration, tmp->delta, (tmp->mode==0)?"Oneshot_sched":"Periodic_sched");
+	for(i = 0; i < thread_queue.heap_num; i++){
+		tmp = thread_queue.heap[i];
+		printf("%d\t%d\t%lld\t%s\n", tmp->id, tmp->expiration, (long long)(tmp->deadline - now), (tmp->mode==0)?"Oneshot_sched":"Periodic_sched");
 	}
+	pthread_mutex_unlock(&thread_lock);
 }
 
 /**
@@ -289,32 +649,27 @@ void list_thread_scheduler(void)
 * @return 
 */
 int fini_thread_scheduler(){
-	struct event *tmp ;
-	struct event *q = NULL;
-	
-	LIST_FOREACH(tmp, &thread_head,list_entry){
-			q = tmp;
-RW_WRLOCK(thread_lock);
-			LIST_REMOVE(tmp, list_entry);		
-RW_UNLOCK(thread_lock);
-			skyeye_free(q);
-	}
-	
-	RWLOCK_DESTROY(thread_lock);
-	if(LIST_EMPTY(&thread_head))		
-		return No_exp;
-
-	return Invarg_exp;
+	pthread_mutex_lock(&thread_lock);
+	flush_event_queue(&thread_queue);
+	update_icount_deadline();
+	pthread_mutex_unlock(&thread_lock);
+	return No_exp;
 }
 /* thread shcheduler end */
 
 /* timer scheduler */
 static struct itimerval value, ovalue;
 
-LIST_HEAD(list_timer_head, event) timer_head;
-RWLOCK_T  timer_lock;	
+static event_queue_t timer_queue;
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+* @brief the passed milliseconds counted by the timer signal
+*/
+static uint64_t timer_ticks = 0;
 
 static void timer_scheduler(int signo){
+	struct event expired;
 	switch (signo){
 		case SIGVTALRM:
 			signal(SIGVTALRM, timer_scheduler);
@@ -323,43 +678,30 @@ static void timer_scheduler(int signo){
 			/* ignored and do nothing */
 			return;
 	}
+	timer_ticks++;
 	/* 
 	 * Check if there is some timer is expiried, we
 	 * should execute the corresponding event.
 	 */
-	struct event *tmp;
-	LIST_FOREACH(tmp, &timer_head,list_entry){
-		/* Decrease dleta */
-		tmp->delta -= 1;
-		
-		if(tmp->delta == 0 || tmp->delta < 0){
-			/* wrong time value */
-			if(tmp->delta < 0)
-				printf("timer scheduler occur later \n");
-			else	
-				/* execute the scheduler callback */
-				if(tmp->func != NULL)
-					tmp->func((void*)tmp->func_arg);
-
-			if(tmp->mode  == Oneshot_sched){
-RW_WRLOCK(timer_lock);
-				LIST_REMOVE(tmp, list_entry);		
-RW_UNLOCK(timer_lock);
-				skyeye_free(tmp);
-			}
-			else{
-				tmp->delta = (int)tmp->expiration;
-			}
-		}
+	if(pthread_mutex_trylock(&timer_lock) != 0)
+		return;
+	while(pop_expired_event(&timer_queue, timer_ticks, &expired)){
+		pthread_mutex_unlock(&timer_lock);
+		/* execute the scheduler callback */
+		if(expired.func != NULL)
+			expired.func((void*)expired.func_arg);
+		if(pthread_mutex_trylock(&timer_lock) != 0)
+			return;
 	}
+	pthread_mutex_unlock(&timer_lock);
 }
 
 /*
  * we add a period scheduler whose interval is one ms.
  */
 int init_timer_scheduler(){
-	RWLOCK_INIT(timer_lock);
-	LIST_INIT(&timer_head);
+	memset(&timer_queue, 0, sizeof(timer_queue));
+	timer_ticks = 0;
 	signal(SIGVTALRM, timer_scheduler);
 
 	value.it_value.tv_sec = 1;
@@ -379,122 +721,109 @@ int init_timer_scheduler(){
 /* create and add an timer event */
 int create_timer_scheduler(unsigned int ms, sched_mode_t mode, sched_func_t func, void *arg, int *id){
 	
-	/* create a new event */
-	struct event* e = skyeye_mm(sizeof(struct event));
-	if( e == NULL){
-		return Malloc_exp;
-	}
-
 	/* check arguments */
-	if( ms < 0){
-		return Invarg_exp;
-	}
 	if(mode != Periodic_sched && mode != Oneshot_sched){
 		return Invarg_exp;
 	}
 	if(func == NULL){
 		return Invarg_exp;
 	}
+
+	/* create a new event */
+	struct event* e = skyeye_mm(sizeof(struct event));
+	if( e == NULL){
+		return Malloc_exp;
+	}
 	e->mode = mode;		
 	e->expiration = ms;
-	e->delta = ms;
 	e->func = func;
 	e->func_arg = (void*)arg;
 
+	pthread_mutex_lock(&timer_lock);
 	/* get the new event id */
-	if(LIST_EMPTY(&timer_head))
-		*id = 0;
-	else
-		*id = LIST_FIRST(&timer_head)->id + 1;
-	e->id = *id;
+	if(alloc_event_id(&timer_queue, e) < 0){
+		pthread_mutex_unlock(&timer_lock);
+		skyeye_free(e);
+		return Malloc_exp;
+	}
+	*id = e->id;
+	e->deadline = timer_ticks + ms;
 
-RW_WRLOCK(timer_lock);
-	/* insert the event to the list */
-	LIST_INSERT_HEAD(&timer_head, e, list_entry);
-RW_UNLOCK(timer_lock);
+	/* insert the event to the heap */
+	heap_insert(&timer_queue, e);
+	pthread_mutex_unlock(&timer_lock);
 
 	return No_exp;
 }
 
 /* modify expiration and mode of the timer scheduler */
 int mod_timer_scheduler(int id,unsigned int ms, sched_mode_t mode){
-	struct event *tmp;
-	LIST_FOREACH(tmp, &timer_head,list_entry){
-		if(tmp->id == id){
-	
-			if( ms < 0){
-				return Invarg_exp;
-			}
-			if(mode != Periodic_sched && mode != Oneshot_sched){
-				return Invarg_exp;
-			}
-
-RW_WRLOCK(timer_lock);
-			/* update the scheduler */
-			tmp->expiration = ms;
-			tmp->delta = (int)ms;
-			tmp->mode = mode;
-RW_UNLOCK(timer_lock);
-			
-			return No_exp;	
-		}
+	struct event *e;
+	if(mode != Periodic_sched && mode != Oneshot_sched){
+		return Invarg_exp;
+	}
+
+	pthread_mutex_lock(&timer_lock);
+	e = find_event(&timer_queue, id);
+	if(e == NULL){
+		pthread_mutex_unlock(&timer_lock);
+		return Invarg_exp;
 	}
-	return  Invarg_exp;
+	/* update the scheduler */
+	heap_remove(&timer_queue, e);
+	e->expiration = ms;
+	e->deadline = timer_ticks + ms;
+	e->mode = mode;
+	heap_insert(&timer_queue, e);
+	pthread_mutex_unlock(&timer_lock);
+			
+	return No_exp;	
 }
 
 /* remove a timer scheduler from the queue */
 int del_timer_scheduler(int id)
 {
-	struct event *tmp ;
-	struct event *q = NULL;
-	LIST_FOREACH(tmp, &timer_head,list_entry){
-		if(tmp->id == id){
-			q = tmp;
-RW_WRLOCK(timer_lock);
-			LIST_REMOVE(tmp, list_entry);		
-RW_UNLOCK(timer_lock);
-			skyeye_free(q);
-			return No_exp;
-		}
+	struct event *e;
+
+	pthread_mutex_lock(&timer_lock);
+	e = find_event(&timer_queue, id);
+	if(e == NULL){
+		pthread_mutex_unlock(&timer_lock);
+		return Invarg_exp;
 	}
-	return Invarg_exp;
+	heap_remove(&timer_queue, e);
+	free_event_id(&timer_queue, id);
+	pthread_mutex_unlock(&timer_lock);
+	skyeye_free(e);
+	return No_exp;
 }
 
 /* list the attributes of all timer scheduler */
 void list_timer_scheduler(void)
 {
 	struct event *tmp ;
+	int i;
+	pthread_mutex_lock(&timer_lock);
 	printf("id\tperiod\tdleta\tmode\n");
-	LIST_FOREACH(tmp, &timer_head,list_entry){
-		printf("%d\t%d\t%d\t%s\n", tmp->id, tmp->expiration, tmp->delta, (tmp->mode==0)?"Oneshot_sched":"Periodic_sched");
+	for(i = 0; i < timer_queue.heap_num; i++){
+		tmp = timer_queue.heap[i];
+		printf("%d\t%d\t%lld\t%s\n", tmp->id, tmp->expiration, (long long)(tmp->deadline - timer_ticks), (tmp->mode==0)?"Oneshot_sched":"Periodic_sched");
 	}
-
-
+	pthread_mutex_unlock(&timer_lock);
 }
 
 int fini_timer_scheduler()
 {
-	struct event *tmp ;
-	struct event *q = NULL;
-
 	/* shenoubang add win32 2012-6-8 */
 #ifndef __WIN32__
 	setitimer(ITIMER_VIRTUAL, &ovalue, NULL);
 #endif
 	
-	LIST_FOREACH(tmp, &timer_head,list_entry){
-			q = tmp;
-RW_WRLOCK(timer_lock);
-			LIST_REMOVE(tmp, list_entry);		
-RW_UNLOCK(timer_lock);
-			skyeye_free(q);
-	}
-	
-	RWLOCK_DESTROY(timer_lock);
-	if(LIST_EMPTY(&timer_head))		
-		return No_exp;
+	pthread_mutex_lock(&timer_lock);
+	flush_event_queue(&timer_queue);
+	pthread_mutex_unlock(&timer_lock);
 
-	return Invarg_exp;
+	return No_exp;
 }
 
 /* timer cheduler end */
@@ -115,6 +115,11 @@ void SIM_init(){
 	init_thread_scheduler();
 	//init_timer_scheduler();
 
+	/*
+	 * initialization of the cells running the cores
+	 */
+	init_cell();
+
 	
 	/*
 	 * initialization of architecture and cores
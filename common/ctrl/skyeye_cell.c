@@ -25,6 +25,9 @@
 
 #include <assert.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "skyeye_obj.h"
 #include "skyeye_internal.h"
 #include "skyeye_thread.h"
@@ -32,12 +35,97 @@
 #include "skyeye_mm.h"
 #include "sim_control.h"
 #include "skyeye_callback.h"
+#include "skyeye_sched.h"
+#include "skyeye_options.h"
+#include "skyeye_log.h"
+#include "skyeye.h"
 
 /**
 * @brief the default cell
 */
 static skyeye_cell_t* default_cell = NULL;
 
+/**
+* @brief the cell which advances the guest time in icount mode
+*/
+static skyeye_cell_t* time_cell = NULL;
+
+/* the exec object running on the calling cell thread */
+static __thread conf_object_t* running_exec_priv = NULL;
+
+/*
+ * In the parallel smp mode every core runs in its own cell, so on its
+ * own host thread. The cores are kept in step by a quantum barrier: a
+ * cell waits for the others after smp_quantum runs of its core, so no
+ * core is more than one quantum ahead of the slowest one.
+ */
+#define SMP_DEFAULT_QUANTUM	1000
+
+static uint32_t smp_cores = 1;
+static bool_t smp_parallel = False;
+static uint32_t smp_quantum = SMP_DEFAULT_QUANTUM;
+
+static pthread_mutex_t smp_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t smp_cond = PTHREAD_COND_INITIALIZER;
+/* the cells taking part in the quantum barrier */
+static int smp_cells = 0;
+static int smp_arrived = 0;
+static uint32_t smp_epoch = 0;
+
+/*
+ * The device models are not thread safe, so in the parallel smp mode the
+ * io bank accesses and the step callbacks of the cells are serialized by
+ * the device lock. It is recursive as a step callback may access the bus.
+ */
+static pthread_mutex_t device_lock;
+static pthread_once_t device_lock_once = PTHREAD_ONCE_INIT;
+
+static void init_device_lock(void){
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&device_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
+
+/**
+* @brief take the device lock in the parallel smp mode
+*/
+void smp_device_lock(void){
+	if(!smp_parallel_enabled())
+		return;
+	pthread_once(&device_lock_once, init_device_lock);
+	pthread_mutex_lock(&device_lock);
+}
+
+/**
+* @brief release the device lock in the parallel smp mode
+*/
+void smp_device_unlock(void){
+	if(!smp_parallel_enabled())
+		return;
+	pthread_mutex_unlock(&device_lock);
+}
+
+/**
+* @brief wait until all the smp cells finish the current quantum
+*/
+static void smp_quantum_sync(void){
+	uint32_t epoch;
+	pthread_mutex_lock(&smp_lock);
+	epoch = smp_epoch;
+	if(++smp_arrived >= smp_cells){
+		smp_arrived = 0;
+		smp_epoch++;
+		pthread_cond_broadcast(&smp_cond);
+	}
+	else{
+		while(epoch == smp_epoch)
+			pthread_cond_wait(&smp_cond, &smp_lock);
+	}
+	pthread_mutex_unlock(&smp_lock);
+}
+
 /**
 * @brief Add an exec object to the cell
 *
@@ -69,14 +157,24 @@ static void cell_running(conf_object_t* argp){
 	assert(cell != NULL);
 	while(1){
 		generic_arch_t *arch_instance = get_arch_instance(NULL);
+		smp_device_lock();
 		exec_callback(Step_callback, arch_instance);
+		smp_device_unlock();
 		while(!SIM_is_running()){
 			usleep(100);
 		}
 		LIST_FOREACH(iterator, &cell->exec_head,list_entry){
 			cell->current_exec_id = iterator->exec_id;
+			running_exec_priv = iterator->priv_data;
 			iterator->run(iterator->priv_data);
 		}
+		if(cell->smp && ++cell->quantum_runs >= smp_quantum){
+			cell->quantum_runs = 0;
+			smp_quantum_sync();
+		}
+		/* the device events are driven by the guest time in icount mode */
+		if(sched_icount_enabled && cell->drives_time && arch_instance->get_step)
+			sched_update_icount(arch_instance->get_step());
 	}
 }
 
@@ -87,12 +185,16 @@ static void cell_running(conf_object_t* argp){
 */
 skyeye_cell_t* create_cell(){
 	pthread_t id;
-	skyeye_cell_t* cell = (skyeye_cell_t*)skyeye_mm(sizeof(skyeye_cell_t));
+	skyeye_cell_t* cell = (skyeye_cell_t*)skyeye_mm_zero(sizeof(skyeye_cell_t));
 	conf_object_t* argp = get_conf_obj_by_cast(cell, "skyeye_cell_t");
-	create_thread(cell_running, argp, &id);
-	cell->thread_id = id;
 	cell->current_exec_id = cell->max_exec_id = 0;
 	LIST_INIT(&cell->exec_head);
+	/* only the first cell advances the guest time */
+	cell->drives_time = (time_cell == NULL);
+	if(time_cell == NULL)
+		time_cell = cell;
+	create_thread(cell_running, argp, &id);
+	cell->thread_id = id;
 	return cell;
 }
 
@@ -117,6 +219,103 @@ skyeye_cell_t* get_default_cell(){
 void add_to_default_cell(skyeye_exec_t* exec){
 	add_to_cell(exec, get_default_cell());
 }
+
+/**
+* @brief add the exec object of a core to a new cell of its own in the
+* parallel smp mode, to the default cell otherwise
+*
+* @param exec the exec object of the core
+*/
+void add_to_smp_cell(skyeye_exec_t* exec){
+	skyeye_cell_t* cell;
+	if(!smp_parallel || smp_cores < 2){
+		add_to_default_cell(exec);
+		return;
+	}
+	cell = create_cell();
+	add_to_cell(exec, cell);
+	pthread_mutex_lock(&smp_lock);
+	smp_cells++;
+	pthread_mutex_unlock(&smp_lock);
+	cell->smp = 1;
+}
+
+/**
+* @brief get the number of cores of the smp option
+*
+* @return the number of cores
+*/
+uint32_t get_smp_cores(void){
+	return smp_cores;
+}
+
+/**
+* @brief check if the cores run on their own host threads
+*
+* @return True in the parallel smp mode
+*/
+bool_t smp_parallel_enabled(void){
+	return (smp_parallel && smp_cores > 1) ? True : False;
+}
+
+/**
+* @brief turn the parallel smp mode off, for the engines that are not
+* thread safe. Call it before the cores are added to the cells.
+*/
+void smp_parallel_disable(void){
+	smp_parallel = False;
+}
+
+/**
+* @brief the handler of smp option
+*
+* @param this_option
+* @param num_params
+* @param params[]
+*
+* @return 
+*/
+static int
+do_smp_option (skyeye_option_t * this_option, int num_params,
+		    const char *params[])
+{
+	char name[MAX_PARAM_NAME], value[MAX_PARAM_NAME];
+	int i;
+	for (i = 0; i < num_params; i++) {
+		if (split_param (params[i], name, value) < 0) {
+			SKYEYE_ERR ("Error: smp has wrong parameter \"%s\".\n", name);
+			continue;
+		}
+		if (!strncmp ("cores", name, strlen (name))) {
+			smp_cores = strtoul (value, NULL, 0);
+			if (smp_cores == 0) {
+				SKYEYE_ERR ("Error: smp needs one core at least\n");
+				smp_cores = 1;
+			}
+		}
+		else if (!strncmp ("parallel", name, strlen (name))) {
+			if (!strncmp ("on", value, strlen (value)) || !strncmp ("yes", value, strlen (value)))
+				smp_parallel = True;
+			else
+				smp_parallel = False;
+		}
+		else if (!strncmp ("quantum", name, strlen (name))) {
+			smp_quantum = strtoul (value, NULL, 0);
+			if (smp_quantum == 0)
+				smp_quantum = SMP_DEFAULT_QUANTUM;
+		}
+		else
+			SKYEYE_ERR ("Error: Unknown smp option \"%s\"\n", params[i]);
+	}
+	return 0;
+}
+
+/**
+* @brief initialization of the cells
+*/
+void init_cell(void){
+	register_option("smp", do_smp_option, "Set the number of cores, run every core on its own host thread with parallel=on, the cores sync every quantum runs.\n");
+}
 /**
 * @brief start the running of a cell
 *
@@ -140,6 +339,19 @@ bool_t start_cell(skyeye_cell_t* cell){
 exception_t stop_cell(skyeye_cell_t* cell){
 	work_thread_t* thread = get_thread_by_cell(cell);
 	stop_thread(thread);
+	/* the stopped cell leaves the quantum barrier, the others do not
+	 * wait for it any more */
+	if(cell->smp){
+		pthread_mutex_lock(&smp_lock);
+		cell->smp = 0;
+		smp_cells--;
+		if(smp_arrived > 0 && smp_arrived >= smp_cells){
+			smp_arrived = 0;
+			smp_epoch++;
+			pthread_cond_broadcast(&smp_cond);
+		}
+		pthread_mutex_unlock(&smp_lock);
+	}
 	return No_exp;
 }
 
@@ -178,3 +390,13 @@ conf_object_t* get_current_exec_priv(pthread_t id){
 	}
 	return NULL;
 }
+
+/**
+* @brief get the exec object running on the calling thread, without
+* looking up the thread and its cell
+*
+* @return the private data of the exec object, NULL out of the cell threads
+*/
+conf_object_t* get_running_exec_priv(void){
+	return running_exec_priv;
+}
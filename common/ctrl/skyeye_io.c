@@ -1,9 +1,207 @@
 #include "skyeye_sched.h"
 #include "skyeye_io.h"
+#include "skyeye_thread.h"
+#include "skyeye_log.h"
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #define IO_CYCLE_DEFAULT 1000
 void register_io_cycle(io_cycle_func_t do_io_cycle,void* arg){
 	assert(do_io_cycle);
 	uint32 id;
 	create_thread_scheduler(IO_CYCLE_DEFAULT, Periodic_sched,do_io_cycle,arg,&id);
 }
+
+/*
+ * The io reactor: one host thread waits on all the watched file
+ * descriptors and posts the handler of a readable one to the thread
+ * scheduler, so the devices need not poll their host side with select.
+ * A descriptor is watched in oneshot mode, the handler calls io_rearm_fd
+ * after it has consumed the input. A backend that only moves the input
+ * into a queue of its own may ask for its handler to be called in the
+ * reactor thread, then the device drains the queue without any syscall.
+ */
+#define MAX_IO_WATCH 64
+
+typedef struct io_watch{
+	int used;
+	int fd;
+	sched_func_t func;
+	void *arg;
+	int in_reactor;
+	int running;	/* the handler is running in the reactor thread */
+}io_watch_t;
+
+static io_watch_t io_watches[MAX_IO_WATCH];
+static pthread_mutex_t io_watch_lock = PTHREAD_MUTEX_INITIALIZER;
+/* signaled when a handler returns in the reactor thread */
+static pthread_cond_t io_watch_cond = PTHREAD_COND_INITIALIZER;
+
+#ifdef __linux__
+static int io_epoll_fd = -1;
+static pthread_t io_reactor_id;
+
+/**
+* @brief the reactor thread
+*/
+static void *io_reactor(void *arg){
+	struct epoll_event events[MAX_IO_WATCH];
+	sched_func_t func;
+	void *func_arg;
+	int in_reactor;
+	int i, n;
+
+	while(1){
+		n = epoll_wait(io_epoll_fd, events, MAX_IO_WATCH, -1);
+		if(n < 0){
+			if(errno == EINTR)
+				continue;
+			skyeye_log(Error_log, __FUNCTION__, "epoll_wait failed, errno=%d\n", errno);
+			return NULL;
+		}
+		for(i = 0; i < n; i++){
+			io_watch_t *w = &io_watches[events[i].data.u32];
+			pthread_mutex_lock(&io_watch_lock);
+			func = w->used ? w->func : NULL;
+			func_arg = w->arg;
+			in_reactor = w->in_reactor;
+			if(func != NULL && in_reactor)
+				w->running = 1;
+			pthread_mutex_unlock(&io_watch_lock);
+			if(func == NULL)
+				continue;
+			if(in_reactor){
+				func(func_arg);
+				pthread_mutex_lock(&io_watch_lock);
+				w->running = 0;
+				pthread_cond_broadcast(&io_watch_cond);
+				pthread_mutex_unlock(&io_watch_lock);
+			}
+			else
+				post_thread_event(func, func_arg);
+		}
+	}
+	return NULL;
+}
+
+static int io_epoll_ctl(int op, int slot){
+	struct epoll_event ev;
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u32 = slot;
+	return epoll_ctl(io_epoll_fd, op, io_watches[slot].fd, &ev);
+}
+#endif
+
+static int find_io_watch(int fd){
+	int i;
+	for(i = 0; i < MAX_IO_WATCH; i++)
+		if(io_watches[i].used && io_watches[i].fd == fd)
+			return i;
+	return -1;
+}
+
+static int io_add_watch(int fd, sched_func_t func, void *arg, int in_reactor){
+#ifdef __linux__
+	int slot;
+	if(fd < 0 || func == NULL)
+		return -1;
+	pthread_mutex_lock(&io_watch_lock);
+	if(io_epoll_fd < 0){
+		if((io_epoll_fd = epoll_create(MAX_IO_WATCH)) < 0){
+			pthread_mutex_unlock(&io_watch_lock);
+			return -1;
+		}
+		create_thread(io_reactor, NULL, &io_reactor_id);
+	}
+	for(slot = 0; slot < MAX_IO_WATCH; slot++)
+		if(!io_watches[slot].used && !io_watches[slot].running)
+			break;
+	if(slot == MAX_IO_WATCH){
+		pthread_mutex_unlock(&io_watch_lock);
+		skyeye_log(Warning_log, __FUNCTION__, "Too many watched file descriptors\n");
+		return -1;
+	}
+	io_watches[slot].fd = fd;
+	io_watches[slot].func = func;
+	io_watches[slot].arg = arg;
+	io_watches[slot].in_reactor = in_reactor;
+	if(io_epoll_ctl(EPOLL_CTL_ADD, slot) != 0){
+		pthread_mutex_unlock(&io_watch_lock);
+		return -1;
+	}
+	io_watches[slot].used = 1;
+	pthread_mutex_unlock(&io_watch_lock);
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+/**
+* @brief call func in the thread scheduler when fd becomes readable
+*
+* @param fd the host file descriptor
+* @param func the handler, it should call io_rearm_fd when done
+* @param arg the argument of the handler
+*
+* @return 0 on success, -1 when the host has no reactor and the caller
+* should keep polling
+*/
+int io_watch_fd(int fd, sched_func_t func, void *arg){
+	return io_add_watch(fd, func, arg, 0);
+}
+
+/**
+* @brief call func in the reactor thread when fd becomes readable. The
+* handler runs concurrently with the cores, it must only read fd into a
+* queue of its own and must not block, io_unwatch_fd may be called from it.
+*
+* @param fd the host file descriptor
+* @param func the handler, it should call io_rearm_fd when done
+* @param arg the argument of the handler
+*
+* @return 0 on success, -1 when the host has no reactor
+*/
+int io_watch_fd_in_reactor(int fd, sched_func_t func, void *arg){
+	return io_add_watch(fd, func, arg, 1);
+}
+
+/**
+* @brief watch fd again after its handler has run
+*
+* @param fd the host file descriptor
+*/
+void io_rearm_fd(int fd){
+#ifdef __linux__
+	int slot;
+	pthread_mutex_lock(&io_watch_lock);
+	if((slot = find_io_watch(fd)) >= 0)
+		io_epoll_ctl(EPOLL_CTL_MOD, slot);
+	pthread_mutex_unlock(&io_watch_lock);
+#endif
+}
+
+/**
+* @brief stop watching fd. The handler running in the reactor thread has
+* returned when it returns, so the caller may free the argument of the
+* handler, unless it is called from the handler itself.
+*
+* @param fd the host file descriptor
+*/
+void io_unwatch_fd(int fd){
+#ifdef __linux__
+	int slot;
+	pthread_mutex_lock(&io_watch_lock);
+	if((slot = find_io_watch(fd)) >= 0){
+		epoll_ctl(io_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+		io_watches[slot].used = 0;
+		if(!pthread_equal(pthread_self(), io_reactor_id))
+			while(io_watches[slot].running)
+				pthread_cond_wait(&io_watch_cond, &io_watch_lock);
+	}
+	pthread_mutex_unlock(&io_watch_lock);
+#endif
+}
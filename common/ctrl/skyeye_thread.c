@@ -28,6 +28,7 @@
 #include <skyeye_exec.h>
 #include <skyeye_log.h>
 #include <sim_control.h>
+#include <skyeye_sched.h>
 
 /**
 * @brief skyeye running flag
@@ -103,6 +104,8 @@ void skyeye_loop(generic_arch_t *arch_instance){
                 }
 		/* run step once */
 		arch_instance->step_once ();
+		if(sched_icount_enabled && arch_instance->get_step)
+			sched_update_icount(arch_instance->get_step());
 	}
 }
 
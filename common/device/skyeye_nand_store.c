@@ -0,0 +1,412 @@
+/*
+	skyeye_nand_store.c - the image file behind a simulated nand flash
+	Copyright (C) 2003 - 2007 Skyeye Develop Group
+	for help please send mail to <skyeye-developer@lists.gro.clinux.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * The flash is read in place from memory, so a mount scan costs no
+ * syscall. The written chunks go back to the files in the background by
+ * msync. On a host without a shared mmap the image is read into a buffer
+ * and the dirty chunks are written back by the same periodic event.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "portable/mman.h"
+#include "skyeye_sched.h"
+#include "skyeye_log.h"
+#include "skyeye_nand_store.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/**
+* @brief the head of the trailer of an overlay, followed by one byte per chunk
+*/
+typedef struct nand_store_header {
+	char magic[8];
+	uint64_t size;
+	uint32_t chunk;
+	uint32_t reserved;
+} nand_store_header_t;
+
+static int store_pread(int fd, void *buf, uint64_t len, uint64_t offset){
+	uint8_t *p = buf;
+	ssize_t n;
+
+	if(lseek(fd, offset, SEEK_SET) == (off_t)-1)
+		return -1;
+	while(len > 0){
+		n = read(fd, p, len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int store_pwrite(int fd, const void *buf, uint64_t len, uint64_t offset){
+	const uint8_t *p = buf;
+	ssize_t n;
+
+	if(lseek(fd, offset, SEEK_SET) == (off_t)-1)
+		return -1;
+	while(len > 0){
+		n = write(fd, p, len);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* make the file at least len bytes long, the new bytes are a hole */
+static int store_grow(int fd, uint64_t len, uint64_t *old_len){
+	struct stat st;
+	uint8_t zero = 0;
+
+	if(fstat(fd, &st) < 0)
+		return -1;
+	*old_len = st.st_size;
+	if(st.st_size >= len)
+		return 0;
+	return store_pwrite(fd, &zero, 1, len - 1);
+}
+
+/* the image is the flash itself */
+static int store_map_image(nand_store_t *store){
+	uint64_t old_len;
+
+	if(store_grow(store->fd, store->size, &old_len) != 0)
+		return -1;
+#ifdef HAVE_MMAP_AND_MUNMAP
+	store->data = mmap(NULL, store->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+	if(store->data == MAP_FAILED){
+		store->data = NULL;
+		return -1;
+	}
+#else
+	if((store->data = malloc(store->map_size)) == NULL)
+		return -1;
+	if(store_pread(store->fd, store->data, old_len < store->size ? old_len : store->size, 0) != 0)
+		return -1;
+#endif
+	/* the blank part of a new image is erased */
+	if(old_len < store->size){
+		skyeye_log(Info_log, __FUNCTION__, "init %llu bytes of the nand image\n",
+			   (unsigned long long)(store->size - old_len));
+		nand_store_erase(store, old_len, store->size - old_len);
+	}
+	return 0;
+}
+
+/* the base is copied on write into private memory */
+static int store_map_base(nand_store_t *store){
+	struct stat st;
+	uint64_t len, mapped = 0;
+
+	if(fstat(store->base_fd, &st) < 0)
+		return -1;
+	len = st.st_size < store->size ? st.st_size : store->size;
+#ifdef HAVE_MMAP_AND_MUNMAP
+	store->data = mmap(NULL, store->map_size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(store->data == MAP_FAILED){
+		store->data = NULL;
+		return -1;
+	}
+	mapped = len - len % getpagesize();
+	if(mapped > 0 && mmap(store->data, mapped, PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_FIXED, store->base_fd, 0) == MAP_FAILED)
+		return -1;
+#else
+	if((store->data = malloc(store->map_size)) == NULL)
+		return -1;
+#endif
+	if(len > mapped && store_pread(store->base_fd, store->data + mapped, len - mapped, mapped) != 0)
+		return -1;
+	memset(store->data + len, 0xff, store->size - len);
+	return 0;
+}
+
+/* load the trailer of the overlay and bring its chunks over the base */
+static int store_open_overlay(nand_store_t *store, const char *image){
+	nand_store_header_t *header;
+	uint64_t old_len;
+	uint32_t i, n;
+
+	store->trailer_size = sizeof(nand_store_header_t) + store->chunk_num;
+	store->trailer_size = (store->trailer_size + NAND_STORE_CHUNK - 1) & ~(NAND_STORE_CHUNK - 1);
+	if(store_grow(store->fd, store->map_size + store->trailer_size, &old_len) != 0)
+		return -1;
+#ifdef HAVE_MMAP_AND_MUNMAP
+	store->trailer = mmap(NULL, store->trailer_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			      store->fd, store->map_size);
+	if(store->trailer == MAP_FAILED){
+		store->trailer = NULL;
+		return -1;
+	}
+#else
+	if((store->trailer = malloc(store->trailer_size)) == NULL)
+		return -1;
+	if(store_pread(store->fd, store->trailer, store->trailer_size, store->map_size) != 0)
+		return -1;
+#endif
+	header = (nand_store_header_t *)store->trailer;
+	store->cow = store->trailer + sizeof(nand_store_header_t);
+	if(memcmp(header->magic, NAND_STORE_MAGIC, sizeof(header->magic))){
+		for(i = 0; i < sizeof(nand_store_header_t); i++)
+			if(store->trailer[i])
+				break;
+		if(i != sizeof(nand_store_header_t)){
+			skyeye_log(Error_log, __FUNCTION__, "%s is not a nand overlay\n", image);
+			errno = EINVAL;
+			return -1;
+		}
+		memcpy(header->magic, NAND_STORE_MAGIC, sizeof(header->magic));
+		header->size = store->size;
+		header->chunk = NAND_STORE_CHUNK;
+		store->need_sync = 1;
+	}
+	else if(header->size != store->size || header->chunk != NAND_STORE_CHUNK){
+		skyeye_log(Error_log, __FUNCTION__, "%s is an overlay of another nand\n", image);
+		errno = EINVAL;
+		return -1;
+	}
+
+	for(i = 0; i < store->chunk_num; i += n){
+		for(n = 0; i + n < store->chunk_num && store->cow[i + n]; n++)
+			;
+		if(n == 0){
+			n = 1;
+			continue;
+		}
+#ifdef HAVE_MMAP_AND_MUNMAP
+		if(mmap(store->data + (uint64_t)i * NAND_STORE_CHUNK, (uint64_t)n * NAND_STORE_CHUNK,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, store->fd,
+			(uint64_t)i * NAND_STORE_CHUNK) == MAP_FAILED)
+			return -1;
+#else
+		if(store_pread(store->fd, store->data + (uint64_t)i * NAND_STORE_CHUNK,
+			       (uint64_t)n * NAND_STORE_CHUNK, (uint64_t)i * NAND_STORE_CHUNK) != 0)
+			return -1;
+#endif
+	}
+	return 0;
+}
+
+static void nand_store_sync_event(void *arg){
+	nand_store_sync((nand_store_t *)arg, 0);
+}
+
+/**
+* @brief open the storage of a nand flash
+*
+* @param store the storage
+* @param image the file that keeps the writes, NULL to keep them in memory
+* @param base the read only base image, NULL if image holds the whole flash
+* @param size the size of the flash with its spare areas
+*
+* @return 0 on success, -1 on failure
+*/
+int nand_store_open(nand_store_t *store, const char *image, const char *base, uint64_t size){
+	const char *name;
+
+	memset(store, 0, sizeof(*store));
+	store->fd = -1;
+	store->base_fd = -1;
+	store->sync_id = -1;
+	store->size = size;
+	store->chunk_num = (size + NAND_STORE_CHUNK - 1) / NAND_STORE_CHUNK;
+	store->map_size = (uint64_t)store->chunk_num * NAND_STORE_CHUNK;
+	if(image != NULL && image[0] == '\0')
+		image = NULL;
+	if(base != NULL && base[0] == '\0')
+		base = NULL;
+	if(image == NULL && base == NULL){
+		skyeye_log(Error_log, __FUNCTION__, "nand flash needs an image file\n");
+		return -1;
+	}
+
+	name = image;
+	if(image != NULL && (store->fd = open(image, O_RDWR | O_CREAT | O_BINARY, S_IRUSR | S_IWUSR)) < 0)
+		goto fail;
+#ifndef HAVE_MMAP_AND_MUNMAP
+	if(store->fd >= 0 && (store->dirty = calloc(store->chunk_num, 1)) == NULL)
+		goto fail;
+#endif
+	if(base != NULL){
+		name = base;
+		if((store->base_fd = open(base, O_RDONLY | O_BINARY)) < 0 || store_map_base(store) != 0)
+			goto fail;
+		name = image;
+		if(store->fd >= 0 && store_open_overlay(store, image) != 0)
+			goto fail;
+	}
+	else if(store_map_image(store) != 0)
+		goto fail;
+
+	if(store->fd >= 0)
+		create_thread_scheduler(NAND_STORE_SYNC_PERIOD, Periodic_sched,
+					nand_store_sync_event, store, &store->sync_id);
+	return 0;
+fail:
+	skyeye_log(Error_log, __FUNCTION__, "can not open the nand image %s: %s\n",
+		   name, strerror(errno));
+	nand_store_close(store);
+	return -1;
+}
+
+/**
+* @brief write the storage back and release it
+*/
+void nand_store_close(nand_store_t *store){
+	if(store->sync_id >= 0)
+		del_thread_scheduler(store->sync_id);
+	store->sync_id = -1;
+	if(store->data != NULL)
+		nand_store_sync(store, 1);
+#ifdef HAVE_MMAP_AND_MUNMAP
+	if(store->data != NULL)
+		munmap(store->data, store->map_size);
+	if(store->trailer != NULL)
+		munmap(store->trailer, store->trailer_size);
+#else
+	free(store->data);
+	free(store->trailer);
+#endif
+	free(store->dirty);
+	if(store->fd >= 0)
+		close(store->fd);
+	if(store->base_fd >= 0)
+		close(store->base_fd);
+	store->data = NULL;
+	store->trailer = NULL;
+	store->cow = NULL;
+	store->dirty = NULL;
+	store->fd = -1;
+	store->base_fd = -1;
+}
+
+/**
+* @brief write the modified chunks back to the image
+*
+* @param store the storage
+* @param wait wait until the data is on the disk
+*/
+void nand_store_sync(nand_store_t *store, int wait){
+#ifndef HAVE_MMAP_AND_MUNMAP
+	uint64_t offset, len;
+	uint32_t i;
+#endif
+	if(store->fd < 0 || !store->need_sync)
+		return;
+	store->need_sync = 0;
+#ifdef HAVE_MMAP_AND_MUNMAP
+	msync(store->data, store->map_size, wait ? MS_SYNC : MS_ASYNC);
+	if(store->trailer != NULL)
+		msync(store->trailer, store->trailer_size, wait ? MS_SYNC : MS_ASYNC);
+#else
+	for(i = 0; i < store->chunk_num; i++){
+		if(!store->dirty[i])
+			continue;
+		store->dirty[i] = 0;
+		offset = (uint64_t)i * NAND_STORE_CHUNK;
+		len = store->size - offset < NAND_STORE_CHUNK ? store->size - offset : NAND_STORE_CHUNK;
+		if(store_pwrite(store->fd, store->data + offset, len, offset) != 0){
+			skyeye_log(Error_log, __FUNCTION__, "nand image write error: %s\n", strerror(errno));
+			continue;
+		}
+		if(store->cow != NULL)
+			store->cow[i] = 1;
+	}
+	if(store->trailer != NULL)
+		store_pwrite(store->fd, store->trailer, store->trailer_size, store->map_size);
+#endif
+}
+
+/* move a chunk of the base into the overlay before it is written */
+static void store_copy_chunk(nand_store_t *store, uint32_t i){
+#ifdef HAVE_MMAP_AND_MUNMAP
+	uint64_t offset = (uint64_t)i * NAND_STORE_CHUNK;
+	if(store_pwrite(store->fd, store->data + offset, NAND_STORE_CHUNK, offset) != 0 ||
+	   mmap(store->data + offset, NAND_STORE_CHUNK, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, store->fd, offset) == MAP_FAILED){
+		skyeye_log(Error_log, __FUNCTION__, "nand overlay write error: %s\n", strerror(errno));
+		return;
+	}
+	store->cow[i] = 1;
+#endif
+}
+
+/**
+* @brief make the bytes from offset writable, they are saved later
+*
+* @return the bytes at offset
+*/
+uint8_t *nand_store_prepare(nand_store_t *store, uint64_t offset, uint64_t len){
+	uint32_t i, last;
+
+	if(len == 0)
+		return store->data + offset;
+	last = (offset + len - 1) / NAND_STORE_CHUNK;
+	for(i = offset / NAND_STORE_CHUNK; i <= last; i++){
+		if(store->cow != NULL && !store->cow[i])
+			store_copy_chunk(store, i);
+		if(store->dirty != NULL)
+			store->dirty[i] = 1;
+	}
+	store->need_sync = 1;
+	return store->data + offset;
+}
+
+/**
+* @brief overwrite the bytes from offset
+*/
+void nand_store_write(nand_store_t *store, uint64_t offset, const void *buf, uint64_t len){
+	memcpy(nand_store_prepare(store, offset, len), buf, len);
+}
+
+/**
+* @brief program the bytes from offset, a bit can only go from 1 to 0
+*/
+void nand_store_program(nand_store_t *store, uint64_t offset, const uint8_t *buf, uint64_t len){
+	uint8_t *p = nand_store_prepare(store, offset, len);
+	uint64_t i;
+	for(i = 0; i < len; i++)
+		p[i] &= buf[i];
+}
+
+/**
+* @brief erase the bytes from offset to 0xff
+*/
+void nand_store_erase(nand_store_t *store, uint64_t offset, uint64_t len){
+	memset(nand_store_prepare(store, offset, len), 0xff, len);
+}
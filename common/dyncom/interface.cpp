@@ -124,6 +124,7 @@ cpu_new(uint32_t flags, uint32_t arch_flags, arch_func_t arch_func)
 	cpu->dyncom_engine->code_end = 0;
 	cpu->dyncom_engine->code_entry = 0;
 	cpu->dyncom_engine->tag = NULL;
+	cpu->dyncom_engine->tlb = NULL;
 
 	/* init hash fast map */
 #ifdef HASH_FAST_MAP
@@ -637,9 +638,9 @@ cpu_run(cpu_t *cpu)
 		int user_mode = (((*(uint32_t *)cpu->rf.cpsr) & 0x1F) == USER32MODE);
 		unsigned long offset = context_id * TLB_SIZE * TLB_ENTRY_SIZE;
 		if(user_mode)
-			ret = pfunc(cpu->dyncom_engine->RAM, cpu->rf.grf, cpu->rf.srf, cpu->rf.frf, cpu->mem_ops.read_memory, cpu->mem_ops.write_memory, (get_tlb(DATA_USER_READ) + offset), (get_tlb(DATA_USER_WRITE) + offset), (get_tlb(MIXED_TLB) + offset), (get_tlb(IO_TLB) + offset), user_mode);
+			ret = pfunc(cpu->dyncom_engine->RAM, cpu->rf.grf, cpu->rf.srf, cpu->rf.frf, cpu->mem_ops.read_memory, cpu->mem_ops.write_memory, (get_tlb(cpu, DATA_USER_READ) + offset), (get_tlb(cpu, DATA_USER_WRITE) + offset), (get_tlb(cpu, MIXED_TLB) + offset), (get_tlb(cpu, IO_TLB) + offset), user_mode);
 		else
-			ret = pfunc(cpu->dyncom_engine->RAM, cpu->rf.grf, cpu->rf.srf, cpu->rf.frf, cpu->mem_ops.read_memory, cpu->mem_ops.write_memory, (get_tlb(DATA_KERNEL_READ) + offset), get_tlb(DATA_KERNEL_WRITE) + offset, (get_tlb(MIXED_TLB) + offset), get_tlb(IO_TLB) + offset, user_mode);
+			ret = pfunc(cpu->dyncom_engine->RAM, cpu->rf.grf, cpu->rf.srf, cpu->rf.frf, cpu->mem_ops.read_memory, cpu->mem_ops.write_memory, (get_tlb(cpu, DATA_KERNEL_READ) + offset), get_tlb(cpu, DATA_KERNEL_WRITE) + offset, (get_tlb(cpu, MIXED_TLB) + offset), get_tlb(cpu, IO_TLB) + offset, user_mode);
 
 		if (ret != JIT_RETURN_FUNCNOTFOUND)
 			return ret;
@@ -56,6 +56,11 @@ void inc_jit_num(addr_t addr){
 	phys_pages[PAGE_INDEX(addr)].jit_num++;
 	return;
 }
+void dec_jit_num(addr_t addr){
+	if(phys_pages[PAGE_INDEX(addr)].jit_num > 0)
+		phys_pages[PAGE_INDEX(addr)].jit_num--;
+	return;
+}
 int get_jit_num(addr_t addr){
 	//DBG("addr=0x%x, index=0x%x in %s\n", addr, PAGE_INDEX(addr), __FUNCTION__);
 	return phys_pages[PAGE_INDEX(addr)].jit_num;
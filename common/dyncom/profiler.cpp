@@ -1,14 +1,20 @@
 #include <algorithm>
+#include <set>
 #include "dyncom/profiler.h"
+#include "dyncom/tag.h"
 #include <skyeye_sched.h>
 
 hotpath_map HotpathCache[65536];
 uint32_t total_hotpath = 0;
 uint64_t total_time = 0;
-vector<uint32_t> trace_set[10240];
-vector<uint32_t> start_addr[10240];
+/* the instructions and the entries of every trace, indexed by the hotspot id */
+map<uint32_t, vector<uint32_t> > trace_set;
+map<uint32_t, vector<uint32_t> > start_addr;
 //vector<uint32_t> inner_jump[1024];
-vector<uint32_t> entry_addr[10240];
+map<uint32_t, vector<uint32_t> > entry_addr;
+/* the traces with native code, and the traces having code on every physical page */
+static map<uint32_t, hotspot *> HotspotSet;
+static map<uint32_t, vector<hotspot *> > HotpathPages;
 
 #define HASH(x) ((x + (x << 2) + (x >> 6)) % 65536)
 void insert_hotpath(vector<uint32_t> &start_addr, hotspot *jit)
@@ -27,6 +33,14 @@ void insert_hotpath(vector<uint32_t> &start_addr, hotspot *jit)
 		HotpathCache[HASH(addr)][addr] = jit;
 	}
 	#endif
+	/* a write to any page the trace was built from drops the whole trace */
+	set<uint32_t> pages;
+	vector<uint32_t> &trace = trace_set[jit->id];
+	for(it = trace.begin(); it != trace.end(); ++it)
+		pages.insert(*it & 0xfffff000);
+	for(set<uint32_t>::iterator p = pages.begin(); p != pages.end(); ++p)
+		HotpathPages[*p].push_back(jit);
+	HotspotSet[jit->id] = jit;
 }
 
 void merge_page(uint32_t id)
@@ -48,23 +62,95 @@ hotspot *find_hotpath(unsigned int addr) {
 		return NULL;
 }
 
+/**
+* @brief Drop the native code of a trace from its cpu, the entries of the
+* trace on every page it crosses are removed from the function map and the
+* instructions are untagged, so they run in the interpreter and can be
+* traced again.
+*
+* @param hs the trace
+*/
+static void remove_hotpath(hotspot *hs)
+{
+	cpu_t *cpu = hs->cpu;
+	vector<uint32_t>::iterator it;
+	uint32_t addr;
+
+	for(it = start_addr[hs->id].begin(); it != start_addr[hs->id].end(); ++it) {
+		addr = *it;
+		hotpath_map::iterator entry = HotpathCache[HASH(addr)].find(addr);
+		if (entry != HotpathCache[HASH(addr)].end() && entry->second == hs)
+			HotpathCache[HASH(addr)].erase(entry);
+	}
+#ifndef __WIN32__
+	pthread_rwlock_wrlock(&(cpu->dyncom_engine->rwlock));
+#endif
+	for(it = trace_set[hs->id].begin(); it != trace_set[hs->id].end(); ++it) {
+		addr = *it;
+#ifdef HASH_FAST_MAP
+		fast_map fmap = cpu->dyncom_engine->fmap;
+#if L3_HASHMAP
+		if (fmap[HASH_MAP_INDEX_L1(addr)] != NULL && fmap[HASH_MAP_INDEX_L1(addr)][HASH_MAP_INDEX_L2(addr)] != NULL
+		    && fmap[HASH_MAP_INDEX_L1(addr)][HASH_MAP_INDEX_L2(addr)][HASH_MAP_INDEX_L3(addr)] == hs->jit)
+			fmap[HASH_MAP_INDEX_L1(addr)][HASH_MAP_INDEX_L2(addr)][HASH_MAP_INDEX_L3(addr)] = NULL;
+#else
+		if (fmap[addr & (HASH_FAST_MAP_SIZE - 1)] == hs->jit)
+			fmap[addr & (HASH_FAST_MAP_SIZE - 1)] = NULL;
+#endif
+#endif
+		set_tag(cpu, addr, get_tag(cpu, addr) & (TAG_FAST_INTERP | TAG_THUMB));
+	}
+#ifndef __WIN32__
+	pthread_rwlock_unlock(&(cpu->dyncom_engine->rwlock));
+#endif
+	HotspotSet.erase(hs->id);
+	trace_set.erase(hs->id);
+	start_addr.erase(hs->id);
+	entry_addr.erase(hs->id);
+	delete hs;
+}
+
+/**
+* @brief Invalidate every trace having code on the physical page pfn, the
+* traces are dropped as a whole since they may cross into other pages.
+*
+* @param pfn the written physical address
+*/
 void flush_hotpath_by_pfn(unsigned int pfn) {
-	hotpath_map::iterator it;
-	uint32_t start;
-
-	for (int i = 0; i < 65536; ++i) {
-		for (it = HotpathCache[i].begin(); it != HotpathCache[i].end(); ) {
-			start = static_cast<uint32_t>(it->first);
-			start &= 0xfffff000;
-			if (start == pfn) {
-				//printf("[ERASE][0x%08x]\n", static_cast<int>(it->first));
-				HotpathCache[i].erase(it ++);
-			} else
-				++it;
+	map<uint32_t, vector<hotspot *> >::iterator page = HotpathPages.find(pfn & 0xfffff000);
+	if (page == HotpathPages.end())
+		return;
+	vector<hotspot *> dead;
+	dead.swap(page->second);
+	HotpathPages.erase(page);
+
+	for (vector<hotspot *>::iterator hs = dead.begin(); hs != dead.end(); ++hs) {
+		/* forget the trace on the other pages it crosses */
+		set<uint32_t> pages;
+		vector<uint32_t> &trace = trace_set[(*hs)->id];
+		for (vector<uint32_t>::iterator it = trace.begin(); it != trace.end(); ++it)
+			pages.insert(*it & 0xfffff000);
+		for (set<uint32_t>::iterator p = pages.begin(); p != pages.end(); ++p) {
+			map<uint32_t, vector<hotspot *> >::iterator other = HotpathPages.find(*p);
+			if (other == HotpathPages.end())
+				continue;
+			other->second.erase(remove(other->second.begin(), other->second.end(), *hs), other->second.end());
+			if (other->second.empty())
+				HotpathPages.erase(other);
 		}
+		remove_hotpath(*hs);
 	}
 }
 
+/**
+* @brief Whether the trace of the id still has native code, the profiling
+* data marked with a dropped trace can join a new one.
+*/
+bool is_hotspot_alive(uint32_t id)
+{
+	return HotspotSet.find(id) != HotspotSet.end();
+}
+
 void print_out(hotspot *hs) {
 	AddrSet::iterator it;
 	for (it = hs->out.begin(); it != hs->out.end(); ++it) {
@@ -121,11 +207,11 @@ void alloc_hotspot_id() {
 
 void free_hotspot_id() {
 //	printf("free hotpath %d\n", total_hotpath);
-	trace_set[total_hotpath].clear();
-	start_addr[total_hotpath].clear();
+	trace_set.erase(total_hotpath);
+	start_addr.erase(total_hotpath);
 //	inner_jump[total_hotpath].clear();
-	entry_addr[total_hotpath].clear();
-	--total_hotpath;
+	entry_addr.erase(total_hotpath);
+	/* the id is not reused, the profiling data may still be marked with it */
 }
 
 uint32_t get_hotspot_id()
@@ -166,8 +252,9 @@ hotspot *gene_native_code(cpu_t *cpu) {
 	#if 1
 	tag_by_trace(cpu, trace_set[total_hotpath], start_addr[total_hotpath]);
 	cpu->dyncom_engine->cur_tagging_pos ++;
-	void * jit = cpu_translate(cpu, cpu->f.get_pc(cpu, cpu->rf.grf));
+	void * jit = cpu_translate(cpu, start_addr[total_hotpath].front());
 	hs = new_hotspot(jit);
+	hs->cpu = cpu;
 //	print_trace();
 //	print_entry();
 	#if 0
@@ -9,7 +9,11 @@
 #ifndef _SHA1_H
 # define _SHA1_H
 
-#include "skyeye_dyncom.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
 
 typedef struct {
   uint32_t state[5];
@@ -22,6 +26,10 @@ void SHA1Init(SHA1_CTX* context);
 void SHA1Update(SHA1_CTX* context, const unsigned char* data, uint32_t len);
 void SHA1Final(unsigned char digest[20], SHA1_CTX* context);
 
+#ifdef __cplusplus
+}
+#endif
+
 # define SHA1_Transform SHA1Transform
 # define SHA1_Init SHA1Init
 # define SHA1_Update SHA1Update
@@ -52,7 +52,9 @@ is_tag_level3_table_allocated(cpu_t *cpu, addr_t addr)
 }
 
 /**
- * @brief initialize tag level2 table
+ * @brief initialize tag level2 table. The tags of a core are also read and
+ * set by the other cores in the parallel smp mode, so the table is
+ * published with compare and swap and the loser frees its copy.
  *
  * @param cpu CPU core structure
  * @param addr address to tag
@@ -64,7 +66,8 @@ init_tag_level2_table(cpu_t *cpu, addr_t addr)
 	memset(tag, 0, TAG_LEVEL2_TABLE_SIZE * sizeof(tag_t *));
 
 	uint32_t level1_offset = TAG_LEVEL1_OFFSET(addr);
-	cpu->dyncom_engine->tag_table[level1_offset] = tag;
+	if (!__sync_bool_compare_and_swap(&cpu->dyncom_engine->tag_table[level1_offset], (tag_t **)NULL, tag))
+		skyeye_free(tag);
 }
 
 /**
@@ -88,7 +91,8 @@ init_tag_level3_table(cpu_t *cpu, addr_t addr)
 
 	uint32_t level1_offset = TAG_LEVEL1_OFFSET(addr);
 	uint32_t level2_offset = TAG_LEVEL2_OFFSET(addr);
-	cpu->dyncom_engine->tag_table[level1_offset][level2_offset] = tag;
+	if (!__sync_bool_compare_and_swap(&cpu->dyncom_engine->tag_table[level1_offset][level2_offset], (tag_t *)NULL, tag))
+		skyeye_free(tag);
 }
 
 /**
@@ -182,8 +186,16 @@ is_inside_code_area(cpu_t *cpu, addr_t a)
 void
 or_tag(cpu_t *cpu, addr_t a, tag_t t)
 {
-	tag_t old_tag = get_tag(cpu, a);
-	set_tag(cpu, a, (old_tag|t));
+	/* NEW_PC_NONE is not a real address. Some branch/call address could not be known at translate-time*/
+	if (a == NEW_PC_NONE) {
+		return;
+	}
+	check_tag_memory_integrity(cpu, a);
+	uint32_t level1_offset = TAG_LEVEL1_OFFSET(a);
+	uint32_t level2_offset = TAG_LEVEL2_OFFSET(a);
+	uint32_t level3_offset = TAG_LEVEL3_OFFSET(a);
+	/* atomic, another core may set the tags of this core at the same time */
+	__sync_fetch_and_or(&cpu->dyncom_engine->tag_table[level1_offset][level2_offset][level3_offset], t);
 	return;
 }
 void
@@ -590,6 +602,7 @@ tag_iterative(cpu_t *cpu, vector<uint32_t> &trace, vector<uint32_t> &start_addr)
 	addr_t new_pc, next_pc, pc;
 
 	vector<uint32_t>::iterator it;
+	vector<uint32_t>::iterator next_start = start_addr.begin();
 	for(it = trace.begin(); it != trace.end(); ++it) {
 		pc = *it;
 //		printf("in tag, pc : %x\n", pc);
@@ -609,6 +622,13 @@ tag_iterative(cpu_t *cpu, vector<uint32_t> &trace, vector<uint32_t> &start_addr)
 		   we remove instr dependant tags. They will be set again anyway */
 		selective_clear_tag(cpu, pc, TAG_BRANCH | TAG_CONDITIONAL | TAG_RET | TAG_STOP | TAG_CONTINUE | TAG_TRAP | TAG_NEW_BB | TAG_END_PAGE);
 		or_tag(cpu, pc, tag | TAG_CODE);
+		/* every block of the trace is an entry, the trace is entered again
+		   after it leaves at the end of a page or through a side exit */
+		if (next_start != start_addr.end() && *next_start == pc) {
+			or_tag(cpu, pc, TAG_ENTRY);
+			save_startbb_addr(cpu, pc);
+			++next_start;
+		}
 #ifdef OPT_LOCAL_REGISTERS
 #if 0
 		if (is_inside_code_area(cpu, next_pc)){
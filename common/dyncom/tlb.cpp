@@ -26,37 +26,176 @@
 #include <stdint.h> 
 #include <string.h>
 #include <stdlib.h>
+#include <assert.h>
 //#define DEBUG
 #include "skyeye_log.h"
+#include "skyeye_types.h"
+#include "skyeye_thread.h"
+extern "C" {
+#include "skyeye_command.h"
+}
 
 //typedef tlb_item 
 #include "dyncom/phys_page.h"
 #include "dyncom/tlb.h"
-//static tlb_item* tlb_cache = NULL;
-static uint64_t tlb_cache[TLB_TOTAL][ASID_SIZE][TLB_SIZE];
-static int max_context_id = 0;
-//static tlb_table tlb[TLB_TOTAL];
-int get_phys_page(unsigned int va, int context_id, unsigned int &pa, tlb_type_t access_type)
+
+/*
+ * The tlb used by the interpreter and the miss path of the JIT is set
+ * associative, every way records its asid and the generation of the
+ * asid when it is inserted. Flushing an asid or the whole tlb only
+ * increases the generation, the stale ways are found invalid by the
+ * next lookup.
+ */
+typedef struct tlb_way {
+	uint32_t va;
+	uint32_t pa;
+	uint32_t asid;
+	uint32_t gen;
+} tlb_way_t;
+
+typedef struct tlb_set {
+	tlb_way_t way[TLB_WAYS];
+	/* tree pseudo-lru bits, bit 0 selects the half, bit 1 and 2 the way */
+	uint32_t plru;
+} tlb_set_t;
+
+/*
+ * Every core fills and flushes its own tlb, so the cores running on
+ * their own host threads never share a way or a JIT view.
+ */
+typedef struct tlb_state {
+	tlb_set_t sets[TLB_TOTAL][TLB_SETS];
+	/* the generation of every asid, indexed by insn or data class */
+	uint32_t asid_gen[2][ASID_SIZE];
+	/* the generation of the whole tlb */
+	uint32_t global_gen[2];
+	tlb_stat_t stat[TLB_TOTAL];
+	/*
+	 * The direct mapped view only read by the code generated by JIT, it is
+	 * indexed by asid so the JIT function can get its table by an offset.
+	 */
+	uint64_t cache[TLB_TOTAL][ASID_SIZE][TLB_SIZE];
+	/* the asid has some valid items in the direct mapped view */
+	uint8_t jit_asid_used[TLB_TOTAL][ASID_SIZE];
+	struct tlb_state *next;
+} tlb_state_t;
+
+/* the tlb of every core, for the tlb-stat command */
+static tlb_state_t *tlb_list = NULL;
+
+#define CPU_TLB(cpu) ((tlb_state_t *)(cpu)->dyncom_engine->tlb)
+
+#define TLB_CLASS(type) (((type) == INSN_USER || (type) == INSN_KERNEL) ? 1 : 0)
+#define TLB_SET_INDEX(va) (((va) >> 12) & (TLB_SETS - 1))
+#define TLB_JIT_INDEX(va) (((va) >> 12) % TLB_SIZE)
+
+static inline uint32_t current_gen(tlb_state_t *t, int type, uint32_t asid){
+	int cls = TLB_CLASS(type);
+	/* both generations only increase, so their sum changes on every flush */
+	return t->global_gen[cls] + t->asid_gen[cls][asid];
+}
+
+/* mark the way as the most recently used one */
+static inline void touch_way(tlb_set_t *set, int i){
+	if(i < 2)
+		set->plru = ((set->plru | 0x1) & ~0x2) | ((i & 1) ? 0 : 0x2);
+	else
+		set->plru = (set->plru & ~0x5) | ((i & 1) ? 0 : 0x4);
+}
+
+/* get the least recently used way by following the plru bits */
+static inline int victim_way(tlb_set_t *set){
+	if(set->plru & 0x1)
+		return 2 + ((set->plru & 0x4) ? 1 : 0);
+	else
+		return (set->plru & 0x2) ? 1 : 0;
+}
+
+static inline tlb_way_t* lookup_way(tlb_state_t *t, int type, uint32_t va, uint32_t asid){
+	tlb_set_t *set = &t->sets[type][TLB_SET_INDEX(va)];
+	uint32_t gen = current_gen(t, type, asid);
+	int i;
+	for(i = 0; i < TLB_WAYS; i++){
+		tlb_way_t *way = &set->way[i];
+		if(way->va == va && way->asid == asid && way->gen == gen && way->pa != INVAILAD_ITEM){
+			touch_way(set, i);
+			return way;
+		}
+	}
+	return NULL;
+}
+
+static void fill_way(tlb_state_t *t, int type, uint32_t va, uint32_t asid, uint32_t pa){
+	tlb_set_t *set = &t->sets[type][TLB_SET_INDEX(va)];
+	uint32_t gen = current_gen(t, type, asid);
+	int i, victim = -1;
+	for(i = 0; i < TLB_WAYS; i++){
+		tlb_way_t *way = &set->way[i];
+		/* reuse the way of the same page or a stale way */
+		if((way->va == va && way->asid == asid) || way->gen != current_gen(t, type, way->asid)
+			|| way->pa == INVAILAD_ITEM){
+			victim = i;
+			break;
+		}
+	}
+	if(victim < 0)
+		victim = victim_way(set);
+	set->way[victim].va = va;
+	set->way[victim].pa = pa;
+	set->way[victim].asid = asid;
+	set->way[victim].gen = gen;
+	touch_way(set, victim);
+
+	/* keep the view of JIT */
+	tlb_item *tlb_entry = (tlb_item *)&t->cache[type][asid][TLB_JIT_INDEX(va)];
+	tlb_entry->pa = pa;
+	tlb_entry->va = va;
+	t->jit_asid_used[type][asid] = 1;
+}
+
+static void clear_way(tlb_state_t *t, int type, uint32_t va, uint32_t asid){
+	tlb_way_t *way = lookup_way(t, type, va, asid);
+	if(way != NULL)
+		way->va = way->pa = INVAILAD_ITEM;
+	tlb_item *tlb_entry = (tlb_item *)&t->cache[type][asid][TLB_JIT_INDEX(va)];
+	if(tlb_entry->va == va)
+		tlb_entry->va = tlb_entry->pa = INVAILAD_ITEM;
+}
+
+/* flush the JIT view of an asid, only if something is inserted */
+static void clear_jit_view(tlb_state_t *t, int type, uint32_t asid){
+	if(t->jit_asid_used[type][asid]){
+		memset(&t->cache[type][asid], 0, sizeof(tlb_item) * TLB_SIZE);
+		t->jit_asid_used[type][asid] = 0;
+	}
+}
+
+static inline uint32_t get_asid(unsigned int va){
+	return va & (ASID_SIZE - 1);
+}
+
+int get_phys_page(cpu_t* cpu, unsigned int va, int context_id, unsigned int &pa, tlb_type_t access_type)
 {
+	tlb_state_t *t = CPU_TLB(cpu);
 	//DBG("type=%d in %s\n", access_type, __FUNCTION__);	
-	tlb_item *tlb_entry = (tlb_item *)&tlb_cache[access_type][context_id][(va >> 12) % TLB_SIZE];
-	if (va == tlb_entry->va) {
-		pa = tlb_entry->pa;
+	tlb_way_t *way = lookup_way(t, access_type, va, context_id);
+	if (way != NULL) {
+		pa = way->pa;
+		t->stat[access_type].hit++;
 		//DBG("get pa 0x%x for va 0x%x in %s\n", va, pa, __FUNCTION__);
 		return 0;
 	} else {
+		t->stat[access_type].miss++;
 		return -1;
 	}
 }
 
-void insert(unsigned int va, int context_id, unsigned int pa, tlb_type_t access_type)
+void insert(cpu_t* cpu, unsigned int va, int context_id, unsigned int pa, tlb_type_t access_type)
 {
-	tlb_item* tlb_entry = NULL;
-	DBG("In %s, index=0x%x, va=0x%x, pa=0x%x, tlb_entry=0x%llx, access_type=%d\n", __FUNCTION__, ((va & 0xff) * TLB_SIZE) + ((va >> 12) % TLB_SIZE), va, pa, (unsigned long)tlb_entry, access_type);
+	tlb_state_t *t = CPU_TLB(cpu);
+	DBG("In %s, va=0x%x, pa=0x%x, access_type=%d\n", __FUNCTION__, va, pa, access_type);
 	/* mark the io page */
 	assert(access_type < TLB_TOTAL && access_type >= 0);
-	if(context_id > max_context_id)
-		max_context_id = context_id;
 	#if 1
 	if((access_type == DATA_USER_WRITE) || (access_type == DATA_KERNEL_WRITE)){
 		/* set to MIXED type for the page also contain some translated instructions */
@@ -65,21 +204,15 @@ void insert(unsigned int va, int context_id, unsigned int pa, tlb_type_t access_
 	}
 	if(access_type == INSN_USER || access_type == INSN_KERNEL){
 		/* also need to check if the corresponding page exist at data tlb */
-		tlb_item* kernel_item = (tlb_item* )&tlb_cache[DATA_KERNEL_WRITE][context_id][(va >> 12) % TLB_SIZE];
-		tlb_item* user_item = (tlb_item* )&tlb_cache[DATA_USER_WRITE][context_id][(va >> 12) % TLB_SIZE];
-		if(kernel_item->va == va && kernel_item->pa == pa){
-			kernel_item->va = kernel_item->pa = INVAILAD_ITEM;
-			tlb_entry = (tlb_item* )&tlb_cache[MIXED_TLB][context_id][(va >> 12) % TLB_SIZE];
-			tlb_entry->pa = pa;
-			tlb_entry->va = va;
-			//access_type = MIXED_TLB;
+		tlb_way_t* kernel_item = lookup_way(t, DATA_KERNEL_WRITE, va, context_id);
+		tlb_way_t* user_item = lookup_way(t, DATA_USER_WRITE, va, context_id);
+		if(kernel_item != NULL && kernel_item->pa == pa){
+			clear_way(t, DATA_KERNEL_WRITE, va, context_id);
+			fill_way(t, MIXED_TLB, va, context_id, pa);
 		}
-		if(user_item->va == va && user_item->pa == pa){
-			user_item->va = user_item->pa = INVAILAD_ITEM;
-			tlb_entry = (tlb_item* )&tlb_cache[MIXED_TLB][context_id][(va >> 12) % TLB_SIZE];
-			tlb_entry->pa = pa;
-			tlb_entry->va = va;
-			//access_type = MIXED_TLB;
+		if(user_item != NULL && user_item->pa == pa){
+			clear_way(t, DATA_USER_WRITE, va, context_id);
+			fill_way(t, MIXED_TLB, va, context_id, pa);
 		}
 	}
 	#endif
@@ -87,104 +220,179 @@ void insert(unsigned int va, int context_id, unsigned int pa, tlb_type_t access_
 		assert(access_type != MIXED_TLB);
 		access_type = IO_TLB;
 	}
-	tlb_entry = (tlb_item* )&tlb_cache[access_type][context_id][(va >> 12) % TLB_SIZE];
-	tlb_entry->pa = pa;
-	tlb_entry->va = va;
+	fill_way(t, access_type, va, context_id, pa);
 	//add_virt_addr(pa, va);
-	if(pa & 0x3 == 0){
-		printf("\n\nap = %d for va=0x%x, we exit here\n\n", pa & 0x3, va);
-		sleep(2);
-		exit(-1);
+}
+
+static const tlb_type_t data_types[] = {DATA_USER_READ, DATA_KERNEL_READ, DATA_USER_WRITE, DATA_KERNEL_WRITE, IO_TLB, MIXED_TLB};
+static const tlb_type_t insn_types[] = {INSN_USER, INSN_KERNEL};
+
+/* invalidate the page of va in all the asids */
+static void erase_page_all_asid(tlb_state_t *t, int type, uint32_t va){
+	tlb_set_t *set = &t->sets[type][TLB_SET_INDEX(va)];
+	int i;
+	for(i = 0; i < TLB_WAYS; i++)
+		if(set->way[i].va == va)
+			set->way[i].va = set->way[i].pa = INVAILAD_ITEM;
+	for(i = 0; i < ASID_SIZE; i++){
+		if(!t->jit_asid_used[type][i])
+			continue;
+		tlb_item *tlb_entry = (tlb_item *)&t->cache[type][i][TLB_JIT_INDEX(va)];
+		if(tlb_entry->va == va)
+			tlb_entry->va = tlb_entry->pa = INVAILAD_ITEM;
 	}
 }
 
 void erase_by_mva(cpu_t* cpu, unsigned int va, tlb_type_t access_type)
 {
+	const tlb_type_t *types;
+	int num, i;
+	uint32_t page = va & 0xfffff000;
 	if(access_type == DATA_TLB){
-		if((va & (ASID_SIZE - 1)) == 0){
-			int i = 0;
-			for(; i <= max_context_id; i++){
-				tlb_cache[DATA_USER_READ][i][(va >> 12) % TLB_SIZE] = 0;
-				tlb_cache[DATA_KERNEL_READ][i][(va >> 12) % TLB_SIZE] = 0;
-				tlb_cache[DATA_USER_WRITE][i][(va >> 12) % TLB_SIZE] = 0;
-				tlb_cache[DATA_KERNEL_WRITE][i][(va >> 12) % TLB_SIZE] = 0;
-				tlb_cache[IO_TLB][i][(va >> 12) % TLB_SIZE] = 0;
-				tlb_cache[MIXED_TLB][i][(va >> 12) % TLB_SIZE] = 0;
-			}
-		}
-		else{
-			tlb_cache[DATA_USER_READ][va & (ASID_SIZE - 1)][(va >> 12) % TLB_SIZE] = 0;
-			tlb_cache[DATA_KERNEL_READ][va & (ASID_SIZE - 1)][(va >> 12) % TLB_SIZE] = 0;
-			tlb_cache[DATA_USER_WRITE][va & (ASID_SIZE - 1)][(va >> 12) % TLB_SIZE] = 0;
-			tlb_cache[DATA_KERNEL_WRITE][va & (ASID_SIZE - 1)][(va >> 12) % TLB_SIZE] = 0;
-			tlb_cache[IO_TLB][va & (ASID_SIZE - 1)][(va >> 12) % TLB_SIZE] = 0;
-			tlb_cache[MIXED_TLB][va & (ASID_SIZE - 1)][(va >> 12) % TLB_SIZE] = 0;
-		}
+		types = data_types;
+		num = sizeof(data_types) / sizeof(data_types[0]);
 	}
 	else if(access_type == INSN_TLB){
-		if((va & (ASID_SIZE - 1)) == 0){
-			int i = 0;
-			for(; i <= max_context_id; i++){
-				tlb_cache[INSN_USER][i][(va >> 12) % TLB_SIZE] = 0;
-				tlb_cache[INSN_KERNEL][i][(va >> 12) % TLB_SIZE] = 0;
-			}
-		}
-		else{
-			tlb_cache[INSN_USER][va & (ASID_SIZE - 1)][(va >> 12) % TLB_SIZE] = 0;
-			tlb_cache[INSN_KERNEL][va & (ASID_SIZE - 1)][(va >> 12) % TLB_SIZE] = 0;
-		}
+		types = insn_types;
+		num = sizeof(insn_types) / sizeof(insn_types[0]);
 	}else{
 		skyeye_error("Wrong tlb type %d\n", access_type);
+		return;
+	}
+	for(i = 0; i < num; i++){
+		if(get_asid(va) == 0)
+			erase_page_all_asid(CPU_TLB(cpu), types[i], page);
+		else
+			clear_way(CPU_TLB(cpu), types[i], page, get_asid(va));
 	}
 }
 
 void erase_by_asid(cpu_t* cpu, unsigned int asid, tlb_type_t access_type)
 {
+	const tlb_type_t *types;
+	int num, i;
+	asid &= (ASID_SIZE - 1);
 	if(access_type == DATA_TLB){
-		memset(&tlb_cache[DATA_USER_READ][asid], 0, sizeof(tlb_item) * TLB_SIZE);
-		memset(&tlb_cache[DATA_USER_WRITE][asid], 0, sizeof(tlb_item) * TLB_SIZE);
-		memset(&tlb_cache[DATA_KERNEL_READ][asid], 0, sizeof(tlb_item) * TLB_SIZE);
-		memset(&tlb_cache[DATA_KERNEL_WRITE][asid], 0, sizeof(tlb_item) * TLB_SIZE);
-		memset(&tlb_cache[IO_TLB][asid], 0, sizeof(tlb_item) * TLB_SIZE);
-		memset(&tlb_cache[MIXED_TLB][asid], 0, sizeof(tlb_item) * TLB_SIZE);
+		types = data_types;
+		num = sizeof(data_types) / sizeof(data_types[0]);
 	}else if(access_type == INSN_TLB){
-		memset(&tlb_cache[INSN_USER][asid], 0, sizeof(tlb_item) * TLB_SIZE);
-		memset(&tlb_cache[INSN_KERNEL][asid], 0, sizeof(tlb_item) * TLB_SIZE);
+		types = insn_types;
+		num = sizeof(insn_types) / sizeof(insn_types[0]);
 	}
 	else{
 		skyeye_error("Wrong tlb type %d\n", access_type);
+		return;
 	}
+	CPU_TLB(cpu)->asid_gen[TLB_CLASS(types[0])][asid]++;
+	for(i = 0; i < num; i++)
+		clear_jit_view(CPU_TLB(cpu), types[i], asid);
 }
 
 void erase_all(cpu_t* cpu, tlb_type_t access_type)
 {
+	const tlb_type_t *types;
+	int num, i, asid;
 	if(access_type == DATA_TLB){
-		memset(&tlb_cache[DATA_USER_READ], 0, sizeof(tlb_item) * TLB_SIZE * ASID_SIZE);
-		memset(&tlb_cache[DATA_USER_WRITE], 0, sizeof(tlb_item) * TLB_SIZE * ASID_SIZE);
-		memset(&tlb_cache[DATA_KERNEL_READ], 0, sizeof(tlb_item) * TLB_SIZE * ASID_SIZE);
-		memset(&tlb_cache[DATA_KERNEL_WRITE], 0, sizeof(tlb_item) * TLB_SIZE * ASID_SIZE);
-		memset(&tlb_cache[IO_TLB], 0, sizeof(tlb_item) * TLB_SIZE * ASID_SIZE);
-		memset(&tlb_cache[MIXED_TLB], 0, sizeof(tlb_item) * TLB_SIZE * ASID_SIZE);
+		types = data_types;
+		num = sizeof(data_types) / sizeof(data_types[0]);
 	}else if(access_type == INSN_TLB){
-		memset(&tlb_cache[INSN_USER], 0, sizeof(tlb_item) * TLB_SIZE * ASID_SIZE);
-		memset(&tlb_cache[INSN_KERNEL], 0, sizeof(tlb_item) * TLB_SIZE * ASID_SIZE);
+		types = insn_types;
+		num = sizeof(insn_types) / sizeof(insn_types[0]);
 	}else{
 		skyeye_error("Wrong tlb type %d\n", access_type);
+		return;
 	}
+	CPU_TLB(cpu)->global_gen[TLB_CLASS(types[0])]++;
+	for(i = 0; i < num; i++)
+		for(asid = 0; asid < ASID_SIZE; asid++)
+			clear_jit_view(CPU_TLB(cpu), types[i], asid);
+}
+
+uint64_t get_tlb(cpu_t* cpu, tlb_type_t access_type){
+	return (unsigned long)&CPU_TLB(cpu)->cache[access_type];
+}
+
+uint64_t* new_tlb(cpu_t* cpu){
+	DBG("In %s, get TLB 0x%llx\n", __FUNCTION__, (unsigned long)CPU_TLB(cpu)->cache);
+	return (uint64_t*)CPU_TLB(cpu)->cache;
+}
+
+/**
+* @brief get the hit and miss counter of a tlb
+*
+* @param cpu the core owning the tlb
+* @param access_type
+*
+* @return 
+*/
+tlb_stat_t* get_tlb_stat(cpu_t* cpu, tlb_type_t access_type){
+	assert(access_type < TLB_TOTAL && access_type >= 0);
+	return &CPU_TLB(cpu)->stat[access_type];
 }
 
-uint64_t get_tlb(tlb_type_t access_type){
-	return (unsigned long)&tlb_cache[access_type];
+static const char* tlb_name[TLB_TOTAL] = {
+	"data_user_read", "data_user_write", "data_kernel_read", "data_kernel_write",
+	"io", "mixed", "insn_user", "insn_kernel"
+};
+
+/**
+* @brief show the hit rate of the tlb, "tlb-stat clear" resets the counters
+*
+* @param arg
+*
+* @return 
+*/
+static int com_tlb_stat(char* arg){
+	tlb_stat_t stat[TLB_TOTAL];
+	tlb_state_t *t;
+	int i;
+	if(arg != NULL && !strncmp(arg, "clear", strlen("clear"))){
+		for(t = tlb_list; t != NULL; t = t->next)
+			memset(t->stat, 0, sizeof(t->stat));
+		return 0;
+	}
+	/* the sum of all the cores */
+	memset(stat, 0, sizeof(stat));
+	for(t = tlb_list; t != NULL; t = t->next)
+		for(i = 0; i < TLB_TOTAL; i++){
+			stat[i].hit += t->stat[i].hit;
+			stat[i].miss += t->stat[i].miss;
+		}
+	printf("%-20s%-16s%-16s%s\n", "tlb", "hit", "miss", "hit rate");
+	for(i = 0; i < TLB_TOTAL; i++){
+		uint64_t total = stat[i].hit + stat[i].miss;
+		printf("%-20s%-16llu%-16llu%.2f%%\n", tlb_name[i], (unsigned long long)stat[i].hit,
+			(unsigned long long)stat[i].miss, total ? (stat[i].hit * 100.0 / total) : 0.0);
+	}
+	printf("%d sets, %d ways\n", TLB_SETS, TLB_WAYS);
+	return 0;
 }
 
-uint64_t* new_tlb(){
-	int size = TLB_TOTAL * TLB_SIZE * ASID_SIZE;
-	#if 0
-	tlb_cache = (tlb_item*)mmap(NULL, size, PROT_WRITE, MAP_32BIT|MAP_ANONYMOUS, NULL, 0);
-	if(tlb_cache == MAP_FAILED){
-		skyeye_debug("mmap failed errno is %d\n", errno);
+/**
+* @brief initialization of the tlb of a core
+*
+* @param cpu the core
+*/
+void init_tlb(cpu_t* cpu){
+	static int command_registered = 0;
+	tlb_state_t *t = CPU_TLB(cpu);
+	if(t == NULL){
+		/* most of the JIT view is never touched, calloc leaves it unmapped */
+		t = (tlb_state_t *)calloc(1, sizeof(tlb_state_t));
+		if(t == NULL){
+			skyeye_log(Critical_log, __FUNCTION__, "Can not allocate the tlb.\n");
+			skyeye_exit(-1);
+		}
+		t->next = tlb_list;
+		tlb_list = t;
+		cpu->dyncom_engine->tlb = t;
+	}
+	else{
+		memset(t->sets, 0, sizeof(t->sets));
+		memset(t->stat, 0, sizeof(t->stat));
+	}
+	if(!command_registered){
+		add_command("tlb-stat", com_tlb_stat, "Show the hit rate of the dyncom tlb.\n");
+		command_registered = 1;
 	}
-	#endif
-	DBG("In %s, get TLB 0x%llx\n", __FUNCTION__, (unsigned long)tlb_cache);
-	return (uint64_t*)tlb_cache;
 }
@@ -39,6 +39,29 @@ typedef struct mem_bank
 	unsigned type;
 } mem_bank_t;
 
+/*
+ * The guest physical space is dispatched at the granularity of a 4K page,
+ * so finding the bank of an address does not depend on the number of banks.
+ */
+#define BANK_PAGE_BITS 12
+#define BANK_PAGE_SIZE (1 << BANK_PAGE_BITS)
+#define BANK_PAGE_MASK (BANK_PAGE_SIZE - 1)
+#define BANK_DIR_BITS 10
+#define BANK_DIR_SIZE (1 << BANK_DIR_BITS)
+
+/* the page is only partially covered by banks, need to scan the memmap */
+#define BANK_PAGE_PARTIAL 0x1
+/* the page belongs to a ram bank that can be written directly */
+#define BANK_PAGE_WRITABLE 0x2
+
+typedef struct bank_page
+{
+	mem_bank_t *bank;
+	/* The host address of the first byte of the page, NULL for io or flash */
+	uint8_t *host;
+	uint32_t flags;
+} bank_page_t;
+
 typedef struct
 {
 	int bank_num;
@@ -61,6 +84,15 @@ int bus_write(short size, generic_address_t addr, uint32_t value);
 
 mem_bank_t * bank_ptr(uint32_t addr);
 
+/* Get the page entry of the given address, NULL if no bank is there */
+bank_page_t * bank_page_ptr(uint32_t addr);
+
+/* Fill the page entries covered by a bank */
+void bank_map_pages(mem_bank_t *bank);
+
+/* Record the host memory of a bank in its page entries */
+void bank_map_host(mem_bank_t *bank, void *host, int writable);
+
 uint64_t get_bank_size (uint32_t addr);
 
 /* fill the zero for global_memmap */
@@ -37,6 +37,7 @@ typedef struct phys_page_desc{
 void init_phys_pages();
 phys_page_desc_t* get_phys_page_desc(addr_t addr);
 void inc_jit_num(addr_t addr);
+void dec_jit_num(addr_t addr);
 int get_jit_num(addr_t addr);
 void add_virt_addr(addr_t pa, addr_t va);
 /* FIXME, the physical address for s3c6410, should get 
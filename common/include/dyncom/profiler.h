@@ -32,6 +32,8 @@ typedef struct _profiling_data {
 	uint32_t size;
 	/* start physical address of this bb */
 	uint32_t start;
+	/* physical address following the last instruction of this bb */
+	uint32_t end;
 	uint32_t addr[2];
 	int32_t  vpc[2];
 	uint32_t count[2];
@@ -50,6 +52,8 @@ typedef struct _hotspot {
        AddrSet out;
        int in_use;
        void *jit;
+       /* the dyncom cpu holding the native code of the trace */
+       cpu_t *cpu;
 } hotspot;
 
 typedef map<unsigned int, hotspot *> hotpath_map;
@@ -65,6 +69,7 @@ void merge_page(uint32_t id);
 void insert_hotpath(vector<uint32_t> &start_addr, hotspot *jit);
 hotspot *find_hotpath(unsigned int addr);
 void flush_hotpath_by_pfn(unsigned int pfn);
+bool is_hotspot_alive(uint32_t id);
 void record_trace(profiling_data *pd);
 void alloc_hotspot_id();
 void free_hotspot_id();
@@ -28,6 +28,9 @@
 #include <skyeye_dyncom.h>
 #define TLB_SIZE 4096
 #define ASID_SIZE 256
+/* the geometry of the set associative tlb */
+#define TLB_SETS 1024
+#define TLB_WAYS 4
 typedef enum _tlb_type {
 	DATA_USER_READ = 0,
 	DATA_USER_WRITE,
@@ -48,10 +51,15 @@ struct tlb_item {
 	uint32_t va;
 };
 
+typedef struct tlb_stat {
+	uint64_t hit;
+	uint64_t miss;
+} tlb_stat_t;
+
 #define TLB_ENTRY_SIZE sizeof(struct tlb_item)
-int get_phys_page(unsigned int va, int context_id, unsigned int &pa, tlb_type_t access_type);
-void insert(unsigned int va, int context_id, unsigned int pa, tlb_type_t access_type);
-uint64_t* new_tlb();
+int get_phys_page(cpu_t* cpu, unsigned int va, int context_id, unsigned int &pa, tlb_type_t access_type);
+void insert(cpu_t* cpu, unsigned int va, int context_id, unsigned int pa, tlb_type_t access_type);
+uint64_t* new_tlb(cpu_t* cpu);
 //inline void insert_tlb(ARMul_State* state, ARMword va, ARMword pa);
 //void invalidate_by_asid(ARMul_State *state, ARMword asid);
 //void invalidate_by_mva(cpu_t* cpu, ARMword va);
@@ -59,7 +67,9 @@ void erase_by_asid(cpu_t* cpu, unsigned int asid, tlb_type_t access_type);
 void erase_by_mva(cpu_t* cpu, unsigned int va, tlb_type_t access_type);
 void erase_all(cpu_t* cpu, tlb_type_t access_type);
 
-uint64_t get_tlb(tlb_type_t access_type);
+uint64_t get_tlb(cpu_t* cpu, tlb_type_t access_type);
+tlb_stat_t* get_tlb_stat(cpu_t* cpu, tlb_type_t access_type);
+void init_tlb(cpu_t* cpu);
 #define GET_AP(phys_page) (phys_page & 0x3)
 
 #define IO_FLAG_MASK 0x4
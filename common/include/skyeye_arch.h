@@ -37,6 +37,10 @@ typedef struct generic_arch_s
 	 * get a signal from external
 	 */
 	exception_t (*signal)(interrupt_signal_t* signal);
+	/**
+	 * read the state of a core from any thread, without stopping it
+	 */
+	int (*get_sample)(int core_id, guest_sample_t *sample);
 
 	endian_t endianess;
 	align_t alignment;
@@ -38,7 +38,7 @@ typedef struct bus_recorder_s{
 	access_t rw;
 	short size;
 	int addr;
-	uint32_t* value;
+	uint32_t value;
 	before_after_t when;
 }bus_recorder_t;
 
@@ -0,0 +1,204 @@
+/*
+        skyeye_bus_trace.h - the binary format of the bus trace
+        Copyright (C) 2003-2007 Skyeye Develop Group
+        for help please send mail to <skyeye-developer@lists.sf.linuxforum.net>
+
+        This program is free software; you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation; either version 2 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program; if not, write to the Free Software
+        Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * The bus accesses are recorded into the ring of every core as fixed size
+ * records, a drain thread writes them to the trace file compressed: every
+ * record is encoded as the difference with the previous record of the
+ * same core, packed in variable length integers. The encoder and the
+ * decoder are inline here so the offline decoder does not need libcommon.
+ */
+#ifndef __SKYEYE_BUS_TRACE_H__
+#define __SKYEYE_BUS_TRACE_H__
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#define BUS_TRACE_MAGIC		"SKYBUSTR"
+#define BUS_TRACE_VERSION	1
+#define BUS_TRACE_MAX_CORES	64
+/* the longest encoded record: the flags, the core and four varints */
+#define BUS_TRACE_MAX_ENCODED	(2 + 5 + 5 + 5 + 10 + 2)
+
+/* the flags byte of an encoded record */
+#define BUS_TRACE_WRITE		0x1
+#define BUS_TRACE_AFTER		0x2
+#define BUS_TRACE_SIZE_SHIFT	2
+#define BUS_TRACE_SIZE_MASK	0xc
+#define BUS_TRACE_NEW_CORE	0x10
+
+typedef struct bus_trace_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+} bus_trace_header_t;
+
+/**
+* @brief one bus access
+*/
+typedef struct bus_trace_rec {
+	uint64_t icount;
+	uint32_t pc;
+	uint32_t addr;
+	uint32_t value;
+	uint8_t size;
+	uint8_t write;
+	uint8_t after;
+	uint8_t core;
+} bus_trace_rec_t;
+
+/**
+* @brief the previous record of every core, shared by encoder and decoder
+*/
+typedef struct bus_trace_codec {
+	bus_trace_rec_t prev[BUS_TRACE_MAX_CORES];
+	uint8_t core;
+} bus_trace_codec_t;
+
+static inline uint8_t *bus_trace_put_varint(uint8_t *p, uint64_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+static inline const uint8_t *bus_trace_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+	int shift = 0;
+	*v = 0;
+	while (p < end && shift < 64) {
+		*v |= (uint64_t)(*p & 0x7f) << shift;
+		if (!(*p++ & 0x80))
+			return p;
+		shift += 7;
+	}
+	return NULL;
+}
+
+static inline uint32_t bus_trace_zigzag(int32_t v)
+{
+	return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t bus_trace_unzigzag(uint32_t v)
+{
+	return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline uint8_t bus_trace_size_code(uint8_t size)
+{
+	return size == 8 ? 0 : size == 16 ? 1 : size == 32 ? 2 : 3;
+}
+
+/**
+* @brief encode a record
+*
+* @param codec the state of the encoder
+* @param rec the record
+* @param buf the output, at least BUS_TRACE_MAX_ENCODED bytes
+*
+* @return the length of the encoded record
+*/
+static inline int bus_trace_encode(bus_trace_codec_t *codec, const bus_trace_rec_t *rec, uint8_t *buf)
+{
+	bus_trace_rec_t *prev = &codec->prev[rec->core % BUS_TRACE_MAX_CORES];
+	uint8_t *p = buf + 1;
+	uint8_t flags = (rec->write ? BUS_TRACE_WRITE : 0) | (rec->after ? BUS_TRACE_AFTER : 0) |
+		(bus_trace_size_code(rec->size) << BUS_TRACE_SIZE_SHIFT);
+
+	if (rec->core != codec->core) {
+		flags |= BUS_TRACE_NEW_CORE;
+		*p++ = rec->core;
+		codec->core = rec->core;
+	}
+	buf[0] = flags;
+	p = bus_trace_put_varint(p, bus_trace_zigzag((int32_t)(rec->pc - prev->pc)));
+	p = bus_trace_put_varint(p, bus_trace_zigzag((int32_t)(rec->addr - prev->addr)));
+	p = bus_trace_put_varint(p, rec->value);
+	p = bus_trace_put_varint(p, rec->icount - prev->icount);
+	*prev = *rec;
+	return p - buf;
+}
+
+/**
+* @brief decode a record
+*
+* @param codec the state of the decoder
+* @param buf the input
+* @param end the end of the input
+* @param rec the decoded record
+*
+* @return the length of the encoded record, 0 if the input is truncated
+*/
+static inline int bus_trace_decode(bus_trace_codec_t *codec, const uint8_t *buf, const uint8_t *end, bus_trace_rec_t *rec)
+{
+	const uint8_t *p = buf + 1;
+	bus_trace_rec_t *prev;
+	uint64_t v;
+	uint8_t flags;
+
+	if (buf >= end)
+		return 0;
+	flags = buf[0];
+	if (flags & BUS_TRACE_NEW_CORE) {
+		if (p >= end)
+			return 0;
+		codec->core = *p++;
+	}
+	prev = &codec->prev[codec->core % BUS_TRACE_MAX_CORES];
+	rec->core = codec->core;
+	rec->write = (flags & BUS_TRACE_WRITE) != 0;
+	rec->after = (flags & BUS_TRACE_AFTER) != 0;
+	rec->size = 8 << ((flags & BUS_TRACE_SIZE_MASK) >> BUS_TRACE_SIZE_SHIFT);
+	if ((p = bus_trace_get_varint(p, end, &v)) == NULL)
+		return 0;
+	rec->pc = prev->pc + bus_trace_unzigzag((uint32_t)v);
+	if ((p = bus_trace_get_varint(p, end, &v)) == NULL)
+		return 0;
+	rec->addr = prev->addr + bus_trace_unzigzag((uint32_t)v);
+	if ((p = bus_trace_get_varint(p, end, &v)) == NULL)
+		return 0;
+	rec->value = (uint32_t)v;
+	if ((p = bus_trace_get_varint(p, end, &v)) == NULL)
+		return 0;
+	rec->icount = prev->icount + v;
+	*prev = *rec;
+	return p - buf;
+}
+
+/* start recording the bus accesses of every core to a file */
+int bus_trace_start(const char *filename);
+/* stop recording, the records left in the rings are written */
+void bus_trace_stop(void);
+/* record the last bus access of the calling core */
+void bus_trace_record(uint32_t pc, uint64_t icount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -25,6 +25,9 @@
 #ifndef __CALLBACK_H__
 #define __CALLBACK_H__
 #include "skyeye_arch.h"
+#ifdef __cplusplus
+ extern "C" {
+#endif
 typedef enum{
 	Step_callback = 0, /* called when step running of core */
 	Mem_read_callback, /* called when memory write */
@@ -38,5 +41,28 @@ typedef enum{
 }callback_kind_t;
 typedef void(*callback_func_t)(generic_arch_t* arch_instance);
 void register_callback(callback_func_t func, callback_kind_t kind);
+void unregister_callback(callback_func_t func, callback_kind_t kind);
 int exec_callback(callback_kind_t kind, generic_arch_t* arch_instance);
+
+/* non-zero when some function is registered for the callback kind */
+extern int callback_armed[Max_callback];
+#define is_callback_armed(kind) (callback_armed[(kind)] != 0)
+
+/*
+ * called by the block based engines (fast interpreter, dyncom) with the
+ * address range [start, end) of a basic block when it is entered, so the
+ * tools need not a per instruction Step_callback.
+ */
+typedef void(*block_callback_func_t)(generic_address_t start, generic_address_t end);
+void register_block_callback(block_callback_func_t func);
+extern block_callback_func_t block_callback;
+#define is_block_callback_armed() (block_callback != NULL)
+/* the engine reports every block, not only the interpreted ones */
+void provide_block_callback(void);
+extern int block_callback_provided;
+#define is_block_callback_provided() (block_callback_provided != 0)
+
+#ifdef __cplusplus
+}
+#endif
 #endif
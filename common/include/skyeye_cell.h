@@ -14,6 +14,12 @@ typedef struct skyeye_cell_s{
 	int current_exec_id;
 	pthread_t thread_id;
 	int max_exec_id;
+	/* the cell runs one core of a parallel smp machine */
+	int smp;
+	/* the cell advances the guest time of the scheduler */
+	int drives_time;
+	/* the runs since the last quantum sync */
+	uint32_t quantum_runs;
 }skyeye_cell_t;
 
 work_thread_t* get_thread_by_cell(skyeye_cell_t* cell);
@@ -25,6 +31,19 @@ void del_from_cell(skyeye_exec_t* exec, skyeye_cell_t* cell);
 void move_to_cell(skyeye_exec_t* exec, skyeye_cell_t* src, skyeye_cell_t* dst);
 */
 skyeye_cell_t* create_cell();
+
+void init_cell(void);
+/* the number of cores given by the smp option, 1 by default */
+uint32_t get_smp_cores(void);
+/* every core runs on its own host thread */
+bool_t smp_parallel_enabled(void);
+/* keep every core on the default cell even if parallel=on */
+void smp_parallel_disable(void);
+/* add the exec object of a core to its own cell in parallel mode */
+void add_to_smp_cell(skyeye_exec_t* exec);
+/* serialize the device accesses of the cores in parallel mode */
+void smp_device_lock(void);
+void smp_device_unlock(void);
 #ifdef __cplusplus
 }
 #endif
@@ -166,6 +166,19 @@ int do_dbct_test_speed_sec();
 
 //#define MAX_OPTION_NAME 32
 //#define MAX_PARAM_NAME  32
+/*
+ * the state of a core taken by the sampling profiler
+ */
+typedef struct guest_sample
+{
+	generic_address_t pc;
+	/* the processor mode and its name, NULL if the arch has no names */
+	uint32_t mode;
+	const char *mode_name;
+	/* the address space id of the mmu, 0 if unknown */
+	uint32_t asid;
+} guest_sample_t;
+
 typedef struct
 {
 	char *arch_name;
@@ -199,6 +212,10 @@ typedef struct
 	 * get a signal from external
 	 */
 	exception_t (*signal)(interrupt_signal_t* signal);
+	/**
+	 * read the state of a core from any thread, without stopping it
+	 */
+	int (*get_sample)(int core_id, guest_sample_t *sample);
 
 	void (*exec) (uint32_t id);
 	void (*stop) (uint32_t id);
@@ -415,6 +415,8 @@ typedef struct dyncom_engine{
 	ExecutionEngine *exec_engine;
 	uint8_t *RAM;
 	//unsigned long TLB;
+	/* the tlb of this core, see dyncom/tlb.cpp */
+	void *tlb;
 //for four memory region
     tag_t *tag_array[4];
     uint32_t code_size[4];
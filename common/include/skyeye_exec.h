@@ -23,6 +23,8 @@ typedef struct skyeye_exec_s{
 * @return 
 */
 conf_object_t* get_current_exec_priv(pthread_t id);
+/* the private data of the exec object running on the calling thread */
+conf_object_t* get_running_exec_priv(void);
 
 skyeye_exec_t* create_exec();
 #ifdef __cplusplus
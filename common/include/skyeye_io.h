@@ -28,4 +28,13 @@
 #include <skyeye_types.h>
 typedef void (*io_cycle_func_t)(void *arg);
 void register_io_cycle(io_cycle_func_t func,void* arg);
+
+#include "skyeye_sched.h"
+/* post func to the thread scheduler when the host fd becomes readable */
+int io_watch_fd(int fd, sched_func_t func, void *arg);
+/* call func in the io reactor thread itself when the host fd becomes readable */
+int io_watch_fd_in_reactor(int fd, sched_func_t func, void *arg);
+/* watch the fd again after its handler consumed the input */
+void io_rearm_fd(int fd);
+void io_unwatch_fd(int fd);
 #endif
@@ -0,0 +1,87 @@
+/*
+	skyeye_nand_store.h - the image file behind a simulated nand flash
+	Copyright (C) 2003 - 2007 Skyeye Develop Group
+	for help please send mail to <skyeye-developer@lists.gro.clinux.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+#ifndef __SKYEYE_NAND_STORE_H__
+#define __SKYEYE_NAND_STORE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* the unit of copy on write and of write back, a multiple of the host page */
+#define NAND_STORE_CHUNK	(64 * 1024)
+#define NAND_STORE_MAGIC	"SKYNAND1"
+/* the interval of the background write back in microseconds */
+#define NAND_STORE_SYNC_PERIOD	1000000
+
+/*
+ * The whole flash is one array in host memory, the devices read it in
+ * place and modify it with nand_store_write, nand_store_program or
+ * nand_store_erase.
+ *
+ * Without a base image the array is a shared mapping of the image file.
+ * With a base image, the base is mapped privately and never written, the
+ * image file is an overlay that holds the chunks written by the guest at
+ * their own offsets, followed by a trailer with one byte per chunk. The
+ * first write of a chunk copies it to the overlay and maps the overlay
+ * over it. Without an image file the writes stay in memory, so several
+ * runs may share one read only base.
+ */
+typedef struct nand_store {
+	uint8_t *data;
+	uint64_t size;
+	uint64_t map_size;
+	/* the image or the overlay, -1 if the writes are not saved */
+	int fd;
+	int base_fd;
+	/* the trailer of the overlay, NULL without a base image */
+	uint8_t *trailer;
+	uint32_t trailer_size;
+	/* one byte per chunk, set when the chunk lives in the overlay */
+	uint8_t *cow;
+	uint32_t chunk_num;
+	/* the chunks to write back when the image is not mapped */
+	uint8_t *dirty;
+	volatile int need_sync;
+	int sync_id;
+} nand_store_t;
+
+int nand_store_open(nand_store_t *store, const char *image, const char *base, uint64_t size);
+void nand_store_close(nand_store_t *store);
+void nand_store_sync(nand_store_t *store, int wait);
+uint8_t *nand_store_prepare(nand_store_t *store, uint64_t offset, uint64_t len);
+void nand_store_write(nand_store_t *store, uint64_t offset, const void *buf, uint64_t len);
+void nand_store_program(nand_store_t *store, uint64_t offset, const uint8_t *buf, uint64_t len);
+void nand_store_erase(nand_store_t *store, uint64_t offset, uint64_t len);
+
+/**
+* @brief the bytes of the flash at offset, only for reading
+*/
+static inline uint8_t *nand_store_ptr(nand_store_t *store, uint64_t offset){
+	return store->data + offset;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,6 +2,7 @@
 #define __MEOMRY_RAM_H__
 
 #include <stdint.h>
+#include "bank_defs.h"
 
 #ifdef __cplusplus
  extern "C" {
@@ -15,12 +16,28 @@
 #define ROM_BANKS       16
 #define ROM_BITS        (28)    /* 0x10000000 each bank */
 
+/*
+ * The dirty flags of a page in mem_state_t.dirty. Every write of a page sets
+ * all of them, each client clears its own flag when it has consumed the
+ * page, so the clients do not disturb each other.
+ */
+/* the page is not saved by the last checkpoint */
+#define MEM_DIRTY_CHECKPOINT	0x1
+/* the page is not drawn by the display */
+#define MEM_DIRTY_DISPLAY	0x2
+/* the code translated from the page may be stale */
+#define MEM_DIRTY_CODE		0x4
+#define MEM_DIRTY_ALL		(MEM_DIRTY_CHECKPOINT | MEM_DIRTY_DISPLAY | MEM_DIRTY_CODE)
+#define MEM_PAGE_NUM(len)	(((len) + BANK_PAGE_SIZE - 1) >> BANK_PAGE_BITS)
+
 typedef struct mem_state_t
 {
         uint32_t *dram;
 	/* The pointer on the host */
         uint32_t *rom[ROM_BANKS];
         unsigned int rom_size[ROM_BANKS];
+	/* one byte of MEM_DIRTY_* flags per page, all set when the page is written */
+	uint8_t *dirty[ROM_BANKS];
 #ifdef DBCT
 //teawater add for arm2x86 2004.12.04-------------------------------------------
         uint8_t *tbp[ROM_BANKS];        //translate block pointer
@@ -41,7 +58,18 @@ void mem_write_word(void * state, uint32_t addr, uint32_t data);
 int mem_read(short size, int offset, uint32_t * value);
 int mem_write(short size, int offset, uint32_t value);
 int warn_write(short size, int offset, uint32_t value);
+int mem_read_page(bank_page_t *page, short size, uint32_t addr, uint32_t *value);
+int mem_write_page(bank_page_t *page, short size, uint32_t addr, uint32_t value);
 unsigned long get_dma_addr(unsigned long guest_addr);
+void mem_mark_dirty(uint32_t addr, uint32_t len);
+int mem_get_dirty(uint32_t addr, uint32_t len, int flags);
+void mem_reset_dirty(uint32_t addr, uint32_t len, int flags);
+int mem_test_and_reset_dirty(uint32_t addr, int flags);
+uint8_t *mem_dirty_flags(uint32_t addr);
+uint8_t *mem_dirty_map(void);
+uint8_t *mem_block_host(uint32_t addr, uint32_t len);
+exception_t mem_write_block(uint32_t addr, const void *buf, uint32_t len);
+exception_t mem_set_block(uint32_t addr, int c, uint32_t len);
 mem_state_t * get_global_memory();
 
 #ifdef __cplusplus
@@ -34,6 +34,12 @@ typedef enum{
 	Periodic_sched		/* scheduled once in a period */
 }sched_mode_t;
 
+/* the clock driving the thread scheduler */
+typedef enum{
+	Wallclock_sched,	/* the host monotonic clock */
+	Icount_sched		/* the guest instruction count, deterministic */
+}sched_clock_t;
+
 /* define scheduler callback function type */ 
 typedef	void(*sched_func_t)(void *arg);
 
@@ -56,6 +62,11 @@ typedef struct skyeye_event{
  */
 int create_thread_scheduler(unsigned int ms, sched_mode_t mode, sched_func_t func, void *arg, int *id);
 
+/*
+ * run a function in the thread scheduler as soon as possible, thread safe
+ */
+int post_thread_event(sched_func_t func, void *arg);
+
 /*
  * mode the attributes of a scheduler
  */
@@ -114,6 +125,22 @@ void list_timer_scheduler(void);
 
 uint64_t get_clock_us();
 uint64_t get_clock_sec();
+
+/*
+ * the microseconds passed since the scheduler starts
+ */
+uint64_t get_sched_clock_us();
+
+/*
+ * select the wall clock or the guest instruction count for thread scheduler
+ */
+int set_sched_clock(sched_clock_t clock, uint64_t per_us);
+
+/*
+ * advance the guest time by the step counter of core in icount mode
+ */
+void sched_update_icount(uint32_t step);
+extern int sched_icount_enabled;
 #ifdef __cplusplus
 }
 #endif
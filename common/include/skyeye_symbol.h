@@ -20,4 +20,14 @@ struct symbolInfo {
 };
 void _print_func_name(uint32_t address);
 
+typedef struct func_symbol {
+	generic_address_t address;
+	/* the address following the last byte of the function */
+	generic_address_t end;
+	const char *name;
+} func_symbol_t;
+int get_func_symbols(func_symbol_t **syms);
+/* the function containing address, NULL if no symbol covers it */
+const char *get_sym_interval(generic_address_t address, generic_address_t *offset);
+
 #endif
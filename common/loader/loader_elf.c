@@ -38,6 +38,23 @@
 //unsigned long load_base = 0x0;
 //unsigned long load_mask = 0xffffffff;
 
+/**
+* @brief get the physical address an elf address is loaded to
+*
+* @param addr the address in the elf file
+*
+* @return the physical address
+*/
+static inline uint32
+phys_load_addr (uint32 addr)
+{
+	sky_pref_t* pref = get_skyeye_pref();
+	unsigned long load_base = pref->exec_load_base;
+	unsigned long load_mask = pref->exec_load_mask;
+	//skyeye_log(Info_log, __FUNCTION__, "load_base=0x%x,load_mask=0x%x", load_base, load_mask);
+	return (addr & load_mask)|load_base;
+}
+
 /**
 * @brief write a buffer to the given physical address
 *
@@ -48,37 +65,9 @@
 static inline void
 write_phys (uint32 addr, uint8_t * buffer, int size)
 {
-	int i,fault;
-	mem_bank_t * bank;
-	sky_pref_t* pref = get_skyeye_pref();
-	unsigned long load_base = pref->exec_load_base;
-	unsigned long load_mask = pref->exec_load_mask;
-	//skyeye_log(Info_log, __FUNCTION__, "load_base=0x%x,load_mask=0x%x", load_base, load_mask);
-	addr = (addr & load_mask)|load_base;
-
-	if(get_skyeye_exec_info()->mmap_access){
-		for (i = 0; i < size; i++) {
-			*(uint8_t *)(addr + i) = buffer[i];
-		}
-		return;
-	}
-	
-	for (i = 0; i < size; i++) {
-		/*
-		if(arch_instance->ICE_write_byte)
-			fault = arch_instance->ICE_write_byte (addr + i, buffer[i]);
-		else
-			fault = -1;
-		*/
-		/* byte write */
-		//fault = mem_write (8, addr + i, buffer[i]);
-		if(bank = bank_ptr(addr))
-	                bank->bank_write(8, addr + i, buffer[i]);
-		else{
-			printf("SKYEYE: write physical address 0x%x error!!!\n", addr + i);
-			return;
-		}
-	}
+	addr = phys_load_addr(addr);
+	if(mem_write_block(addr, buffer, size) != No_exp)
+		printf("SKYEYE: write physical address 0x%x error!!!\n", addr);
 }
 
 /**
@@ -347,6 +336,23 @@ load_exec (const char *file, addr_type_t addr_type)
 #endif
             }
 	if (bfd_section_size (tmp_bfd, s) > 0) {
+		/* read the section into the ram directly if it lies in one bank */
+		if(addr_type == Phys_addr || get_user_mode()){
+			uint32 phys = phys_load_addr(bfd_section_vma (tmp_bfd, s));
+			uint8_t *host = mem_block_host(phys, bfd_section_size (tmp_bfd, s));
+			if(host){
+				if (!bfd_get_section_contents(tmp_bfd, s, host, 0,
+					bfd_section_size (tmp_bfd, s))) {
+					fprintf (stderr,
+						 "get session %s content error: %s\n",
+						 bfd_section_name (tmp_bfd, s),
+						 bfd_errmsg (bfd_get_error()));
+					goto out;
+				}
+				mem_mark_dirty(phys, bfd_section_size (tmp_bfd, s));
+				continue;
+			}
+		}
 		tmp_str = (char *)skyeye_mm (bfd_section_size
 						(tmp_bfd, s));
 		if (!tmp_str) {
@@ -392,13 +398,7 @@ load_exec (const char *file, addr_type_t addr_type)
 					unsigned int bss_addr = (unsigned int) bfd_section_vma (tmp_bfd, s);
 					unsigned int bss_size = (unsigned int) bfd_section_size (tmp_bfd, s);
 					//printf ("find .bss section: addr = 0x%08x  size = 0x%08x .\n", bss_addr, bss_size);
-					unsigned long host_addr = get_dma_addr(bss_addr);
-					memset(host_addr, '\0', bss_size);
-					#if 0
-					int i;
-					for(i=0; i<bss_size; i++)
-						bus_write(8, bss_addr + i, 0);
-					#endif
+					mem_set_block(bss_addr, 0, bss_size);
 					//printf("bss cleared.\n");
 				}
 			}else{
@@ -33,6 +33,9 @@
 #include "bank_defs.h"
 #include "skyeye_ram.h"
 
+/* the files crossing banks are copied through a buffer of this size */
+#define LOAD_FILE_CHUNK (64 * 1024)
+
 /**
 * @brief load a block of data to the memory
 *
@@ -43,16 +46,7 @@
 * @return 
 */
 exception_t load_data(void* src, size_t len, generic_address_t load_addr){
-	char* p = src;
-	generic_address_t addr = load_addr;
-	int i = 0;
-	while(i < len){
-		//skyeye_log(Debug_log, __FUNCTION__, "data=0x%x,addr=0x%x\n", *(p + i), addr);
-		bus_write(8, addr, *(p + i));
-		addr++;
-		i++;
-	}
-	return No_exp;
+	return mem_write_block(load_addr, src, len);
 }
 
 /**
@@ -65,48 +59,45 @@ exception_t load_data(void* src, size_t len, generic_address_t load_addr){
 */
 exception_t load_file(const char* filename, generic_address_t load_addr){
 	FILE* f;
-	uint8 data;
-	int nread = 0;
+	static uint8_t buf[LOAD_FILE_CHUNK];
+	size_t nread = 0;
 	generic_address_t addr = load_addr;
-	unsigned long host_addr = get_dma_addr(addr);
-	skyeye_log(Debug_log, __FUNCTION__, "addr=0x%x, host_addr=0x%lx.\n", addr, (unsigned long) host_addr);
 	struct stat stat_buf;
 	if(stat(filename, &stat_buf) != 0){
 		skyeye_log(Error_log, __FUNCTION__, "Can not stat file %s.\n", filename);
 		return File_open_exp;
 	}
 	off_t size = stat_buf.st_size;
-	if(size >= (get_bank_size(addr) - addr)){
-		skyeye_log(Error_log, __FUNCTION__, "File %s too big.\n", filename);
-		return Excess_range_exp;
-	}
 	f = fopen(filename, "rb");
 	if(f == NULL){
 		skyeye_log(Error_log, __FUNCTION__, "Can not open file %s.\n", filename);
 		return File_open_exp;
 	}
 
-	nread = fread((uint8_t *)host_addr, 1, size, f);
+	uint8_t *host_addr = mem_block_host(addr, size);
+	skyeye_log(Debug_log, __FUNCTION__, "addr=0x%x, host_addr=0x%lx.\n", addr, (unsigned long) host_addr);
+	if(host_addr){
+		/* the whole file lies in one ram bank, read it in place */
+		nread = fread(host_addr, 1, size, f);
+		mem_mark_dirty(addr, nread);
+	}
+	else{
+		size_t n;
+		while((n = fread(buf, 1, sizeof(buf), f)) > 0){
+			if(mem_write_block(addr, buf, n) != No_exp){
+				skyeye_log(Error_log, __FUNCTION__, "File %s too big.\n", filename);
+				fclose(f);
+				return Excess_range_exp;
+			}
+			addr += n;
+			nread += n;
+		}
+	}
 	if(nread != size){
-		skyeye_log(Error_log, __FUNCTION__, "Can not stat file %s.\n", filename);
+		skyeye_log(Error_log, __FUNCTION__, "Can not read file %s.\n", filename);
 		fclose(f);
 		return File_open_exp;
 	}
-	#if 0
-	/* read a char and write it to the memory */
-	while(nread = fread(&data, 1, 1, f)){
-		#if 0
-		if(bus_write(8, addr, data) != 0){
-			/* error handler for address error */
-			fclose(f);
-			return Excess_range_exp;
-		}
-		#endif
-		*(uint8_t *)host_addr = data;
-		host_addr++;
-		addr++;
-	}
-	#endif
 	skyeye_log(Info_log, __FUNCTION__, "Load the file %s to the memory 0x%x\n", filename, load_addr);
 	fclose(f);
 #if 0 
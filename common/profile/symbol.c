@@ -25,7 +25,7 @@
 #include <config.h>
 #include <assert.h>
 #include "bfd.h"
-#include <search.h>
+#include <string.h>
 #include "skyeye_symbol.h"
 #include "skyeye_mm.h"
 #include "skyeye_log.h"
@@ -33,24 +33,92 @@
 #include "portable/portable.h"
 
 /*
- * FIXME: GNU hash table isn't exist everywhere!!!
+ * The function symbols are kept in an index sorted by address, every entry
+ * covers the addresses up to the next symbol or the end of its section, so
+ * a pc inside a function is resolved by a binary search.
  */
 
-static char itoa_tab[16] = {'0','1','2','3','4','5','6','7','8','9','a','b','c','d','e','f'} ;
 static long storage_needed = 0;
 static asymbol **symbol_table = NULL;
 static unsigned long number_of_symbols = 0, kernel_number = 0;
+static func_symbol_t *sym_index = NULL;
+static int sym_index_num = 0;
 
-/**************************************************************************
-  This function read the symbol list and store into a table
-  It then generates a hash table based on the value of function symbol
-  and the data is the pointer to struct funcsym defined in armsym.h
+static int is_func_symbol(unsigned long i)
+{
+	return ((i < kernel_number) && (symbol_table[i]->flags == 0x01)) || // <tktan> BUG200105172154, BUG200106022219
+		((i < kernel_number) && (symbol_table[i]->flags == 0x02)) || // <tktan> BUG200204051654
+		(symbol_table[i]->flags & 0x10); // Is a function symbol
+}
 
-  The GNU hash table is used.
-**************************************************************************/
-/***************
- * added by ksh
- ***************/ 
+static int func_symbol_cmp(const void *a, const void *b)
+{
+	const func_symbol_t *x = a, *y = b;
+	if (x->address != y->address)
+		return x->address < y->address ? -1 : 1;
+	return 0;
+}
+
+/**
+* @brief build the sorted index of the function symbols
+*
+* @param abfd the bfd of the symbol table
+*/
+static void build_symbol_index(bfd *abfd)
+{
+	unsigned long i;
+	int num = 0, j;
+	asymbol *symptr;
+
+	sym_index = skyeye_mm(number_of_symbols * sizeof(func_symbol_t));
+	if (sym_index == NULL) {
+		fprintf(stderr, "Can not alloc memory for symbol index.\n");
+		return;
+	}
+	for (i = 0; i < number_of_symbols; i++) {
+		if (!is_func_symbol(i))
+			continue;
+		symptr = symbol_table[i];
+		sym_index[num].address = symptr->value + symptr->section->vma; // adjust for section address
+		sym_index[num].end = symptr->section->vma + bfd_section_size(abfd, symptr->section);
+		sym_index[num].name = symptr->name;
+		num++;
+	}
+	qsort(sym_index, num, sizeof(func_symbol_t), func_symbol_cmp);
+	/* drop the aliases of an address, the first one is kept */
+	for (i = 1, j = 0; i < num; i++)
+		if (sym_index[i].address != sym_index[j].address)
+			sym_index[++j] = sym_index[i];
+	sym_index_num = num ? j + 1 : 0;
+	/* a symbol ends at the next one or at the end of its section */
+	for (j = 0; j < sym_index_num; j++) {
+		if (sym_index[j].end <= sym_index[j].address)
+			sym_index[j].end = sym_index[j].address + 1;
+		if (j + 1 < sym_index_num && sym_index[j].end > sym_index[j + 1].address)
+			sym_index[j].end = sym_index[j + 1].address;
+	}
+}
+
+/**
+* @brief find the last symbol starting at or before an address
+*
+* @param address
+*
+* @return the index in sym_index, -1 if none
+*/
+static int find_symbol_index(generic_address_t address)
+{
+	int lo = 0, hi = sym_index_num - 1, mid, found = -1;
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if (sym_index[mid].address <= address) {
+			found = mid;
+			lo = mid + 1;
+		} else
+			hi = mid - 1;
+	}
+	return found;
+}
 
 /**
 * @brief  initialization of a symbol table
@@ -60,12 +128,7 @@ static unsigned long number_of_symbols = 0, kernel_number = 0;
 */
 void init_symbol_table(char* filename, char* arch_name)
 {
-  long i,j, digit;
-  ENTRY newentry, *oldentry;
-  SYM_FUNC *symp;
-  asymbol *symptr;
-  int key;
-  bfd *abfd;
+	bfd *abfd;
 
 	if(!filename){
 		skyeye_info("Can not get correct kernel filename!Maybe your skyeye.conf have something wrong!\n");
@@ -101,94 +164,60 @@ void init_symbol_table(char* filename, char* arch_name)
 		exit(0);
 	}
 
-	if (!hcreate(number_of_symbols << 1)) {
-		printf("Not enough memory for hash table\n");
-		exit(0);
-	}
-	for (i = 0; i < number_of_symbols; i++) {
-		symptr = symbol_table[i] ;
-		key = symptr->value + symptr->section->vma; // adjust for section address
-
-    if (((i<kernel_number) && (symbol_table[i]->flags == 0x01)) || // <tktan> BUG200105172154, BUG200106022219 
-	((i<kernel_number) && (symbol_table[i]->flags == 0x02)) || // <tktan> BUG200204051654
-	(symbol_table[i]->flags & 0x10)) { // Is a function symbol
-      // printf("%x %8x %s\n", symbol_table[i]->flags, key, symbol_table[i]->name);
-
-      // ***********************************************************
-      // This is converting the function symbol value to char string
-      // and use it as a key in the GNU hash table
-      // ********************************************************
-      newentry.key = (char *) skyeye_mm_zero(9);
-      for (j=0;j<8;j++) {
-        newentry.key[j] = itoa_tab[((key) >> (j << 2)) & 0xf] ;
-      }
-      newentry.key[8] = 0 ;
-
-      // *************************************************
-      // This is allocating memory for a struct funcsym
-      // *************************************************
-      symp = (SYM_FUNC *) skyeye_mm_zero(sizeof(SYM_FUNC));
-      newentry.data = (char *) symp; 
-      symp->name = (char *) symbol_table[i]->name ;
-      symp->total_cycle = 0;
-      symp->total_energy = 0;
-      symp->instances = 0;
-
-      // ***********************************************
-      // Insert into hash table
-      // *******************************************
-      /* <tktan> BUG200106022219 */
-      oldentry = hsearch(newentry, FIND) ;
-      if (oldentry) { // was entered
-        // printf("Duplicate Symbol: %x %s\n", key, symp->name);
-        oldentry->data = (char *) symp ;	
-      } else if (!hsearch(newentry, ENTER)) { 
-        printf("Insufficient memory\n");
-        exit(0) ;
-      }
-    }
-  }
-
-  return;
+	build_symbol_index(abfd);
+	return;
 }
-/***************************************************************
-  This function get check the hash table for an entry
-  If it exists, the corresponding pointer to the SYM_FUNC will
-  be returned
-*************************************************************/
 
 /**
 * @brief get the symbol of a given address
 *
-* @param address
+* @param address the entry of a function
 *
-* @return 
+* @return the name of the function starting at address, NULL if none
 */
 char *get_sym(generic_address_t address)
 {
-	int j ;
-	ENTRY entry, *ep;
-	char text[9] ;
-	SYM_FUNC *symp;
-
-	//printf("GetSym %x\n", address);
-	/*
-	 * If storage_needed is zero, means symbol table is not initialized.
-	 */
-	if(storage_needed == 0)
+	int i = find_symbol_index(address);
+	if (i < 0 || sym_index[i].address != address)
 		return NULL;
-	//assert(!symbol_table);
-	entry.key = text ;
-	for (j=0;j<8;j++) {
-		entry.key[j] = itoa_tab[(address >> (j << 2)) & 0xf] ;
-	}
-	entry.key[8] = 0 ;
-	/*a bug need to fixed */
-	ep = hsearch(entry, FIND) ;
-
-	if (ep != 0) {
-		symp = (SYM_FUNC *) ep->data;
-		return(symp->name);
-	} else
-		return(NULL);
+	return (char *)sym_index[i].name;
+}
+
+/**
+* @brief get the function containing an address
+*
+* @param address any address inside a function
+* @param offset the offset of address from the entry of the function
+*
+* @return the name of the function, NULL if no symbol covers address
+*/
+const char *get_sym_interval(generic_address_t address, generic_address_t *offset)
+{
+	int i = find_symbol_index(address);
+	if (i < 0 || address >= sym_index[i].end)
+		return NULL;
+	if (offset)
+		*offset = address - sym_index[i].address;
+	return sym_index[i].name;
+}
+
+/**
+* @brief get the function symbols sorted by address, the symbols of the
+* same address are reported once.
+*
+* @param syms the array of symbols, allocated by skyeye_mm and freed by
+* the caller
+*
+* @return the number of symbols, 0 if the symbol table is not initialized
+*/
+int get_func_symbols(func_symbol_t **syms)
+{
+	*syms = NULL;
+	if (sym_index_num == 0)
+		return 0;
+	*syms = skyeye_mm(sym_index_num * sizeof(func_symbol_t));
+	if (*syms == NULL)
+		return 0;
+	memcpy(*syms, sym_index, sym_index_num * sizeof(func_symbol_t));
+	return sym_index_num;
 }
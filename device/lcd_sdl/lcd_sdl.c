@@ -188,8 +188,8 @@ typedef struct {
  * and return 1.
  *
  * If 'dirty_base' is not 0, it is a physical address that will be
- * used to speed-up the check using the VGA dirty bits. In practice
- * this is only used if your kernel driver does not implement.
+ * used to speed-up the check using the display dirty flags of the
+ * guest ram.
  *
  * This function assumes that the framebuffers are in linear memory.
  * This may change later when we want to support larger framebuffers
@@ -205,37 +205,39 @@ compute_fb_update_rect_linear(FbUpdateState*  fbs,
     const uint8_t* src_line = fbs->src_pixels;
     uint8_t*       dst_line = fbs->dst_pixels;
     uint32_t       dirty_addr = dirty_base;
+    /* the last page looked up, it may be shared by the next line */
+    uint32_t       dirty_page = 1;
+    int            page_dirty = 0;
     rect->xmin = rect->ymin = INT_MAX;
     rect->xmax = rect->ymax = INT_MIN;
     for (yy = 0; yy < fbs->height; yy++) {
         int xx1, xx2;
         /* If dirty_addr is != 0, then use it as a physical address to
-         * use the VGA dirty bits table to speed up the detection of
-         * changed pixels.
+         * use the display dirty flags of the pages to skip the lines
+         * that were not written. The flags are cleared as the pages are
+         * scanned, so a write racing with the scan is seen next time.
          */
-
-	//modified by xiaoqiao
-#if 0
         if (dirty_addr != 0) {
+            uint32_t page = dirty_addr & ~BANK_PAGE_MASK;
+            uint32_t last = (dirty_addr + fbs->src_pitch - 1) & ~BANK_PAGE_MASK;
             int  dirty = 0;
-            int  len   = fbs->src_pitch;
-
-            while (len > 0) {
-                int  len2 = TARGET_PAGE_SIZE - (dirty_addr & (TARGET_PAGE_SIZE-1));
 
-                if (len2 > len)
-                    len2 = len;
-
-                dirty |= cpu_physical_memory_get_dirty(dirty_addr, VGA_DIRTY_FLAG);
-                dirty_addr  += len2;
-                len         -= len2;
+            for (;;) {
+                if (page != dirty_page) {
+                    dirty_page = page;
+                    page_dirty = mem_test_and_reset_dirty(page, MEM_DIRTY_DISPLAY);
+                }
+                dirty |= page_dirty;
+                if (page == last)
+                    break;
+                page += BANK_PAGE_SIZE;
             }
+            dirty_addr += fbs->src_pitch;
 
             if (!dirty) { /* this line was not modified, skip to next one */
                 goto NEXT_LINE;
             }
         }
-#endif
 
         /* Then compute actual bounds of the changed pixels, while
          * copying them from 'src' to 'dst'. This depends on the pixel depth.
@@ -360,13 +362,6 @@ compute_fb_update_rect_linear(FbUpdateState*  fbs,
         return 0;
     }
 
-//modified by xiaoqiao
-    /* Always clear the dirty VGA bits */
-#if 0
-    cpu_physical_memory_reset_dirty(dirty_base + rect->ymin * fbs->src_pitch,
-                                    dirty_base + (rect->ymax+1)* fbs->src_pitch,
-                                    VGA_DIRTY_FLAG);
-#endif
     return 1;
 }
 
@@ -20,30 +20,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/stat.h>
 #include <unistd.h>
 #include <stdlib.h>
-//#include <sys/mman.h>
-#include "portable/mman.h"
 #include "skyeye_nandflash.h"
 #include "nandflash_K9G8G08.h"
 #include "skyeye.h"
 static void nandflash_sb_reset(struct nandflash_device *dev);
 static void nandflash_sb_doerase(struct nandflash_device *dev,struct nandflash_sb_status *nf)
 {
-	uint32 blocks,len,base,i;
+	uint32 blocks,len,base;
 	if(nf->WP==NF_HIGH)
 	{
 		len=dev->erasesize;
 		base=nf->address-nf->address%len;
-#ifndef POSIX_SHARE_MEMORY_BROKEN
-		for (i=0;i<len;i++)
-			*(nf->addrspace+base+i)=0xFF;
-#else
-		lseek(nf->fdump,base,SEEK_SET);
-		memset(nf->readbuffer,0xff,dev->pagedumpsize);
-		nf->curblock=-1;
-		for(i=0;i<dev->pagenum;i++)
-		  write(nf->fdump,nf->readbuffer,dev->pagedumpsize);
-#endif
-		//msync(nf->addrspace+base,len,MS_ASYNC);
+		nand_store_erase(&nf->store,base,len);
 	}
 }
 static void nandflash_sb_dodatawrite(struct nandflash_device *dev,struct nandflash_sb_status *nf)
@@ -61,42 +49,19 @@ static void nandflash_sb_dodatawrite(struct nandflash_device *dev,struct nandfla
 }
 static void nandflash_sb_finishwrite(struct nandflash_device *dev,struct nandflash_sb_status *nf)
 {
-	uint32 i,base;
+	uint32 base;
 	if(nf->WP==NF_HIGH)
 	{
 		base=nf->address-nf->address%dev->pagedumpsize;
-#ifndef POSIX_SHARE_MEMORY_BROKEN
-		for (i=0;i<dev->pagedumpsize;i++)
-		{
-			*(nf->addrspace+base+i)&=nf->writebuffer[i];
-		}
-#else
-		//printf("DEBUG:nand flash write\n");
-		lseek(nf->fdump,base,SEEK_SET);
-		if(write(nf->fdump,nf->writebuffer,dev->pagedumpsize)!=dev->pagedumpsize)
-			printf("nand flash write error\n");
-		//fsync(nf->fdump);
-#endif
-		//msync(nf->addrspace+base,528,MS_ASYNC);
+		nand_store_program(&nf->store,base,nf->writebuffer,dev->pagedumpsize);
 	}
 }
 static void nandflash_sb_doread(struct nandflash_device *dev,struct nandflash_sb_status *nf)
 {
 	if(nf->address<dev->devicesize)
 	{
-#ifndef POSIX_SHARE_MEMORY_BROKEN
-		nf->IOPIN=*(nf->addrspace+nf->address);
-#else
-	    	int blockoff=nf->address%dev->pagedumpsize;
-	    	nf->IOPIN=nf->readbuffer[blockoff];
-#endif
+		nf->IOPIN=*nand_store_ptr(&nf->store,nf->address);
 		nf->address++;
-#ifdef POSIX_SHARE_MEMORY_BROKEN
-		if((nf->address%dev->pagedumpsize)==0)
-		{
-			nf->curblock=-1;
-		}
-#endif
 		if((nf->address%dev->pagedumpsize==0)&&(nf->cmd==NAND_CMD_READOOB))
 		{
 			nf->address+=dev->pagesize;
@@ -265,28 +230,6 @@ static void nandflash_sb_doaddr(struct nandflash_device *dev,struct nandflash_sb
 		if ((nf->cmd==NAND_CMD_READ0)||(nf->cmd==NAND_CMD_READ1)||(nf->cmd==NAND_CMD_READOOB) || nf->cmd == NAND_CMD_READSTART)
 		{
 			nf->iostatus=NF_DATAREAD;
-			#ifdef POSIX_SHARE_MEMORY_BROKEN
-				int block=nf->address/dev->pagedumpsize;
-				int tmp;
-				//if(block!=nf->curblock)
-				//{
-					//printf("nand read address:%08x\n",nf->address);
-					if (nf->address<dev->devicesize)
-					{
-						memset(nf->readbuffer,0xff,dev->pagedumpsize);						
-						if(lseek(nf->fdump,block*dev->pagedumpsize,SEEK_SET)==-1)
-							printf("lseek error\n");
-						//printf("offset:%d\n",block);
-						tmp=read(nf->fdump,nf->readbuffer,dev->pagedumpsize);
-						if  (tmp!=dev->pagedumpsize)
-					  		printf("read error address:%08x,readsize:%d,block:%d\n",nf->address,tmp,block);
-					  }
-					  else
-					  {
-					  	printf("read outof bound\n");
-					  }
-				//}
-			#endif
 		}
 		else if (nf->cmd==NAND_CMD_SEQIN)
 		{
@@ -526,11 +469,7 @@ static void nandflash_sb_reset(struct nandflash_device *dev)
 
 void  nandflash_sb_K9G8G08_setup(struct nandflash_device* dev)
 {
-	uint8 flag=0xFF;
-	int len,start,needinit=0;
-	struct stat statbuf;
 	struct nandflash_sb_status *nf;
-	int i;
 	nf=(struct nandflash_sb_status *)malloc(sizeof(struct nandflash_sb_status));
 	if (nf==NULL) 
 	{
@@ -552,105 +491,27 @@ void  nandflash_sb_K9G8G08_setup(struct nandflash_device* dev)
 	dev->setWE=nandflash_sb_setWE;
 	dev->setWP=nandflash_sb_setWP;
 	memset(nf,0,sizeof(struct nandflash_sb_status));
-#ifdef POSIX_SHARE_MEMORY_BROKEN
-	nf->readbuffer=(uint8*)malloc(dev->pagedumpsize);
-#endif
 	nf->writebuffer=(uint8*)malloc(dev->pagedumpsize);
-	//nf->memsize=528*32*4096;
-       if ((nf->fdump= open(dev->dump, FILE_FLAG, S_IRUSR |S_IWUSR )) < 0)
-       {
-       	free(nf);
-       	printf("error open nandflash dump!\n");
-       	skyeye_exit(-1);
-       }
-	
-       if (fstat(nf->fdump, &statbuf) < 0)   /* need size of input file */
-       {
-       	free(nf);
-       	printf("error fstat function\n");
+	if (nand_store_open(&nf->store, dev->dump, dev->base, dev->devicesize) != 0)
+	{
+		free(nf->writebuffer);
+		free(nf);
+		printf("error open nandflash dump!\n");
 		skyeye_exit(-1);
-       }
-       if (statbuf.st_size<dev->devicesize)
-       {
-		printf("\nInit nandflash dump file.\n");
-		needinit=1;
-		start=statbuf.st_size;
-		len=dev->devicesize-start;
-		lseek(nf->fdump,dev->devicesize-1,SEEK_SET);
-		write(nf->fdump,&flag,1);
-#ifndef __MINGW32__
-		fsync(nf->fdump);
-#else
-		_flushall();
-#endif
-       }
-#ifndef POSIX_SHARE_MEMORY_BROKEN
-       
-	if (fstat(nf->fdump, &statbuf) < 0)   /* need size of input file */
-       	{
-       		free(nf);
-       		printf("error fstat function\n");
-				skyeye_exit(-1);
-       	}
-
-			printf("file size:%d\n",statbuf.st_size);
-         if ((nf->addrspace= mmap(0, statbuf.st_size, PROT_READ | PROT_WRITE,
-      		MAP_SHARED, nf->fdump, 0)) == MAP_FAILED)
-      	{
-      		free(nf);
-      		printf("error mmap nandflash file\n");
-		      skyeye_exit(-1);
-      	}
-      	if (needinit)
-      	{
-      		for(i=start;i<dev->devicesize;i++)
-      		{
-      			*(nf->addrspace+i)=flag;
-      		}
-      		if (!msync(nf->addrspace,dev->devicesize,MS_SYNC))
-			printf("finish init nandflash dump\n");
-		
-      	}
-		
- #else
-   	nf->curblock=-1;
- 	if (needinit)
- 	{
- 		memset(nf->readbuffer,0xff,dev->pagedumpsize);
- 		lseek(nf->fdump,start,SEEK_SET);
- 		while((dev->devicesize-start)>=dev->pagesize)
- 		{
- 		  write(nf->fdump,nf->readbuffer,dev->pagesize);
- 		  start=start+dev->pagesize;
- 		 }
- 		 for (i=start;i<dev->devicesize;i++)
- 		   write(nf->fdump,&flag,1);
- 	}
- #endif
-      	dev->priv=nf;
+	}
+	dev->priv=nf;
       	nandflash_sb_poweron(dev);
 }
 void nandflash_sb_K9G8G08_uninstall(struct nandflash_device* dev)
 {
 	struct nandflash_sb_status *nf;
-	if(!dev->priv)
+	if(dev->priv)
 	{
 		nf=(struct nandflash_sb_status*)dev->priv;
-		if (!nf->fdump)
-		{
-			//msync(nf->addrspace,nf->memsize,MS_SYNC);
-#ifndef POSIX_SHARE_MEMORY_BROKEN
-			munmap(nf->addrspace,dev->devicesize);
-#endif
-			close(nf->fdump);
-			NANDFLASH_DBG("Unistall nandflash\n");
-		}
-#ifdef POSIX_SHARE_MEMORY_BROKEN
-		if(!nf->readbuffer)
-		  free(nf->readbuffer);
-#endif
-		if(!nf->writebuffer)
-		  free(nf->writebuffer);
+		nand_store_close(&nf->store);
+		NANDFLASH_DBG("Unistall nandflash\n");
+		free(nf->writebuffer);
 		free(nf);
+		dev->priv=NULL;
 	}
 }
@@ -20,16 +20,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #define _NANDFLASH_SMALLBLOCK_H_
 #include <stdio.h>
 #include "skyeye_nandflash.h"
-
-#ifdef __MINGW32__
-	#define FILE_FLAG   (O_RDWR | O_CREAT | O_BINARY)
-#else
-	#define FILE_FLAG   (O_RDWR | O_CREAT)
-#endif
-
-#if (defined(__MINGW32__) || defined(__BEOS__))
-	#define POSIX_SHARE_MEMORY_BROKEN
-#endif
+#include "skyeye_nand_store.h"
 
 //nandflash cmd status
 
@@ -73,16 +64,9 @@ struct nandflash_sb_status
       iostatustype iostatus;
       uint32 address;
       //uint32 memsize;
-      int fdump;
       uint8  *writebuffer;
       uint16  pageoffset;
-      #ifdef POSIX_SHARE_MEMORY_BROKEN
-      uint8 *readbuffer;
-      uint32 curblock;
-      FILE *fd;
-      #else
-      uint8* addrspace;
-      #endif
+      nand_store_t store;
 };
 
 #endif //_NANDFLASH_SMALLBLOCK_H_
@@ -102,6 +102,7 @@ nandflash_setup (struct device_desc *dev, void *option)
 
 	memset (nandflash_dev, 0, sizeof (struct nandflash_device));
 	memcpy (&nandflash_dev->dump[0], &nandflash_opt->dump[0], MAX_STR_NAME);
+	memcpy (&nandflash_dev->base[0], &nandflash_opt->base[0], MAX_STR_NAME);
 
 	dev->dev = (void *) nandflash_dev;
 	return ret;
@@ -147,10 +148,15 @@ do_nandflash_option (skyeye_option_t * this_option, int num_params,
 		if (!strncmp("dump", name, strlen(name))) {
 			memcpy(&flash_opt.dump[0], value, strlen(value) + 1);
 		}
+		else if (!strncmp("base", name, strlen(name))) {
+			memcpy(&flash_opt.base[0], value, strlen(value) + 1);
+		}
 	}
 
 	SKYEYE_INFO ("nandflash: dump %s\n",
 		     flash_opt.dump[0] == 0 ? "none" : flash_opt.dump);
+	if (flash_opt.base[0] != 0)
+		SKYEYE_INFO ("nandflash: base %s\n", flash_opt.base);
 
 	setup_device_option (this_option->option_name, (void *) &flash_opt,
 			     num_params, params);
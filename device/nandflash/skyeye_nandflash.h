@@ -57,6 +57,8 @@ struct nandflash_device
 	/* private data. */
 	void *priv;
 	char dump[MAX_STR_NAME];
+	/* the read only base image, dump is then an overlay of it */
+	char base[MAX_STR_NAME];
 	uint32 pagesize,obbsize;
 	uint32 pagenum;           /* page numbers per block*/
 	uint32 blocknum;          /* block numbers per device*/
@@ -107,6 +109,7 @@ static nandflash_module_option nandflash_module_data[]={
 struct flash_option
 {
         char dump[MAX_STR_NAME];
+        char base[MAX_STR_NAME];
 };
 
 #endif	/*__SKYEYE_NANDFLASH_H_*/
@@ -28,6 +28,7 @@
 
 #include "skyeye_device.h"
 #include <skyeye_sched.h>
+#include "skyeye_io.h"
 #include "skyeye_net.h"
 #include "skyeye_config.h"
 #include "dev_net_cs8900a.h"
@@ -43,47 +44,8 @@ static struct device_default_value cs8900a_net_def[] = {
 
 #define MAX_DEVICE_NUM 10
 static struct device_desc *cs8900a_devs[MAX_DEVICE_NUM];
-static struct timeval eth_timeout[MAX_DEVICE_NUM];
-static int eth_timeout_flags[MAX_DEVICE_NUM] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 static void net_cs8900a_reset (struct device_desc *dev);
-
-#define TIMEVAL_ADD_USEC(tv, usec)					\
-	do {								\
-		tv.tv_sec += ((tv.tv_usec + usec) / (1000000UL));	\
-		tv.tv_usec = ((tv.tv_usec + usec) % (1000000UL));	\
-	} while (0)
-
-#define TIMEVAL_CMP(tv1, tv2)						\
-	(memcmp(&tv1, &tv2, sizeof(struct timeval)) == 0 ?		\
-	 0 : (								\
-		tv1.tv_sec < tv2.tv_sec ? -1 : (			\
-		(tv1.tv_sec == tv2.tv_sec && tv1.tv_usec < tv2.tv_usec) ? -1 : 1        \
-	)))
-
-static void set_time(int index, int packets)
-{
-	eth_timeout_flags[index] = 0;
-
-	if (packets <= 0) return;
-	if (gettimeofday(&eth_timeout[index], NULL) != 0) return;
-
-#if 0
-	TIMEVAL_ADD_USEC(eth_timeout[index], (unsigned int)packets * 100UL);
-#else
-	/* 
-	 * NOTE by Stano:
-	 * 	In 10 ms - no reason to wait 1 second for a big packet
-	 *
-	 * NOTE by Lee:
-	 * 	Though the timeout just for generating interrupt,
-	 *	but please increase the timeout microseconds to decrease
-	 *	the loading of CPU when connecting to an external network.
-	 */
-	TIMEVAL_ADD_USEC(eth_timeout[index], 10000UL);
-#endif
-
-	eth_timeout_flags[index] = 1;
-}
+static void net_cs8900a_rx_event (void *arg);
 
 void
 net_cs8900a_set_update_intr (struct device_desc *dev)
@@ -107,22 +69,25 @@ static void send_interrupt(int index)
 			/* only update once. */
 			net_cs8900a_set_update_intr (dev);
 			io->need_update = 0;
-			set_time (index, 0);
 		}
 	}
 }
 
-static void check_timeout(int index)
+/* the coalescing timer of the device expired */
+static void eth_coalesce_event(void *arg)
 {
-	struct timeval tv;
-
-	if (!eth_timeout_flags[index]) return;
-	if (gettimeofday(&tv, NULL) != 0) return;
-	if (TIMEVAL_CMP(tv, eth_timeout[index]) < 1) return;
+	send_interrupt((long)arg);
+}
 
-	send_interrupt(index);
+/* raise the interrupt now, or when enough events are coalesced */
+static void request_interrupt(struct device_desc *dev)
+{
+	struct net_device *net_dev = (struct net_device *) dev->dev;
+	struct net_cs8900a_io *io = (struct net_cs8900a_io *) dev->data;
 
-	eth_timeout_flags[index] = 0;
+	io->need_update = 1;
+	if (net_coalesce (net_dev))
+		send_interrupt (io->index);
 }
 
 /* ISQ read*/
@@ -174,6 +139,9 @@ frame_read (struct device_desc *dev, uint16 * data)
 	*data = io->rx_frame[io->rx_tail];
 	if (io->rx_tail==io->rx_head) {
 		io->ctrl_st[CtrlStNum (PP_RxEvent)] &= ~0x100;
+		/* the guest took the frame, hand it the next queued one */
+		if (net_dev->rx_ring != NULL && net_rx_peek (net_dev) > 0)
+			post_thread_event (net_cs8900a_rx_event, (void *) dev);
 	}
 	io->rx_tail++;
 }
@@ -285,6 +253,8 @@ static void
 net_cs8900a_fini (struct device_desc *dev)
 {
 	struct net_cs8900a_io *io = (struct net_cs8900a_io *) dev->data;
+	struct net_device *net_dev = (struct net_device *) dev->dev;
+	net_rx_stop (net_dev);
 	free (dev->dev);
 	free (io);
 }
@@ -341,14 +311,41 @@ net_cs8900a_update (struct device_desc *dev)
 	struct net_cs8900a_io *io = (struct net_cs8900a_io *) dev->data;
 	struct machine_config *mc = (struct machine_config *) dev->mach;
 	if ((!mc->mach_pending_intr (intr->interrupts[INT_CS8900A]))) {
-		struct timeval tv;
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-		if(net_dev->net_wait_packet (net_dev, &tv) == 0) cs8900a_input (dev);
+		if (net_rx_pending (net_dev)) cs8900a_input (dev);
 	}
 
 }
 
+/* the retry interval when the guest has not taken the last frame yet */
+#define CS8900A_RX_RETRY	1000
+
+/**
+* @brief called when the rx ring has frames, or the guest took the last one
+*
+* @param arg the device
+*/
+static void
+net_cs8900a_rx_event (void *arg)
+{
+	struct device_desc *dev = (struct device_desc *) arg;
+	struct device_interrupt *intr = &dev->intr;
+	struct net_device *net_dev = (struct net_device *) dev->dev;
+	struct net_cs8900a_io *io = (struct net_cs8900a_io *) dev->data;
+	struct machine_config *mc = (struct machine_config *) dev->mach;
+	int id;
+
+	if (!net_rx_pending (net_dev))
+		return;
+	/* the frame stays in the ring until the guest is ready for it */
+	if (mc->mach_pending_intr (intr->interrupts[INT_CS8900A]) ||
+	    (io->ctrl_st[CtrlStNum (PP_RxEvent)] & 0x100)) {
+		create_thread_scheduler (CS8900A_RX_RETRY, Oneshot_sched,
+					 net_cs8900a_rx_event, arg, &id);
+		return;
+	}
+	cs8900a_input (dev);
+}
+
 
 int
 net_cs8900a_read_halfword (struct device_desc *dev, uint32 addr, uint16 * data)
@@ -518,7 +515,7 @@ cs8900a_input (struct device_desc *dev)
 	if (io->ctrl_st[CtrlStNum (PP_RxEvent)] & 0x100)
 		return;
 	bufptr = (uint8 *) & (io->rx_frame[2]);
-	packet_len = net_dev->net_read (net_dev, bufptr, Rx_Max_Count);
+	packet_len = net_rx_frame (net_dev, bufptr, Rx_Max_Count);
 	if (packet_len < 0)
 		return;
 
@@ -540,9 +537,7 @@ cs8900a_input (struct device_desc *dev)
 	io->ctrl_st[CtrlStNum (PP_RxEvent)] |= 0x100;	//TxOK
 	if (io->ctrl_st[CtrlStNum (PP_BusCTL)] & EnableRQ) {
 		//printf("%s:%x, packet_len:%d\n", __FUNCTION__, io->ctrl_st[CtrlStNum(PP_RxEvent)], packet_len);
-		set_time (io->index, packet_len);
-		io->need_update = 1;
-		net_cs8900a_set_update_intr (dev);
+		request_interrupt (dev);
 	}
 }
 
@@ -557,18 +552,15 @@ cs8900a_output (struct device_desc *dev, uint8 * buf, uint16 packet_len)
 #if 0
 	print_packet (buf, packet_len);
 #endif
-	if ((len = net_dev->net_write (net_dev, buf, packet_len)) == -1) {
+	if ((len = net_tx_frame (net_dev, buf, packet_len)) == -1) {
 		fprintf (stderr, "write to tapif error in skyeye-ne2k.c\n");
 		return -1;
 	}
 	io->ctrl_st[CtrlStNum (PP_TxEvent)] |= 0x100;
 	io->ctrl_st[CtrlStNum (PP_BusST)] |= Rdy4TxNOW;
 
-	if (io->ctrl_st[CtrlStNum (PP_BusCTL)] & EnableRQ) {
-		set_time (io->index, packet_len);
-		io->need_update = 1;
-		net_cs8900a_set_update_intr (dev);
-	}
+	if (io->ctrl_st[CtrlStNum (PP_BusCTL)] & EnableRQ)
+		request_interrupt (dev);
 	return 0;
 }
 static int
@@ -581,7 +573,6 @@ net_cs8900a_setup (struct device_desc *dev)
 
 	dev->fini = net_cs8900a_fini;
 	dev->reset = net_cs8900a_reset;
-	dev->update = net_cs8900a_update;
 	dev->read_halfword = net_cs8900a_read_halfword;
 	dev->write_halfword = net_cs8900a_write_halfword;
 
@@ -598,9 +589,6 @@ net_cs8900a_setup (struct device_desc *dev)
 	 * */
 	set_device_default (dev, cs8900a_net_def);
 
-	int id; 
-	create_thread_scheduler(10000,Periodic_sched,net_cs8900a_update, (void*)dev, &id);
-
 	for (i = 0; i < MAX_DEVICE_NUM; i++) {
 		if (cs8900a_devs[i] == NULL) {
 			cs8900a_devs[i] = dev;
@@ -612,6 +600,16 @@ net_cs8900a_setup (struct device_desc *dev)
 	if (enough == 0)
 		return 1;
 
+	net_coalesce_init ((struct net_device *) dev->dev, eth_coalesce_event,
+			   (void *) (long) io->index);
+	/* receive the frames queued by the io reactor, poll only if there is none */
+	if (net_rx_start ((struct net_device *) dev->dev,
+			  net_cs8900a_rx_event, (void *) dev) != 0) {
+		int id;
+		dev->update = net_cs8900a_update;
+		create_thread_scheduler(10000,Periodic_sched,net_cs8900a_update, (void*)dev, &id);
+	}
+
 	return 0;
 }
 
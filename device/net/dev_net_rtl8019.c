@@ -37,6 +37,8 @@
 #include "skyeye_device.h"
 #include "skyeye_net.h"
 #include "skyeye_config.h"
+#include "skyeye_sched.h"
+#include "skyeye_io.h"
 #include "dev_net_rtl8019.h"
 #include "portable/gettimeofday.h"
 
@@ -60,47 +62,7 @@ static struct device_default_value rtl8019_net_def[] = {
 
 #define MAX_DEVICE_NUM 10
 static struct device_desc *rtl8019_devs[MAX_DEVICE_NUM];
-static struct timeval eth_timeout[MAX_DEVICE_NUM];
-static int eth_timeout_flags[MAX_DEVICE_NUM] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-
-#define TIMEVAL_ADD_USEC(tv, usec)					\
-	do {								\
-		tv.tv_sec += ((tv.tv_usec + usec) / (1000000UL));	\
-		tv.tv_usec = ((tv.tv_usec + usec) % (1000000UL));	\
-	} while (0)
-
-#define TIMEVAL_CMP(tv1, tv2)						\
-	(memcmp(&tv1, &tv2, sizeof(struct timeval)) == 0 ?		\
-	 0 : (								\
-		tv1.tv_sec < tv2.tv_sec ? -1 : (			\
-		(tv1.tv_sec == tv2.tv_sec && tv1.tv_usec < tv2.tv_usec) ? -1 : 1        \
-	)))
-
-static void set_time(int index, int packets)
-{
-	eth_timeout_flags[index] = 0;
-
-	if (packets <= 0) return;
-
-	if (gettimeofday(&eth_timeout[index], NULL) != 0) return;
-
-#if 0
-	TIMEVAL_ADD_USEC(eth_timeout[index], (unsigned int)packets * 100UL);
-#else
-	/* 
-	 * NOTE by Stano:
-	 * 	In 10 ms - no reason to wait 1 second for a big packet
-	 *
-	 * NOTE by Lee:
-	 * 	Though the timeout just for generating interrupt,
-	 *	but please increase the timeout microseconds to decrease
-	 *	the loading of CPU when connecting to an external network.
-	 */
-	TIMEVAL_ADD_USEC(eth_timeout[index], 10000UL);
-#endif
-
-	eth_timeout_flags[index] = 1;
-}
+static void net_rtl8019_rx_event (void *arg);
 
 static inline void
 net_rtl8019_set_update_intr (struct device_desc *dev)
@@ -123,22 +85,25 @@ static void send_interrupt(int index)
 		if ((io->need_update) && (io->IMR & io->ISR)) {
 			net_rtl8019_set_update_intr(dev);
 			io->need_update = 0;
-			set_time(index, 0);
 		}
 	}
 }
 
-static void check_timeout(int index)
+/* the coalescing timer of the device expired */
+static void eth_coalesce_event(void *arg)
 {
-	struct timeval tv;
-
-	if (!eth_timeout_flags[index]) return;
-	if (gettimeofday(&tv, NULL) != 0) return;
-	if (TIMEVAL_CMP(tv, eth_timeout[index]) < 1) return;
+	send_interrupt((long)arg);
+}
 
-	send_interrupt(index);
+/* raise the interrupt now, or when enough events are coalesced */
+static void request_interrupt(struct device_desc *dev)
+{
+	struct net_device *net_dev = (struct net_device *) dev->dev;
+	struct net_rtl8019_io *io = (struct net_rtl8019_io *) dev->data;
 
-	eth_timeout_flags[index] = 0;
+	io->need_update = 1;
+	if (net_coalesce (net_dev))
+		send_interrupt (io->index);
 }
 
 static void
@@ -177,9 +142,7 @@ write_cr (struct device_desc *dev, uint8 data)
 
 		/**** send a interrupt to CPU here! ****/
 		io->ISR |= ISR_PTX;
-		set_time (io->index, packet_len);
-		io->need_update = 1;
-		//net_rtl8019_set_update_intr(dev);
+		request_interrupt (dev);
 
 	}
 
@@ -355,6 +318,8 @@ static void
 net_rtl8019_fini (struct device_desc *dev)
 {
 	struct net_rtl8019_io *io = (struct net_rtl8019_io *) dev->data;
+	struct net_device *net_dev = (struct net_device *) dev->dev;
+	net_rx_stop (net_dev);
 	free (dev->dev);
 	free (io);
 }
@@ -429,9 +394,6 @@ net_rtl8019_update (struct device_desc *dev)
 	struct net_device *net_dev = (struct net_device *) dev->dev;
 	struct net_rtl8019_io *io = (struct net_rtl8019_io *) dev->data;
 	struct machine_config *mc = (struct machine_config *) dev->mach;
-	struct timeval tv;
-	tv.tv_sec = 0;
-	tv.tv_usec = 0;
 
 #if 0
 	/* disabled: ISR_OVW instead of this */
@@ -439,9 +401,36 @@ net_rtl8019_update (struct device_desc *dev)
 #else
 	if (!(io->ISR & ISR_OVW))
 #endif
-		if(net_dev->net_wait_packet (net_dev, &tv) == 0) rtl8019_input (dev);
+		if (net_rx_pending (net_dev)) rtl8019_input (dev);
+}
+
+/* the retry interval when the receive ring of the guest is full */
+#define RTL8019_RX_RETRY	1000
+
+/**
+* @brief called when the rx ring has frames, moves as many as the receive
+* ring of the guest can hold
+*
+* @param arg the device
+*/
+static void
+net_rtl8019_rx_event (void *arg)
+{
+	struct device_desc *dev = (struct device_desc *) arg;
+	struct net_device *net_dev = (struct net_device *) dev->dev;
+	struct net_rtl8019_io *io = (struct net_rtl8019_io *) dev->data;
+	int i, id;
 
-	check_timeout(io->index);
+	for (i = 0; i < NET_RING_SIZE; i++) {
+		if (!net_rx_pending (net_dev))
+			return;
+		if ((io->ISR & ISR_OVW) || (io->CR & CMD_STOP) || (io->TCR & TCR_LOOP_EXT))
+			break;
+		rtl8019_input (dev);
+	}
+	/* the frames left wait for the guest */
+	create_thread_scheduler(RTL8019_RX_RETRY, Oneshot_sched,
+				net_rtl8019_rx_event, arg, &id);
 }
 
 
@@ -799,7 +788,20 @@ rtl8019_input (struct device_desc *dev)
 	}
 
 
-	packet_len = net_dev->net_read (net_dev, buf, sizeof (buf));
+	/* a queued frame that does not fit stays in the ring */
+	packet_len = net_rx_peek (net_dev);
+	if (packet_len < 0)
+		return;
+	if (packet_len > 0 &&
+	    ((packet_len < 60 ? 60 : packet_len) + 4 + 255) / PAGE_SIZE > free_pages) {
+		io->ISR |= ISR_OVW;
+		if ((ISR_OVW & io->IMR)) {
+			net_rtl8019_set_update_intr (dev);
+		}
+		return;
+	}
+
+	packet_len = net_rx_frame (net_dev, buf, sizeof (buf));
 	if (packet_len < 0)
 		return;
 	/* if packet_len < 60, pad zero to 60 bytes length. */
@@ -897,9 +899,7 @@ rtl8019_input (struct device_desc *dev)
 	io->ISR |= ISR_PRX;	//got packet int
 	if ((ISR_PRX & io->IMR)) {
 		//printf ("+++%s: raise RX interrupt, ISR:%x, IMR:%x\n", __FUNCTION__, io->ISR, io->IMR);
-		set_time (io->index, rtl8019_len);
-		io->need_update = 1;
-		net_rtl8019_set_update_intr (dev);
+		request_interrupt (dev);
 	}
 }
 
@@ -918,7 +918,7 @@ rtl8019_output (struct device_desc *dev, uint8 * buf, uint16 packet_len)
 	fprintf(stderr, "\n----(%s)(packet_len:%d)----", __FUNCTION__, packet_len);
 	print_packet (buf, packet_len);
 #endif
-	if ((len = net_dev->net_write (net_dev, buf, packet_len)) == -1) {
+	if ((len = net_tx_frame (net_dev, buf, packet_len)) == -1) {
 		fprintf (stderr, "write to tapif error in skyeye-ne2k.c\n");
 		return -1;
 	}
@@ -936,7 +936,6 @@ net_rtl8019_setup(struct device_desc *dev)
 
 	dev->fini = net_rtl8019_fini;
 	dev->reset = net_rtl8019_reset;
-	dev->update = net_rtl8019_update;
 	dev->read_byte = net_rtl8019_read_byte;
 	dev->write_byte = net_rtl8019_write_byte;
 	dev->read_halfword = net_rtl8019_read_halfword;
@@ -964,6 +963,13 @@ net_rtl8019_setup(struct device_desc *dev)
 
 	if (enough == 0) return 1;
 
+	net_coalesce_init((struct net_device *) dev->dev, eth_coalesce_event,
+			  (void *)(long)io->index);
+	/* receive the frames queued by the io reactor, poll only if there is none */
+	if (net_rx_start((struct net_device *) dev->dev,
+			 net_rtl8019_rx_event, (void *) dev) != 0)
+		dev->update = net_rtl8019_update;
+
 	return 0;
 }
 
@@ -26,6 +26,7 @@
 
 #include <sys/time.h>
 #include <sys/types.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 //#include "armdefs.h"
@@ -101,8 +102,20 @@ net_setup (struct device_desc *dev, void *option)
 		net_dev->net_write = vhub_write;
 		net_dev->net_wait_packet = vhub_wait_packet;
 		break;
+	case NET_MOD_SOCKET:
+		net_dev->net_open = socket_open;
+		net_dev->net_close = socket_close;
+		net_dev->net_read = socket_read;
+		net_dev->net_write = socket_write;
+		net_dev->net_wait_packet = socket_wait_packet;
+		net_dev->net_read_batch = socket_read_batch;
+		net_dev->net_write_batch = socket_write_batch;
+		break;
 
 	}
+	net_dev->coalesce_usecs = net_opt->coalesce_usecs;
+	net_dev->coalesce_frames = net_opt->coalesce_frames;
+	memcpy (net_dev->sock_path, net_opt->sock_path, NET_SOCK_PATH_LEN);
 	
 	ret = net_dev->net_open (net_dev);
 
@@ -187,6 +200,7 @@ do_net_option (skyeye_option_t * this_option, int num_params,
 	unsigned char hip[4];
 	unsigned char *maddr, *ip;
 
+	memset (&net_opt, 0, sizeof (net_opt));
 	for (i = 0; i < num_params; i++) {
 		if (split_param (params[i], name, value) < 0) {
 			SKYEYE_ERR ("Error: %s has wrong parameter \"%s\".\n",
@@ -222,6 +236,18 @@ do_net_option (skyeye_option_t * this_option, int num_params,
 			else if (!strncmp("vhub", value, strlen(value))) {
 				net_opt.ethmod = NET_MOD_VHUB;
 			}
+			else if (!strncmp("socket", value, strlen(value))) {
+				net_opt.ethmod = NET_MOD_SOCKET;
+			}
+		}
+		else if (!strncmp ("sock", name, strlen (name))) {
+			strncpy (net_opt.sock_path, value, NET_SOCK_PATH_LEN - 1);
+		}
+		else if (!strncmp ("coalesce_usecs", name, strlen (name))) {
+			net_opt.coalesce_usecs = strtol (value, NULL, 0);
+		}
+		else if (!strncmp ("coalesce_frames", name, strlen (name))) {
+			net_opt.coalesce_frames = strtol (value, NULL, 0);
 		}
 	}
 	maddr = net_opt.macaddr;
@@ -28,13 +28,44 @@
 #define __SKYEYE_NET_H_
 
 #include <sys/time.h>
+#include <pthread.h>
 
 #include "skyeye_device.h"
+#include "skyeye_sched.h"
 
 #define NET_MOD_LINUX   0
 #define NET_MOD_TUNTAP  1
 #define NET_MOD_VNET    2
 #define NET_MOD_VHUB    3
+#define NET_MOD_SOCKET  4
+
+#define NET_SOCK_PATH_LEN	108
+
+/*
+ * The frames of a net device are moved between the host and the device
+ * through two rings, one producer and one consumer without a lock. The
+ * io reactor thread fills the rx ring in batches, the frames sent by the
+ * device are queued in the tx ring and written in batches by an event of
+ * the thread scheduler.
+ */
+#define NET_FRAME_MAX	1600
+#define NET_RING_SIZE	64	/* power of 2 */
+#define NET_BATCH	16	/* the frames of one host read or write */
+
+struct net_frame
+{
+	int len;
+	uint8 data[NET_FRAME_MAX];
+};
+
+struct net_ring
+{
+	volatile uint32 head;	/* advanced by the consumer */
+	volatile uint32 tail;	/* advanced by the producer */
+	volatile int stalled;	/* rx: full, the fd waits for a rearm */
+	struct net_frame frames[NET_RING_SIZE];
+};
+
 struct net_device
 {
 	int net_fd;
@@ -50,6 +81,29 @@ struct net_device
 	int (*net_read) (struct net_device * net_dev, void *buf, size_t count);
 	int (*net_write) (struct net_device * net_dev, void *buf, size_t count);
 	int (*net_wait_packet) (struct net_device * net_dev, struct timeval *tv);
+	/* optional, move up to count frames in one syscall, -1 on error */
+	int (*net_read_batch) (struct net_device * net_dev, struct net_frame *frames, int count);
+	int (*net_write_batch) (struct net_device * net_dev, struct net_frame *frames, int count);
+
+	/* the batched host io, NULL when the device polls the backend */
+	struct net_ring *rx_ring;
+	struct net_ring *tx_ring;
+	sched_func_t rx_notify;		/* posted when the rx ring gets frames */
+	void *rx_notify_arg;
+	volatile int rx_notified;
+	volatile int tx_posted;
+	pthread_mutex_t tx_lock;
+
+	/* interrupt coalescing, an interrupt every coalesce_frames events
+	 * or coalesce_usecs after the first one, 0 usecs for no delay */
+	int coalesce_usecs;
+	int coalesce_frames;
+	volatile int coalesce_count;
+	volatile int coalesce_armed;
+	sched_func_t coalesce_raise;
+	void *coalesce_arg;
+
+	char sock_path[NET_SOCK_PATH_LEN];
 };
 
 struct net_option
@@ -57,6 +111,9 @@ struct net_option
         unsigned char macaddr[6];
         unsigned char hostip[4];
         int ethmod;
+        int coalesce_usecs;
+        int coalesce_frames;
+        char sock_path[NET_SOCK_PATH_LEN];
 };
 
 /* TUNTAP */
@@ -80,6 +137,28 @@ extern int vhub_read (struct net_device *net_dev, void *buf, size_t count);
 extern int vhub_write (struct net_device *net_dev, void *buf, size_t count);
 extern int vhub_wait_packet (struct net_device *net_dev, struct timeval *tv);
 
+/* SOCKET, a unix seqpacket socket, e.g. the peer of net_bench */
+extern int socket_open (struct net_device *net_dev);
+extern int socket_close (struct net_device *net_dev);
+extern int socket_read (struct net_device *net_dev, void *buf, size_t count);
+extern int socket_write (struct net_device *net_dev, void *buf, size_t count);
+extern int socket_wait_packet (struct net_device *net_dev, struct timeval *tv);
+extern int socket_read_batch (struct net_device *net_dev, struct net_frame *frames, int count);
+extern int socket_write_batch (struct net_device *net_dev, struct net_frame *frames, int count);
+
+/* the frame rings */
+extern int net_rx_start (struct net_device *net_dev, sched_func_t notify, void *arg);
+extern void net_rx_stop (struct net_device *net_dev);
+extern int net_rx_pending (struct net_device *net_dev);
+extern int net_rx_peek (struct net_device *net_dev);
+extern int net_rx_frame (struct net_device *net_dev, void *buf, size_t count);
+extern int net_tx_frame (struct net_device *net_dev, void *buf, size_t count);
+extern void net_tx_flush (struct net_device *net_dev);
+
+/* interrupt coalescing */
+extern void net_coalesce_init (struct net_device *net_dev, sched_func_t raise, void *arg);
+extern int net_coalesce (struct net_device *net_dev);
+
 /* ethernet controller initialize functions*/
 extern void net_rtl8019_init (struct device_module_set *mod_set);
 extern void net_cs8900a_init (struct device_module_set *mod_set);
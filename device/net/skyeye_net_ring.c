@@ -0,0 +1,419 @@
+/*
+	skyeye_net_ring.c - the batched frame rings between the host and the
+	simulated net devices
+	Copyright (C) 2003 - 2007 Skyeye Develop Group
+	for help please send mail to <skyeye-developer@lists.gro.clinux.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * The rx ring is filled in the io reactor thread with as many frames as
+ * the host has, and the device is notified once per batch, so a device
+ * takes the next frame as soon as the guest has room for it, without a
+ * syscall. The tx ring is flushed by an event of the thread scheduler,
+ * the frames queued meanwhile are written in one batch.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "skyeye_net.h"
+#include "skyeye_io.h"
+#include "skyeye_log.h"
+
+#define NET_RING_MASK	(NET_RING_SIZE - 1)
+/* the delay before writing again the frames the host could not take */
+#define NET_TX_RETRY	1000
+
+/**
+* @brief read the frames of the host one by one, the fd is non blocking
+*
+* @return the frames read, -1 if the first read failed
+*/
+static int
+net_read_frames (struct net_device *net_dev, struct net_frame *frames, int count)
+{
+	int i, len;
+
+	for (i = 0; i < count; i++) {
+		len = net_dev->net_read (net_dev, frames[i].data, NET_FRAME_MAX);
+		if (len <= 0) {
+			if (len == 0 && i == 0)
+				errno = ECONNRESET;
+			return i ? i : -1;
+		}
+		frames[i].len = len;
+	}
+	return count;
+}
+
+static int
+net_write_frames (struct net_device *net_dev, struct net_frame *frames, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		if (net_dev->net_write (net_dev, frames[i].data, frames[i].len) < 0)
+			return i ? i : -1;
+	return count;
+}
+
+/**
+* @brief move the frames of the host into the rx ring, called in the io
+* reactor thread when the fd is readable
+*
+* @param arg the net device
+*/
+static void
+net_rx_ready (void *arg)
+{
+	struct net_device *net_dev = (struct net_device *) arg;
+	struct net_ring *ring = net_dev->rx_ring;
+	uint32 tail = ring->tail;
+	uint32 space = NET_RING_SIZE - (tail - ring->head);
+	int got = 0, closed = 0, n, batch, off;
+
+	while (space > 0) {
+		off = tail & NET_RING_MASK;
+		batch = NET_RING_SIZE - off;
+		if (batch > space)
+			batch = space;
+		if (batch > NET_BATCH)
+			batch = NET_BATCH;
+
+		if (net_dev->net_read_batch != NULL)
+			n = net_dev->net_read_batch (net_dev, &ring->frames[off], batch);
+		else
+			n = net_read_frames (net_dev, &ring->frames[off], batch);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				break;
+			/* the host side is gone, stop watching it */
+			skyeye_log (Warning_log, __FUNCTION__, "net fd %d closed, errno=%d\n",
+				    net_dev->net_fd, errno);
+			io_unwatch_fd (net_dev->net_fd);
+			closed = 1;
+			break;
+		}
+		/* publish the frames before the tail */
+		__sync_synchronize ();
+		tail += n;
+		ring->tail = tail;
+		space -= n;
+		got += n;
+		if (n < batch)
+			break;
+	}
+
+	if (!closed) {
+		if (space == 0) {
+			/* rearmed when the device takes a frame */
+			ring->stalled = 1;
+			__sync_synchronize ();
+			/* unless it took them all meanwhile */
+			if (ring->tail - ring->head < NET_RING_SIZE &&
+			    __sync_bool_compare_and_swap (&ring->stalled, 1, 0))
+				io_rearm_fd (net_dev->net_fd);
+		} else
+			io_rearm_fd (net_dev->net_fd);
+	}
+	if (got > 0 && net_dev->rx_notify != NULL &&
+	    __sync_bool_compare_and_swap (&net_dev->rx_notified, 0, 1))
+		post_thread_event (net_dev->rx_notify, net_dev->rx_notify_arg);
+}
+
+/**
+* @brief move the frames of the host into the rx ring from the io reactor
+*
+* @param net_dev the net device
+* @param notify posted to the thread scheduler when frames arrive, NULL if
+* the device polls net_rx_pending
+* @param arg the argument of notify
+*
+* @return 0 on success, -1 if the device should poll the backend
+*/
+int
+net_rx_start (struct net_device *net_dev, sched_func_t notify, void *arg)
+{
+	int flags;
+
+	if (net_dev->rx_ring != NULL)
+		return 0;
+	net_dev->rx_ring = (struct net_ring *) malloc (sizeof (struct net_ring));
+	net_dev->tx_ring = (struct net_ring *) malloc (sizeof (struct net_ring));
+	if (net_dev->rx_ring == NULL || net_dev->tx_ring == NULL)
+		goto fail;
+	memset (net_dev->rx_ring, 0, sizeof (struct net_ring));
+	memset (net_dev->tx_ring, 0, sizeof (struct net_ring));
+	pthread_mutex_init (&net_dev->tx_lock, NULL);
+	net_dev->rx_notify = notify;
+	net_dev->rx_notify_arg = arg;
+	net_dev->rx_notified = 0;
+	net_dev->tx_posted = 0;
+
+	/* a batch is read until the host has no more frame */
+	if ((flags = fcntl (net_dev->net_fd, F_GETFL)) < 0 ||
+	    fcntl (net_dev->net_fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		goto fail;
+	if (io_watch_fd_in_reactor (net_dev->net_fd, net_rx_ready, net_dev) != 0) {
+		fcntl (net_dev->net_fd, F_SETFL, flags);
+		goto fail;
+	}
+	return 0;
+
+fail:
+	free (net_dev->rx_ring);
+	free (net_dev->tx_ring);
+	net_dev->rx_ring = net_dev->tx_ring = NULL;
+	return -1;
+}
+
+void
+net_rx_stop (struct net_device *net_dev)
+{
+	if (net_dev->rx_ring == NULL)
+		return;
+	/* the reactor is out of net_rx_ready when it returns */
+	io_unwatch_fd (net_dev->net_fd);
+	net_tx_flush (net_dev);
+	free (net_dev->rx_ring);
+	free (net_dev->tx_ring);
+	net_dev->rx_ring = net_dev->tx_ring = NULL;
+}
+
+/**
+* @brief if a frame is ready for the device, a syscall only when polled
+*/
+int
+net_rx_pending (struct net_device *net_dev)
+{
+	struct net_ring *ring = net_dev->rx_ring;
+	struct timeval tv;
+
+	if (ring == NULL) {
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		return net_dev->net_wait_packet (net_dev, &tv) == 0;
+	}
+	if (ring->head != ring->tail)
+		return 1;
+	/* let the reactor notify the next batch, then check for a frame
+	 * published before the flag was cleared */
+	net_dev->rx_notified = 0;
+	__sync_synchronize ();
+	return ring->head != ring->tail;
+}
+
+/**
+* @brief the length of the next frame
+*
+* @return the length, 0 if unknown because the backend is polled, -1 if
+* the ring is empty
+*/
+int
+net_rx_peek (struct net_device *net_dev)
+{
+	struct net_ring *ring = net_dev->rx_ring;
+
+	if (ring == NULL)
+		return 0;
+	if (ring->head == ring->tail)
+		return -1;
+	__sync_synchronize ();
+	return ring->frames[ring->head & NET_RING_MASK].len;
+}
+
+/**
+* @brief take the next frame
+*
+* @param net_dev the net device
+* @param buf the frame
+* @param count the size of buf
+*
+* @return the length of the frame, -1 if there is none
+*/
+int
+net_rx_frame (struct net_device *net_dev, void *buf, size_t count)
+{
+	struct net_ring *ring = net_dev->rx_ring;
+	struct net_frame *frame;
+	uint32 head;
+	int len;
+
+	if (ring == NULL)
+		return net_dev->net_read (net_dev, buf, count);
+	head = ring->head;
+	if (head == ring->tail)
+		return -1;
+	/* read the frame after the tail */
+	__sync_synchronize ();
+	frame = &ring->frames[head & NET_RING_MASK];
+	len = frame->len < count ? frame->len : count;
+	memcpy (buf, frame->data, len);
+	__sync_synchronize ();
+	ring->head = head + 1;
+
+	if (ring->stalled && __sync_bool_compare_and_swap (&ring->stalled, 1, 0))
+		io_rearm_fd (net_dev->net_fd);
+	return len;
+}
+
+static void net_tx_event (void *arg);
+
+/**
+* @brief write the queued frames to the host, the frames left when the host
+* queue is full are written again by a later event
+*/
+void
+net_tx_flush (struct net_device *net_dev)
+{
+	struct net_ring *ring = net_dev->tx_ring;
+	uint32 head;
+	int batch, off, n, full = 0, id;
+
+	if (ring == NULL)
+		return;
+	pthread_mutex_lock (&net_dev->tx_lock);
+	head = ring->head;
+	while (head != ring->tail) {
+		__sync_synchronize ();
+		off = head & NET_RING_MASK;
+		batch = ring->tail - head;
+		if (batch > NET_RING_SIZE - off)
+			batch = NET_RING_SIZE - off;
+		if (batch > NET_BATCH)
+			batch = NET_BATCH;
+
+		if (net_dev->net_write_batch != NULL)
+			n = net_dev->net_write_batch (net_dev, &ring->frames[off], batch);
+		else
+			n = net_write_frames (net_dev, &ring->frames[off], batch);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			full = 1;
+			break;
+		}
+		/* a frame the host can not take is dropped, as on a real link */
+		if (n <= 0)
+			n = 1;
+		head += n;
+		__sync_synchronize ();
+		ring->head = head;
+	}
+	pthread_mutex_unlock (&net_dev->tx_lock);
+	if (full && __sync_bool_compare_and_swap (&net_dev->tx_posted, 0, 1) &&
+	    create_thread_scheduler (NET_TX_RETRY, Oneshot_sched,
+				     net_tx_event, net_dev, &id) != 0)
+		net_dev->tx_posted = 0;
+}
+
+static void
+net_tx_event (void *arg)
+{
+	struct net_device *net_dev = (struct net_device *) arg;
+
+	/* the frames queued from now on need another event */
+	net_dev->tx_posted = 0;
+	__sync_synchronize ();
+	net_tx_flush (net_dev);
+}
+
+/**
+* @brief send a frame, queued for the next batch if the device has rings
+*
+* @return the length of the frame, -1 on error
+*/
+int
+net_tx_frame (struct net_device *net_dev, void *buf, size_t count)
+{
+	struct net_ring *ring = net_dev->tx_ring;
+	struct net_frame *frame;
+	uint32 tail;
+
+	if (ring == NULL)
+		return net_dev->net_write (net_dev, buf, count);
+	if (count > NET_FRAME_MAX)
+		return -1;
+	tail = ring->tail;
+	if (tail - ring->head == NET_RING_SIZE) {
+		net_tx_flush (net_dev);
+		/* the host queue is still full, the frame is dropped */
+		if (tail - ring->head == NET_RING_SIZE)
+			return count;
+	}
+	frame = &ring->frames[tail & NET_RING_MASK];
+	memcpy (frame->data, buf, count);
+	frame->len = count;
+	__sync_synchronize ();
+	ring->tail = tail + 1;
+
+	if (__sync_bool_compare_and_swap (&net_dev->tx_posted, 0, 1))
+		post_thread_event (net_tx_event, net_dev);
+	return count;
+}
+
+static void
+net_coalesce_timeout (void *arg)
+{
+	struct net_device *net_dev = (struct net_device *) arg;
+
+	net_dev->coalesce_armed = 0;
+	if (__sync_lock_test_and_set (&net_dev->coalesce_count, 0) > 0)
+		net_dev->coalesce_raise (net_dev->coalesce_arg);
+}
+
+/**
+* @brief set the function raising the interrupt of a device when the
+* coalescing timer expires
+*/
+void
+net_coalesce_init (struct net_device *net_dev, sched_func_t raise, void *arg)
+{
+	net_dev->coalesce_raise = raise;
+	net_dev->coalesce_arg = arg;
+	net_dev->coalesce_count = 0;
+	net_dev->coalesce_armed = 0;
+	if (net_dev->coalesce_frames <= 0)
+		net_dev->coalesce_frames = 1;
+}
+
+/**
+* @brief count an event of the device that wants an interrupt
+*
+* @return 1 if the device should raise the interrupt now, 0 if it is raised
+* later by the coalescing timer
+*/
+int
+net_coalesce (struct net_device *net_dev)
+{
+	int id;
+
+	if (net_dev->coalesce_usecs <= 0 || net_dev->coalesce_raise == NULL)
+		return 1;
+	if (__sync_add_and_fetch (&net_dev->coalesce_count, 1) >= net_dev->coalesce_frames) {
+		net_dev->coalesce_count = 0;
+		return 1;
+	}
+	if (__sync_bool_compare_and_swap (&net_dev->coalesce_armed, 0, 1) &&
+	    create_thread_scheduler (net_dev->coalesce_usecs, Oneshot_sched,
+				     net_coalesce_timeout, net_dev, &id) != 0) {
+		net_dev->coalesce_armed = 0;
+		net_dev->coalesce_count = 0;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+	skyeye_net_socket.c - a unix seqpacket socket as the host side of a
+	net device
+	Copyright (C) 2003 - 2007 Skyeye Develop Group
+	for help please send mail to <skyeye-developer@lists.gro.clinux.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * Every frame is one message on a unix seqpacket socket connected to the
+ * path of the "sock" parameter, so a local process such as net_bench can
+ * stand in for the network without root or a tap device. The frames are
+ * moved in batches with recvmmsg and sendmmsg.
+ */
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#endif
+
+#include "skyeye_net.h"
+
+#ifdef __linux__
+
+int
+socket_open (struct net_device *net_dev)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (net_dev->sock_path[0] == '\0') {
+		fprintf (stderr, "net: ethmod=socket needs the sock parameter\n");
+		return 1;
+	}
+	if ((fd = socket (AF_UNIX, SOCK_SEQPACKET, 0)) < 0) {
+		perror ("net socket");
+		return 1;
+	}
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strncpy (addr.sun_path, net_dev->sock_path, sizeof (addr.sun_path) - 1);
+	if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) < 0) {
+		fprintf (stderr, "net: can not connect to %s: %s\n",
+			 net_dev->sock_path, strerror (errno));
+		close (fd);
+		return 1;
+	}
+	net_dev->net_fd = fd;
+	return 0;
+}
+
+int
+socket_close (struct net_device *net_dev)
+{
+	close (net_dev->net_fd);
+	return 0;
+}
+
+int
+socket_read (struct net_device *net_dev, void *buf, size_t count)
+{
+	return recv (net_dev->net_fd, buf, count, 0);
+}
+
+int
+socket_write (struct net_device *net_dev, void *buf, size_t count)
+{
+	return send (net_dev->net_fd, buf, count, MSG_NOSIGNAL);
+}
+
+int
+socket_wait_packet (struct net_device *net_dev, struct timeval *tv)
+{
+	fd_set frds;
+
+	FD_ZERO (&frds);
+	FD_SET (net_dev->net_fd, &frds);
+	if (select (net_dev->net_fd + 1, &frds, NULL, NULL, tv) <= 0)
+		return -1;
+	if (!FD_ISSET (net_dev->net_fd, &frds))
+		return -1;
+	return 0;
+}
+
+int
+socket_read_batch (struct net_device *net_dev, struct net_frame *frames, int count)
+{
+	struct mmsghdr msgs[NET_BATCH];
+	struct iovec iov[NET_BATCH];
+	int i, n;
+
+	if (count > NET_BATCH)
+		count = NET_BATCH;
+	memset (msgs, 0, sizeof (msgs));
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = frames[i].data;
+		iov[i].iov_len = NET_FRAME_MAX;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	n = recvmmsg (net_dev->net_fd, msgs, count, MSG_DONTWAIT, NULL);
+	if (n <= 0)
+		return n;
+	for (i = 0; i < n; i++) {
+		/* an empty message is the end of the connection */
+		if (msgs[i].msg_len == 0) {
+			if (i == 0) {
+				errno = ECONNRESET;
+				return -1;
+			}
+			return i;
+		}
+		frames[i].len = msgs[i].msg_len;
+	}
+	return n;
+}
+
+int
+socket_write_batch (struct net_device *net_dev, struct net_frame *frames, int count)
+{
+	struct mmsghdr msgs[NET_BATCH];
+	struct iovec iov[NET_BATCH];
+	int i;
+
+	if (count > NET_BATCH)
+		count = NET_BATCH;
+	memset (msgs, 0, sizeof (msgs));
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = frames[i].data;
+		iov[i].iov_len = frames[i].len;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+	return sendmmsg (net_dev->net_fd, msgs, count, MSG_NOSIGNAL);
+}
+
+#else /* other systems */
+
+int
+socket_open (struct net_device *net_dev)
+{
+	return -1;
+}
+
+int
+socket_close (struct net_device *net_dev)
+{
+	return 0;
+}
+
+int
+socket_read (struct net_device *net_dev, void *buf, size_t count)
+{
+	return 0;
+}
+
+int
+socket_write (struct net_device *net_dev, void *buf, size_t count)
+{
+	return 0;
+}
+
+int
+socket_wait_packet (struct net_device *net_dev, struct timeval *tv)
+{
+	return -1;
+}
+
+int
+socket_read_batch (struct net_device *net_dev, struct net_frame *frames, int count)
+{
+	return -1;
+}
+
+int
+socket_write_batch (struct net_device *net_dev, struct net_frame *frames, int count)
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1,332 @@
+/*
+	sd_card.c - a simulated sd memory card
+	Copyright (C) 2003 - 2007 Skyeye Develop Group
+	for help please send mail to <skyeye-developer@lists.gro.clinux.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * The card is always a high capacity card (SDHC), it is addressed in
+ * blocks of 512 bytes whatever CMD16 sets. Only the commands a driver
+ * needs to identify the card and to move blocks are answered, the others
+ * time out like on a card of another kind.
+ */
+#include <string.h>
+#include "skyeye_log.h"
+#include "sd_card.h"
+
+#define SD_OCR_BUSY	(1 << 31)
+#define SD_OCR_CCS	(1 << 30)
+#define SD_OCR_VDD	0x00ff8000
+#define SD_RCA		0x4567
+
+static void sd_card_reset(sd_card_t *card){
+	card->state = SD_STATE_IDLE;
+	card->status = 0;
+	card->ocr = SD_OCR_VDD;
+	card->rca = 0;
+	card->app_cmd = 0;
+	card->bus_width = 1;
+	card->high_speed = 0;
+	card->data_dir = SD_DATA_NONE;
+	card->reg_len = 0;
+}
+
+static void sd_card_ident(sd_card_t *card){
+	uint32_t c_size, psn = 0x20100601;
+
+	/* cid: manufacturer, "SE", "SKYSD", revision 1.0, serial, 2010/06 */
+	card->cid[0] = (0x00 << 24) | ('S' << 16) | ('E' << 8) | 'S';
+	card->cid[1] = ('K' << 24) | ('Y' << 16) | ('S' << 8) | 'D';
+	card->cid[2] = (0x10 << 24) | (psn >> 8);
+	card->cid[3] = (psn << 24) | (0x0a6 << 8) | 1;
+
+	/* csd version 2.0, the capacity is (C_SIZE + 1) * 512K */
+	c_size = card->image.size / (512 * 1024);
+	c_size = c_size ? c_size - 1 : 0;
+	card->csd[0] = 0x400e0032;
+	card->csd[1] = (0x5b5 << 20) | (9 << 16) | ((c_size >> 16) & 0x3f);
+	card->csd[2] = ((c_size & 0xffff) << 16) | (1 << 14) | (0x7f << 7);
+	card->csd[3] = (2 << 26) | (9 << 22) | 1;
+
+	/* scr: physical layer 2.00, sdhc security, 1 and 4 bit bus */
+	memset(card->scr, 0, sizeof(card->scr));
+	card->scr[0] = 0x02;
+	card->scr[1] = 0x35;
+}
+
+/**
+* @brief open the image and insert the card in the slot
+*/
+int sd_card_insert(sd_card_t *card, const char *path, sd_image_format_t format, uint64_t size){
+	if(sd_image_open(&card->image, path, format, size) < 0)
+		return -1;
+	sd_card_ident(card);
+	sd_card_reset(card);
+	card->inserted = 1;
+	return 0;
+}
+
+void sd_card_eject(sd_card_t *card){
+	if(!card->inserted)
+		return;
+	sd_image_close(&card->image);
+	card->inserted = 0;
+}
+
+/**
+* @brief the card status of a R1 response, the error bits are reported once
+*/
+static uint32_t sd_card_r1(sd_card_t *card, sd_state_t state){
+	uint32_t r1 = card->status | (state << SD_STATUS_STATE_SHIFT);
+
+	if(state == SD_STATE_TRAN)
+		r1 |= SD_STATUS_READY_DATA;
+	if(card->app_cmd)
+		r1 |= SD_STATUS_APP_CMD;
+	card->status = 0;
+	return r1;
+}
+
+static void sd_card_switch(sd_card_t *card, uint32_t arg){
+	int fn = arg & 0xf;
+
+	memset(card->reg_data, 0, sizeof(card->reg_data));
+	card->reg_data[1] = 100;	/* 100mA */
+	/* group 2 and group 1 support the default function, group 1 high speed */
+	card->reg_data[10] = 0x80;
+	card->reg_data[11] = 0x01;
+	card->reg_data[12] = 0x80;
+	card->reg_data[13] = 0x03;
+	if(fn > 1 && fn != 0xf)
+		fn = 0xf;
+	else if(fn == 0xf)
+		fn = card->high_speed;
+	card->reg_data[16] = fn;
+	if((arg & (1 << 31)) && fn != 0xf)
+		card->high_speed = fn;
+	card->reg_len = 64;
+}
+
+static sd_rsp_t sd_card_block_cmd(sd_card_t *card, uint32_t arg, sd_data_dir_t dir, int multi, uint32_t *response){
+	uint64_t addr = (uint64_t)arg * SD_BLOCK_SIZE;
+
+	if(card->state != SD_STATE_TRAN){
+		card->status |= SD_STATUS_ILLEGAL_CMD;
+		response[0] = sd_card_r1(card, card->state);
+		return SD_RSP_R1;
+	}
+	if(addr >= card->image.size)
+		card->status |= SD_STATUS_OUT_OF_RANGE;
+	else if(dir == SD_DATA_WRITE && sd_card_write_protected(card))
+		card->status |= SD_STATUS_WP_VIOLATION;
+	response[0] = sd_card_r1(card, card->state);
+	if(response[0] & (SD_STATUS_OUT_OF_RANGE | SD_STATUS_WP_VIOLATION))
+		return SD_RSP_R1;
+	card->data_dir = dir;
+	card->multi_block = multi;
+	card->data_addr = addr;
+	card->reg_len = 0;
+	card->state = dir == SD_DATA_READ ? SD_STATE_DATA : SD_STATE_RCV;
+	return SD_RSP_R1;
+}
+
+static sd_rsp_t sd_card_app_command(sd_card_t *card, int cmd, uint32_t arg, uint32_t *response){
+	switch(cmd){
+	case 6:		/* SET_BUS_WIDTH */
+		card->bus_width = (arg & 3) == 2 ? 4 : 1;
+		response[0] = sd_card_r1(card, card->state);
+		return SD_RSP_R1;
+	case 13:	/* SD_STATUS */
+		memset(card->reg_data, 0, sizeof(card->reg_data));
+		card->reg_data[0] = card->bus_width == 4 ? 0x80 : 0;
+		card->reg_len = 64;
+		break;
+	case 41:	/* SD_SEND_OP_COND */
+		if(card->state != SD_STATE_IDLE)
+			return SD_RSP_NONE;
+		/* an inquiry without a voltage window leaves the card idle */
+		if(arg & SD_OCR_VDD){
+			card->ocr |= SD_OCR_BUSY | SD_OCR_CCS;
+			card->state = SD_STATE_READY;
+		}
+		response[0] = card->ocr;
+		return SD_RSP_R3;
+	case 42:	/* SET_CLR_CARD_DETECT */
+		response[0] = sd_card_r1(card, card->state);
+		return SD_RSP_R1;
+	case 51:	/* SEND_SCR */
+		memcpy(card->reg_data, card->scr, sizeof(card->scr));
+		card->reg_len = sizeof(card->scr);
+		break;
+	default:
+		return SD_RSP_NONE;
+	}
+	/* the register is read like a block */
+	response[0] = sd_card_r1(card, card->state);
+	card->data_dir = SD_DATA_READ;
+	card->multi_block = 0;
+	card->state = SD_STATE_DATA;
+	return SD_RSP_R1;
+}
+
+/**
+* @brief execute a command
+*
+* @param cmd the index of the command
+* @param arg the argument
+* @param response the response, response[0] unless it is R2
+*
+* @return the type of the response, SD_RSP_NONE if the card did not answer
+*/
+sd_rsp_t sd_card_command(sd_card_t *card, int cmd, uint32_t arg, uint32_t *response){
+	sd_state_t state = card->state;
+	sd_rsp_t rsp;
+
+	if(!card->inserted)
+		return SD_RSP_NONE;
+	if(card->app_cmd && cmd != 55){
+		rsp = sd_card_app_command(card, cmd, arg, response);
+		card->app_cmd = 0;
+		if(rsp != SD_RSP_NONE)
+			return rsp;
+	}
+	card->app_cmd = 0;
+
+	switch(cmd){
+	case 0:		/* GO_IDLE_STATE */
+		sd_card_reset(card);
+		return SD_RSP_NONE;
+	case 2:		/* ALL_SEND_CID */
+		if(state != SD_STATE_READY)
+			return SD_RSP_NONE;
+		memcpy(response, card->cid, sizeof(card->cid));
+		card->state = SD_STATE_IDENT;
+		return SD_RSP_R2;
+	case 3:		/* SEND_RELATIVE_ADDR */
+		if(state != SD_STATE_IDENT && state != SD_STATE_STBY)
+			return SD_RSP_NONE;
+		card->rca = SD_RCA;
+		card->state = SD_STATE_STBY;
+		response[0] = (card->rca << 16) | (state << SD_STATUS_STATE_SHIFT);
+		return SD_RSP_R6;
+	case 6:		/* SWITCH_FUNC */
+		if(state != SD_STATE_TRAN)
+			return SD_RSP_NONE;
+		sd_card_switch(card, arg);
+		response[0] = sd_card_r1(card, state);
+		card->data_dir = SD_DATA_READ;
+		card->multi_block = 0;
+		card->state = SD_STATE_DATA;
+		return SD_RSP_R1;
+	case 7:		/* SELECT/DESELECT_CARD */
+		if(state < SD_STATE_STBY)
+			return SD_RSP_NONE;
+		if((arg >> 16) != card->rca){
+			card->state = SD_STATE_STBY;
+			return SD_RSP_NONE;
+		}
+		response[0] = sd_card_r1(card, state);
+		card->state = SD_STATE_TRAN;
+		return SD_RSP_R1B;
+	case 8:		/* SEND_IF_COND */
+		if(state != SD_STATE_IDLE)
+			return SD_RSP_NONE;
+		response[0] = arg & 0xfff;
+		return SD_RSP_R7;
+	case 9:		/* SEND_CSD */
+	case 10:	/* SEND_CID */
+		if(state != SD_STATE_STBY || (arg >> 16) != card->rca)
+			return SD_RSP_NONE;
+		memcpy(response, cmd == 9 ? card->csd : card->cid, sizeof(card->csd));
+		return SD_RSP_R2;
+	case 12:	/* STOP_TRANSMISSION */
+		response[0] = sd_card_r1(card, state);
+		if(state == SD_STATE_DATA || state == SD_STATE_RCV)
+			sd_card_data_done(card);
+		return SD_RSP_R1B;
+	case 13:	/* SEND_STATUS */
+		if((arg >> 16) != card->rca)
+			return SD_RSP_NONE;
+		response[0] = sd_card_r1(card, state);
+		return SD_RSP_R1;
+	case 16:	/* SET_BLOCKLEN */
+	case 23:	/* SET_BLOCK_COUNT */
+		response[0] = sd_card_r1(card, state);
+		return SD_RSP_R1;
+	case 17:	/* READ_SINGLE_BLOCK */
+	case 18:	/* READ_MULTIPLE_BLOCK */
+		return sd_card_block_cmd(card, arg, SD_DATA_READ, cmd == 18, response);
+	case 24:	/* WRITE_BLOCK */
+	case 25:	/* WRITE_MULTIPLE_BLOCK */
+		return sd_card_block_cmd(card, arg, SD_DATA_WRITE, cmd == 25, response);
+	case 55:	/* APP_CMD */
+		if(state != SD_STATE_IDLE && (arg >> 16) != card->rca)
+			return SD_RSP_NONE;
+		card->app_cmd = 1;
+		response[0] = sd_card_r1(card, state);
+		return SD_RSP_R1;
+	default:
+		skyeye_log(Debug_log, __FUNCTION__, "sd card ignores CMD%d 0x%x\n", cmd, arg);
+		return SD_RSP_NONE;
+	}
+}
+
+static int sd_card_blocks(sd_card_t *card, const struct iovec *iov, int iovcnt, uint32_t count, sd_data_dir_t dir){
+	uint64_t len = (uint64_t)count * SD_BLOCK_SIZE;
+	int ret;
+
+	if(card->data_dir != dir || card->reg_len != 0)
+		return -1;
+	if(card->data_addr + len > card->image.size){
+		card->status |= SD_STATUS_OUT_OF_RANGE;
+		return -1;
+	}
+	if(dir == SD_DATA_READ)
+		ret = sd_image_readv(&card->image, iov, iovcnt, card->data_addr);
+	else
+		ret = sd_image_writev(&card->image, iov, iovcnt, card->data_addr);
+	if(ret < 0){
+		card->status |= SD_STATUS_ERROR;
+		return -1;
+	}
+	card->data_addr += len;
+	return 0;
+}
+
+/**
+* @brief read count blocks from the card to iov, at most one without CMD18
+*/
+int sd_card_read_blocks(sd_card_t *card, const struct iovec *iov, int iovcnt, uint32_t count){
+	return sd_card_blocks(card, iov, iovcnt, count, SD_DATA_READ);
+}
+
+/**
+* @brief write count blocks from iov to the card
+*/
+int sd_card_write_blocks(sd_card_t *card, const struct iovec *iov, int iovcnt, uint32_t count){
+	return sd_card_blocks(card, iov, iovcnt, count, SD_DATA_WRITE);
+}
+
+/**
+* @brief the data phase of the command ended, go back to the transfer state
+*/
+void sd_card_data_done(sd_card_t *card){
+	card->data_dir = SD_DATA_NONE;
+	card->reg_len = 0;
+	if(card->state == SD_STATE_DATA || card->state == SD_STATE_RCV)
+		card->state = SD_STATE_TRAN;
+}
@@ -0,0 +1,105 @@
+/*
+	sd_card.h - a simulated sd memory card
+	Copyright (C) 2003 - 2007 Skyeye Develop Group
+	for help please send mail to <skyeye-developer@lists.gro.clinux.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+#ifndef __SD_CARD_H__
+#define __SD_CARD_H__
+
+#include <stdint.h>
+#include "sd_image.h"
+
+#define SD_BLOCK_SIZE	512
+
+/* the states of the card, as in CURRENT_STATE of the card status */
+typedef enum{
+	SD_STATE_IDLE = 0,
+	SD_STATE_READY,
+	SD_STATE_IDENT,
+	SD_STATE_STBY,
+	SD_STATE_TRAN,
+	SD_STATE_DATA,
+	SD_STATE_RCV,
+	SD_STATE_PRG,
+	SD_STATE_DIS
+}sd_state_t;
+
+/* the bits of the card status */
+#define SD_STATUS_OUT_OF_RANGE	(1 << 31)
+#define SD_STATUS_WP_VIOLATION	(1 << 26)
+#define SD_STATUS_ILLEGAL_CMD	(1 << 22)
+#define SD_STATUS_ERROR		(1 << 19)
+#define SD_STATUS_READY_DATA	(1 << 8)
+#define SD_STATUS_APP_CMD	(1 << 5)
+#define SD_STATUS_STATE_SHIFT	9
+
+typedef enum{
+	SD_RSP_NONE,	/* the card does not answer */
+	SD_RSP_R1,
+	SD_RSP_R1B,
+	SD_RSP_R2,	/* response[0..3] hold bits 127..0 of the cid or csd */
+	SD_RSP_R3,
+	SD_RSP_R6,
+	SD_RSP_R7
+}sd_rsp_t;
+
+typedef enum{
+	SD_DATA_NONE,
+	SD_DATA_READ,	/* from the card to the host */
+	SD_DATA_WRITE
+}sd_data_dir_t;
+
+typedef struct sd_card{
+	sd_image_t image;
+	int inserted;
+	sd_state_t state;
+	uint32_t status;
+	uint32_t ocr;
+	uint32_t rca;
+	uint32_t cid[4];
+	uint32_t csd[4];
+	uint8_t scr[8];
+	int app_cmd;
+	int bus_width;
+	int high_speed;
+
+	/* the data phase of the last command */
+	sd_data_dir_t data_dir;
+	int multi_block;
+	/* the byte address of the next block */
+	uint64_t data_addr;
+	/* a register read by ACMD13, ACMD51 or CMD6 instead of blocks */
+	uint8_t reg_data[64];
+	int reg_len;
+}sd_card_t;
+
+int sd_card_insert(sd_card_t *card, const char *path, sd_image_format_t format, uint64_t size);
+void sd_card_eject(sd_card_t *card);
+sd_rsp_t sd_card_command(sd_card_t *card, int cmd, uint32_t arg, uint32_t *response);
+int sd_card_read_blocks(sd_card_t *card, const struct iovec *iov, int iovcnt, uint32_t count);
+int sd_card_write_blocks(sd_card_t *card, const struct iovec *iov, int iovcnt, uint32_t count);
+void sd_card_data_done(sd_card_t *card);
+
+/**
+* @brief whether the image of the card can not be written
+*/
+static inline int sd_card_write_protected(sd_card_t *card){
+	return card->image.read_only;
+}
+
+#endif
@@ -0,0 +1,348 @@
+/*
+	sd_image.c - the host image behind a simulated sd card
+	Copyright (C) 2003 - 2007 Skyeye Develop Group
+	for help please send mail to <skyeye-developer@lists.gro.clinux.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * A transfer of the card arrives as a list of guest buffers, it is done
+ * with one preadv or pwritev per run of the image that is contiguous in
+ * the host file, so a multiple block transfer costs one syscall for a raw
+ * image and one per run of clusters for a sparse one.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "skyeye_log.h"
+#include "sd_image.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+/* the most buffers handed to one syscall */
+#define SD_IOV_BATCH 64
+
+#ifndef __linux__
+static ssize_t sd_rw_emul(int fd, const struct iovec *iov, int iovcnt, off_t offset, int write_op){
+	ssize_t done = 0, n;
+	int i;
+
+	if(lseek(fd, offset, SEEK_SET) == (off_t)-1)
+		return -1;
+	for(i = 0; i < iovcnt; i++){
+		n = write_op ? write(fd, iov[i].iov_base, iov[i].iov_len)
+			: read(fd, iov[i].iov_base, iov[i].iov_len);
+		if(n < 0)
+			return done ? done : -1;
+		done += n;
+		if(n < iov[i].iov_len)
+			break;
+	}
+	return done;
+}
+#define preadv(fd, iov, iovcnt, offset) sd_rw_emul(fd, iov, iovcnt, offset, 0)
+#define pwritev(fd, iov, iovcnt, offset) sd_rw_emul(fd, iov, iovcnt, offset, 1)
+#endif
+
+#ifdef __MINGW32__
+static ssize_t sd_pread(int fd, void *buf, size_t len, off_t offset){
+	struct iovec v = {buf, len};
+	return sd_rw_emul(fd, &v, 1, offset, 0);
+}
+static ssize_t sd_pwrite(int fd, const void *buf, size_t len, off_t offset){
+	struct iovec v = {(void *)buf, len};
+	return sd_rw_emul(fd, &v, 1, offset, 1);
+}
+#define pread sd_pread
+#define pwrite sd_pwrite
+#endif
+
+static size_t iov_total(const struct iovec *iov, int iovcnt){
+	size_t len = 0;
+	int i;
+	for(i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+	return len;
+}
+
+/**
+* @brief the buffers of iov from skip for *len bytes, at most SD_IOV_BATCH
+* of them, *len is shortened when they do not fit
+*/
+static int iov_slice(const struct iovec *iov, int iovcnt, size_t skip, size_t *len, struct iovec *out){
+	size_t left = *len, n;
+	int i = 0, cnt = 0;
+
+	while(i < iovcnt && skip >= iov[i].iov_len){
+		skip -= iov[i].iov_len;
+		i++;
+	}
+	for(; i < iovcnt && left > 0 && cnt < SD_IOV_BATCH; i++){
+		n = iov[i].iov_len - skip;
+		if(n > left)
+			n = left;
+		out[cnt].iov_base = (uint8_t *)iov[i].iov_base + skip;
+		out[cnt].iov_len = n;
+		cnt++;
+		left -= n;
+		skip = 0;
+	}
+	*len -= left;
+	return cnt;
+}
+
+/**
+* @brief read or write all of iov at offset of the file, the part of a read
+* beyond the end of the file is zeroed
+*/
+static int file_rw(int fd, const struct iovec *iov, int iovcnt, uint64_t offset, int write_op){
+	struct iovec v[SD_IOV_BATCH];
+	ssize_t ret;
+	int i, n;
+
+	while(iovcnt > 0){
+		n = iovcnt < SD_IOV_BATCH ? iovcnt : SD_IOV_BATCH;
+		memcpy(v, iov, n * sizeof(*v));
+		i = 0;
+		while(i < n){
+			if(v[i].iov_len == 0){
+				i++;
+				continue;
+			}
+			ret = write_op ? pwritev(fd, v + i, n - i, offset)
+				: preadv(fd, v + i, n - i, offset);
+			if(ret < 0 && errno == EINTR)
+				continue;
+			if(ret < 0 || (ret == 0 && write_op))
+				return -1;
+			if(ret == 0){
+				for(; i < n; i++){
+					memset(v[i].iov_base, 0, v[i].iov_len);
+					offset += v[i].iov_len;
+				}
+				break;
+			}
+			offset += ret;
+			while(ret > 0){
+				if((size_t)ret >= v[i].iov_len){
+					ret -= v[i].iov_len;
+					i++;
+				}
+				else{
+					v[i].iov_base = (uint8_t *)v[i].iov_base + ret;
+					v[i].iov_len -= ret;
+					ret = 0;
+				}
+			}
+		}
+		iov += n;
+		iovcnt -= n;
+	}
+	return 0;
+}
+
+static int sparse_create(sd_image_t *image){
+	sd_sparse_header_t header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SD_SPARSE_MAGIC, sizeof(header.magic));
+	header.size = image->size;
+	header.cluster_size = SD_SPARSE_CLUSTER;
+	header.cluster_num = image->cluster_num;
+	if(pwrite(image->fd, &header, sizeof(header), 0) != sizeof(header))
+		return -1;
+	/* the table reads as zeros until a cluster is allocated */
+	return ftruncate(image->fd, (off_t)image->next_cluster * SD_SPARSE_CLUSTER);
+}
+
+static int sparse_open(sd_image_t *image, uint64_t file_size){
+	sd_sparse_header_t header;
+	uint64_t table_end;
+
+	if(file_size == 0){
+		if(image->size == 0 || image->read_only){
+			errno = EINVAL;
+			return -1;
+		}
+	}
+	else{
+		if(pread(image->fd, &header, sizeof(header), 0) != sizeof(header) ||
+		   memcmp(header.magic, SD_SPARSE_MAGIC, sizeof(header.magic)) ||
+		   header.cluster_size != SD_SPARSE_CLUSTER){
+			errno = EINVAL;
+			return -1;
+		}
+		image->size = header.size;
+	}
+	image->cluster_num = (image->size + SD_SPARSE_CLUSTER - 1) / SD_SPARSE_CLUSTER;
+	if(file_size != 0 && header.cluster_num != image->cluster_num){
+		errno = EINVAL;
+		return -1;
+	}
+	table_end = SD_SPARSE_HEADER + (uint64_t)image->cluster_num * sizeof(uint32_t);
+	image->next_cluster = (table_end + SD_SPARSE_CLUSTER - 1) / SD_SPARSE_CLUSTER;
+	if(file_size > (uint64_t)image->next_cluster * SD_SPARSE_CLUSTER)
+		image->next_cluster = (file_size + SD_SPARSE_CLUSTER - 1) / SD_SPARSE_CLUSTER;
+
+	image->table = calloc(image->cluster_num ? image->cluster_num : 1, sizeof(uint32_t));
+	if(image->table == NULL)
+		return -1;
+	if(file_size == 0)
+		return sparse_create(image);
+	{
+		struct iovec v;
+		v.iov_base = image->table;
+		v.iov_len = image->cluster_num * sizeof(uint32_t);
+		return file_rw(image->fd, &v, 1, SD_SPARSE_HEADER, 0);
+	}
+}
+
+/**
+* @brief give the cluster an own place at the end of the file
+*/
+static int sparse_alloc(sd_image_t *image, uint32_t cluster){
+	uint32_t index = image->next_cluster;
+
+	if(ftruncate(image->fd, (off_t)(index + 1) * SD_SPARSE_CLUSTER) < 0)
+		return -1;
+	if(pwrite(image->fd, &index, sizeof(index),
+		  SD_SPARSE_HEADER + (off_t)cluster * sizeof(uint32_t)) != sizeof(index))
+		return -1;
+	image->table[cluster] = index;
+	image->next_cluster++;
+	return 0;
+}
+
+static int sparse_rw(sd_image_t *image, const struct iovec *iov, int iovcnt, uint64_t offset, int write_op){
+	struct iovec v[SD_IOV_BATCH];
+	size_t total = iov_total(iov, iovcnt), done = 0, len, next;
+	uint32_t cluster, k;
+	uint64_t in;
+	int n, i;
+
+	while(done < total){
+		cluster = (offset + done) / SD_SPARSE_CLUSTER;
+		in = (offset + done) % SD_SPARSE_CLUSTER;
+		len = SD_SPARSE_CLUSTER - in;
+		if(len > total - done)
+			len = total - done;
+		if(write_op && image->table[cluster] == 0 && sparse_alloc(image, cluster) < 0)
+			return -1;
+		/* the following clusters that lie behind it in the file */
+		for(k = 1; image->table[cluster] != 0 && done + len < total &&
+			    cluster + k < image->cluster_num &&
+			    image->table[cluster + k] == image->table[cluster] + k; k++){
+			next = total - done - len;
+			len += next < SD_SPARSE_CLUSTER ? next : SD_SPARSE_CLUSTER;
+		}
+		n = iov_slice(iov, iovcnt, done, &len, v);
+		if(image->table[cluster] == 0){
+			for(i = 0; i < n; i++)
+				memset(v[i].iov_base, 0, v[i].iov_len);
+		}
+		else if(file_rw(image->fd, v, n, (uint64_t)image->table[cluster] * SD_SPARSE_CLUSTER + in, write_op) < 0)
+			return -1;
+		done += len;
+	}
+	return 0;
+}
+
+/**
+* @brief open the image of a card
+*
+* @param path the image file, created when it does not exist and size is given
+* @param format raw or sparse
+* @param size the size of a new image, a raw image smaller than size is extended
+*
+* @return 0 on success, -1 with errno set on failure
+*/
+int sd_image_open(sd_image_t *image, const char *path, sd_image_format_t format, uint64_t size){
+	struct stat st;
+
+	memset(image, 0, sizeof(*image));
+	image->format = format;
+	image->size = size;
+	image->fd = open(path, O_RDWR | O_CREAT | O_BINARY, 0644);
+	if(image->fd < 0 && (errno == EACCES || errno == EROFS)){
+		image->fd = open(path, O_RDONLY | O_BINARY);
+		image->read_only = 1;
+	}
+	if(image->fd < 0)
+		return -1;
+	if(fstat(image->fd, &st) < 0)
+		goto fail;
+
+	if(format == SD_IMAGE_SPARSE){
+		if(sparse_open(image, st.st_size) < 0)
+			goto fail;
+	}
+	else{
+		if((uint64_t)st.st_size < size && !image->read_only){
+			if(ftruncate(image->fd, size) < 0)
+				goto fail;
+		}
+		else
+			image->size = st.st_size;
+	}
+	/* the card is addressed in blocks of 512 bytes */
+	image->size &= ~(uint64_t)511;
+	if(image->size == 0){
+		errno = EINVAL;
+		goto fail;
+	}
+	return 0;
+fail:
+	{
+		int err = errno;
+		sd_image_close(image);
+		errno = err;
+	}
+	return -1;
+}
+
+void sd_image_close(sd_image_t *image){
+	if(image->fd >= 0)
+		close(image->fd);
+	image->fd = -1;
+	free(image->table);
+	image->table = NULL;
+}
+
+int sd_image_readv(sd_image_t *image, const struct iovec *iov, int iovcnt, uint64_t offset){
+	if(offset + iov_total(iov, iovcnt) > image->size)
+		return -1;
+	if(image->format == SD_IMAGE_SPARSE)
+		return sparse_rw(image, iov, iovcnt, offset, 0);
+	return file_rw(image->fd, iov, iovcnt, offset, 0);
+}
+
+int sd_image_writev(sd_image_t *image, const struct iovec *iov, int iovcnt, uint64_t offset){
+	if(image->read_only || offset + iov_total(iov, iovcnt) > image->size)
+		return -1;
+	if(image->format == SD_IMAGE_SPARSE)
+		return sparse_rw(image, iov, iovcnt, offset, 1);
+	return file_rw(image->fd, iov, iovcnt, offset, 1);
+}
@@ -0,0 +1,73 @@
+/*
+	sd_image.h - the host image behind a simulated sd card
+	Copyright (C) 2003 - 2007 Skyeye Develop Group
+	for help please send mail to <skyeye-developer@lists.gro.clinux.org>
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+#ifndef __SD_IMAGE_H__
+#define __SD_IMAGE_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+#ifndef __MINGW32__
+#include <sys/uio.h>
+#else
+struct iovec{
+	void *iov_base;
+	size_t iov_len;
+};
+#endif
+
+typedef enum{
+	SD_IMAGE_RAW,
+	SD_IMAGE_SPARSE
+}sd_image_format_t;
+
+/*
+ * A sparse image starts with a header and a table of one 32 bit entry per
+ * cluster of the card, the entry is the index of the cluster in the file
+ * or 0 when the cluster was never written and reads as zeros. The clusters
+ * are appended to the file when they are first written.
+ */
+#define SD_SPARSE_MAGIC		"SKYSDSP1"
+#define SD_SPARSE_CLUSTER	(64 * 1024)
+#define SD_SPARSE_HEADER	4096
+
+typedef struct sd_sparse_header{
+	char magic[8];
+	uint64_t size;
+	uint32_t cluster_size;
+	uint32_t cluster_num;
+}sd_sparse_header_t;
+
+typedef struct sd_image{
+	int fd;
+	int read_only;
+	sd_image_format_t format;
+	uint64_t size;
+	/* the cluster table of a sparse image */
+	uint32_t *table;
+	uint32_t cluster_num;
+	uint32_t next_cluster;
+}sd_image_t;
+
+int sd_image_open(sd_image_t *image, const char *path, sd_image_format_t format, uint64_t size);
+void sd_image_close(sd_image_t *image);
+int sd_image_readv(sd_image_t *image, const struct iovec *iov, int iovcnt, uint64_t offset);
+int sd_image_writev(sd_image_t *image, const struct iovec *iov, int iovcnt, uint64_t offset);
+
+#endif
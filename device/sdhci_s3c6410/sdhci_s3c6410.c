@@ -9,9 +9,16 @@
 ** MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
 ** GNU General Public License for more details.
 */
-//#include "android/android.h"
-//#include "android/utils/debug.h"
-//#include "android/utils/duff.h"
+/*
+ * The HSMMC channel of s3c6410, a standard sd host controller with one
+ * slot. The card is moved by PIO through BDATA, by SDMA or by ADMA2. A
+ * dma transfer hands all guest buffers of the transfer to the image in
+ * one vectored call, and with "async=on" that call is made by an io
+ * thread while the guest keeps running until the transfer interrupt.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <skyeye_types.h>
 #include <skyeye_sched.h>
 #include <skyeye_signal.h>
@@ -19,52 +26,755 @@
 #include <skyeye_interface.h>
 #include <skyeye_obj.h>
 #include <skyeye_mm.h>
+#include <skyeye_options.h>
+#include <skyeye_thread.h>
+#include <skyeye_ram.h>
+#include <bank_defs.h>
 #include <memory_space.h>
-#define DEBUG
 #include <skyeye_log.h>
 
 #include "sdhci_s3c6410.h"
 
-static exception_t s3c6410_sdhci_read(conf_object_t *opaque, generic_address_t offset, void* buf, size_t count)
-{
-	uint32_t ret;
-	struct s3c6410_fb_device *s = opaque->obj;
-	DBG("In %s, offset=0x%x\n", __FUNCTION__, offset);
-	switch(offset) {
+/* the "sdcard" option */
+static struct sdcard_option{
+	char image[MAX_PARAM_NAME];
+	sd_image_format_t format;
+	uint64_t size;
+	int async;
+}sdcard_opt;
+
+static void sdhci_update_irq(s3c6410_sdhci_device *dev){
+	sdhci_reg_t *regs = dev->regs;
+	int level;
+
+	if(regs->errintsts)
+		regs->norintsts |= INT_ERROR;
+	else
+		regs->norintsts &= ~INT_ERROR;
+	level = (regs->norintsts & regs->norintsigen & ~INT_ERROR) ||
+		(regs->errintsts & regs->errintsigen);
+	if(dev->master != NULL && dev->master->raise_signal != NULL){
+		if(level)
+			dev->master->raise_signal(dev->master->conf_obj, dev->line_no);
+		else if(dev->irq_level)
+			dev->master->lower_signal(dev->master->conf_obj, dev->line_no);
+	}
+	dev->irq_level = level;
+}
+
+static void sdhci_set_int(s3c6410_sdhci_device *dev, uint16_t norint, uint16_t errint){
+	sdhci_reg_t *regs = dev->regs;
+
+	regs->norintsts |= norint & regs->norintstsen;
+	regs->errintsts |= errint & regs->errintstsen;
+	sdhci_update_irq(dev);
+}
+
+static void *sdhci_io_thread(void *arg);
+
+/**
+* @brief insert the card of the "sdcard" option, at the first access since
+* the option is parsed after the device is created
+*/
+static void sdhci_attach_card(s3c6410_sdhci_device *dev){
+	if(dev->card_checked)
+		return;
+	dev->card_checked = 1;
+	if(sdcard_opt.image[0] == '\0')
+		return;
+	dev->async = sdcard_opt.async;
+	if(dev->async)
+		create_thread(sdhci_io_thread, dev, &dev->io_thread);
+	if(sd_card_insert(&dev->card, sdcard_opt.image, sdcard_opt.format, sdcard_opt.size) < 0){
+		skyeye_log(Error_log, __FUNCTION__, "Can not open the sd card image %s: %s\n",
+			   sdcard_opt.image, strerror(errno));
+		return;
+	}
+	skyeye_log(Info_log, __FUNCTION__, "sd card %s, %llu bytes%s\n", sdcard_opt.image,
+		   (unsigned long long)dev->card.image.size,
+		   sd_card_write_protected(&dev->card) ? ", write protected" : "");
+}
+
+static uint16_t sdhci_block_size(s3c6410_sdhci_device *dev){
+	return dev->regs->blksize & 0xfff;
+}
+
+/**
+* @brief the data phase ended, stop the card with CMD12 if it was asked for
+*/
+static void sdhci_end_transfer(s3c6410_sdhci_device *dev, uint16_t norint, uint16_t errint){
+	sdhci_reg_t *regs = dev->regs;
+	uint32_t response[4];
+
+	dev->xfer_active = 0;
+	dev->dma_paused = 0;
+	dev->buf_pos = dev->buf_len = 0;
+	if(errint == 0 && dev->card.multi_block && (regs->trnmod & TRNMOD_ACMD12)){
+		if(sd_card_command(&dev->card, 12, 0, response) == SD_RSP_NONE)
+			regs->acmd12errsts |= 1;
+		else
+			regs->rspreg[3] = response[0];
+	}
+	else
+		sd_card_data_done(&dev->card);
+	if(regs->acmd12errsts)
+		errint |= ERR_ACMD12;
+	if(errint == 0)
+		norint |= INT_XFER_DONE;
+	sdhci_set_int(dev, norint, errint);
+}
+
+static void sdhci_blocks_done(s3c6410_sdhci_device *dev, uint32_t count){
+	sdhci_reg_t *regs = dev->regs;
+
+	dev->blocks -= count;
+	if(regs->trnmod & TRNMOD_BLKCNT)
+		regs->blkcnt = dev->blocks;
+}
+
+/**
+* @brief load the next block of a PIO read into the buffer
+*/
+static void sdhci_pio_fill(s3c6410_sdhci_device *dev){
+	uint16_t size = sdhci_block_size(dev);
+	struct iovec iov;
+
+	if(dev->card.reg_len){
+		memset(dev->buf, 0, size);
+		memcpy(dev->buf, dev->card.reg_data, size < dev->card.reg_len ? size : dev->card.reg_len);
+	}
+	else{
+		iov.iov_base = dev->buf;
+		iov.iov_len = size;
+		if(sd_card_read_blocks(&dev->card, &iov, 1, 1) < 0){
+			sdhci_end_transfer(dev, 0, ERR_DATA_TIMEOUT);
+			return;
+		}
+	}
+	dev->buf_pos = 0;
+	dev->buf_len = size;
+	sdhci_set_int(dev, INT_BUF_READ, 0);
+}
+
+static uint32_t sdhci_pio_read(s3c6410_sdhci_device *dev){
+	uint32_t data = 0;
+	int i;
+
+	if(!dev->xfer_active || !dev->xfer_read || (dev->regs->trnmod & TRNMOD_DMA) ||
+	   dev->buf_pos >= dev->buf_len)
+		return 0;
+	for(i = 0; i < 4 && dev->buf_pos < dev->buf_len; i++)
+		data |= dev->buf[dev->buf_pos++] << (i * 8);
+	if(dev->buf_pos < dev->buf_len)
+		return data;
+	sdhci_blocks_done(dev, 1);
+	if(dev->blocks == 0)
+		sdhci_end_transfer(dev, 0, 0);
+	else
+		sdhci_pio_fill(dev);
+	return data;
+}
+
+static void sdhci_pio_write(s3c6410_sdhci_device *dev, uint32_t data){
+	struct iovec iov;
+	int i;
+
+	if(!dev->xfer_active || dev->xfer_read || (dev->regs->trnmod & TRNMOD_DMA) ||
+	   dev->buf_pos >= dev->buf_len)
+		return;
+	for(i = 0; i < 4 && dev->buf_pos < dev->buf_len; i++)
+		dev->buf[dev->buf_pos++] = data >> (i * 8);
+	if(dev->buf_pos < dev->buf_len)
+		return;
+	iov.iov_base = dev->buf;
+	iov.iov_len = dev->buf_len;
+	if(sd_card_write_blocks(&dev->card, &iov, 1, 1) < 0){
+		sdhci_end_transfer(dev, 0, ERR_DATA_TIMEOUT);
+		return;
+	}
+	sdhci_blocks_done(dev, 1);
+	if(dev->blocks == 0)
+		sdhci_end_transfer(dev, 0, 0);
+	else{
+		dev->buf_pos = 0;
+		sdhci_set_int(dev, INT_BUF_WRITE, 0);
+	}
+}
+
+/**
+* @brief add a guest buffer to the dma, in place when it is in ram
+*/
+static int sdhci_dma_add(sdhci_dma_t *dma, uint32_t addr, uint32_t len){
+	uint8_t *host;
+
+	if(dma->segs == SDHCI_MAX_SEGS)
+		return -1;
+	dma->seg_addr[dma->segs] = addr;
+	dma->seg_len[dma->segs] = len;
+	dma->segs++;
+	dma->len += len;
+	host = mem_block_host(addr, len);
+	if(host == NULL)
+		dma->iovcnt = -1;
+	if(dma->iovcnt >= 0){
+		dma->iov[dma->iovcnt].iov_base = host;
+		dma->iov[dma->iovcnt].iov_len = len;
+		dma->iovcnt++;
+	}
+	return 0;
+}
+
+/**
+* @brief the buffers up to the next SDMA buffer boundary
+*/
+static int sdhci_sdma_prepare(s3c6410_sdhci_device *dev){
+	sdhci_reg_t *regs = dev->regs;
+	sdhci_dma_t *dma = &dev->dma;
+	uint32_t boundary = 4096 << ((regs->blksize >> 12) & 7);
+	uint32_t size = sdhci_block_size(dev);
+	uint32_t addr = regs->sdmasysad;
+	uint32_t blocks;
+
+	blocks = (boundary - (addr & (boundary - 1)) + size - 1) / size;
+	if(blocks > dev->blocks)
+		blocks = dev->blocks;
+	dma->blocks = blocks;
+	dma->next_addr = addr + blocks * size;
+	return sdhci_dma_add(dma, addr, blocks * size);
+}
+
+/**
+* @brief walk the ADMA2 descriptors for the buffers of the whole transfer
+*/
+static int sdhci_adma_prepare(s3c6410_sdhci_device *dev){
+	sdhci_reg_t *regs = dev->regs;
+	sdhci_dma_t *dma = &dev->dma;
+	uint32_t total = dev->blocks * sdhci_block_size(dev);
+	uint32_t desc = regs->admasysaddr, attr, addr, len;
+	int n;
+
+	dma->blocks = dev->blocks;
+	for(n = 0; dma->len < total; n++){
+		/* a loop of links, or more descriptors than any driver makes */
+		if(n == SDHCI_MAX_SEGS * 4)
+			return -1;
+		if(bus_read(32, desc, &attr) != 0 || bus_read(32, desc + 4, &addr) != 0)
+			return -1;
+		regs->admasysaddr = desc;
+		if(!(attr & ADMA_VALID))
+			return -1;
+		len = attr >> 16;
+		if(len == 0)
+			len = 0x10000;
+		if((attr & ADMA_ACT_MASK) == ADMA_ACT_LINK){
+			desc = addr;
+			continue;
+		}
+		if((attr & ADMA_ACT_MASK) == ADMA_ACT_TRAN){
+			if(len > total - dma->len)
+				len = total - dma->len;
+			if(sdhci_dma_add(dma, addr, len) < 0)
+				return -1;
+			if(attr & ADMA_INT)
+				dma->norint |= INT_DMA;
+		}
+		desc += 8;
+		if(attr & ADMA_END)
+			break;
+	}
+	regs->admasysaddr = desc;
+	return dma->len == total ? 0 : -1;
+}
+
+/**
+* @brief collect the buffers of the next dma step, a copy of the guest
+* buffers that are not in ram is written by the card
+*/
+static int sdhci_dma_prepare(s3c6410_sdhci_device *dev){
+	sdhci_dma_t *dma = &dev->dma;
+	uint8_t *p;
+	uint32_t i, v;
+	int s, ret;
+
+	dma->segs = 0;
+	dma->iovcnt = 0;
+	dma->bounce = NULL;
+	dma->blocks = 0;
+	dma->len = 0;
+	dma->norint = 0;
+	if((dev->regs->hostctl & HOSTCTL_DMA_MASK) == HOSTCTL_ADMA2)
+		ret = sdhci_adma_prepare(dev);
+	else
+		ret = sdhci_sdma_prepare(dev);
+	if(ret < 0){
+		dev->regs->admaerr |= 1;
+		return -1;
+	}
+	if(dma->iovcnt >= 0)
+		return 0;
+	p = dma->bounce = skyeye_mm(dma->len);
+	dma->iov[0].iov_base = p;
+	dma->iov[0].iov_len = dma->len;
+	dma->iovcnt = 1;
+	if(dev->xfer_read)
+		return 0;
+	for(s = 0; s < dma->segs; s++)
+		for(i = 0; i < dma->seg_len[s]; i++){
+			bus_read(8, dma->seg_addr[s] + i, &v);
+			*p++ = v;
+		}
+	return 0;
+}
+
+static int sdhci_dma_io(s3c6410_sdhci_device *dev){
+	sdhci_dma_t *dma = &dev->dma;
+
+	if(dev->card.reg_len){
+		/* ACMD51 and the like, the register is short */
+		uint32_t len = dma->len < dev->card.reg_len ? dma->len : dev->card.reg_len;
+		uint8_t *src = dev->card.reg_data;
+		int i;
+		for(i = 0; i < dma->iovcnt && len > 0; i++){
+			uint32_t n = dma->iov[i].iov_len < len ? dma->iov[i].iov_len : len;
+			memcpy(dma->iov[i].iov_base, src, n);
+			src += n;
+			len -= n;
+		}
+		return 0;
+	}
+	if(dev->xfer_read)
+		return sd_card_read_blocks(&dev->card, dma->iov, dma->iovcnt, dma->blocks);
+	return sd_card_write_blocks(&dev->card, dma->iov, dma->iovcnt, dma->blocks);
+}
+
+static void sdhci_dma_finish(s3c6410_sdhci_device *dev, int ret){
+	sdhci_dma_t *dma = &dev->dma;
+	uint8_t *p = dma->bounce;
+	int s;
+
+	if(ret == 0 && dev->xfer_read){
+		for(s = 0; s < dma->segs; s++){
+			if(p != NULL){
+				mem_write_block(dma->seg_addr[s], p, dma->seg_len[s]);
+				p += dma->seg_len[s];
+			}
+			else
+				mem_mark_dirty(dma->seg_addr[s], dma->seg_len[s]);
+		}
+	}
+	if(dma->bounce != NULL){
+		skyeye_free(dma->bounce);
+		dma->bounce = NULL;
+	}
+	if(ret < 0){
+		sdhci_end_transfer(dev, 0, ERR_DATA_TIMEOUT);
+		return;
+	}
+	sdhci_blocks_done(dev, dma->blocks);
+	if((dev->regs->hostctl & HOSTCTL_DMA_MASK) != HOSTCTL_ADMA2)
+		dev->regs->sdmasysad = dma->next_addr;
+	if(dev->blocks == 0){
+		sdhci_end_transfer(dev, dma->norint, 0);
+		return;
+	}
+	/* stopped at a buffer boundary, wait for the next SDMASYSAD */
+	dev->dma_paused = 1;
+	sdhci_set_int(dev, INT_DMA | dma->norint, 0);
+}
+
+/**
+* @brief run the next dma step, in the io thread in async mode and then
+* completed by sdhci_io_done
+*/
+static void sdhci_dma_start(s3c6410_sdhci_device *dev){
+	dev->dma_paused = 0;
+	if(sdhci_dma_prepare(dev) < 0){
+		sdhci_end_transfer(dev, 0, ERR_ADMA);
+		return;
+	}
+	if(dev->async){
+		dev->io_pending = 1;
+		pthread_cond_signal(&dev->io_cond);
+		return;
+	}
+	sdhci_dma_finish(dev, sdhci_dma_io(dev));
+}
+
+/**
+* @brief complete the dma step of the io thread in the thread scheduler,
+* the guest memory, the registers and the interrupt controller are only
+* changed there
+*/
+static void sdhci_io_done(void *arg){
+	s3c6410_sdhci_device *dev = arg;
+
+	pthread_mutex_lock(&dev->lock);
+	sdhci_dma_finish(dev, dev->io_ret);
+	pthread_mutex_unlock(&dev->lock);
+}
+
+static void *sdhci_io_thread(void *arg){
+	s3c6410_sdhci_device *dev = arg;
+
+	pthread_mutex_lock(&dev->lock);
+	for(;;){
+		while(!dev->io_pending)
+			pthread_cond_wait(&dev->io_cond, &dev->lock);
+		dev->io_pending = 0;
+		/* the guest does not touch the registers of a busy transfer */
+		pthread_mutex_unlock(&dev->lock);
+		dev->io_ret = sdhci_dma_io(dev);
+		post_thread_event(sdhci_io_done, dev);
+		pthread_mutex_lock(&dev->lock);
+	}
+	return NULL;
+}
+
+static void sdhci_start_transfer(s3c6410_sdhci_device *dev){
+	sdhci_reg_t *regs = dev->regs;
+	sd_card_t *card = &dev->card;
+	uint16_t size = sdhci_block_size(dev);
+
+	if(card->data_dir == SD_DATA_NONE || size == 0 ||
+	   (card->reg_len == 0 && size != SD_BLOCK_SIZE) || (card->reg_len && size > card->reg_len)){
+		sd_card_data_done(card);
+		sdhci_set_int(dev, 0, ERR_DATA_TIMEOUT);
+		return;
+	}
+	dev->xfer_active = 1;
+	dev->xfer_read = card->data_dir == SD_DATA_READ;
+	if(!(regs->trnmod & TRNMOD_MULTI) || !card->multi_block)
+		dev->blocks = 1;
+	else if(regs->trnmod & TRNMOD_BLKCNT)
+		dev->blocks = regs->blkcnt;
+	else
+		dev->blocks = 0xffff;
+	if(dev->blocks == 0){
+		sdhci_end_transfer(dev, 0, 0);
+		return;
+	}
+	if(regs->trnmod & TRNMOD_DMA){
+		sdhci_dma_start(dev);
+		return;
+	}
+	if(dev->xfer_read)
+		sdhci_pio_fill(dev);
+	else{
+		dev->buf_pos = 0;
+		dev->buf_len = size;
+		sdhci_set_int(dev, INT_BUF_WRITE, 0);
+	}
+}
+
+static void sdhci_send_command(s3c6410_sdhci_device *dev){
+	sdhci_reg_t *regs = dev->regs;
+	uint32_t r[4] = {0, 0, 0, 0};
+	int cmd = CMDREG_INDEX(regs->cmdreg);
+	sd_rsp_t rsp;
+
+	/* CMD12 aborts the transfer in progress */
+	if(cmd == 12 && dev->xfer_active){
+		dev->xfer_active = 0;
+		dev->dma_paused = 0;
+		dev->buf_pos = dev->buf_len = 0;
+	}
+	rsp = sd_card_command(&dev->card, cmd, regs->argument, r);
+	if(rsp == SD_RSP_NONE && (regs->cmdreg & CMDREG_RSP_MASK) != 0){
+		sdhci_set_int(dev, 0, ERR_CMD_TIMEOUT);
+		return;
+	}
+	if(rsp == SD_RSP_R2){
+		/* bits 127..8 of the response, without the crc */
+		regs->rspreg[0] = (r[3] >> 8) | (r[2] << 24);
+		regs->rspreg[1] = (r[2] >> 8) | (r[1] << 24);
+		regs->rspreg[2] = (r[1] >> 8) | (r[0] << 24);
+		regs->rspreg[3] = r[0] >> 8;
+	}
+	else
+		regs->rspreg[0] = r[0];
+	sdhci_set_int(dev, INT_CMD_DONE, 0);
+	if(regs->cmdreg & CMDREG_DATA)
+		sdhci_start_transfer(dev);
+}
+
+static uint32_t sdhci_prnsts(s3c6410_sdhci_device *dev){
+	uint32_t status = PRNSTS_STABLE | PRNSTS_LINES;
+
+	if(dev->card.inserted)
+		status |= PRNSTS_INSERTED | PRNSTS_DETECT;
+	if(!dev->card.inserted || !sd_card_write_protected(&dev->card))
+		status |= PRNSTS_WRITABLE;
+	if(!dev->xfer_active)
+		return status;
+	status |= PRNSTS_DAT_INHIBIT | PRNSTS_DAT_ACTIVE;
+	status |= dev->xfer_read ? PRNSTS_READ_ACTIVE : PRNSTS_WRITE_ACTIVE;
+	if(!(dev->regs->trnmod & TRNMOD_DMA) && dev->buf_pos < dev->buf_len)
+		status |= dev->xfer_read ? PRNSTS_BUF_READ : PRNSTS_BUF_WRITE;
+	return status;
+}
+
+static void sdhci_reset(s3c6410_sdhci_device *dev, uint8_t mask){
+	sdhci_reg_t *regs = dev->regs;
+	uint32_t capareg = regs->capareg, maxcurr = regs->maxcurr;
+
+	if(mask & 0x5){
+		dev->xfer_active = 0;
+		dev->dma_paused = 0;
+		dev->buf_pos = dev->buf_len = 0;
+		sd_card_data_done(&dev->card);
+	}
+	if(mask & 0x1){
+		memset(regs, 0, sizeof(*regs));
+		regs->capareg = capareg;
+		regs->maxcurr = maxcurr;
+	}
+	sdhci_update_irq(dev);
+}
+
+static uint32_t sdhci_read32(s3c6410_sdhci_device *dev, uint32_t offset){
+	sdhci_reg_t *regs = dev->regs;
+
+	switch(offset){
+	case SDMASYSAD:
+		return regs->sdmasysad;
+	case BLKSIZE:
+		return regs->blksize | (regs->blkcnt << 16);
+	case ARGUMENT:
+		return regs->argument;
+	case TRNMOD:
+		return regs->trnmod | (regs->cmdreg << 16);
+	case RSPREG0 ... RSPREG3:
+		return regs->rspreg[(offset - RSPREG0) / 4];
+	case BDATA:
+		return sdhci_pio_read(dev);
+	case PRNSTS:
+		return sdhci_prnsts(dev);
+	case HOSTCTL:
+		return regs->hostctl | (regs->pwrcon << 8) | (regs->blkgap << 16) | (regs->wakcon << 24);
+	case CLKCON:
+		/* the software reset is done at once */
+		return regs->clkcon | (regs->timeoutcon << 16);
+	case NORINTSTS:
+		return regs->norintsts | (regs->errintsts << 16);
+	case NORINTSTSEN:
+		return regs->norintstsen | (regs->errintstsen << 16);
+	case NORINTSIGEN:
+		return regs->norintsigen | (regs->errintsigen << 16);
+	case ACMD12ERRSTS:
+		return regs->acmd12errsts;
+	case CAPAREG:
+		return regs->capareg;
+	case MAXCURR:
+		return regs->maxcurr;
+	case ADMAERR:
+		return regs->admaerr;
+	case ADMASYSADDR:
+		return regs->admasysaddr;
+	case CONTROL2:
+		return regs->control2;
+	case CONTROL3:
+		return regs->control3;
+	case CONTROL4:
+		return regs->control4;
+	case HCVER:
+		/* host controller spec 2.00, the interrupt of the slot */
+		return (0x2401 << 16) | (dev->irq_level ? 1 : 0);
 	default:
-		printf("Can not read the register at 0x%x\n", offset);
 		return 0;
 	}
 }
 
-//static void s3c6410_fb_write(void *opaque, target_phys_addr_t offset,
- //                       uint32_t val)
+#define MERGE(reg, val, mask, shift) \
+	((reg) = ((reg) & ~((mask) >> (shift))) | (((val) & (mask)) >> (shift)))
+
+static void sdhci_write32(s3c6410_sdhci_device *dev, uint32_t offset, uint32_t val, uint32_t mask){
+	sdhci_reg_t *regs = dev->regs;
+
+	switch(offset){
+	case SDMASYSAD:
+		MERGE(regs->sdmasysad, val, mask, 0);
+		if(dev->dma_paused && (mask & 0xff000000))
+			sdhci_dma_start(dev);
+		break;
+	case BLKSIZE:
+		MERGE(regs->blksize, val, mask & 0x7fff, 0);
+		MERGE(regs->blkcnt, val, mask & 0xffff0000, 16);
+		break;
+	case ARGUMENT:
+		MERGE(regs->argument, val, mask, 0);
+		break;
+	case TRNMOD:
+		MERGE(regs->trnmod, val, mask & 0xffff, 0);
+		MERGE(regs->cmdreg, val, mask & 0xffff0000, 16);
+		/* writing the index issues the command */
+		if(mask & 0xff000000)
+			sdhci_send_command(dev);
+		break;
+	case BDATA:
+		sdhci_pio_write(dev, val);
+		break;
+	case HOSTCTL:
+		MERGE(regs->hostctl, val, mask & 0xff, 0);
+		MERGE(regs->pwrcon, val, mask & 0xff00, 8);
+		MERGE(regs->blkgap, val, mask & 0xff0000, 16);
+		MERGE(regs->wakcon, val, mask & 0xff000000, 24);
+		break;
+	case CLKCON:
+		MERGE(regs->clkcon, val, mask & 0xffff, 0);
+		/* the internal and the external clocks are stable at once */
+		if(regs->clkcon & 0x1)
+			regs->clkcon |= 0xa;
+		else
+			regs->clkcon &= ~0xa;
+		MERGE(regs->timeoutcon, val, mask & 0xff0000, 16);
+		if(mask & 0xff000000)
+			sdhci_reset(dev, val >> 24);
+		break;
+	case NORINTSTS:
+		regs->norintsts &= ~(val & mask & 0x7fff);
+		regs->errintsts &= ~((val & mask) >> 16);
+		sdhci_update_irq(dev);
+		break;
+	case NORINTSTSEN:
+		MERGE(regs->norintstsen, val, mask & 0xffff, 0);
+		MERGE(regs->errintstsen, val, mask & 0xffff0000, 16);
+		break;
+	case NORINTSIGEN:
+		MERGE(regs->norintsigen, val, mask & 0xffff, 0);
+		MERGE(regs->errintsigen, val, mask & 0xffff0000, 16);
+		sdhci_update_irq(dev);
+		break;
+	case FEAER:
+		regs->acmd12errsts |= val & mask & 0x9f;
+		sdhci_set_int(dev, 0, (val & mask) >> 16);
+		break;
+	case ADMAERR:
+		MERGE(regs->admaerr, val, mask, 0);
+		break;
+	case ADMASYSADDR:
+		MERGE(regs->admasysaddr, val, mask, 0);
+		break;
+	case CONTROL2:
+		MERGE(regs->control2, val, mask, 0);
+		break;
+	case CONTROL3:
+		MERGE(regs->control3, val, mask, 0);
+		break;
+	case CONTROL4:
+		MERGE(regs->control4, val, mask, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+* @brief the width of an access, the registers are 8, 16 or 32 bits wide
+*/
+static int sdhci_access_width(generic_address_t offset, size_t count){
+	if(count >= 4 && !(offset & 3))
+		return 4;
+	if(count >= 2 && !(offset & 1))
+		return 2;
+	return 1;
+}
+
+static exception_t s3c6410_sdhci_read(conf_object_t *opaque, generic_address_t offset, void* buf, size_t count)
+{
+	s3c6410_sdhci_device *dev = opaque->obj;
+	int width = sdhci_access_width(offset, count);
+	uint32_t data;
+
+	pthread_mutex_lock(&dev->lock);
+	sdhci_attach_card(dev);
+	data = sdhci_read32(dev, offset & ~3) >> ((offset & 3) * 8);
+	pthread_mutex_unlock(&dev->lock);
+	if(width < 4)
+		data &= (1 << (width * 8)) - 1;
+	*(uint32_t*)buf = data;
+	return No_exp;
+}
+
 static exception_t s3c6410_sdhci_write(conf_object_t *opaque, generic_address_t offset, uint32_t* buf, size_t count)
 {
-	struct s3c6410_sdhci_device *s = opaque->obj;
-	DBG("In %s, offset=0x%x\n", __FUNCTION__, offset);
-	uint32_t val = *(uint32_t*)buf;
-	switch(offset) {
-        default:
-            break;
-	}
+	s3c6410_sdhci_device *dev = opaque->obj;
+	int width = sdhci_access_width(offset, count);
+	int shift = (offset & 3) * 8;
+	uint32_t mask = width == 4 ? 0xffffffff : ((1 << (width * 8)) - 1) << shift;
 
+	pthread_mutex_lock(&dev->lock);
+	sdhci_attach_card(dev);
+	sdhci_write32(dev, offset & ~3, *buf << shift, mask);
+	pthread_mutex_unlock(&dev->lock);
 	return No_exp;
 }
+
 static conf_object_t* new_s3c6410_sdhci(char* obj_name){
 	s3c6410_sdhci_device* dev = skyeye_mm_zero(sizeof(s3c6410_sdhci_device));
 	dev->obj = new_conf_object(obj_name, dev);
 	sdhci_reg_t* regs =  skyeye_mm_zero(sizeof(sdhci_reg_t));
+	/* SDMA, ADMA2, high speed and 3.3V, 512 byte blocks, 50MHz clocks */
+	regs->capareg = (1 << 24) | (1 << 22) | (1 << 21) | (1 << 19) |
+			(50 << 8) | (1 << 7) | 50;
+	regs->maxcurr = 100 / 4;
 	dev->regs = regs;
+	pthread_mutex_init(&dev->lock, NULL);
+	pthread_cond_init(&dev->io_cond, NULL);
+	dev->card.image.fd = -1;
 	/* Register io function to the object */
 	memory_space_intf* io_memory = skyeye_mm_zero(sizeof(memory_space_intf));
+	io_memory->conf_obj = dev->obj;
 	io_memory->read = s3c6410_sdhci_read;
 	io_memory->write = s3c6410_sdhci_write;
-	SKY_register_interface(io_memory, obj_name, MEMORY_SPACE_INTF_NAME);	
+	SKY_register_interface(io_memory, obj_name, MEMORY_SPACE_INTF_NAME);
+
+	general_signal_intf* sdhci_signal = skyeye_mm_zero(sizeof(general_signal_intf));
+	sdhci_signal->conf_obj = NULL;
+	sdhci_signal->raise_signal = NULL;
+	sdhci_signal->lower_signal = NULL;
+	dev->master = sdhci_signal;
+	dev->line_no = 56; /* HSMMC0 */
+	SKY_register_interface(sdhci_signal, obj_name, GENERAL_SIGNAL_INTF_NAME);
 	return dev->obj;
 }
 void free_s3c6410_sdhci(conf_object_t* dev){
-	
+
+}
+
+/**
+* @brief parse "sdcard: image=<file>, format=raw|sparse, size=<n>[KMG], async=on"
+*/
+static int do_sdcard_option(skyeye_option_t * this_option, int num_params,
+		 const char *params[])
+{
+	char name[MAX_PARAM_NAME], value[MAX_PARAM_NAME];
+	char *end;
+	int i;
+
+	for (i = 0; i < num_params; i++) {
+		if (split_param (params[i], name, value) < 0) {
+			skyeye_log(Error_log, __FUNCTION__, "sdcard has wrong parameter \"%s\".\n", name);
+			continue;
+		}
+		if (!strncmp("image", name, strlen(name)))
+			strncpy(sdcard_opt.image, value, MAX_PARAM_NAME - 1);
+		else if (!strncmp("format", name, strlen(name)))
+			sdcard_opt.format = strcmp(value, "sparse") ? SD_IMAGE_RAW : SD_IMAGE_SPARSE;
+		else if (!strncmp("size", name, strlen(name))) {
+			sdcard_opt.size = strtoull(value, &end, 0);
+			if (*end == 'k' || *end == 'K')
+				sdcard_opt.size <<= 10;
+			else if (*end == 'm' || *end == 'M')
+				sdcard_opt.size <<= 20;
+			else if (*end == 'g' || *end == 'G')
+				sdcard_opt.size <<= 30;
+		}
+		else if (!strncmp("async", name, strlen(name)))
+			sdcard_opt.async = !strcmp(value, "on") || !strcmp(value, "1");
+		else
+			skyeye_log(Error_log, __FUNCTION__, "Unknown sdcard parameter \"%s\".\n", name);
+	}
+	return 0;
 }
 
 void init_s3c6410_sdhci(){
@@ -76,6 +786,7 @@ void init_s3c6410_sdhci(){
 		.get_attr = NULL,
 		.set_attr = NULL
 	};
-	
+
 	SKY_register_class(class_data.class_name, &class_data);
+	register_option("sdcard", do_sdcard_option, "The image of the sd card in the sdhci slot.");
 }
@@ -1,10 +1,177 @@
 #ifndef __SDHCI_S3C6410_H__
 #define __SDHCI_S3C6410_H__
+#include <pthread.h>
+#include "sd_card.h"
+
+/* the offsets of the registers of a HSMMC channel */
+#define SDMASYSAD	0x00
+#define BLKSIZE		0x04
+#define BLKCNT		0x06
+#define ARGUMENT	0x08
+#define TRNMOD		0x0c
+#define CMDREG		0x0e
+#define RSPREG0		0x10
+#define RSPREG3		0x1c
+#define BDATA		0x20
+#define PRNSTS		0x24
+#define HOSTCTL		0x28
+#define PWRCON		0x29
+#define BLKGAP		0x2a
+#define WAKCON		0x2b
+#define CLKCON		0x2c
+#define TIMEOUTCON	0x2e
+#define SWRST		0x2f
+#define NORINTSTS	0x30
+#define ERRINTSTS	0x32
+#define NORINTSTSEN	0x34
+#define ERRINTSTSEN	0x36
+#define NORINTSIGEN	0x38
+#define ERRINTSIGEN	0x3a
+#define ACMD12ERRSTS	0x3c
+#define CAPAREG		0x40
+#define MAXCURR		0x48
+#define FEAER		0x50
+#define ADMAERR		0x54
+#define ADMASYSADDR	0x58
+#define CONTROL2	0x80
+#define CONTROL3	0x84
+#define CONTROL4	0x8c
+#define HCVER		0xfc
+
+/* TRNMOD */
+#define TRNMOD_DMA	(1 << 0)
+#define TRNMOD_BLKCNT	(1 << 1)
+#define TRNMOD_ACMD12	(1 << 2)
+#define TRNMOD_READ	(1 << 4)
+#define TRNMOD_MULTI	(1 << 5)
+
+/* CMDREG */
+#define CMDREG_RSP_MASK	0x3
+#define CMDREG_RSP_136	0x1
+#define CMDREG_DATA	(1 << 5)
+#define CMDREG_INDEX(x)	(((x) >> 8) & 0x3f)
+
+/* PRNSTS */
+#define PRNSTS_CMD_INHIBIT	(1 << 0)
+#define PRNSTS_DAT_INHIBIT	(1 << 1)
+#define PRNSTS_DAT_ACTIVE	(1 << 2)
+#define PRNSTS_WRITE_ACTIVE	(1 << 8)
+#define PRNSTS_READ_ACTIVE	(1 << 9)
+#define PRNSTS_BUF_WRITE	(1 << 10)
+#define PRNSTS_BUF_READ		(1 << 11)
+#define PRNSTS_INSERTED		(1 << 16)
+#define PRNSTS_STABLE		(1 << 17)
+#define PRNSTS_DETECT		(1 << 18)
+#define PRNSTS_WRITABLE		(1 << 19)
+#define PRNSTS_LINES		(0x1f << 20)
+
+/* HOSTCTL */
+#define HOSTCTL_DMA_MASK	(3 << 3)
+#define HOSTCTL_ADMA2		(2 << 3)
+
+/* NORINTSTS */
+#define INT_CMD_DONE	(1 << 0)
+#define INT_XFER_DONE	(1 << 1)
+#define INT_DMA		(1 << 3)
+#define INT_BUF_WRITE	(1 << 4)
+#define INT_BUF_READ	(1 << 5)
+#define INT_INSERT	(1 << 6)
+#define INT_REMOVE	(1 << 7)
+#define INT_ERROR	(1 << 15)
+
+/* ERRINTSTS */
+#define ERR_CMD_TIMEOUT		(1 << 0)
+#define ERR_DATA_TIMEOUT	(1 << 4)
+#define ERR_ACMD12		(1 << 8)
+#define ERR_ADMA		(1 << 9)
+
+/* the attributes of an ADMA2 descriptor */
+#define ADMA_VALID	(1 << 0)
+#define ADMA_END	(1 << 1)
+#define ADMA_INT	(1 << 2)
+#define ADMA_ACT_MASK	(3 << 4)
+#define ADMA_ACT_TRAN	(2 << 4)
+#define ADMA_ACT_LINK	(3 << 4)
+
+/* the most buffers of one dma transfer that are handed to the image */
+#define SDHCI_MAX_SEGS	256
+/* the largest block of the controller */
+#define SDHCI_MAX_BLOCK	4096
+
 typedef struct sdhci_reg{
+	uint32_t sdmasysad;
+	uint16_t blksize;
+	uint16_t blkcnt;
+	uint32_t argument;
+	uint16_t trnmod;
+	uint16_t cmdreg;
+	uint32_t rspreg[4];
+	uint8_t hostctl;
+	uint8_t pwrcon;
+	uint8_t blkgap;
+	uint8_t wakcon;
+	uint16_t clkcon;
+	uint8_t timeoutcon;
+	uint16_t norintsts;
+	uint16_t errintsts;
+	uint16_t norintstsen;
+	uint16_t errintstsen;
+	uint16_t norintsigen;
+	uint16_t errintsigen;
+	uint16_t acmd12errsts;
+	uint32_t capareg;
+	uint32_t maxcurr;
+	uint32_t admaerr;
+	uint32_t admasysaddr;
+	uint32_t control2;
+	uint32_t control3;
+	uint32_t control4;
 }sdhci_reg_t;
 
+/* a dma transfer between the card and the guest buffers */
+typedef struct sdhci_dma{
+	uint32_t seg_addr[SDHCI_MAX_SEGS];
+	uint32_t seg_len[SDHCI_MAX_SEGS];
+	int segs;
+	/* the host memory of the segments, or one bounce buffer */
+	struct iovec iov[SDHCI_MAX_SEGS];
+	int iovcnt;
+	uint8_t *bounce;
+	uint32_t blocks;
+	uint32_t len;
+	/* SDMASYSAD after the transfer */
+	uint32_t next_addr;
+	/* the interrupts asked for by the descriptors */
+	uint16_t norint;
+}sdhci_dma_t;
+
 typedef struct s3c6410_sdhci_device{
 	conf_object_t* obj;
 	sdhci_reg_t* regs;
+	general_signal_intf* master;
+	int line_no;
+	int irq_level;
+	sd_card_t card;
+	int card_checked;
+
+	/* the data phase of the current command */
+	int xfer_active;
+	int xfer_read;
+	uint32_t blocks;
+	/* the dma waits for a new SDMASYSAD at a buffer boundary */
+	int dma_paused;
+	uint8_t buf[SDHCI_MAX_BLOCK];
+	uint32_t buf_pos;
+	uint32_t buf_len;
+	sdhci_dma_t dma;
+
+	/* the registers are also changed by the completion of the io thread */
+	pthread_mutex_t lock;
+	int async;
+	pthread_t io_thread;
+	pthread_cond_t io_cond;
+	int io_pending;
+	/* the result of the io, handed to the thread scheduler */
+	int io_ret;
 }s3c6410_sdhci_device;
 #endif
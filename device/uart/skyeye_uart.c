@@ -28,6 +28,11 @@
 #include "skyeye_uart_ops.h"
 
 #include "skyeye_uart.h"
+#include "skyeye_io.h"
+#include "sim_control.h"
+
+#include <unistd.h>
+#include <errno.h>
 
 #include "portable/gettimeofday.h"
 //#include "portable/usleep.h"
@@ -64,6 +69,112 @@ static int skyeye_uart_check_timeout(struct timeval *tv)
 }
 
 
+/**
+* @brief move the input of the watched fd into the receive queue, called in
+* the io reactor thread when the fd is readable
+*
+* @param arg the uart device
+*/
+static void uart_rx_ready(void *arg)
+{
+	struct uart_device *uart_dev = arg;
+	struct uart_rx_queue *rx = &uart_dev->rx;
+	uint32_t tail = rx->tail;
+	uint32_t off = tail & (UART_RX_QUEUE_SIZE - 1);
+	uint32_t space = UART_RX_QUEUE_SIZE - (tail - rx->head);
+	int fd = rx->fd;
+	int n;
+
+	if (fd < 0) return;
+	/*
+	 * a full queue, or a stopped simulation that leaves stdin to the
+	 * command line: the fd is rearmed by the next read of the device.
+	 */
+	if (space == 0 || !SIM_is_running()) {
+		rx->stalled = 1;
+		return;
+	}
+	if (space > UART_RX_QUEUE_SIZE - off) space = UART_RX_QUEUE_SIZE - off;
+
+	n = read(fd, &rx->buf[off], space);
+	if (n > 0) {
+		/* publish the bytes before the tail */
+		__sync_synchronize();
+		rx->tail = tail + n;
+	} else if ((n == 0 && !isatty(fd)) || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+		/* the end of file, or the peer hung up */
+		uart_rx_unwatch(uart_dev);
+		if (uart_dev->uart_hangup != NULL) uart_dev->uart_hangup(uart_dev);
+		return;
+	}
+	io_rearm_fd(fd);
+}
+
+/**
+* @brief take the queued input of a device, no syscall unless the queue
+* was stalled
+*
+* @return the bytes taken
+*/
+static int uart_rx_pop(struct uart_device *uart_dev, void *buf, size_t count)
+{
+	struct uart_rx_queue *rx = &uart_dev->rx;
+	uint32_t head = rx->head;
+	uint32_t avail = rx->tail - head;
+	uint8_t *p = buf;
+	int n = 0;
+
+	/* read the bytes after the tail */
+	__sync_synchronize();
+	while (n < count && avail != 0) {
+		p[n++] = rx->buf[head++ & (UART_RX_QUEUE_SIZE - 1)];
+		avail--;
+	}
+	__sync_synchronize();
+	rx->head = head;
+
+	if (rx->stalled && __sync_bool_compare_and_swap(&rx->stalled, 1, 0) && rx->fd >= 0)
+		io_rearm_fd(rx->fd);
+	return n;
+}
+
+/**
+* @brief let the io reactor move the input of fd into the receive queue
+*
+* @param uart_dev the uart device
+* @param fd the host fd of the input
+*
+* @return 0 on success, -1 if the backend should be polled
+*/
+int uart_rx_watch(struct uart_device *uart_dev, int fd)
+{
+	uart_dev->rx.stalled = 0;
+	uart_dev->rx.fd = fd;
+	if (io_watch_fd_in_reactor(fd, uart_rx_ready, uart_dev) != 0) {
+		uart_dev->rx.fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+void uart_rx_unwatch(struct uart_device *uart_dev)
+{
+	int fd = uart_dev->rx.fd;
+
+	if (fd < 0) return;
+	uart_dev->rx.fd = -1;
+	io_unwatch_fd(fd);
+}
+
+static int uart_dev_read(struct uart_device *uart_dev, void *buf, size_t count, struct timeval *timeout)
+{
+	/* the input left in the queue is taken even after an unwatch */
+	if (uart_dev->rx.fd >= 0 || uart_dev->rx.tail != uart_dev->rx.head)
+		return uart_rx_pop(uart_dev, buf, count);
+	return uart_dev->uart_read(uart_dev, buf, count, timeout);
+}
+
+
 int uart_read(int devIndex, void *buf, size_t count, struct timeval *timeout, int *retDevIndex)
 {
 	int retVal = -1;
@@ -74,11 +185,15 @@ int uart_read(int devIndex, void *buf, size_t count, struct timeval *timeout, in
 	if (retDevIndex != NULL) *retDevIndex = -1;
 
 	if (devIndex >= config->uart.count || buf == NULL || count == 0) { /* invalid */
-	} else if(devIndex >= 0) { /* single device */
+	} else if(devIndex >= 0 && (config->uart.devs[devIndex]->rx.fd < 0 ||
+				    (timeout != NULL && timeout->tv_sec == 0 && timeout->tv_usec == 0))) { /* single device */
 		uart_dev = config->uart.devs[devIndex];
-		retVal = uart_dev->uart_read(uart_dev, buf, count, timeout);
-	} else { /* all devices */
+		retVal = uart_dev_read(uart_dev, buf, count, timeout);
+	} else { /* all devices, or waiting on a queue */
 		int i, stop_flags = 0;
+		int first = (devIndex >= 0 ? devIndex : 0);
+		int last = (devIndex >= 0 ? devIndex : config->uart.count - 1);
+		int all_flags = ((1 << (last + 1)) - 1) & ~((1 << first) - 1);
 		struct timeval tv, zero_tv;
 
 		if (!(timeout == NULL || gettimeofday(&tv, NULL) == 0)) { /* something error */
@@ -92,9 +207,9 @@ int uart_read(int devIndex, void *buf, size_t count, struct timeval *timeout, in
 			zero_tv.tv_usec = 0;
 
 			do {
-				for (i = 0; i < config->uart.count; i++) {
+				for (i = first; i <= last; i++) {
 					uart_dev = config->uart.devs[i];
-					retVal = uart_dev->uart_read(uart_dev, buf, count, &zero_tv);
+					retVal = uart_dev_read(uart_dev, buf, count, &zero_tv);
 
 					if(retVal > 0) { /* got something */
 						devIndex = i;
@@ -104,7 +219,7 @@ int uart_read(int devIndex, void *buf, size_t count, struct timeval *timeout, in
 					stop_flags |= (1 << i); /* failed */
 				}
 
-				if (stop_flags == (1 << config->uart.count) - 1) { /* all failed */
+				if (stop_flags == all_flags) { /* all failed */
 					retVal = -1;
 				} else if (retVal > 0) {
 					stop_flags = 1;
@@ -157,6 +272,7 @@ void skyeye_uart_cleanup()
 	config->uart.count = 0;
 	while (--i >= 0) {
 		dev = config->uart.devs[i];
+		uart_rx_unwatch(dev);
 		dev->uart_close(dev);
 		free(dev);
 	}
@@ -178,6 +294,7 @@ int skyeye_uart_setup(struct uart_option *uart_opt)
 	if (uart_dev == NULL) return -1;
 
 	memset(uart_dev, 0, sizeof(struct uart_device));
+	uart_dev->rx.fd = -1;
 
 	uart_dev->mod = uart_opt->mod;
 	memcpy(&uart_dev->desc_in[0], &uart_opt->desc_in[0], MAX_STR_NAME);
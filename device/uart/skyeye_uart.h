@@ -22,6 +22,7 @@
 #define __SKYEYE_UART_H_
 
 #include <sys/time.h>
+#include <stdint.h>
 
 #include "skyeye_device.h"
 #include "skyeye_config.h"
@@ -32,6 +33,20 @@
 #define UART_SIM_NET		2	/* use tcp port as fd */
 #define UART_SIM_TERM		3	/* use extern term as fd */
 
+/*
+ * The receive queue of a uart device, filled by the io reactor thread and
+ * drained by the device, one producer and one consumer without a lock.
+ */
+#define UART_RX_QUEUE_SIZE	4096	/* power of 2 */
+
+struct uart_rx_queue {
+	volatile uint32_t head;		/* advanced by the device */
+	volatile uint32_t tail;		/* advanced by the reactor */
+	volatile int fd;		/* the watched host fd, -1 if the backend is polled */
+	volatile int stalled;		/* full or paused, the fd waits for a rearm */
+	uint8_t buf[UART_RX_QUEUE_SIZE];
+};
+
 struct uart_device {
 	int mod;
 
@@ -45,6 +60,10 @@ struct uart_device {
 	int (*uart_close)(struct uart_device *uart_dev);
 	int (*uart_read)(struct uart_device *uart_dev, void *buf, size_t count, struct timeval *timeout);
 	int (*uart_write)(struct uart_device *uart_dev, void *buf, size_t count);
+	/* called in the reactor thread when the peer of the watched fd hangs up */
+	void (*uart_hangup)(struct uart_device *uart_dev);
+
+	struct uart_rx_queue rx;
 
 	char converter[MAX_STR_NAME];
 	void *converter_priv; /* converter private data. */
@@ -68,6 +87,10 @@ struct uart_option
 void skyeye_uart_cleanup();
 int skyeye_uart_setup(struct uart_option *uart_opt);
 
+/* move the input of fd into the receive queue from the io reactor */
+int uart_rx_watch(struct uart_device *uart_dev, int fd);
+void uart_rx_unwatch(struct uart_device *uart_dev);
+
 
 /* converter */
 void skyeye_uart_converter_setup(void);
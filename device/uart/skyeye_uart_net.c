@@ -56,13 +56,7 @@
  */
 struct uart_link_state{
 	struct termios* term;
-	struct {
-                uint8_t *bufp;  /* Non null if allocated */
-                int     head;
-                int     tail;
-                int     count;
-                int     size;
-        } in;
+	struct uart_device *uart_dev;	/* the input is queued into uart_dev->rx */
 	int     tty_skt;        /* socket to send / receive to client on */
         int  tty_attached;
         pthread_t pthread_id;
@@ -110,7 +104,6 @@ static int create_term(char * hostname, int port){
 
 /* we will fork another process as the console daemon */
 static int create_uart_console(struct uart_link_state * ul_state){
-	uint8_t buf[1024];
 #define	MAXHOSTNAME	256
 	char	myhostname[MAXHOSTNAME];
 	int sv_skt;
@@ -158,90 +151,52 @@ retry:
 	//create_term(myhostname, ntohs(server.sin_port));
 	/* main loop */
 	do {
-		if (!ul_state->tty_attached) {
-			/*
-			PRINTF(("\ndumbserial: Waiting for connection to : %s:%d\n",
-			    myhostname, ntohs(ds_server.sin_port)));
-			*/
-			//printf("Waiting for connection to %s:%d", myhostname, ntohs(server.sin_port));
-			length = sizeof(from);
-			ul_state->tty_skt = accept(sv_skt, (struct sockaddr *)&from, (int*)&length);
-
-			hp = gethostbyaddr((char *)&from.sin_addr, 4, AF_INET);
-			if (hp == (struct hostent *)0) {
-				froms = inet_ntoa(from.sin_addr);
-				fprintf(stderr,"cant resolve hostname for %s\n", froms);
-			} else {
-				froms = hp->h_name;
-			}
-			/*
-			PRINTF(("dumbserial: Accepted connection on %s:%d from %s:%d\n",
-			    myhostname, ntohs(ds_server.sin_port),
-			    froms, ntohs(from.sin_port)));
-			*/
-			//printf("Accepted connection.\n");
-			pthread_mutex_lock(&ul_state->tty_lock);
-			ul_state->tty_attached = 1;
-			pthread_mutex_unlock(&ul_state->tty_lock);
-			pthread_cond_signal(&ul_state->tty_cv);
-		} 
-		else { /* begin receive data. */
-			int res;
-			struct pollfd fds;
-
-			//printf("In %s, begin receive data\n", __FUNCTION__);
-#define	POLL_TIMEOUT	-1		/* wait forever ? FIXME ? */
-			fds.fd = ul_state->tty_skt;
-			fds.events = POLLIN|POLLPRI;
-#if HOST_OS_SOLARIS9		/* { */
-			fds.events |= POLLRDNORM|POLLRDBAND;
-#endif				/* } */
-			fds.revents = 0;
-
-			res = poll(&fds, 1, POLL_TIMEOUT);
-
-			if (fds.revents & POLLIN) {
-				res = read(ul_state->tty_skt, buf, sizeof (buf));
-				if (res == 0) {
-						/* a read of 0 bytes is an EOF */
-					pthread_mutex_lock(&ul_state->tty_lock);
-					ul_state->tty_attached = 0;
-					pthread_mutex_unlock(&ul_state->tty_lock);
-					pthread_cond_signal(&ul_state->tty_cv);
-					close(ul_state->tty_skt);
-					//SANITY(dsp->tty_skt = -1;);
-				} else if (res<0) {
-					perror("read");
-				} else {
-					int i;
-					for (i = 0; i < res; i++) {
-						if (ul_state->in.count < ul_state->in.size) {
-							ul_state->in.bufp[ul_state->in.tail] = buf[i];
-							ul_state->in.tail++;
-							if (ul_state->in.tail >= ul_state->in.size)
-								ul_state->in.tail = 0;
-							ul_state->in.count++;
-						} else {
-							fprintf(stderr, "Overflow for uart link.\n");
-						}
-					}
-				}
-			}//if (fds.revents & POLLIN) 
+		/* the io reactor moves the input, wait for the hang up */
+		pthread_mutex_lock(&ul_state->tty_lock);
+		while (ul_state->tty_attached) pthread_cond_wait(&ul_state->tty_cv, &ul_state->tty_lock);
+		pthread_mutex_unlock(&ul_state->tty_lock);
+
+		/*
+		PRINTF(("\ndumbserial: Waiting for connection to : %s:%d\n",
+		    myhostname, ntohs(ds_server.sin_port)));
+		*/
+		length = sizeof(from);
+		ul_state->tty_skt = accept(sv_skt, (struct sockaddr *)&from, (int*)&length);
+		if (ul_state->tty_skt < 0) {
+			perror("accept");
+			continue;
 		}
+
+		hp = gethostbyaddr((char *)&from.sin_addr, 4, AF_INET);
+		if (hp == (struct hostent *)0) {
+			froms = inet_ntoa(from.sin_addr);
+			fprintf(stderr,"cant resolve hostname for %s\n", froms);
+		} else {
+			froms = hp->h_name;
+		}
+		/* without an io reactor, uart_net_read polls the link */
+		uart_rx_watch(ul_state->uart_dev, ul_state->tty_skt);
+		pthread_mutex_lock(&ul_state->tty_lock);
+		ul_state->tty_attached = 1;
+		pthread_mutex_unlock(&ul_state->tty_lock);
+		pthread_cond_broadcast(&ul_state->tty_cv);
 	} while (1);
 	return 0;
 }
 
+/* called when the client closes the link, in the io reactor thread unless
+ * the link is polled */
+static void uart_net_hangup(struct uart_device *uart_dev){
+	struct uart_link_state *ul_state = uart_dev->priv;
+
+	pthread_mutex_lock(&ul_state->tty_lock);
+	ul_state->tty_attached = 0;
+	close(ul_state->tty_skt);
+	pthread_mutex_unlock(&ul_state->tty_lock);
+	pthread_cond_broadcast(&ul_state->tty_cv);
+}
+
 static int init_ul_state(struct uart_link_state* ul_state){
-	/* initilizaiton the rx fifo */
-	ul_state->in.count = 0;
-	ul_state->in.head = 0;
-	ul_state->in.tail = 0;
-	/* we allocate the 1024 byte for rx buffer  */
-	ul_state->in.size = 1024;
-	if(((ul_state->in.bufp = malloc(1024))) == NULL)
-		return -1;
-	
 	ul_state->tty_skt = -1;
 	ul_state->tty_attached = 0;
 	pthread_mutex_init(&ul_state->tty_lock, NULL);
@@ -270,6 +225,8 @@ int uart_net_open(struct uart_device *uart_dev)
 	if((ul_state = malloc(sizeof(struct uart_link_state))) == NULL) return -1;
 
 	uart_dev->priv = ul_state; /* the priv data used to save the internal uart link state */
+	uart_dev->uart_hangup = uart_net_hangup;
+	ul_state->uart_dev = uart_dev;
 	init_ul_state(ul_state);
 	//ret=pthread_create(&id,NULL,(void *) create_uart_console,NULL);
 	//create_uart_console(ul_state);
@@ -284,9 +241,9 @@ int uart_net_close(struct uart_device *uart_dev)
 		struct uart_link_state *ul_state;
 		ul_state = (struct uart_link_state *)uart_dev->priv;
 
-		free(ul_state->in.bufp);
-		ul_state->in.bufp = NULL;
-
+		/* the link is unwatched by the caller, drop the client */
+		if (ul_state->tty_attached)
+			close(ul_state->tty_skt);
 		free(uart_dev->priv);
 		uart_dev->priv = NULL;
 	}
@@ -296,24 +253,30 @@ int uart_net_close(struct uart_device *uart_dev)
 
 int uart_net_read(struct uart_device *uart_dev, void *buf, size_t count, struct timeval *timeout)
 {
-	int ret = -1;
-	char* buf1 = buf;
+	/*
+	 * only called while the link is not watched, the input of a watched
+	 * link is queued by the io reactor. The host has no reactor when a
+	 * client is attached here, poll the link.
+	 */
 	struct uart_link_state * ul_state = uart_dev->priv;
-	if (ul_state->tty_attached) {
-		/* move the charaters in buffer */
-		int i = 0;
-               //printf("In %s, count=%d, head=%d, tail=%d\n", __FUNCTION__, count, ul_state->in.head, ul_state->in.tail);
-		while(i < count && (ul_state->in.head < ul_state->in.tail)){
-			buf1[i] =  ul_state->in.bufp[ul_state->in.head];
-			i++;
-			ul_state->in.head++;
-                       //printf("In %s, i=%d, count=%d, head=%d, tail=%d\n", __FUNCTION__, i, count, ul_state->in.head, ul_state->in.tail);
-		}
-               /* read the char expected */
-		if((i == count) || (ul_state->in.head == ul_state->in.tail))
-			ret = i;
+	struct pollfd fds;
+	int res;
+
+	if (!ul_state->tty_attached)
+		return -1;
+	fds.fd = ul_state->tty_skt;
+	fds.events = POLLIN|POLLPRI;
+	fds.revents = 0;
+	res = poll(&fds, 1, timeout == NULL ? -1 : timeout->tv_sec * 1000 + timeout->tv_usec / 1000);
+	if (res <= 0 || !(fds.revents & (POLLIN|POLLPRI|POLLHUP)))
+		return 0;
+	res = read(ul_state->tty_skt, buf, count);
+	if (res == 0) {
+		/* a read of 0 bytes is an EOF */
+		uart_net_hangup(uart_dev);
+		return -1;
 	}
-	return ret;
+	return res < 0 ? 0 : res;
 }
 
 
@@ -83,7 +83,12 @@ int uart_pipe_open(struct uart_device *uart_dev)
 		}
 	}
 
-	if(ret == 0) uart_dev->priv = (void*)dev;
+	if(ret == 0)
+	{
+		uart_dev->priv = (void*)dev;
+		/* queue the input from the io reactor, or poll it with select */
+		uart_rx_watch(uart_dev, dev->fd_in);
+	}
 	else free(dev);
 
 	return ret;
@@ -64,6 +64,9 @@ int uart_stdio_open(struct uart_device *uart_dev)
 	tmp.c_cc[VTIME] = 0;
 	tcsetattr(0, TCSANOW, &tmp);
 
+	/* queue the input from the io reactor, or poll stdin with select */
+	uart_rx_watch(uart_dev, 0);
+
 	return 0;
 }
 
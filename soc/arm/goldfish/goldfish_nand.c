@@ -28,6 +28,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <unistd.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <stdarg.h>
 #include "skyeye_arch.h"
 #include <skyeye_interface.h>
@@ -69,28 +70,6 @@ xlog( const char*  format, ... )
     vfprintf(stderr, format, args);
     va_end(args);
 }
-static int  do_read(int  fd, void*  buf, size_t  size)
-{
-    int  ret;
-    do {
-        ret = read(fd, buf, size);
-	//perror("read");
-    } while (ret < 0 && errno == EINTR);
-
-    return ret;
-}
-
-/* EINTR-proof write - due to SIGALRM in use elsewhere */
-static int  do_write(int  fd, const void*  buf, size_t  size)
-{
-    int  ret;
-    do {
-        ret = write(fd, buf, size);
-    } while (ret < 0 && errno == EINTR);
-
-    return ret;
-}
-
 /* EINTR-proof lseek - due to SIGALRM in use elsewhere */
 static int  do_lseek(int  fd, off_t offset, int whence)
 {
@@ -168,87 +147,33 @@ static exception_t nand_read(conf_object_t *obj,generic_address_t offset,void* b
 
 static uint32_t nand_dev_read_file(nand_dev_t *dev, uint32_t data, uint64_t addr, uint32_t total_len)
 {
-    uint32_t len = total_len;
-    size_t read_len = dev->erase_size;
-    uint32_t dst  = data;
-    int ret  = 0;
-    int eof = 0;
-    int i;
+    uint8_t *src = nand_store_ptr(&dev->store, addr);
+    uint32_t i;
   //  NAND_UPDATE_READ_THRESHOLD(total_len);
 
     generic_arch_t *arch = get_arch_instance("");
-    ret = do_lseek(dev->fd, addr, SEEK_SET);
-    while(len > 0) {
-        if(read_len < dev->erase_size) { // read all
-            memset(dev->data, 0xff, dev->erase_size);
-            read_len = dev->erase_size;
-            eof = 1;
-        }
-        if(len < read_len)
-            read_len = len;
-        if(!eof) {
-            read_len = do_read(dev->fd, dev->data, read_len);
-	}
-	for(i = 0; i< read_len;i++){
-		arch->mmu_write(8,(dst + i),dev->data[i]);
-	}/*
-	if(addr == 5280){
-		printf("readlen 0x%x,readlen 0x%x\n",total_len,read_len);
-		for(i = 0; i < 0x200;i++){
-			printf("offset %d,value 0x%x\n",i ,dev->data[ i]);
-		}
-	}*/
-        dst += read_len;
-        len -= read_len;
-    }
+    for(i = 0; i < total_len; i++)
+        arch->mmu_write(8, data + i, src[i]);
     return total_len;
 }
 static uint32_t nand_dev_write_file(nand_dev_t *dev, uint32_t data, uint64_t addr, uint32_t total_len)
 {
-    uint32_t len = total_len;
-    size_t write_len = dev->erase_size;
-    int ret;
-	uint32_t i;
-	generic_arch_t *arch = get_arch_instance("");
+    uint8_t *dst = nand_store_prepare(&dev->store, addr, total_len);
+    uint32_t i, value;
+    generic_arch_t *arch = get_arch_instance("");
 //    NAND_UPDATE_WRITE_THRESHOLD(total_len);
 
-    do_lseek(dev->fd, addr, SEEK_SET);
-    while(len > 0) {
-        if(len < write_len)
-            write_len = len;
-    	for(i = 0; i < write_len; i++){
-		arch->mmu_read(8,(data + i),&(dev->data[i]));
-	}
-        ret = do_write(dev->fd, dev->data, write_len);
-        if(ret < write_len) {
-            fprintf(stderr,"nand_dev_write_file, write failed: %s\n", strerror(errno));
-            break;
-        }
-        data += write_len;
-        len -= write_len;
+    for(i = 0; i < total_len; i++){
+        arch->mmu_read(8, data + i, &value);
+        dst[i] = value;
     }
-    return total_len - len;
+    return total_len;
 }
 
 static uint32_t nand_dev_erase_file(nand_dev_t *dev, uint64_t addr, uint32_t total_len)
 {
-    uint32_t len = total_len;
-    size_t write_len = dev->erase_size;
-    int ret;
-
-    do_lseek(dev->fd, addr, SEEK_SET);
-    memset(dev->data, 0xff, dev->erase_size);
-    while(len > 0) {
-        if(len < write_len)
-            write_len = len;
-        ret = do_write(dev->fd, dev->data, write_len);
-        if(ret < write_len) {
-            fprintf(stderr, "nand_dev_write_file, write failed: %s\n", strerror(errno));
-            break;
-        }
-        len -= write_len;
-    }
-    return total_len - len;
+    nand_store_erase(&dev->store, addr, total_len);
+    return total_len;
 }
 static uint32_t nand_dev_do_cmd(nand_dev_controller_t *s, uint32_t cmd)
 {
@@ -281,7 +206,7 @@ static uint32_t nand_dev_do_cmd(nand_dev_controller_t *s, uint32_t cmd)
             return 0;
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
-        if(dev->fd >= 0)
+        if(dev->store.data != NULL)
             return nand_dev_read_file(dev, s->data, addr, size);
     case NAND_CMD_WRITE:
         if(dev->flags & NAND_DEV_FLAG_READ_ONLY)
@@ -290,7 +215,7 @@ static uint32_t nand_dev_do_cmd(nand_dev_controller_t *s, uint32_t cmd)
             return 0;
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
-        if(dev->fd >= 0)
+        if(dev->store.data != NULL)
             return nand_dev_write_file(dev, s->data, addr, size);
         return size;
     case NAND_CMD_ERASE:
@@ -300,9 +225,8 @@ static uint32_t nand_dev_do_cmd(nand_dev_controller_t *s, uint32_t cmd)
             return 0;
         if(size > dev->max_size - addr)
             size = dev->max_size - addr;
-        if(dev->fd >= 0)
+        if(dev->store.data != NULL)
             return nand_dev_erase_file(dev, addr, size);
-        memset(&dev->data[addr], 0xff, size);
         return size;
     case NAND_CMD_BLOCK_BAD_GET: // no bad block support
         return 0;
@@ -368,11 +292,10 @@ void nand_add_dev(const char *arg)
     size_t devname_len = 0;
     char *initfilename = NULL;
     char *rwfilename = NULL;
-    int initfd = -1;
     int rwfd = -1;
     int read_only = 0;
     int pad;
-    ssize_t read_size;
+    struct stat st;
     //uint32_t page_size = 2048;
 #if 0
     uint32_t page_size = 512;
@@ -487,34 +410,14 @@ void nand_add_dev(const char *arg)
             dprint( "mapping '%.*s' NAND image to %s", devname_len, devname, rwfilename);
     }
 
-#ifndef O_BINARY
-#define O_BINARY 0
-    if(rwfilename) {
-        rwfd = open(rwfilename, O_BINARY | (read_only ? O_RDONLY : O_RDWR));
-        if(rwfd < 0) {
-            XLOG("could not open file %s, %s\n", rwfilename, strerror(errno));
-            exit(1);
-        }
-        /* this could be a writable temporary file. use atexit_close_fd to ensure
-         * that it is properly cleaned up at exit on Win32
-         */
-        if (!read_only)
-            atexit_close_fd(rwfd);
-    }
-
     if(initfilename) {
-        initfd = open(initfilename, O_BINARY | O_RDONLY);
-        if(initfd < 0) {
+        if(stat(initfilename, &st) < 0) {
             XLOG("could not open file %s, %s\n", initfilename, strerror(errno));
             exit(1);
         }
-        if(dev_size == 0) {
-            dev_size = do_lseek(initfd, 0, SEEK_END);
-            do_lseek(initfd, 0, SEEK_SET);
-        }
+        if(dev_size == 0)
+            dev_size = st.st_size;
     }
-#undef O_BINARY
-#endif
 
     new_devs = realloc(nand_devs, sizeof(nand_devs[0]) * (nand_dev_count + 1));
     if(new_devs == NULL)
@@ -535,26 +438,28 @@ void nand_add_dev(const char *arg)
     dev->initfile = initfilename; 
     dev->rwfile = rwfilename; 
     dev->max_size = dev_size;
-    dev->data = malloc(dev->erase_size);
-    if(dev->data == NULL)
-        goto out_of_memory;
     dev->flags = read_only ? NAND_DEV_FLAG_READ_ONLY : 0;
-
-    if (initfd >= 0) {
-        do {
-            read_size = do_read(initfd, dev->data, dev->erase_size);
-            if(read_size < 0) {
-                XLOG("could not read file %s, %s\n", initfilename, strerror(errno));
-                exit(1);
-            }
-            if(do_write(rwfd, dev->data, read_size) != read_size) {
-                XLOG("could not write file %s, %s\n", rwfilename, strerror(errno));
-                exit(1);
-            }
-        } while(read_size == dev->erase_size);
-        close(initfd);
+    memset(&dev->store, 0, sizeof(dev->store));
+
+    /* the init file is the base of an overlay that starts empty, as the
+     * copy of the init file did, a read only device keeps its writes in memory
+     */
+    if(initfilename && !read_only) {
+        rwfd = open(rwfilename, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+        if(rwfd >= 0)
+            close(rwfd);
+    }
+    if(dev_size != 0 &&
+       nand_store_open(&dev->store, read_only ? NULL : rwfilename,
+                       initfilename ? initfilename : (read_only ? rwfilename : NULL), dev_size) != 0) {
+        XLOG("could not open file %s, %s\n", rwfilename, strerror(errno));
+        exit(1);
     }
-    dev->fd = rwfd;
+    /* this could be a writable temporary file. use atexit_close_fd to ensure
+     * that it is properly cleaned up at exit on Win32
+     */
+    if (dev->store.fd >= 0)
+        atexit_close_fd(dev->store.fd);
 
     nand_dev_count++;
 
@@ -608,34 +513,15 @@ static void nand_finalize_instance(conf_object_t *obj){
 	nand_dev_controller_t* s = obj->obj;
 	nand_dev_t *dev  = &s->nand_dev[s->dev];
 	dev->devname_len = strlen(dev->devname);
-	uint32_t dev_siz;
-	int initfd;
-	int rwfd;
-	int read_size;
-#ifndef O_BINARY
-#define O_BINARY 0
+	struct stat st;
 	if(dev->initfile){
-		initfd  = open(dev->initfile,O_BINARY | O_RDONLY);
-		if(initfd < 0){
+		if(stat(dev->initfile, &st) < 0)
 			fprintf(stderr,"could not open file %s in %s\n",dev->initfile,__FUNCTION__);
-			//skyeye_exit(-10);
-		}
-		if(s->dev_size == 0){
-			s->dev_size = do_lseek(initfd,0,SEEK_END);
-			do_lseek(initfd,0,SEEK_SET);
-		}
+		else if(s->dev_size == 0)
+			s->dev_size = st.st_size;
 	}else {
 		fprintf(stderr,"you need to tell initfile\n");
-	}	
-	if(dev->rwfile){
-		rwfd = open(dev->rwfile,O_BINARY | ((dev->read_only) ? O_RDONLY : O_RDWR ));
-		if(rwfd < 0) {
-			fprintf(stderr,"can not open rwfile %s\n",dev->rwfile);
-		
-		}
 	}
-#undef O_BINARY
-#endif
 	uint32_t page_size = dev->page_size;
 	if(!page_size){
 		page_size = 512;
@@ -652,24 +538,10 @@ static void nand_finalize_instance(conf_object_t *obj){
 		s->dev_size += (dev->erase_size - pad);
 	}
 	dev->max_size = s->dev_size;
-	dev->data = skyeye_mm(dev->erase_size);
-	if(!dev->data){
-		fprintf(stderr,"mm alloc failed\n");
-	} 
 	dev->flags = dev->read_only ? NAND_DEV_FLAG_READ_ONLY : 0;
-	if(initfd >= 0){
-		do {
-			read_size  = do_read(initfd,dev->data,dev->erase_size);
-			if(read_size < 0){
-				fprintf(stderr,"could not read file %s\n",dev->initfile);
-			}
-			if(do_write(rwfd,dev->data,read_size) != read_size){
-				fprintf(stderr,"could not write file %s\n",dev->rwfile);
-			}
-		}while(read_size == dev->erase_size);
-		close(initfd);
-	}
-	dev->fd  = rwfd;
+	if(nand_store_open(&dev->store, dev->read_only ? NULL : dev->rwfile,
+			   dev->initfile, dev->max_size) != 0)
+		fprintf(stderr,"can not open rwfile %s\n",dev->rwfile);
 
 }
 
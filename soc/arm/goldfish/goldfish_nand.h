@@ -21,11 +21,11 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "skyeye_types.h"
 #include "memory_space.h"
+#include "skyeye_nand_store.h"
 
 typedef struct {
 	char* devname;
 	size_t devname_len;
-	uint8_t* data;
 	uint32_t flags;
 	uint32_t page_size;
 	uint32_t extra_size;
@@ -34,7 +34,7 @@ typedef struct {
 	uint32_t read_only;
 	char* rwfile;
 	char* initfile;
-	int fd;
+	nand_store_t store;
 }nand_dev_t;
 
 typedef struct {
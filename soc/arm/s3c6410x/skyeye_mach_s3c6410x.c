@@ -891,15 +891,32 @@ s3c6410x_io_read_word (void *arch_instance, uint32 addr)
 	return data;
 }
 
+/* the devices on the address space see the width of a narrow access */
+static exception_t
+s3c6410x_space_access (uint32 addr, uint32 *data, size_t count, int write)
+{
+	conf_object_t* conf_obj = get_conf_obj("s3c6410_mach_space");
+	addr_space_t* phys_mem = (addr_space_t*)conf_obj->obj;
+	if (write)
+		return phys_mem->memory_space->write(conf_obj, addr, data, count);
+	return phys_mem->memory_space->read(conf_obj, addr, data, count);
+}
+
 static uint32
 s3c6410x_io_read_byte (void *arch_instance, uint32 addr)
 {
+	uint32 data = 0;
+	if (s3c6410x_space_access (addr, &data, 1, 0) == No_exp)
+		return data;
 	return s3c6410x_io_read_word (arch_instance, addr);
 }
 
 static uint32
 s3c6410x_io_read_halfword (void *arch_instance, uint32 addr)
 {
+	uint32 data = 0;
+	if (s3c6410x_space_access (addr, &data, 2, 0) == No_exp)
+		return data;
 	return s3c6410x_io_read_word (arch_instance, addr);
 }
 
@@ -1097,6 +1114,8 @@ s3c6410x_io_write_word (generic_arch_t *state, uint32 addr, uint32 data)
 static void
 s3c6410x_io_write_byte (generic_arch_t *state, uint32 addr, uint32 data)
 {
+	if (s3c6410x_space_access (addr, &data, 1, 1) == No_exp)
+		return;
 	SKYEYE_DBG ("SKYEYE: s3c6410x_io_write_byte error\n");
 	s3c6410x_io_write_word (state, addr, data);
 }
@@ -1104,6 +1123,8 @@ s3c6410x_io_write_byte (generic_arch_t *state, uint32 addr, uint32 data)
 static void
 s3c6410x_io_write_halfword (generic_arch_t *state, uint32 addr, uint32 data)
 {
+	if (s3c6410x_space_access (addr, &data, 2, 1) == No_exp)
+		return;
 	SKYEYE_DBG ("SKYEYE: s3c6410x_io_write_halfword error\n");
 	s3c6410x_io_write_word (state, addr, data);
 }
@@ -1132,10 +1153,14 @@ static int vic_lower_signal(conf_object_t* target, int line){
 	int irq_no;
 	if(line < 32){	/* line < 32 vic0 */
 		irq_no = line;
-		io.vic0irqstatus &= ~irq_no;
+		io.vic0rawintr &= ~(1 << irq_no);
+		io.vic0irqstatus &= ~(1 << irq_no);
+		io.vic0fiqstatus &= ~(1 << irq_no);
 	}else{		/* line >= 32 vic1 */
 		irq_no = line - 32;
-		io.vic1irqstatus &= ~irq_no;
+		io.vic1rawintr &= ~(1 << irq_no);
+		io.vic1irqstatus &= ~(1 << irq_no);
+		io.vic1fiqstatus &= ~(1 << irq_no);
 	}
 
 	s3c6410x_update_int(NULL);
@@ -1246,6 +1271,22 @@ s3c6410x_mach_init (void *arch_instance, machine_config_t *this_mach)
 		skyeye_log(Error_log, __FUNCTION__, "Can not register io memory for ac97\n");
 	}
 
+	conf_object_t* sdhci = pre_conf_obj("s3c6410_sdhci_0", "s3c6410_sdhci");
+	if(sdhci != NULL){
+		memory_space_intf* sdhci_io_memory = (memory_space_intf*)SKY_get_interface(sdhci, MEMORY_SPACE_INTF_NAME);
+		ret = add_map(phys_mem, 0x7C200000, 0x1000, 0x0, sdhci_io_memory, 1, 1);
+		if(ret != No_exp){
+			skyeye_log(Error_log, __FUNCTION__, "Can not register io memory for sdhci\n");
+		}
+		/* HSMMC0 interrupt goes to the vic */
+		general_signal_intf* sdhci_intr_signal = (general_signal_intf*)SKY_get_interface(sdhci, GENERAL_SIGNAL_INTF_NAME);
+		if(sdhci_intr_signal != NULL){
+			sdhci_intr_signal->conf_obj = vic_signal->conf_obj;
+			sdhci_intr_signal->raise_signal = vic_signal->raise_signal;
+			sdhci_intr_signal->lower_signal = vic_signal->lower_signal;
+		}
+	}
+
 	/* Register lcd io memory to the whole address space */
 	conf_object_t* lcd = pre_conf_obj("s3c6410_lcd_0", "s3c6410_lcd");
 	if(lcd != NULL){
@@ -23,80 +23,67 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "skyeye_arch.h"
 #include "skyeye_callback.h"
 #include "skyeye_command.h"
 #include "skyeye_bus.h"
+#include "skyeye_bus_trace.h"
 
 /* flag to enable log function. */
 static int enable_log_flag;
 
-/* the log file for record. */
-static const char* log_filename = "./bus.log";
-
-/* fd of log_filename */
-static FILE* log_fd;
-
-const char* read_str = "read";
-const char* write_str = "write";
-const char* before_str = "before";
-const char* after_str = "after";
-
+/* the default trace file, decoded to text by bus_log_decode */
+static const char* log_filename = "./bus.trace";
 
 /* callback function for bus access. Will record pc here. */
 static void log_bus_callback(generic_arch_t* arch_instance){
-	unsigned int current_pc = arch_instance->get_pc();
 	if(enable_log_flag){
-		bus_recorder_t* recorder_buffer;
-		recorder_buffer = get_last_bus_access();
-		char* access;
-		char* when;
-		if(recorder_buffer->rw == SIM_access_read)
-			access = read_str;
-		else
-			access = write_str;
-		if(recorder_buffer->when == Before_act)
-			when = before_str;
-		else
-			when = after_str;
-
+		unsigned int current_pc = arch_instance->get_pc();
 		if(!strncmp("arm", arch_instance->arch_name, strlen("arm"))){
 			current_pc -=8;
 		}
-		fprintf(log_fd, "Bus %s %s access @0x%x, size=%d, addr=0x%x, value=0x%x\n", 
-		when, access, current_pc, recorder_buffer->size, recorder_buffer->addr, recorder_buffer->value);
+		bus_trace_record(current_pc, arch_instance->get_step());
 	}
 }
 
-/* enable log functionality */
+/* stop the trace, the bus callbacks are removed so the bus does not pay for them */
+static void stop_log_bus(){
+	if(!enable_log_flag)
+		return;
+	enable_log_flag = 0;
+	unregister_callback(log_bus_callback, Bus_read_callback);
+	unregister_callback(log_bus_callback, Bus_write_callback);
+	bus_trace_stop();
+}
+
+/* enable log functionality, "log-bus [file]" to start and "log-bus off" to stop */
 void com_log_bus(char *arg) {
-	enable_log_flag = 1;
-	/* open file for record pc */
-	log_fd = fopen(log_filename, "w");	
-	if(log_fd == NULL){
-		fprintf(stderr, "Can not open the file %s for log-bus module.\n", log_filename);
+	stop_log_bus();
+	if(arg != NULL && !strcmp(arg, "off"))
+		return;
+	if(bus_trace_start((arg == NULL || *arg == '\0') ? log_filename : arg) != 0){
+		fprintf(stderr, "Can not start the bus trace for log-bus module.\n");
 		return;
 	}
-
+	/* register callback function */
+	register_callback(log_bus_callback, Bus_read_callback);
+	register_callback(log_bus_callback, Bus_write_callback);
+	enable_log_flag = 1;
 }
 
 /* some initialization for log functionality */
 exception_t bus_log_init(){
 	exception_t exp;
-	/* register callback function */
-	register_callback(log_bus_callback, Bus_read_callback);
-	register_callback(log_bus_callback, Bus_write_callback);
 	/* add corresponding command */
-	add_command("log-bus", com_log_bus, "record every bus access to log file.\n");
+	add_command("log-bus", com_log_bus, "record every bus access to a binary trace file, \"log-bus off\" to stop.\n");
 
 	return No_exp;
 }
 
 /* destruction function for log functionality */
 exception_t bus_log_fini(){
-	if(log_fd != NULL){
-		fclose(log_fd);
-	}
+	stop_log_bus();
 
 	return No_exp;
 }
@@ -0,0 +1,92 @@
+/*
+        bus_log_decode.c - a tool that converts the binary bus trace of
+        log-bus to text output.
+
+        Copyright (C) 2003-2007 Skyeye Develop Group
+        for help please send mail to <skyeye-developer@lists.sf.linuxforum.net>
+
+        This program is free software; you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation; either version 2 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program; if not, write to the Free Software
+        Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "skyeye_bus_trace.h"
+
+#define DECODE_BUF_SIZE	(64 * 1024)
+
+int main(int argc, char** argv){
+	static uint8_t buf[DECODE_BUF_SIZE];
+	bus_trace_codec_t codec;
+	bus_trace_header_t header;
+	bus_trace_rec_t rec;
+	FILE *in, *out = stdout;
+	size_t len = 0, n;
+	int verbose = 0;
+	int argi = 1;
+
+	if(argc > 1 && !strcmp(argv[argi], "-v")){
+		verbose = 1;
+		argi++;
+	}
+	if(argc - argi < 1 || argc - argi > 2){
+		printf("Purpose: convert the bus trace of log-bus to the text output.\n");
+		printf("Usage: %s [-v] bus.trace [output]\n", argv[0]);
+		printf("       -v print the core and the instruction count of every access.\n");
+		return 1;
+	}
+	in = fopen(argv[argi], "rb");
+	if(in == NULL){
+		fprintf(stderr, "Can not open %s\n", argv[argi]);
+		return 1;
+	}
+	if(fread(&header, sizeof(header), 1, in) != 1 ||
+	   memcmp(header.magic, BUS_TRACE_MAGIC, sizeof(header.magic)) ||
+	   header.version != BUS_TRACE_VERSION){
+		fprintf(stderr, "%s is not a bus trace of version %d\n", argv[argi], BUS_TRACE_VERSION);
+		return 1;
+	}
+	if(argc - argi == 2 && (out = fopen(argv[argi + 1], "w")) == NULL){
+		fprintf(stderr, "Can not open %s\n", argv[argi + 1]);
+		return 1;
+	}
+
+	memset(&codec, 0, sizeof(codec));
+	while((n = fread(buf + len, 1, sizeof(buf) - len, in)) > 0 || len > 0){
+		uint8_t *p = buf;
+		uint8_t *end = buf + len + n;
+		int used;
+		while((used = bus_trace_decode(&codec, p, end, &rec)) > 0){
+			p += used;
+			if(verbose)
+				fprintf(out, "[core %d icount %llu] ", rec.core, (unsigned long long)rec.icount);
+			fprintf(out, "Bus %s %s access @0x%x, size=%d, addr=0x%x, value=0x%x\n",
+				rec.after ? "after" : "before", rec.write ? "write" : "read",
+				rec.pc, rec.size, rec.addr, rec.value);
+		}
+		/* keep the truncated record for the next read */
+		len = end - p;
+		memmove(buf, p, len);
+		if(n == 0){
+			if(len)
+				fprintf(stderr, "the trace ends with a truncated record\n");
+			break;
+		}
+	}
+	fclose(in);
+	if(out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -23,6 +23,7 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -32,35 +33,42 @@
 #include "skyeye_arch.h"
 #include "skyeye_command.h"
 #include "skyeye_callback.h"
+#include "skyeye_symbol.h"
+#include "skyeye_pref.h"
+#include "skyeye_mm.h"
 #include "portable/portable.h"
+#include "code_cov.h"
 #define COV_ON 1
 #define COV_OFF 0
 #define COV_START 2
 
-static int
-do_code_cov_option (skyeye_option_t * this_option, int num_params,
-		const char *params[]);
+/* the byte and the shift of the four bits recording a word */
+#define PROF_BYTE(addr) (((addr) - prof_start) >> 3)
+#define PROF_SHIFT(addr) ((((addr) - prof_start) >> 2 & 1) << 2)
+
 /**
  *  pointer of memory allocated for code coverage
  */
 static uint8_t * prof_mem;
-static size_t prof_start;
-static size_t prof_end;
+static size_t prof_mem_size;
+static generic_address_t prof_start;
+static generic_address_t prof_end;
 
 static char cov_state = COV_START;	//0: off, 1: on, 2: off(never on before) 
-static char cov_filename[30];
-void cov_init(size_t start_addr, size_t end_addr){
+static char cov_filename[MAX_PARAM_NAME];
+void cov_init(generic_address_t start_addr, generic_address_t end_addr){
 
 	size_t prof_size = end_addr - start_addr;
 
 	/* we use four bits to record the WRX action for a 32 bit word */
-	size_t mem_alloc = (prof_size / 4) / 2;
-	prof_mem = malloc(prof_size);
+	size_t mem_alloc = ((prof_size + 3) / 4 + 1) / 2;
+	prof_mem = malloc(mem_alloc);
 	if(!prof_mem)
 		fprintf(stderr, "Can not alloc memory for code coverage, profiling is disabled.\n");
 	else{
 		printf("Begin do code coverage between 0x%x and 0x%x .\n", prof_start, prof_end);
-		bzero(prof_mem, prof_size);
+		bzero(prof_mem, mem_alloc);
+		prof_mem_size = mem_alloc;
 	}
 //	register_option("code_coverage", do_code_cov_option, "");
 }
@@ -69,19 +77,47 @@ void cov_init(size_t start_addr, size_t end_addr){
  *
  */
 	void cov_prof(int flags,generic_address_t addr){
-		if(addr < prof_start || addr >= prof_end)
+		if(prof_mem == NULL || addr < prof_start || addr >= prof_end)
 			return;	
-		int offset = (addr - prof_start) / 8;
-		unsigned int * prof_addr  =(unsigned int *)&prof_mem[offset] ;
-		*prof_addr |= flags << ((addr - prof_start) % 8);
-		//printf("addr=0x%x, flags=0x%x, offset=0x%x,(addr - prof_start)%8=0x%x\n", addr, flags, offset, (addr - prof_start)%8);
+		prof_mem[PROF_BYTE(addr)] |= flags << PROF_SHIFT(addr);
 		return;
 	}
 
+/**
+* @brief mark the words of an executed basic block [start, end)
+*
+* @param start the address of the first instruction
+* @param end the address following the last instruction
+*/
+void cov_block(generic_address_t start, generic_address_t end){
+	generic_address_t addr;
+	if(prof_mem == NULL)
+		return;
+	if(start < prof_start)
+		start = prof_start;
+	if(end > prof_end)
+		end = prof_end;
+	if(start >= end)
+		return;
+	start &= ~3;
+	/* the block has been entered before */
+	if((prof_mem[PROF_BYTE(start)] >> PROF_SHIFT(start)) & EXEC_FLAG &
+	   (prof_mem[PROF_BYTE(end - 1)] >> PROF_SHIFT(end - 1)))
+		return;
+	for(addr = start; addr < end && (addr & 7); addr += 4)
+		cov_prof(EXEC_FLAG, addr);
+	/* both words of a byte */
+	for(; addr + 8 <= end; addr += 8)
+		prof_mem[PROF_BYTE(addr)] |= EXEC_FLAG | (EXEC_FLAG << 4);
+	for(; addr < end; addr += 4)
+		cov_prof(EXEC_FLAG, addr);
+}
+
 /**
  * deinitialization function
  */
 void cov_fini(char * filename){
+	prof_header_t header;
 	if (prof_mem == NULL)
 		return;
 	FILE * fp = fopen(filename, "w+");
@@ -89,9 +125,15 @@ void cov_fini(char * filename){
 		fprintf(stderr, "Warning: can not open file %s for code coverage\n", filename);
 		return;
 	}
-	int count = fwrite(prof_mem, (prof_end - prof_start), 1, fp);
-	if(count < (prof_end - prof_start))
-		printf("Write %d bytes for code coverage .\n", (prof_end - prof_start));	
+	memset(&header, 0, sizeof(header));
+	header.ver = PROF_HEADER_VER;
+	header.header_length = sizeof(header);
+	header.prof_start = prof_start;
+	header.prof_end = prof_end;
+	strncpy(header.desc, "skyeye code coverage", MAX_DESC_STR - 1);
+	if(fwrite(&header, sizeof(header), 1, fp) != 1 ||
+	   fwrite(prof_mem, prof_mem_size, 1, fp) != 1)
+		fprintf(stderr, "Warning: can not write %lu bytes for code coverage.\n", (unsigned long)prof_mem_size);
 	fclose(fp);
 	if(prof_mem){
 		free(prof_mem);
@@ -99,6 +141,57 @@ void cov_fini(char * filename){
 	}
 	return;
 }
+
+static int cov_word_executed(generic_address_t addr){
+	return (prof_mem[PROF_BYTE(addr)] >> PROF_SHIFT(addr)) & EXEC_FLAG;
+}
+
+/**
+* @brief write the coverage in the lcov tracefile format. There is no line
+* information in the symbol table, so the lines of the tracefile are the
+* words from prof_start: line n is the word at prof_start + (n - 1) * 4.
+* The functions come from the symbol table of the executable.
+*
+* @param filename the tracefile
+*
+* @return 0 on success
+*/
+static int cov_write_lcov(const char *filename){
+	func_symbol_t *syms;
+	generic_address_t addr, next;
+	int num, i, fn_hit = 0, fn_num = 0, line_hit = 0;
+	char *exec_file = get_exec_file();
+	FILE *fp = fopen(filename, "w");
+	if(fp == NULL)
+		return -1;
+
+	fprintf(fp, "TN:\nSF:%s\n", exec_file ? exec_file : "unknown");
+	num = get_func_symbols(&syms);
+	for(i = 0; i < num; i++){
+		if(syms[i].address < prof_start || syms[i].address >= prof_end)
+			continue;
+		next = (i + 1 < num && syms[i + 1].address < prof_end) ? syms[i + 1].address : prof_end;
+		int hit = 0;
+		for(addr = syms[i].address & ~3; addr < next && !hit; addr += 4)
+			hit = cov_word_executed(addr);
+		fprintf(fp, "FN:%u,%s\n", ((syms[i].address - prof_start) >> 2) + 1, syms[i].name);
+		fprintf(fp, "FNDA:%d,%s\n", hit, syms[i].name);
+		fn_num++;
+		fn_hit += hit;
+	}
+	if(syms)
+		skyeye_free(syms);
+	fprintf(fp, "FNF:%d\nFNH:%d\n", fn_num, fn_hit);
+	for(addr = prof_start; addr < prof_end; addr += 4){
+		int hit = cov_word_executed(addr);
+		fprintf(fp, "DA:%u,%d\n", ((addr - prof_start) >> 2) + 1, hit);
+		line_hit += hit;
+	}
+	fprintf(fp, "LF:%u\nLH:%d\nend_of_record\n", (prof_end - prof_start + 3) >> 2, line_hit);
+	fclose(fp);
+	return 0;
+}
+
 /**
  *parse the configuration file
  */
@@ -145,15 +238,25 @@ static void cov_writemem_callback(generic_arch_t* arch_instance)
 	if (cov_state == COV_ON)
 		cov_prof(2,arch_instance->get_pc());
 }
+static void cov_block_callback(generic_address_t start, generic_address_t end)
+{
+	if (cov_state == COV_ON)
+		cov_block(start, end);
+}
 
 void cov_state_on(char *arg)
 {
 
 	if (cov_state == COV_START) { //run this function first time
 		cov_init(prof_start, prof_end);
-		register_callback(cov_readmem_callback, Mem_read_callback);
-		register_callback(cov_writemem_callback, Mem_write_callback);
-		register_callback(cov_execmem_callback, Step_callback);
+		/* the block based engines report the entered blocks instead of steps */
+		if (is_block_callback_provided())
+			register_block_callback(cov_block_callback);
+		else {
+			register_callback(cov_readmem_callback, Mem_read_callback);
+			register_callback(cov_writemem_callback, Mem_write_callback);
+			register_callback(cov_execmem_callback, Step_callback);
+		}
 	}else
 		printf("code coverage state: on\n");
 
@@ -169,6 +272,21 @@ void cov_state_off(char *arg)
 	return;
 }
 
+void cov_lcov(char *arg)
+{
+	if (prof_mem == NULL) {
+		printf("code coverage is not started, run cov-on first.\n");
+		return;
+	}
+	if (arg == NULL || *arg == '\0') {
+		printf("Usage: cov-lcov tracefile\n");
+		return;
+	}
+	if (cov_write_lcov(arg) != 0)
+		printf("Can not write the lcov tracefile %s.\n", arg);
+	return;
+}
+
 void cov_state_show(char *arg)
 {
 	if (cov_state == COV_OFF || cov_state == COV_START)
@@ -184,11 +302,13 @@ int cov_module_init()
 	add_command("cov-on", cov_state_on, "turn on code coverage switch.\n");
 	add_command("cov-off", cov_state_off, "turn off code coverage switch.\n");
 	add_command("cov-state", cov_state_show, "show code coverage state.\n");
+	add_command("cov-lcov", cov_lcov, "write the code coverage as a lcov tracefile.\n");
 	return 0;
 }
 
 int cov_module_exit()
 {
+	register_block_callback(NULL);
 	cov_fini(cov_filename);
 	return 0;
 }
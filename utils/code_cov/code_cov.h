@@ -24,6 +24,7 @@
 
 #ifndef __CODE_COV_H__
 #define __CODE_COV_H__
+#include "skyeye_types.h"
 
 /*  Perform the code coverage if configured */
 /*  Code coverage   */
@@ -39,13 +40,31 @@
 #define WRITE_FLAG 0x2
 #define EXEC_FLAG 0x1
 
-void cov_init(int start_addr, int end_addr);
-void cov_prof(int flags, WORD addr);
+/*
+ * The data file is a prof_header_t followed by four bits for every 32 bit
+ * word of [prof_start, prof_end): the low nibble of a byte is for the word
+ * at the lower address, the high nibble for the next word.
+ */
+#define PROF_HEADER_VER 1
+#define MAX_DESC_STR 32
+typedef struct prof_header_s{
+        /* the version of header file */
+        int ver;
+        /* The length of header */
+        int header_length;
+        int prof_start;
+        int prof_end;
+        /* The description info for profiling file */
+        char desc[MAX_DESC_STR];
+}prof_header_t;
+
+void cov_init(generic_address_t start_addr, generic_address_t end_addr);
+void cov_prof(int flags, generic_address_t addr);
+void cov_block(generic_address_t start, generic_address_t end);
 void cov_fini(char * filename);
 //add
 
 
 int cov_module_init();
 
-	
 #endif
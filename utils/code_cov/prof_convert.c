@@ -24,17 +24,7 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
-#define MAX_DESC_STR 32
-typedef struct prof_header_s{
-        /* the version of header file */
-        int ver;
-        /* The length of header */
-        int header_length;
-        int prof_start;
-        int prof_end;
-        /* The description info for profiling file */
-        char desc[MAX_DESC_STR];
-}prof_header_t;
+#include "code_cov.h"
 
 /*
  * dump header of data file
@@ -0,0 +1,270 @@
+/*
+        net_bench.c - a host side peer of ethmod=socket that measures the
+        frame rate and the throughput of a simulated net device.
+
+        Copyright (C) 2003-2007 Skyeye Develop Group
+        for help please send mail to <skyeye-developer@lists.sf.linuxforum.net>
+
+        This program is free software; you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation; either version 2 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program; if not, write to the Free Software
+        Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * net_bench listens on a unix seqpacket socket, skyeye connects to it with
+ * "ethmod=socket, sock=<path>". After the guest answered an arp request,
+ * udp datagrams are sent to its echo port with a window of frames in
+ * flight, the echoed datagrams are counted and the rate is reported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#define BENCH_FRAME_MAX	1514
+#define ETH_HLEN	14
+#define IP_HLEN		20
+#define UDP_HLEN	8
+#define ECHO_PORT	7
+#define BENCH_PORT	5007
+
+static uint8_t host_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static uint8_t guest_mac[6];
+static uint8_t bcast_mac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+static uint32_t host_ip, guest_ip;
+
+static double now(void){
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void put16(uint8_t *p, int v){
+	p[0] = v >> 8;
+	p[1] = v;
+}
+
+static int get16(const uint8_t *p){
+	return (p[0] << 8) | p[1];
+}
+
+static uint16_t ip_sum(const uint8_t *p, int len){
+	uint32_t sum = 0;
+	int i;
+	for(i = 0; i < len; i += 2)
+		sum += get16(p + i);
+	while(sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return ~sum;
+}
+
+static void eth_header(uint8_t *f, const uint8_t *dst, int type){
+	memcpy(f, dst, 6);
+	memcpy(f + 6, host_mac, 6);
+	put16(f + 12, type);
+}
+
+static int send_arp(int fd, int op, const uint8_t *dst_mac, uint32_t dst_ip){
+	uint8_t f[60];
+	memset(f, 0, sizeof(f));
+	eth_header(f, op == 1 ? bcast_mac : dst_mac, 0x0806);
+	put16(f + 14, 1);
+	put16(f + 16, 0x0800);
+	f[18] = 6;
+	f[19] = 4;
+	put16(f + 20, op);
+	memcpy(f + 22, host_mac, 6);
+	memcpy(f + 28, &host_ip, 4);
+	if(op != 1)
+		memcpy(f + 32, dst_mac, 6);
+	memcpy(f + 38, &dst_ip, 4);
+	return send(fd, f, sizeof(f), 0);
+}
+
+static int send_udp(int fd, int size, uint32_t seq){
+	uint8_t f[BENCH_FRAME_MAX];
+	uint8_t *ip = f + ETH_HLEN, *udp = ip + IP_HLEN;
+	int payload = size - ETH_HLEN - IP_HLEN - UDP_HLEN;
+
+	memset(f, 0, size);
+	eth_header(f, guest_mac, 0x0800);
+	ip[0] = 0x45;
+	put16(ip + 2, size - ETH_HLEN);
+	put16(ip + 4, seq);
+	ip[8] = 64;
+	ip[9] = 17;
+	memcpy(ip + 12, &host_ip, 4);
+	memcpy(ip + 16, &guest_ip, 4);
+	put16(ip + 10, ip_sum(ip, IP_HLEN));
+	put16(udp, BENCH_PORT);
+	put16(udp + 2, ECHO_PORT);
+	put16(udp + 4, UDP_HLEN + payload);
+	memcpy(udp + UDP_HLEN, &seq, payload < 4 ? payload : 4);
+	return send(fd, f, size, 0);
+}
+
+/*
+ * Handle one frame from the guest, answer its arp requests.
+ * Returns 1 for an echoed datagram, 2 for the arp reply of the guest.
+ */
+static int recv_frame(int fd){
+	uint8_t f[BENCH_FRAME_MAX + 4];
+	uint32_t ip;
+	int len;
+
+	len = recv(fd, f, sizeof(f), 0);
+	if(len <= 0)
+		return -1;
+	if(len < ETH_HLEN + 28)
+		return 0;
+	if(get16(f + 12) == 0x0806){
+		memcpy(&ip, f + 38, 4);
+		if(get16(f + 20) == 1 && ip == host_ip){
+			memcpy(&ip, f + 28, 4);
+			send_arp(fd, 2, f + 22, ip);
+			return 0;
+		}
+		memcpy(&ip, f + 28, 4);
+		if(get16(f + 20) == 2 && ip == guest_ip){
+			memcpy(guest_mac, f + 22, 6);
+			return 2;
+		}
+		return 0;
+	}
+	if(get16(f + 12) == 0x0800 && f[ETH_HLEN + 9] == 17 &&
+	   get16(f + ETH_HLEN + IP_HLEN) == ECHO_PORT)
+		return 1;
+	return 0;
+}
+
+static int wait_frame(int fd, int ms){
+	struct pollfd p;
+	p.fd = fd;
+	p.events = POLLIN;
+	return poll(&p, 1, ms);
+}
+
+static void usage(const char *name){
+	printf("Purpose: measure the net device of a guest that runs an udp echo server.\n");
+	printf("Usage: %s [-n frames] [-s frame size] [-w window] socket guest_ip [host_ip]\n", name);
+	printf("       the config of skyeye has \"ethmod=socket, sock=<socket>\",\n");
+	printf("       host_ip is 10.0.0.1 by default.\n");
+}
+
+int main(int argc, char** argv){
+	struct sockaddr_un addr;
+	const char *path;
+	int frames = 10000, size = BENCH_FRAME_MAX, window = 32;
+	int lfd, fd, c, r;
+	int sent = 0, echoed = 0, lost = 0, inflight = 0;
+	double start, elapsed;
+
+	while((c = getopt(argc, argv, "n:s:w:")) != -1){
+		switch(c){
+		case 'n': frames = atoi(optarg); break;
+		case 's': size = atoi(optarg); break;
+		case 'w': window = atoi(optarg); break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+	if(argc - optind < 2 || argc - optind > 3){
+		usage(argv[0]);
+		return 1;
+	}
+	if(size < ETH_HLEN + IP_HLEN + UDP_HLEN + 4)
+		size = ETH_HLEN + IP_HLEN + UDP_HLEN + 4;
+	if(size > BENCH_FRAME_MAX)
+		size = BENCH_FRAME_MAX;
+	if(window < 1)
+		window = 1;
+	path = argv[optind];
+	if(inet_pton(AF_INET, argv[optind + 1], &guest_ip) != 1 ||
+	   inet_pton(AF_INET, argc - optind > 2 ? argv[optind + 2] : "10.0.0.1", &host_ip) != 1){
+		fprintf(stderr, "Bad ip address\n");
+		return 1;
+	}
+
+	lfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	if(lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 1) < 0){
+		fprintf(stderr, "Can not listen on %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	printf("Waiting for skyeye on %s\n", path);
+	if((fd = accept(lfd, NULL, NULL)) < 0){
+		perror("accept");
+		return 1;
+	}
+
+	/* find the guest */
+	printf("Resolving %s\n", argv[optind + 1]);
+	for(r = 0; r != 2; ){
+		send_arp(fd, 1, NULL, guest_ip);
+		start = now();
+		while(r != 2 && now() - start < 1.0){
+			if(wait_frame(fd, 100) > 0 && (r = recv_frame(fd)) < 0){
+				fprintf(stderr, "skyeye closed the connection\n");
+				return 1;
+			}
+		}
+	}
+
+	start = now();
+	while(echoed + lost < frames){
+		while(sent < frames && inflight < window){
+			if(send_udp(fd, size, sent) < 0){
+				perror("send");
+				return 1;
+			}
+			sent++;
+			inflight++;
+		}
+		if(wait_frame(fd, 1000) <= 0){
+			/* the frames in flight are lost */
+			lost += inflight;
+			inflight = 0;
+			continue;
+		}
+		r = recv_frame(fd);
+		if(r < 0){
+			fprintf(stderr, "skyeye closed the connection\n");
+			break;
+		}
+		if(r == 1 && inflight > 0){
+			echoed++;
+			inflight--;
+		}
+	}
+	elapsed = now() - start;
+
+	printf("%d frames of %d bytes sent, %d echoed, %d lost in %.3f s\n",
+	       sent, size, echoed, lost, elapsed);
+	if(elapsed > 0)
+		printf("%.0f frames/s, %.2f Mbit/s each way\n", echoed / elapsed,
+		       echoed * (double)size * 8 / elapsed / 1e6);
+	close(fd);
+	close(lfd);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,440 @@
+/*
+        sample_prof.c - a sampling profiler of the guest
+        Copyright (C) 2003-2007 Skyeye Develop Group
+        for help please send mail to <skyeye-developer@lists.sf.linuxforum.net>
+
+        This program is free software; you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation; either version 2 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program; if not, write to the Free Software
+        Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+/*
+ * A periodic event of the thread scheduler reads the pc, the mode and the
+ * asid of every core, so the guest runs at full speed without any callback
+ * per instruction. In the icount mode the period is guest time. The
+ * samples are counted per (pc, mode, asid) and resolved against the symbol
+ * table only when the profile is written, either as folded stacks for the
+ * flame graph tools or as a legacy binary cpu profile of pprof.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "skyeye_types.h"
+#include "skyeye_arch.h"
+#include "skyeye_options.h"
+#include "skyeye_config.h"
+#include "skyeye_command.h"
+#include "skyeye_sched.h"
+#include "skyeye_symbol.h"
+#include "skyeye_pref.h"
+#include "skyeye_mm.h"
+#include "skyeye_log.h"
+
+#define SAMPLE_DEFAULT_RATE	1000
+#define SAMPLE_MAX_CORES	64
+#define SAMPLE_INIT_BITS	12
+#define SAMPLE_UNKNOWN_PAGE	0xfffff000
+
+typedef enum {
+	Folded_format,
+	Pprof_format
+} prof_format_t;
+
+typedef struct sample_entry {
+	generic_address_t pc;
+	uint32_t mode;
+	uint32_t asid;
+	const char *mode_name;
+	uint32_t count;
+} sample_entry_t;
+
+/* the samples counted per (pc, mode, asid) in an open addressing table */
+static sample_entry_t *sample_table;
+static uint32_t sample_mask;
+static uint32_t sample_num;
+static uint64_t sample_total;
+static pthread_mutex_t sample_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int sample_rate = SAMPLE_DEFAULT_RATE;
+static prof_format_t sample_format = Folded_format;
+static char sample_filename[MAX_PARAM_NAME];
+static int sample_event_id = -1;
+
+static inline uint32_t sample_hash(generic_address_t pc, uint32_t mode, uint32_t asid)
+{
+	return ((uint32_t)pc * 0x9e3779b1) ^ (mode << 24) ^ (asid << 16);
+}
+
+static sample_entry_t *sample_find(sample_entry_t *table, uint32_t mask, generic_address_t pc, uint32_t mode, uint32_t asid)
+{
+	uint32_t i = sample_hash(pc, mode, asid) & mask;
+	while (table[i].count != 0 &&
+	       (table[i].pc != pc || table[i].mode != mode || table[i].asid != asid))
+		i = (i + 1) & mask;
+	return &table[i];
+}
+
+static int sample_table_grow(void)
+{
+	uint32_t size = sample_table ? (sample_mask + 1) * 2 : 1 << SAMPLE_INIT_BITS;
+	sample_entry_t *table = skyeye_mm_zero(size * sizeof(sample_entry_t));
+	uint32_t i;
+
+	if (table == NULL)
+		return -1;
+	if (sample_table) {
+		for (i = 0; i <= sample_mask; i++)
+			if (sample_table[i].count)
+				*sample_find(table, size - 1, sample_table[i].pc,
+					sample_table[i].mode, sample_table[i].asid) = sample_table[i];
+		skyeye_free(sample_table);
+	}
+	sample_table = table;
+	sample_mask = size - 1;
+	return 0;
+}
+
+/**
+* @brief count a sample
+*
+* @param sample the state of a core
+*/
+static void sample_add(const guest_sample_t *sample)
+{
+	sample_entry_t *e;
+
+	/* keep the load factor under 1/2 */
+	if ((sample_table == NULL || (sample_num + 1) * 2 > sample_mask + 1) &&
+	    sample_table_grow() != 0)
+		return;
+	e = sample_find(sample_table, sample_mask, sample->pc, sample->mode, sample->asid);
+	if (e->count == 0) {
+		e->pc = sample->pc;
+		e->mode = sample->mode;
+		e->asid = sample->asid;
+		e->mode_name = sample->mode_name;
+		sample_num++;
+	}
+	e->count++;
+	sample_total++;
+}
+
+/**
+* @brief the periodic event taking a sample of every core
+*
+* @param arg the arch instance
+*/
+static void sample_cores(void *arg)
+{
+	generic_arch_t *arch_instance = arg;
+	guest_sample_t sample;
+	int id;
+
+	pthread_mutex_lock(&sample_lock);
+	for (id = 0; id < SAMPLE_MAX_CORES; id++) {
+		memset(&sample, 0, sizeof(sample));
+		if (arch_instance->get_sample(id, &sample) != 0)
+			break;
+		sample_add(&sample);
+	}
+	pthread_mutex_unlock(&sample_lock);
+}
+
+/**
+* @brief the function of a sample, the symbols are looked up in a sorted
+* interval index so any pc inside a function is resolved.
+*
+* @param pc the sampled pc
+* @param start the entry of the function, the page of pc if unknown
+*
+* @return the name of the function, NULL if unknown
+*/
+static const char *sample_func(generic_address_t pc, generic_address_t *start)
+{
+	generic_address_t offset;
+	const char *name = get_sym_interval(pc, &offset);
+	if (name == NULL) {
+		*start = pc & SAMPLE_UNKNOWN_PAGE;
+		return NULL;
+	}
+	*start = pc - offset;
+	return name;
+}
+
+typedef struct folded_entry {
+	uint32_t asid;
+	uint32_t mode;
+	generic_address_t start;
+	const char *mode_name;
+	const char *name;
+	uint64_t count;
+} folded_entry_t;
+
+static int folded_entry_cmp(const void *a, const void *b)
+{
+	const folded_entry_t *x = a, *y = b;
+	if (x->asid != y->asid)
+		return x->asid < y->asid ? -1 : 1;
+	if (x->mode != y->mode)
+		return x->mode < y->mode ? -1 : 1;
+	if (x->start != y->start)
+		return x->start < y->start ? -1 : 1;
+	return 0;
+}
+
+/**
+* @brief write the samples as folded stacks, one line per asid, mode and
+* function: "asid_1;svc;do_idle 42". The asid frame is left out for 0.
+*
+* @param fp the output
+*
+* @return 0 on success
+*/
+static int write_folded(FILE *fp)
+{
+	folded_entry_t *list;
+	uint32_t i, num = 0, j;
+
+	if (sample_num == 0)
+		return 0;
+	list = skyeye_mm(sample_num * sizeof(folded_entry_t));
+	if (list == NULL)
+		return -1;
+	for (i = 0; i <= sample_mask; i++) {
+		sample_entry_t *e = &sample_table[i];
+		if (e->count == 0)
+			continue;
+		list[num].asid = e->asid;
+		list[num].mode = e->mode;
+		list[num].mode_name = e->mode_name;
+		list[num].name = sample_func(e->pc, &list[num].start);
+		list[num].count = e->count;
+		num++;
+	}
+	qsort(list, num, sizeof(folded_entry_t), folded_entry_cmp);
+	for (i = 0; i < num; i = j) {
+		uint64_t count = list[i].count;
+		/* merge the pcs of a function */
+		for (j = i + 1; j < num && folded_entry_cmp(&list[i], &list[j]) == 0; j++)
+			count += list[j].count;
+		if (list[i].asid)
+			fprintf(fp, "asid_%u;", list[i].asid);
+		if (list[i].mode_name)
+			fprintf(fp, "%s;", list[i].mode_name);
+		else
+			fprintf(fp, "mode_0x%x;", list[i].mode);
+		if (list[i].name)
+			fprintf(fp, "%s", list[i].name);
+		else
+			fprintf(fp, "[unknown 0x%08x]", list[i].start);
+		fprintf(fp, " %llu\n", (unsigned long long)count);
+	}
+	skyeye_free(list);
+	return 0;
+}
+
+static void write_slot(FILE *fp, uint64_t v)
+{
+	fwrite(&v, sizeof(v), 1, fp);
+}
+
+/**
+* @brief write the samples in the legacy binary cpu profile format of
+* pprof with 64 bit slots. Every sample is a stack of one pc, the guest
+* executable is mapped over the whole address space so pprof resolves the
+* pcs with its symbols.
+*
+* @param fp the output
+*
+* @return 0 on success
+*/
+static int write_pprof(FILE *fp)
+{
+	char *exec_file = get_exec_file();
+	uint32_t i;
+
+	/* header: 0, 3 slots, version 0, period in us, padding */
+	write_slot(fp, 0);
+	write_slot(fp, 3);
+	write_slot(fp, 0);
+	write_slot(fp, 1000000 / sample_rate);
+	write_slot(fp, 0);
+	for (i = 0; sample_table && i <= sample_mask; i++) {
+		if (sample_table[i].count == 0)
+			continue;
+		write_slot(fp, sample_table[i].count);
+		write_slot(fp, 1);
+		write_slot(fp, sample_table[i].pc);
+	}
+	/* trailer */
+	write_slot(fp, 0);
+	write_slot(fp, 1);
+	write_slot(fp, 0);
+	fprintf(fp, "00000000-ffffffff r-xp 00000000 00:00 0 %s\n",
+		exec_file ? exec_file : "unknown");
+	return ferror(fp) ? -1 : 0;
+}
+
+/**
+* @brief write the profile
+*
+* @param filename the output file
+*
+* @return the exception
+*/
+static exception_t write_profile(const char *filename)
+{
+	FILE *fp;
+	int ret;
+
+	fp = fopen(filename, sample_format == Pprof_format ? "wb" : "w");
+	if (fp == NULL) {
+		skyeye_log(Error_log, __FUNCTION__, "Can not open %s for the profile.\n", filename);
+		return File_open_exp;
+	}
+	pthread_mutex_lock(&sample_lock);
+	if (sample_format == Pprof_format)
+		ret = write_pprof(fp);
+	else
+		ret = write_folded(fp);
+	pthread_mutex_unlock(&sample_lock);
+	fclose(fp);
+	if (ret != 0) {
+		skyeye_log(Error_log, __FUNCTION__, "Can not write the profile %s.\n", filename);
+		return Unknown_exp;
+	}
+	printf("Write %llu samples to %s.\n", (unsigned long long)sample_total, filename);
+	return No_exp;
+}
+
+/**
+* @brief the handler of sample_profile option
+*
+* @param option
+* @param num_params
+* @param params[]
+*
+* @return
+*/
+static int sample_prof_parse(skyeye_option_t *option, int num_params, const char *params[])
+{
+	char name[MAX_PARAM_NAME], value[MAX_PARAM_NAME];
+	int i;
+
+	for (i = 0; i < num_params; i++) {
+		if (split_param (params[i], name, value) < 0) {
+			skyeye_log(Error_log, __FUNCTION__, "Error: sample_profile has wrong parameter \"%s\".\n", name);
+			continue;
+		}
+		if (!strncmp ("rate", name, strlen (name))) {
+			sample_rate = strtol (value, NULL, 0);
+			if (sample_rate <= 0 || sample_rate > 1000000) {
+				skyeye_log(Error_log, __FUNCTION__, "Error: sample_profile rate should be between 1 and 1000000.\n");
+				sample_rate = SAMPLE_DEFAULT_RATE;
+			}
+		}
+		else if (!strncmp ("filename", name, strlen (name)))
+			strncpy (sample_filename, value, MAX_PARAM_NAME - 1);
+		else if (!strncmp ("format", name, strlen (name))) {
+			if (!strcmp (value, "pprof"))
+				sample_format = Pprof_format;
+			else if (!strcmp (value, "folded"))
+				sample_format = Folded_format;
+			else
+				skyeye_log(Error_log, __FUNCTION__, "Error: Unknown sample_profile format \"%s\".\n", value);
+		}
+		else
+			skyeye_log(Error_log, __FUNCTION__, "Error: Unknown sample_profile option \"%s\"\n", params[i]);
+	}
+	return 0;
+}
+
+static int sample_prof_on(char *arg)
+{
+	generic_arch_t *arch_instance = get_arch_instance("");
+
+	if (sample_event_id != -1) {
+		printf("sampling profiler is already on.\n");
+		return No_exp;
+	}
+	if (arch_instance == NULL || arch_instance->get_sample == NULL) {
+		printf("The arch can not be sampled.\n");
+		return Not_found_exp;
+	}
+	if (arg != NULL && *arg != '\0')
+		sample_rate = strtol(arg, NULL, 0);
+	if (sample_rate <= 0 || sample_rate > 1000000)
+		sample_rate = SAMPLE_DEFAULT_RATE;
+	if (create_thread_scheduler(1000000 / sample_rate, Periodic_sched,
+			sample_cores, arch_instance, &sample_event_id) != 0) {
+		sample_event_id = -1;
+		return Unknown_exp;
+	}
+	printf("sampling profiler is on, %d samples per second.\n", sample_rate);
+	return No_exp;
+}
+
+static int sample_prof_off(char *arg)
+{
+	if (sample_event_id == -1)
+		return No_exp;
+	del_thread_scheduler(sample_event_id);
+	sample_event_id = -1;
+	printf("sampling profiler is off.\n");
+	return No_exp;
+}
+
+static int sample_prof_dump(char *arg)
+{
+	if (arg != NULL && *arg != '\0')
+		return write_profile(arg);
+	if (sample_filename[0] != '\0')
+		return write_profile(sample_filename);
+	printf("Usage: sample-prof-dump filename\n");
+	return Invarg_exp;
+}
+
+static int sample_prof_reset(char *arg)
+{
+	pthread_mutex_lock(&sample_lock);
+	if (sample_table)
+		memset(sample_table, 0, (sample_mask + 1) * sizeof(sample_entry_t));
+	sample_num = 0;
+	sample_total = 0;
+	pthread_mutex_unlock(&sample_lock);
+	return No_exp;
+}
+
+int sample_prof_init()
+{
+	register_option("sample_profile", sample_prof_parse, "the sampling profiler of the guest, rate=samples per second, filename=output, format=folded|pprof.\n");
+	add_command("sample-prof-on", sample_prof_on, "start the sampling profiler, with an optional rate.\n");
+	add_command("sample-prof-off", sample_prof_off, "stop the sampling profiler.\n");
+	add_command("sample-prof-dump", sample_prof_dump, "write the profile to a file.\n");
+	add_command("sample-prof-reset", sample_prof_reset, "drop the samples taken.\n");
+	return 0;
+}
+
+int sample_prof_fini()
+{
+	sample_prof_off(NULL);
+	if (sample_filename[0] != '\0' && sample_total != 0)
+		write_profile(sample_filename);
+	if (sample_table) {
+		skyeye_free(sample_table);
+		sample_table = NULL;
+	}
+	return 0;
+}
@@ -0,0 +1,38 @@
+/*
+        sample_prof_module.c - the module of the sampling profiler
+        Copyright (C) 2003-2007 Skyeye Develop Group
+        for help please send mail to <skyeye-developer@lists.sf.linuxforum.net>
+
+        This program is free software; you can redistribute it and/or modify
+        it under the terms of the GNU General Public License as published by
+        the Free Software Foundation; either version 2 of the License, or
+        (at your option) any later version.
+
+        This program is distributed in the hope that it will be useful,
+        but WITHOUT ANY WARRANTY; without even the implied warranty of
+        MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+        GNU General Public License for more details.
+
+        You should have received a copy of the GNU General Public License
+        along with this program; if not, write to the Free Software
+        Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*/
+#include <stdio.h>
+#include "skyeye_types.h"
+#include "skyeye_module.h"
+
+int sample_prof_init();
+int sample_prof_fini();
+/* module name */
+const char* skyeye_module = "sample-prof";
+
+/* module initialization and will be executed automatically when loading. */
+void module_init(){
+	sample_prof_init();
+}
+
+/* module destruction and will be executed automatically when unloading */
+void module_fini(){
+	sample_prof_fini();
+}
@@ -48,6 +48,9 @@ static shutdown_config_t* shutdown = NULL;
 static max_insn_shutdown_enable = 0;
 static addr_access_shutdown_enable = 0;
 
+static void max_insn_callback(generic_arch_t* arch_instance);
+static void write_shutdown_callback(generic_arch_t* arch_instance);
+
 static int
 do_shutdown_option (skyeye_option_t * this_option, int num_params,
 		const char *params[])
@@ -67,6 +70,9 @@ do_shutdown_option (skyeye_option_t * this_option, int num_params,
 		SKYEYE_ERR ("Error, shutdown address needs align on 8 bytes\n");
 		return -1;
 	}
+	/* only the machines with a shutdown device pay for the callbacks */
+	if(!addr_access_shutdown_enable)
+		register_callback(write_shutdown_callback, Bus_write_callback);
 	addr_access_shutdown_enable = 1;
 
 	if(ret = strncmp(params[1],"max_ins=",8)){
@@ -78,6 +84,8 @@ do_shutdown_option (skyeye_option_t * this_option, int num_params,
 		shutdown->max_ins = strtoull(value,NULL,16);
 	else
 		shutdown->max_ins = strtoull(value,NULL,10);
+	if(!max_insn_shutdown_enable)
+		register_callback(max_insn_callback, Step_callback);
 	max_insn_shutdown_enable = 1;
 
 	printf("Shutdown addr=%x, max_ins=%x\n",shutdown->shutdown_addr,shutdown->max_ins);
@@ -109,14 +117,18 @@ const char* skyeye_module = "shutdown";
 /* module initialization and will be executed automatically when loading. */
 void module_init(){
 	shutdown = malloc(sizeof(shutdown_config_t));
-	register_callback(max_insn_callback, Step_callback);
-	register_callback(write_shutdown_callback, Bus_write_callback);
 	if(register_option("shutdown_device", do_shutdown_option, "Used to stop machine by writing a special address or set the max executed instruction number.") != No_exp)
 		fprintf(stderr,"Can not register shutdown_device option\n");
 }
 
 /* module destruction and will be executed automatically when unloading */
 void module_fini(){
+	if(max_insn_shutdown_enable)
+		unregister_callback(max_insn_callback, Step_callback);
+	if(addr_access_shutdown_enable)
+		unregister_callback(write_shutdown_callback, Bus_write_callback);
+	max_insn_shutdown_enable = 0;
+	addr_access_shutdown_enable = 0;
 	if(shutdown != NULL){
 		free(shutdown);
 		shutdown = NULL;